@@ -1,7 +1,7 @@
 #!/bin/bash
 
 echo "Building"
-g++ -std=c++17 ../src/*.cc ../src/util/*.cc -I../src -I../src/util -o dactyl
+g++ -std=c++17 ../src/*.cc ../src/util/*.cc -I../src -I../src/util -pthread -o dactyl
 if [ $? -ne 0 ]; then
   echo "Failed to build"
   exit 1
@@ -0,0 +1,185 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "alloc_tracker.h"
+
+namespace scad {
+namespace bench {
+namespace {
+
+double RunOnce(const Benchmark& benchmark, long iterations, long long* allocations) {
+  long long start_allocations = GetAllocationCount();
+  auto start = std::chrono::steady_clock::now();
+  benchmark.run(iterations);
+  auto end = std::chrono::steady_clock::now();
+  *allocations = GetAllocationCount() - start_allocations;
+  return std::chrono::duration<double>(end - start).count();
+}
+
+// Finds the value after "key": in a line of our own json.
+bool FindValue(const std::string& line, const std::string& key, std::string* value) {
+  std::string pattern = "\"" + key + "\": ";
+  size_t start = line.find(pattern);
+  if (start == std::string::npos) {
+    return false;
+  }
+  start += pattern.size();
+  if (line[start] == '"') {
+    size_t end = line.find('"', start + 1);
+    *value = line.substr(start + 1, end - start - 1);
+  } else {
+    size_t end = line.find_first_of(",}", start);
+    *value = line.substr(start, end - start);
+  }
+  return true;
+}
+
+}  // namespace
+
+std::vector<BenchmarkResult> RunBenchmarks(const std::vector<Benchmark>& benchmarks,
+                                           const RunOptions& options) {
+  std::vector<BenchmarkResult> results;
+  for (const Benchmark& benchmark : benchmarks) {
+    if (benchmark.name.find(options.filter) == std::string::npos) {
+      continue;
+    }
+    // Warm up caches and any lazily built state.
+    long long allocations = 0;
+    RunOnce(benchmark, 1, &allocations);
+
+    long iterations = 1;
+    double seconds = RunOnce(benchmark, iterations, &allocations);
+    while (seconds < options.min_seconds) {
+      // Aim a little past the minimum so the final run usually only happens once more.
+      double scale = seconds > 0 ? 1.4 * options.min_seconds / seconds : 100;
+      iterations = (long)(iterations * std::min(100.0, std::max(2.0, scale)));
+      seconds = RunOnce(benchmark, iterations, &allocations);
+    }
+
+    BenchmarkResult result;
+    result.name = benchmark.name;
+    result.iterations = iterations;
+    result.ns_per_iteration = seconds * 1e9 / iterations;
+    result.allocations_per_iteration = (double)allocations / iterations;
+    if (benchmark.bytes_per_iteration > 0) {
+      result.mb_per_second = benchmark.bytes_per_iteration * iterations / seconds / 1e6;
+    }
+    results.push_back(result);
+  }
+  return results;
+}
+
+void PrintResults(const std::vector<BenchmarkResult>& results, std::FILE* file) {
+  fprintf(file,
+          "%-32s %12s %16s %14s %10s\n",
+          "benchmark",
+          "iterations",
+          "ns/iteration",
+          "allocs/iter",
+          "MB/s");
+  for (const BenchmarkResult& r : results) {
+    fprintf(file,
+            "%-32s %12ld %16.1f %14.1f %10.1f\n",
+            r.name.c_str(),
+            r.iterations,
+            r.ns_per_iteration,
+            r.allocations_per_iteration,
+            r.mb_per_second);
+  }
+}
+
+bool WriteResultsJson(const std::vector<BenchmarkResult>& results, const std::string& file_name) {
+  std::FILE* file = std::fopen(file_name.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  fprintf(file, "{\"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchmarkResult& r = results[i];
+    fprintf(file,
+            "  {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_iteration\": %.3f, "
+            "\"allocations_per_iteration\": %.3f, \"mb_per_second\": %.3f}%s\n",
+            r.name.c_str(),
+            r.iterations,
+            r.ns_per_iteration,
+            r.allocations_per_iteration,
+            r.mb_per_second,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "]}\n");
+  std::fclose(file);
+  return true;
+}
+
+bool ReadResultsJson(const std::string& file_name, std::vector<BenchmarkResult>* results) {
+  std::ifstream file(file_name);
+  if (!file) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    BenchmarkResult r;
+    std::string value;
+    if (!FindValue(line, "name", &r.name)) {
+      continue;
+    }
+    if (FindValue(line, "iterations", &value)) {
+      r.iterations = std::atol(value.c_str());
+    }
+    if (FindValue(line, "ns_per_iteration", &value)) {
+      r.ns_per_iteration = std::atof(value.c_str());
+    }
+    if (FindValue(line, "allocations_per_iteration", &value)) {
+      r.allocations_per_iteration = std::atof(value.c_str());
+    }
+    if (FindValue(line, "mb_per_second", &value)) {
+      r.mb_per_second = std::atof(value.c_str());
+    }
+    results->push_back(r);
+  }
+  return true;
+}
+
+int CompareToBaseline(const std::vector<BenchmarkResult>& results,
+                      const std::vector<BenchmarkResult>& baseline,
+                      double threshold,
+                      std::FILE* file) {
+  std::map<std::string, const BenchmarkResult*> baseline_by_name;
+  for (const BenchmarkResult& r : baseline) {
+    baseline_by_name[r.name] = &r;
+  }
+
+  int regressions = 0;
+  fprintf(file, "%-32s %16s %16s %9s\n", "benchmark", "baseline ns", "ns", "change");
+  for (const BenchmarkResult& r : results) {
+    auto it = baseline_by_name.find(r.name);
+    if (it == baseline_by_name.end() || it->second->ns_per_iteration <= 0) {
+      fprintf(file, "%-32s %16s %16.1f\n", r.name.c_str(), "-", r.ns_per_iteration);
+      continue;
+    }
+    double change = r.ns_per_iteration / it->second->ns_per_iteration - 1;
+    bool regressed = change > threshold;
+    regressions += regressed ? 1 : 0;
+    fprintf(file,
+            "%-32s %16.1f %16.1f %+8.1f%%%s\n",
+            r.name.c_str(),
+            it->second->ns_per_iteration,
+            r.ns_per_iteration,
+            change * 100,
+            regressed ? " REGRESSION" : "");
+  }
+  return regressions;
+}
+
+}  // namespace bench
+}  // namespace scad
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace scad {
+namespace bench {
+
+// Keeps the compiler from optimizing away a result which is never read.
+template <typename T>
+void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+// Runs the code under test iterations times.
+using BenchmarkFn = std::function<void(long iterations)>;
+
+struct Benchmark {
+  std::string name;
+  BenchmarkFn run;
+  // Bytes produced by one iteration, used to report throughput. 0 if it doesn't apply.
+  long bytes_per_iteration = 0;
+};
+
+struct BenchmarkResult {
+  std::string name;
+  long iterations = 0;
+  double ns_per_iteration = 0;
+  // Only counted when built with DACTYL_TRACK_ALLOCATIONS, otherwise 0.
+  double allocations_per_iteration = 0;
+  double mb_per_second = 0;
+};
+
+struct RunOptions {
+  // Only run benchmarks whose name contains this.
+  std::string filter;
+  // Keep doubling the iterations until a run takes at least this long.
+  double min_seconds = 0.5;
+};
+
+std::vector<BenchmarkResult> RunBenchmarks(const std::vector<Benchmark>& benchmarks,
+                                           const RunOptions& options);
+
+void PrintResults(const std::vector<BenchmarkResult>& results, std::FILE* file);
+bool WriteResultsJson(const std::vector<BenchmarkResult>& results, const std::string& file_name);
+// Only reads back what WriteResultsJson writes.
+bool ReadResultsJson(const std::string& file_name, std::vector<BenchmarkResult>* results);
+
+// Prints the change against the baseline for every benchmark in both. Returns the number of
+// benchmarks more than threshold (0.1 is 10%) slower than the baseline.
+int CompareToBaseline(const std::vector<BenchmarkResult>& results,
+                      const std::vector<BenchmarkResult>& baseline,
+                      double threshold,
+                      std::FILE* file);
+
+}  // namespace bench
+}  // namespace scad
@@ -0,0 +1,255 @@
+#include <cstdio>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "connector_plan.h"
+#include "key.h"
+#include "key_data.h"
+#include "minkowski.h"
+#include "scad.h"
+#include "scad_stream.h"
+#include "target_graph.h"
+#include "targets.h"
+#include "transform.h"
+
+using namespace scad;
+using namespace scad::bench;
+
+namespace {
+
+#ifdef _WIN32
+const char* kNullFile = "NUL";
+#else
+const char* kNullFile = "/dev/null";
+#endif
+
+// A square grid of n by n quads, as a stand in for a large mesh.
+void AddGridMesh(int n, std::vector<Point3d>* points, std::vector<std::vector<int>>* faces) {
+  for (int y = 0; y <= n; ++y) {
+    for (int x = 0; x <= n; ++x) {
+      points->push_back({(double)x, (double)y, 0.1 * ((x * y) % 7)});
+    }
+  }
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      int i = y * (n + 1) + x;
+      faces->push_back({i, i + 1, i + n + 2});
+      faces->push_back({i, i + n + 2, i + n + 1});
+    }
+  }
+}
+
+// Builds every output the same way as running dactyl with no arguments, measuring the outputs
+// instead of writing them.
+void RunPipeline(const BuildProfile& profile) {
+  TargetInputs inputs;
+  inputs.profile = profile;
+  OutputReport report(false);
+  TargetGraph graph;
+  AddTargets(inputs, &report, &graph);
+  graph.Run({}, 1);
+}
+
+std::vector<Benchmark> GetBenchmarks(KeyData& d) {
+  std::vector<Benchmark> benchmarks;
+
+  Transform transform(1, 2, 3);
+  transform.SetRotation(10, 20, 30);
+  benchmarks.push_back({"Transform::Apply/point", [transform](long iterations) {
+                          glm::vec3 p(1, 2, 3);
+                          for (long i = 0; i < iterations; ++i) {
+                            p = transform.Apply(p);
+                            DoNotOptimize(p);
+                          }
+                        }});
+  benchmarks.push_back({"Transform::Apply/shape", [transform](long iterations) {
+                          Shape connector = GetPostConnector();
+                          for (long i = 0; i < iterations; ++i) {
+                            Shape s = transform.Apply(connector);
+                            DoNotOptimize(s);
+                          }
+                        }});
+
+  TransformList corner = d.key_e.GetTopRight();
+  benchmarks.push_back({"TransformList::Apply/point", [corner](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            glm::vec3 p = corner.Apply(kOrigin);
+                            DoNotOptimize(p);
+                          }
+                        }});
+  benchmarks.push_back({"TransformList::Apply/shape", [corner](long iterations) {
+                          Shape connector = GetPostConnector();
+                          for (long i = 0; i < iterations; ++i) {
+                            Shape s = corner.Apply(connector);
+                            DoNotOptimize(s);
+                          }
+                        }});
+
+  benchmarks.push_back({"Key::GetTopRight", [&d](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            TransformList t = d.key_e.GetTopRight();
+                            DoNotOptimize(t);
+                          }
+                        }});
+  benchmarks.push_back({"Key::GetCorners", [&d](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            std::vector<TransformList> corners = d.key_e.GetCorners();
+                            DoNotOptimize(corners);
+                          }
+                        }});
+
+  // Connecting the main keys, which used to be ConnectMainKeys.
+  benchmarks.push_back({"ConnectorPlan/grid", [&d](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            ConnectorPlan plan;
+                            plan.AddGrid(d.grid);
+                            Shape s = plan.Build();
+                            DoNotOptimize(s);
+                          }
+                        }});
+
+  // Rounding the connectors, which are unions of hulls of posts.
+  Shape connectors = MakeConnectors(d);
+  benchmarks.push_back({"MinkowskiSum/connectors", [connectors](long iterations) {
+                          Shape ball = Sphere(1, 8);
+                          for (long i = 0; i < iterations; ++i) {
+                            Shape s = MinkowskiSum(connectors, ball);
+                            DoNotOptimize(s);
+                          }
+                        }});
+
+  benchmarks.push_back({"MakeSwitch", [](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            Shape s = MakeSwitch();
+                            DoNotOptimize(s);
+                          }
+                        }});
+  benchmarks.push_back({"Key::GetSwitch", [&d](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            Shape s = d.key_e.GetSwitch();
+                            DoNotOptimize(s);
+                          }
+                        }});
+
+  // Everything but the walls of the case so writing dominates.
+  std::vector<Shape> case_shapes = {MakeConnectors(d)};
+  for (const Shape& s : MakeSwitches(d, GetFinalProfile())) {
+    case_shapes.push_back(s);
+  }
+  Shape case_shape = UnionAll(case_shapes);
+  benchmarks.push_back({"WriteToFile/null",
+                        [case_shape](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            case_shape.WriteToFile(kNullFile);
+                          }
+                        },
+                        case_shape.GetScadStats().bytes});
+
+  // Writing a large mesh as a Polyhedron, which holds every point and face until it is released,
+  // and streamed a point and a face at a time.
+  std::vector<Point3d> mesh_points;
+  std::vector<std::vector<int>> mesh_faces;
+  AddGridMesh(200, &mesh_points, &mesh_faces);
+  Shape mesh = Polyhedron(mesh_points, mesh_faces);
+  long mesh_bytes = mesh.GetScadStats().bytes;
+  benchmarks.push_back({"Polyhedron/write",
+                        [mesh_points, mesh_faces](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            Polyhedron(mesh_points, mesh_faces).WriteToFile(kNullFile);
+                          }
+                        },
+                        mesh_bytes});
+  benchmarks.push_back({"ScadStream/polyhedron",
+                        [](long iterations) {
+                          int n = 200;
+                          for (long i = 0; i < iterations; ++i) {
+                            ScadStream stream;
+                            stream.Open(kNullFile);
+                            stream.BeginPolyhedron();
+                            for (int y = 0; y <= n; ++y) {
+                              for (int x = 0; x <= n; ++x) {
+                                stream.AddPoint(x, y, 0.1 * ((x * y) % 7));
+                              }
+                            }
+                            for (int y = 0; y < n; ++y) {
+                              for (int x = 0; x < n; ++x) {
+                                int j = y * (n + 1) + x;
+                                stream.AddFace({j, j + 1, j + n + 2});
+                                stream.AddFace({j, j + n + 2, j + n + 1});
+                              }
+                            }
+                            stream.EndPolyhedron();
+                            stream.Close();
+                          }
+                        },
+                        mesh_bytes});
+
+  benchmarks.push_back({"Pipeline/final", [](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            RunPipeline(GetFinalProfile());
+                          }
+                        }});
+  benchmarks.push_back({"Pipeline/draft", [](long iterations) {
+                          for (long i = 0; i < iterations; ++i) {
+                            RunPipeline(GetDraftProfile());
+                          }
+                        }});
+  return benchmarks;
+}
+
+}  // namespace
+
+// Usage: dactyl_bench [--filter name] [--min_time seconds] [--json out.json]
+//                     [--baseline baseline.json] [--threshold 0.15]
+// With a baseline the exit status is non zero if any benchmark is slower than the baseline by more
+// than the threshold.
+int main(int argc, char** argv) {
+  RunOptions options;
+  std::string json_file;
+  std::string baseline_file;
+  double threshold = 0.15;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--filter" && has_value) {
+      options.filter = argv[++i];
+    } else if (arg == "--min_time" && has_value) {
+      options.min_seconds = std::atof(argv[++i]);
+    } else if (arg == "--json" && has_value) {
+      json_file = argv[++i];
+    } else if (arg == "--baseline" && has_value) {
+      baseline_file = argv[++i];
+    } else if (arg == "--threshold" && has_value) {
+      threshold = std::atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  KeyData d(GetKeyOrigin());
+  ConfigureKeys(d, GetFinalProfile());
+  std::vector<BenchmarkResult> results = RunBenchmarks(GetBenchmarks(d), options);
+  PrintResults(results, stdout);
+
+  if (!json_file.empty() && !WriteResultsJson(results, json_file)) {
+    return 1;
+  }
+  if (!baseline_file.empty()) {
+    std::vector<BenchmarkResult> baseline;
+    if (!ReadResultsJson(baseline_file, &baseline)) {
+      return 1;
+    }
+    printf("\n");
+    int regressions = CompareToBaseline(results, baseline, threshold, stdout);
+    if (regressions > 0) {
+      printf("%d benchmarks regressed by more than %.0f%%\n", regressions, threshold * 100);
+      return 1;
+    }
+  }
+  return 0;
+}
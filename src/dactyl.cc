@@ -1,471 +1,574 @@
-#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
 #include <string>
+#include <thread>
 #include <vector>
 
-#include "key.h"
+#include "alloc_tracker.h"
+#include "chunked_render.h"
+#include "clearance.h"
+#include "file_watcher.h"
 #include "key_data.h"
-#include "scad.h"
+#include "layout.h"
+#include "layout_optimizer.h"
+#include "mesh.h"
+#include "mesh_simplify.h"
+#include "render_cache.h"
+#include "render_profile.h"
+#include "slicer.h"
+#include "target_graph.h"
+#include "targets.h"
+#include "trace.h"
 #include "transform.h"
 
 using namespace scad;
 
-constexpr bool kWriteTestKeys = false;
-// Add the caps into the stl for testing.
-constexpr bool kAddCaps = false;
-
-enum class Direction { UP, DOWN, LEFT, RIGHT };
-
-void AddShapes(std::vector<Shape>* shapes, std::vector<Shape> to_add) {
-  for (Shape s : to_add) {
-    shapes->push_back(s);
+int CheckKeyClearance(KeyData& d);
+int CheckPcbAccess(KeyData& d, const BuildProfile& profile, SocketAccessOptions options, int jobs);
+int OptimizeKeyLayout(KeyData& d,
+                      const Layout& layout,
+                      const std::string& output_file,
+                      const std::vector<std::string>& key_names);
+
+std::vector<std::string> SplitNames(const std::string& names) {
+  std::vector<std::string> result;
+  size_t start = 0;
+  while (start < names.size()) {
+    size_t end = names.find(',', start);
+    if (end == std::string::npos) {
+      end = names.size();
+    }
+    if (end > start) {
+      result.push_back(names.substr(start, end - start));
+    }
+    start = end + 1;
   }
+  return result;
 }
 
-Shape ConnectMainKeys(KeyData& d);
+bool ApplyLayout(const std::string& layout_file, KeyData& d, Layout* layout) {
+  if (layout_file.empty()) {
+    return true;
+  }
+  TRACE_SCOPE("ApplyLayout", layout_file);
+  AllocationPhase allocation_phase("ApplyLayout");
+  return layout->Load(layout_file) && layout->Apply(d.all_keys());
+}
 
-int main() {
-  printf("generating..\n");
-  TransformList key_origin;
-  key_origin.Translate(-20, -40, 3);
+// Reads the layout and profile overrides into inputs, starting from profile.
+bool LoadInputs(const BuildProfile& profile,
+                const std::string& layout_file,
+                const std::string& profile_file,
+                TargetInputs* inputs) {
+  inputs->profile = profile;
+  inputs->layout = Layout();
+  if (!profile_file.empty() && !LoadBuildProfile(profile_file, &inputs->profile)) {
+    return false;
+  }
+  return layout_file.empty() || inputs->layout.Load(layout_file);
+}
 
-  // This is where all of the logic to position the keys is done. Everything below is cosmetic
-  // trying to build the case.
-  KeyData d(key_origin);
+// Builds the selected targets with a fresh set of keys since the profile changes them.
+bool BuildTargets(const TargetInputs& inputs,
+                  const std::vector<std::string>& targets,
+                  int jobs,
+                  OutputReport* report) {
+  TRACE_SCOPE("BuildTargets", inputs.profile.name);
+  TargetGraph graph;
+  AddTargets(inputs, report, &graph);
+  return graph.Run(targets, jobs);
+}
 
-  if (kWriteTestKeys) {
-    std::vector<Shape> test_shapes;
-    std::vector<Key*> test_keys = {&d.key_e, &d.key_d, &d.key_r, &d.key_t, &d.key_d};
-    for (Key* key : test_keys) {
-      key->add_side_nub = false;
-      key->extra_z = 4;
-      test_shapes.push_back(key->GetSwitch());
-      if (kAddCaps) {
-        test_shapes.push_back(key->GetCap().Color("red"));
+struct Flags {
+  bool check_clearance = false;
+  bool check_access = false;
+  SocketAccessOptions access_options;
+  bool list_targets = false;
+  bool compare_profiles = false;
+  bool trace = false;
+  bool alloc_report = false;
+  bool watch = false;
+  bool render = false;
+  bool render_profile = false;
+  bool render_cache = false;
+  long long cache_size_mb = 1024;
+  ChunkedRenderOptions render_options;
+  int analyze_top_n = 0;
+  BuildProfile profile = GetFinalProfile();
+  int jobs = std::max(1, (int)std::thread::hardware_concurrency());
+  std::vector<std::string> targets;
+  std::string layout_file;
+  std::string profile_file;
+  std::string optimize_output;
+  std::vector<std::string> optimize_keys;
+  std::vector<std::string> mesh_stats_files;
+  bool simplify = false;
+  SimplifyOptions simplify_options;
+  bool slice = false;
+  SliceOptions slice_options;
+  bool export_flat = false;
+  bool help = false;
+};
+
+// With no targets every output is written, otherwise only the named targets and what they depend
+// on are built.
+constexpr char kUsage[] = R"usage(Usage: dactyl [flags] [targets..]
+e.g. "dactyl v1_left bottom". Flags:
+  --help                   print this and exit
+  --list_targets           list the targets which can be built
+  --jobs N                 threads to build, render and check with
+  --profile NAME           the build profile, draft or final
+  --profile_file FILE      override profile fields from a file
+  --add_caps               add key caps to the outputs
+  --cut_thumb_plate        cut off the parts sticking up into the thumb plate
+  --compare_profiles       build with the draft and final profiles and print both reports
+  --layout FILE            apply the key adjustments in a layout file
+  --optimize_layout FILE   move keys to reduce travel and write the adjustments to FILE
+  --optimize_keys A,B      the keys to move, instead of the keys with clearance problems
+  --check_clearance        check the caps of neighbouring keys against each other
+  --check_access           check a PCB fits under every switch and can be soldered
+  --pcb_size MM            the width and length of the PCB for --check_access
+  --iron_depth MM          the room needed below the PCB for --check_access
+  --analyze N              rank the N most expensive labeled subtrees of each output
+  --trace                  write trace.json for chrome://tracing or Perfetto
+  --alloc_report           print the allocations of each phase, if built with
+                           DACTYL_TRACK_ALLOCATIONS
+  --watch                  rebuild as the layout and profile files change
+  --render                 render each output to stl
+  --chunks N               the pieces to render each output in
+  --renderer PATH          the OpenSCAD binary to render with
+  --render_profile         render each labeled subtree on its own and print the times
+  --render_cache           import labeled subtrees rendered by earlier runs
+  --cache_size MB          the size the render cache is trimmed to
+  --mesh_stats A.stl,B.stl print the size, area, volume and watertightness of stl files
+  --simplify               remove slivers and merge coplanar faces of the rendered stls, or
+                           write <name>_simplified.stl for each --mesh_stats file
+  --max_deviation MM       how far --simplify may move the surface
+  --slice                  report overhangs and thin walls of the rendered or --mesh_stats stls
+                           and draw the worst layers in <name>_layers.svg
+  --layer_height MM        the layer height for --slice
+  --overhang_angle DEG     faces further than this from vertical need support
+  --nozzle_width MM        walls thinner than this can't be printed
+  --export_flat            also write the plates and adapters as svg, dxf and stl
+)usage";
+
+bool ParseFlags(int argc, char** argv, Flags* flags) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--help") {
+      printf("%s", kUsage);
+      flags->help = true;
+      return true;
+    } else if (arg == "--check_clearance") {
+      flags->check_clearance = true;
+    } else if (arg == "--check_access") {
+      flags->check_access = true;
+    } else if (arg == "--pcb_size" && has_value) {
+      flags->access_options.pcb_width = std::atof(argv[++i]);
+      flags->access_options.pcb_length = flags->access_options.pcb_width;
+    } else if (arg == "--iron_depth" && has_value) {
+      flags->access_options.iron_depth = std::atof(argv[++i]);
+    } else if (arg == "--layout" && has_value) {
+      flags->layout_file = argv[++i];
+    } else if (arg == "--optimize_layout" && has_value) {
+      flags->optimize_output = argv[++i];
+    } else if (arg == "--optimize_keys" && has_value) {
+      flags->optimize_keys = SplitNames(argv[++i]);
+    } else if (arg == "--jobs" && has_value) {
+      flags->jobs = std::atoi(argv[++i]);
+    } else if (arg == "--list_targets") {
+      flags->list_targets = true;
+    } else if (arg == "--profile" && has_value) {
+      if (!GetBuildProfile(argv[++i], &flags->profile)) {
+        return false;
       }
+    } else if (arg == "--add_caps") {
+      flags->profile.add_caps = true;
+    } else if (arg == "--cut_thumb_plate") {
+      flags->profile.cut_thumb_plate = true;
+    } else if (arg == "--compare_profiles") {
+      flags->compare_profiles = true;
+    } else if (arg == "--trace") {
+      flags->trace = true;
+    } else if (arg == "--alloc_report") {
+      flags->alloc_report = true;
+    } else if (arg == "--watch") {
+      flags->watch = true;
+    } else if (arg == "--profile_file" && has_value) {
+      flags->profile_file = argv[++i];
+    } else if (arg == "--render") {
+      flags->render = true;
+    } else if (arg == "--render_profile") {
+      flags->render_profile = true;
+    } else if (arg == "--render_cache") {
+      flags->render_cache = true;
+    } else if (arg == "--cache_size" && has_value) {
+      flags->cache_size_mb = std::atoll(argv[++i]);
+    } else if (arg == "--chunks" && has_value) {
+      flags->render_options.chunks = std::atoi(argv[++i]);
+    } else if (arg == "--renderer" && has_value) {
+      flags->render_options.renderer = argv[++i];
+    } else if (arg == "--mesh_stats" && has_value) {
+      flags->mesh_stats_files = SplitNames(argv[++i]);
+    } else if (arg == "--simplify") {
+      flags->simplify = true;
+    } else if (arg == "--max_deviation" && has_value) {
+      flags->simplify_options.max_deviation = std::atof(argv[++i]);
+    } else if (arg == "--slice") {
+      flags->slice = true;
+    } else if (arg == "--layer_height" && has_value) {
+      flags->slice_options.layer_height = std::atof(argv[++i]);
+    } else if (arg == "--overhang_angle" && has_value) {
+      flags->slice_options.overhang_angle = std::atof(argv[++i]);
+    } else if (arg == "--nozzle_width" && has_value) {
+      flags->slice_options.nozzle_width = std::atof(argv[++i]);
+    } else if (arg == "--export_flat") {
+      flags->export_flat = true;
+    } else if (arg == "--analyze" && has_value) {
+      flags->analyze_top_n = std::atoi(argv[++i]);
+    } else if (arg.empty() || arg[0] != '-') {
+      flags->targets.push_back(arg);
+    } else {
+      fprintf(stderr, "Unknown argument %s\n%s", arg.c_str(), kUsage);
+      return false;
     }
-    UnionAll(test_shapes).WriteToFile("test_keys.scad");
-    return 0;
   }
+  return true;
+}
 
-  // Set all of the widths here. This must be done before calling any of GetTopLeft etc.
-
-  d.key_thumb1.extra_width_bottom = 2;
-  d.key_thumb1.extra_width_left = 2;
-  d.key_thumb2.extra_width_top = 2;
-  d.key_thumb2.extra_width_bottom = 2;
-  d.key_thumb3.extra_width_top = 2;
-  d.key_thumb3.extra_width_bottom = 2;
-  d.key_thumb4.extra_width_top = 2;
-  d.key_thumb4.extra_width_right = 2;
-  d.key_thumb4.extra_width_bottom = 2;
-
-  // left wall
-  for (Key* key : d.grid.column(0)) {
-    if (key) {
-      key->extra_width_left = 4;
+// Builds once, then rebuilds whenever the layout or profile file changes. The graph keeps every
+// part from the previous run so only targets depending on the keys are built again, and only
+// outputs whose scad changed are rewritten.
+int Watch(const Flags& flags) {
+  std::vector<std::string> files;
+  for (const std::string& file : {flags.layout_file, flags.profile_file}) {
+    if (!file.empty()) {
+      files.push_back(file);
     }
   }
-
-  d.key_t.extra_width_right = 2;
-  d.key_g.extra_width_right = 3;
-  d.key_b.extra_width_right = 3;
-
-  for (Key* key : d.grid.row(0)) {
-    // top row
-    if (key) {
-      key->extra_width_top = 2;
+  if (files.empty()) {
+    fprintf(stderr, "--watch needs --layout or --profile_file\n");
+    return 1;
+  }
+  FileWatcher watcher;
+  for (const std::string& file : files) {
+    if (!watcher.Add(file)) {
+      return 1;
     }
   }
-  d.key_b.extra_width_bottom = 3;
-
-  std::vector<Shape> shapes;
-
-  //
-  // Thumb plate
-  //
-
-  shapes.push_back(Union(ConnectHorizontal(d.key_thumb1, d.key_thumb2)
-                        ,ConnectHorizontal(d.key_thumb2, d.key_thumb3)
-                        ,ConnectHorizontal(d.key_thumb3, d.key_thumb4)
-                        ,Tri(d.key_thumb1.GetTopLeft(),
-                             d.key_thumb1.GetTopRight(),
-                             d.key_thumb2.GetTopLeft())
-                        ,Tri(d.key_thumb2.GetTopLeft(),
-                             d.key_thumb2.GetTopRight(),
-                             d.key_thumb3.GetTopLeft())
-                         ));
-
-  shapes.push_back(ConnectMainKeys(d));
-
-  shapes.push_back(TriFan(d.key_thumb2.GetTopLeft(),
-                          {
-                              d.key_b.GetBottomRight(),
-                              d.key_b.GetTopRight(),
-                              d.key_g.GetBottomRight(),
-                          })
-
-  );
-
-  // These transforms with TranslateFront are moving the connectors down in the z direction to
-  // reduce the vertical jumps.
-  TransformList slash_bottom_right = d.key_slash.GetBottomRight().TranslateFront(0, 0, -1);
-  TransformList right_bottom_right = d.key_right_arrow.GetBottomRight().TranslateFront(0, 0, -3);
-
-  shapes.push_back(TriFan(d.key_thumb1.GetTopLeft(),
-                          {
-                              right_bottom_right,
-                              d.key_right_arrow.GetBottomLeft().TranslateFront(0, 0, -1),
-                              d.key_left_arrow.GetBottomRight().TranslateFront(0, 0, -1),
-                              d.key_left_arrow.GetBottomLeft().TranslateFront(0, 0, -1),
-                              slash_bottom_right,
-                              d.key_thumb1.GetBottomLeft(),
-                          }));
-  shapes.push_back(TriFan(d.key_thumb1.GetTopRight(),
-                          {
-                              d.key_thumb1.GetTopLeft(),
-                              right_bottom_right,
-                              d.key_b.GetBottomRight(),
-                              d.key_thumb2.GetTopLeft(),
-                          }));
-  shapes.push_back(TriFan(d.key_thumb2.GetTopRight(),
-                          {
-                              d.key_thumb2.GetTopLeft(),
-                              d.key_b.GetBottomRight(),
-                              d.key_thumb3.GetTopLeft(),
-                          }));
-  shapes.push_back(TriFan(d.key_b.GetBottomLeft(),
-                          {
-                              d.key_b.GetBottomRight(),
-                              right_bottom_right,
-                              d.key_right_arrow.GetTopRight(),
-                              d.key_v.GetBottomRight(),
-                          }));
-  shapes.push_back(TriFan(d.key_tilde.GetBottomRight(),
-                          {
-                              d.key_slash.GetBottomLeft(),
-                              slash_bottom_right,
-                          }));
-
-  // Bottom right corner.
-  shapes.push_back(TriFan(d.key_shift.GetBottomRight(),
-                          {
-                              d.key_z.GetBottomLeft(),
-                              d.key_tilde.GetTopLeft(),
-                              d.key_tilde.GetBottomLeft(),
-                              d.key_shift.GetBottomLeft(),
-                          }));
-
-  //
-  // Make the wall
-  //
-  {
-    struct WallPoint {
-      WallPoint(TransformList transforms,
-                Direction out_direction,
-                float extra_distance = 0,
-                float extra_width = 0)
-          : transforms(transforms),
-            out_direction(out_direction),
-            extra_distance(extra_distance),
-            extra_width(extra_width) {
-      }
-      TransformList transforms;
-      Direction out_direction;
-      float extra_distance;
-      float extra_width;
-    };
-
-    Direction up = Direction::UP;
-    Direction down = Direction::DOWN;
-    Direction left = Direction::LEFT;
-    Direction right = Direction::RIGHT;
 
-    std::vector<WallPoint> wall_points = {
-        // Start top left and go clockwise
-        {d.key_tab.GetTopLeft(), up},
-        {d.key_tab.GetTopRight(), up, 0, .3},
-
-        {d.key_q.GetTopLeft(), up, 0, .5},
-        {d.key_q.GetTopRight().RotateFront(0, 0, 30), up, 0, 1},
-
-        {d.key_w.GetTopLeft(), up, 0, .3},
-        {d.key_w.GetTopRight(), up},
-
-        {d.key_e.GetTopLeft(), up},
-        {d.key_e.GetTopRight(), up},
-
-        {d.key_r.GetTopLeft(), up},
-        {d.key_r.GetTopRight(), up},
-        {d.key_t.GetTopRight(), up},
-        {d.key_t.GetTopRight(), right},
-        {d.key_t.GetBottomRight(), right},
-
-        {d.key_g.GetTopRight(), right},
-        {d.key_g.GetBottomRight(), right, 1, .5},
-
-        {d.key_b.GetTopRight(), right, 1, .5},
-        {d.key_b.GetBottomRight(), right, 1, .5},
-
-        // thumb plate
-        {d.key_thumb3.GetTopLeft().RotateFront(0, 0, -25), up, 1, .5},
-        {d.key_thumb3.GetTopRight(), up, 1, .5},
-        {d.key_thumb4.GetTopLeft(), up, 1, .5},
-
-        // round the corner
-        {d.key_thumb4.GetTopRight(), up, 1, .5},
-        {d.key_thumb4.GetTopRight(), right, 1, .5},
-        {d.key_thumb4.GetBottomRight(), right, 1, .5},
-        {d.key_thumb4.GetBottomRight(), down, 1, .5},
-	// bottom edge
-        {d.key_thumb4.GetBottomLeft(), down, 1, .5},
-        {d.key_thumb3.GetBottomRight(), down, 1, .5},
-        {d.key_thumb3.GetBottomLeft(), down, 1, .5},
-        {d.key_thumb2.GetBottomRight(), down, 1, .5},
-        {d.key_thumb2.GetBottomLeft(), down, 1, .5},
-        {d.key_thumb1.GetBottomRight(), down, 1, .5},
-        {d.key_thumb1.GetBottomLeft().RotateFront(0, 0, 15), down, 1, .5},
-        {d.key_thumb1.GetBottomLeft(), left, 1, .5},
-        // /thumb plate
-
-        {slash_bottom_right.RotateFront(0, 0, -25), down},
-
-        {d.key_tilde.GetBottomRight(), down},
-        {d.key_tilde.GetBottomLeft(), down},
-
-        {d.key_shift.GetBottomLeft(), down, 0, .75},
-        {d.key_shift.GetBottomLeft(), left, 0, .5},
-        {d.key_shift.GetTopLeft(), left, 0, .5},
-
-        {d.key_caps.GetBottomLeft(), left},
-        {d.key_caps.GetTopLeft(), left},
-
-        {d.key_tab.GetBottomLeft(), left},
-        {d.key_tab.GetTopLeft(), left},
-
-        {d.key_tab.GetBottomLeft(), left},
-        {d.key_tab.GetTopLeft(), left},
-    };
+  TargetInputs inputs;
+  if (!LoadInputs(flags.profile, flags.layout_file, flags.profile_file, &inputs)) {
+    return 1;
+  }
+  OutputReport report;
+  report.SetSkipUnchanged(true);
+  report.SetAnalyze(flags.analyze_top_n);
+  TargetGraph graph;
+  AddTargets(inputs, &report, &graph);
+  if (!graph.Run(flags.targets, flags.jobs)) {
+    return 1;
+  }
+  report.Print(inputs.profile.name, stdout);
+
+  while (true) {
+    printf("watching %d files..\n", (int)files.size());
+    fflush(stdout);
+    std::vector<std::string> changed = watcher.Wait();
+    for (const std::string& file : changed) {
+      printf("%s changed\n", file.c_str());
+    }
+    TargetInputs new_inputs;
+    if (!LoadInputs(flags.profile, flags.layout_file, flags.profile_file, &new_inputs)) {
+      // Probably saved half way through an edit. Keep the last good build.
+      continue;
+    }
+    if (new_inputs.profile == inputs.profile && new_inputs.layout == inputs.layout) {
+      printf("no changes to the inputs\n");
+      continue;
+    }
 
-    std::vector<std::vector<Shape>> wall_slices;
-    for (WallPoint point : wall_points) {
-      Shape s1 = point.transforms.Apply(GetPostConnector());
+    auto start = std::chrono::steady_clock::now();
+    inputs = new_inputs;
+    int invalidated = graph.Invalidate("keys");
+    report.Clear();
+    if (!graph.Run(flags.targets, flags.jobs)) {
+      return 1;
+    }
+    auto end = std::chrono::steady_clock::now();
+    report.Print(inputs.profile.name, stdout);
+    printf("rebuilt %d targets in %.3f s\n",
+           invalidated,
+           std::chrono::duration<double>(end - start).count());
+  }
+}
 
-      TransformList t = point.transforms;
-      glm::vec3 out_dir;
-      float distance = 4.8 + point.extra_distance;
-      switch (point.out_direction) {
-        case Direction::UP:
-          t.AppendFront(TransformList().Translate(0, distance, 0).RotateX(-20));
-          break;
-        case Direction::DOWN:
-          t.AppendFront(TransformList().Translate(0, -1 * distance, 0).RotateX(20));
-          break;
-        case Direction::LEFT:
-          t.AppendFront(TransformList().Translate(-1 * distance, 0, 0).RotateY(-20));
-          break;
-        case Direction::RIGHT:
-          t.AppendFront(TransformList().Translate(distance, 0, 0).RotateY(20));
-          break;
-      }
+// Welds, removes slivers and decimates the mesh in input and writes it to output as binary stl.
+bool SimplifyStl(const std::string& input, const std::string& output, const Flags& flags) {
+  Mesh mesh;
+  if (!ReadMesh(input, &mesh, flags.jobs)) {
+    return false;
+  }
+  SimplifyOptions options = flags.simplify_options;
+  options.jobs = flags.jobs;
+  SimplifyResult result = SimplifyMesh(options, &mesh);
+  PrintSimplifyResult(output, result, stdout);
+  return WriteStl(output, GetStlTriangles(mesh));
+}
 
-      // Make sure the section extruded to the bottom is thick enough. With certain angles the
-      // projection is very small if you just use the post connector from the transform. Compute
-      // an explicit shape.
-      const glm::vec3 post_offset(0, 0, -4);
-      const glm::vec3 p = point.transforms.Apply(post_offset);
-      const glm::vec3 p2 = t.Apply(post_offset);
+// Slices the stl in file_name, prints what won't print well and draws the worst layers in
+// <name>_layers.svg.
+bool SliceStl(const std::string& file_name, const Flags& flags) {
+  Mesh mesh;
+  if (!ReadMesh(file_name, &mesh, flags.jobs)) {
+    return false;
+  }
+  SliceOptions options = flags.slice_options;
+  options.jobs = flags.jobs;
+  SliceResult result = SliceMesh(mesh, options);
+  PrintSliceResult(file_name, result, stdout);
+  return WriteWorstLayersSvg(file_name.substr(0, file_name.rfind(".stl")) + "_layers.svg", result);
+}
 
-      glm::vec3 out_v = p2 - p;
-      out_v.z = 0;
-      const glm::vec3 in_v = -1.f * glm::normalize(out_v);
+// Renders every output to stl, one at a time so each gets all of the jobs for its chunks.
+int RenderOutputs(const std::map<std::string, Shape>& shapes, const Flags& flags) {
+  ChunkedRenderOptions options = flags.render_options;
+  options.jobs = flags.jobs;
+  int failed = 0;
+  for (const auto& [name, shape] : shapes) {
+    ChunkedRenderResult result = RenderChunked(shape, name, options);
+    PrintChunkedRenderResult(name, result, stdout);
+    if (result.ok && flags.simplify) {
+      result.ok = SimplifyStl(name + ".stl", name + ".stl", flags);
+    }
+    if (result.ok && flags.slice) {
+      result.ok = SliceStl(name + ".stl", flags);
+    }
+    failed += result.ok ? 0 : 1;
+  }
+  return failed > 0 ? 1 : 0;
+}
 
-      float width = 3.3 + point.extra_width;
-      Shape s2 = Hull(Cube(.1).Translate(p2), Cube(.1).Translate(p2 + (width * in_v)));
+// Renders the labeled subtrees of every output on their own and prints how long each took.
+void ProfileOutputs(const std::map<std::string, Shape>& shapes, const Flags& flags) {
+  RenderProfileOptions options;
+  options.renderer = flags.render_options.renderer;
+  options.jobs = flags.jobs;
+  for (const auto& [name, shape] : shapes) {
+    printf("\n%s\n", name.c_str());
+    PrintRenderProfile(ProfileSubtreeRenders(shape, name, options), stdout);
+  }
+}
 
-      std::vector<Shape> slice;
-      slice.push_back(Hull(s1, s2));
-      slice.push_back(Hull(s2, s2.Projection().LinearExtrude(.1).TranslateZ(.05)));
+// Renders the labeled subtrees which aren't cached yet, then writes every output importing the
+// cached stls in their place.
+bool CacheOutputs(std::map<std::string, Shape>* shapes, const Flags& flags) {
+  RenderCacheOptions options;
+  options.renderer = flags.render_options.renderer;
+  options.jobs = flags.jobs;
+  options.max_bytes = flags.cache_size_mb << 20;
+  RenderCache cache(options);
+  std::vector<Shape> all_shapes;
+  for (const auto& [name, shape] : *shapes) {
+    all_shapes.push_back(shape);
+  }
+  bool ok = cache.Update(all_shapes);
+  for (auto& [name, shape] : *shapes) {
+    shape = cache.Substitute(shape);
+    shape.WriteToFile(name + ".scad");
+  }
+  cache.Trim();
+  cache.PrintStats(stdout);
+  return ok;
+}
 
-      wall_slices.push_back(slice);
+// Checks stl files, e.g. the rendered parts in things/, without opening them in a viewer.
+int PrintMeshStats(const Flags& flags) {
+  int status = 0;
+  for (const std::string& file_name : flags.mesh_stats_files) {
+    Mesh mesh;
+    if (!ReadMesh(file_name, &mesh, flags.jobs)) {
+      status = 1;
+      continue;
     }
-
-    for (size_t i = 0; i < wall_slices.size(); ++i) {
-      auto& slice = wall_slices[i];
-      auto& next_slice = wall_slices[(i + 1) % wall_slices.size()];
-      for (size_t j = 0; j < slice.size(); ++j) {
-        shapes.push_back(Hull(slice[j], next_slice[j]));
-        // Uncomment for testing. Much faster and easier to visualize.
-        // shapes.push_back(slice[j]);
-      }
+    MeshStats stats = GetMeshStats(mesh, flags.jobs);
+    PrintMeshStats(file_name, stats, stdout);
+    if (flags.slice && !SliceStl(file_name, flags)) {
+      status = 1;
+    }
+    if (!flags.simplify) {
+      continue;
     }
+    std::string output = file_name.substr(0, file_name.rfind(".stl")) + "_simplified.stl";
+    if (!SimplifyStl(file_name, output, flags) || !ReadMesh(output, &mesh, flags.jobs)) {
+      status = 1;
+      continue;
+    }
+    PrintMeshStats(output, GetMeshStats(mesh, flags.jobs), stdout);
   }
+  return status;
+}
 
-  for (Key* key : d.all_keys()) {
-    shapes.push_back(key->GetSwitch());
-    if (kAddCaps) {
-      shapes.push_back(key->GetCap().Color("red"));
+int Generate(const Flags& flags) {
+  if (!flags.mesh_stats_files.empty()) {
+    return PrintMeshStats(flags);
+  }
+  if (flags.watch) {
+    return Watch(flags);
+  }
+  if (flags.list_targets) {
+    TargetGraph graph;
+    OutputReport report;
+    TargetInputs inputs;
+    AddTargets(inputs, &report, &graph);
+    graph.PrintTargets(stdout);
+    return 0;
+  }
+  if (flags.check_clearance || flags.check_access || !flags.optimize_output.empty()) {
+    KeyData d(GetKeyOrigin());
+    Layout layout;
+    if (!ApplyLayout(flags.layout_file, d, &layout)) {
+      return 1;
+    }
+    if (flags.check_clearance) {
+      return CheckKeyClearance(d);
     }
+    if (flags.check_access) {
+      return CheckPcbAccess(d, flags.profile, flags.access_options, flags.jobs);
+    }
+    return OptimizeKeyLayout(d, layout, flags.optimize_output, flags.optimize_keys);
   }
 
-  // Add all the screw inserts.
-  std::vector<Shape> screw_holes;
-  {
-    double screw_height = 5;
-    double screw_radius = 4.4 / 2.0;
-    Shape screw_hole = Cylinder(screw_height + 2, screw_radius, 30);
-    Shape screw_insert =
-        Cylinder(screw_height, screw_radius + 1.65, 30).TranslateZ(screw_height / 2);
-
-    glm::vec3 screw_left_bottom = d.key_shift.GetBottomLeft().Apply(kOrigin);
-    screw_left_bottom.z = 0;
-    screw_left_bottom.x += 3.2;
-
-    glm::vec3 screw_left_top = d.key_tab.GetTopLeft().Apply(kOrigin);
-    screw_left_top.z = 0;
-    screw_left_top.x += 2.8;
-    screw_left_top.y += -.5;
-
-    glm::vec3 screw_right_top = d.key_t.GetTopRight().Apply(kOrigin);
-    screw_right_top.z = 0;
-    screw_right_top.x -= .8;
-    screw_right_top.y += -.5;
-
-    glm::vec3 screw_right_bottom = d.key_thumb1.GetBottomLeft().Apply(kOrigin);
-    screw_right_bottom.z = 0;
-    screw_right_bottom.y += 2.3;
-    screw_right_bottom.x += 1.4;
-
-    glm::vec3 screw_right_mid = d.key_thumb3.GetTopLeft().Apply(kOrigin);
-    screw_right_mid.z = 0;
-    screw_right_mid.y += -.9;
-
-    shapes.push_back(Union(screw_insert.Translate(screw_left_top),
-                           screw_insert.Translate(screw_right_top),
-                           screw_insert.Translate(screw_right_mid),
-                           screw_insert.Translate(screw_right_bottom),
-                           screw_insert.Translate(screw_left_bottom)));
-    screw_holes = {
-        screw_hole.Translate(screw_left_top),
-        screw_hole.Translate(screw_right_top),
-        screw_hole.Translate(screw_right_mid),
-        screw_hole.Translate(screw_right_bottom),
-        screw_hole.Translate(screw_left_bottom),
-    };
+  if (flags.compare_profiles) {
+    // Only measures what each profile would write.
+    for (const BuildProfile& p : {GetDraftProfile(), GetFinalProfile()}) {
+      TargetInputs inputs;
+      if (!LoadInputs(p, flags.layout_file, "", &inputs)) {
+        return 1;
+      }
+      OutputReport report(false);
+      report.SetAnalyze(flags.analyze_top_n);
+      if (!BuildTargets(inputs, flags.targets, flags.jobs, &report)) {
+        return 1;
+      }
+      report.Print(p.name, stdout);
+    }
+    return 0;
   }
 
-  std::vector<Shape> negative_shapes;
-  AddShapes(&negative_shapes, screw_holes);
-//  Cut off the parts sticking up into the thumb plate.
-//  negative_shapes.push_back(
-//    d.key_thumb1.GetTopLeft().Apply(Cube(50, 50, 6).TranslateZ(3)).Color("red"));
-
-  // Cut out holes for cords. Inserts can be printed to fit in.
-  Shape connector_hole = Cube(10, 20, 10).TranslateZ(12 / 2);
-  glm::vec3 connector_location1 = d.key_r.GetTopLeft().Apply(kOrigin);
-  connector_location1.z = 6;
-  connector_location1.x += 9.75;
-  glm::vec3 connector_location2 = d.key_t.GetTopLeft().Apply(kOrigin);
-  connector_location2.z = 6;
-  connector_location2.x += 10.5;
-  negative_shapes.push_back(connector_hole.Translate(connector_location1));
-  negative_shapes.push_back(connector_hole.Translate(connector_location2));
-
-  Shape result = UnionAll(shapes);
-  // Subtracting is expensive to preview and is best to disable while testing.
-  result = result.Subtract(UnionAll(negative_shapes));
-  result.WriteToFile("v1_left.scad");
-  result.MirrorX().WriteToFile("v1_right.scad");
-
-  {
-    double depth = 13;
-    double width = 10;
-    double top_width = width;
-    double mid_width = 6;
-    double mid_height = 5.75;
-    // Height of the bottom plate on the trrs jack.
-    double bottom_plate_height = 2;
-
-    Shape bottom_plate =
-        Cube(width, 2, depth).TranslateY(-1 - bottom_plate_height).TranslateZ(depth / 2);
-    Shape bottom_face = Cube(width, 5, 2).Translate(0, -(5 / 2 + 3), 1);
-    Shape top_face = Cube(top_width, 5, 2).Translate(0, 5 / 2 + mid_height + 1, 1);
-
-    Shape top_plate = Cube(top_width, 2, depth).TranslateY(1 + mid_height).TranslateZ(depth / 2);
-    double back_height = mid_height + 6;
-    Shape back_plate = Cube(top_width, back_height, 2).Translate(0, back_height / 2 - 4, 1 + depth);
-
-    Union(top_face, bottom_plate, bottom_face, top_plate, back_plate).WriteToFile("trrs.scad");
+  TargetInputs inputs;
+  if (!LoadInputs(flags.profile, flags.layout_file, flags.profile_file, &inputs)) {
+    return 1;
   }
-
-  {
-    // trrs front plate
-    double inner_radius = 9.8 / 2;
-    double width = 3;
-    double depth = 1;
-    double fn = 20;
-
-    Circle(inner_radius + width, fn)
-        .Subtract(Circle(inner_radius, fn))
-        .LinearExtrude(depth)
-        .WriteToFile("trrs_front.scad");
-    Square(13).LinearExtrude(depth).WriteToFile("cover.scad");
+  // With the cache the outputs are written once the cached subtrees are known.
+  OutputReport report(!flags.render_cache);
+  report.SetAnalyze(flags.analyze_top_n);
+  report.SetKeepShapes(flags.render || flags.render_profile || flags.render_cache);
+  report.SetExportFlat(flags.export_flat);
+  if (!BuildTargets(inputs, flags.targets, flags.jobs, &report)) {
+    return 1;
   }
+  report.Print(inputs.profile.name, stdout);
 
-  {
-    // usbc adapter
-    double width = 11.8;
-    double height = 7.4;
-
-    double thickness = 4;
-    double depth = 7;
-
-    Square(11.8 + thickness * 2, 7.4 + thickness * 2)
-        .Subtract(Square(11.8, 7.4))
-        .LinearExtrude(depth)
-        .WriteToFile("usbc.scad");
+  std::map<std::string, Shape> shapes = report.GetShapes();
+  if (flags.render_profile) {
+    ProfileOutputs(shapes, flags);
+  }
+  if (flags.render_cache && !CacheOutputs(&shapes, flags)) {
+    return 1;
   }
+  if (flags.render) {
+    return RenderOutputs(shapes, flags);
+  }
+  return 0;
+}
 
-  // Bottom plate
-  {
-    std::vector<Shape> bottom_plate_shapes = {result};
-    for (Key* key : d.all_keys()) {
-      bottom_plate_shapes.push_back(Hull(key->GetSwitch()));
-    }
+// See kUsage for the flags, or run dactyl --help.
+int main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    return 1;
+  }
+  if (flags.help) {
+    return 0;
+  }
 
-    Shape bottom_plate = UnionAll(bottom_plate_shapes)
-                             .Projection()
-                             .LinearExtrude(1.5)
-                             .Subtract(UnionAll(screw_holes));
-    bottom_plate.WriteToFile("v1_bottom_left.scad");
-    bottom_plate.MirrorX().WriteToFile("v1_bottom_right.scad");
+  printf("generating..\n");
+  if (flags.trace) {
+    StartTracing();
+  }
+  int status = Generate(flags);
+  if (flags.alloc_report) {
+    PrintAllocationReport(stdout);
   }
+  if (flags.trace && !WriteTrace("trace.json")) {
+    return 1;
+  }
+  return status;
+}
 
-  return 0;
+// Checks the caps of neighbouring keys against each other without going through OpenSCAD.
+int CheckKeyClearance(KeyData& d) {
+  TRACE_SCOPE("CheckKeyClearance");
+  AllocationPhase allocation_phase("CheckKeyClearance");
+  auto start = std::chrono::steady_clock::now();
+  std::vector<ClearanceResult> results =
+      CheckClearance(GetNeighbourPairs(d.grid, d.thumb_keys()));
+  auto end = std::chrono::steady_clock::now();
+  int violations = PrintClearanceReport(results);
+  printf("checked in %.3f ms\n", std::chrono::duration<double, std::milli>(end - start).count());
+  return violations > 0 ? 1 : 0;
 }
 
-Shape ConnectMainKeys(KeyData& d) {
-  std::vector<Shape> shapes;
-  for (int r = 0; r < d.grid.num_rows(); ++r) {
-    for (int c = 0; c < d.grid.num_columns(); ++c) {
-      Key* key = d.grid.get_key(r, c);
-      if (!key) {
-        // No key at this location.
-        continue;
-      }
-      Key* left = d.grid.get_key(r, c - 1);
-      Key* top_left = d.grid.get_key(r - 1, c - 1);
-      Key* top = d.grid.get_key(r - 1, c);
+// Checks that a PCB fits under every switch and can be soldered, against the walls, plate and
+// screw inserts around it, without going through OpenSCAD.
+int CheckPcbAccess(KeyData& d, const BuildProfile& profile, SocketAccessOptions options, int jobs) {
+  TRACE_SCOPE("CheckPcbAccess");
+  AllocationPhase allocation_phase("CheckPcbAccess");
+  auto start = std::chrono::steady_clock::now();
+  ConfigureKeys(d, profile);
+  std::vector<SocketObstacle> obstacles = GetCaseObstacles(d, profile);
+  options.jobs = jobs;
+  std::vector<SocketAccessResult> results = CheckSocketAccess(d.all_keys(), obstacles, options);
+  auto end = std::chrono::steady_clock::now();
+  int violations = PrintSocketAccessReport(results);
+  printf("checked %d keys against %d obstacles in %.3f ms\n",
+         (int)results.size(),
+         (int)obstacles.size(),
+         std::chrono::duration<double, std::milli>(end - start).count());
+  return violations > 0 ? 1 : 0;
+}
 
-      if (left) {
-        shapes.push_back(ConnectHorizontal(*left, *key));
-      }
-      if (top) {
-        shapes.push_back(ConnectVertical(*top, *key));
-        if (left && top_left) {
-          shapes.push_back(ConnectDiagonal(*top_left, *top, *key, *left));
-        }
-      }
-    }
+// Moves the selected keys (or the keys with clearance problems) to reduce travel and keep the
+// bowl regular, and writes the adjustments as a layout which can be passed back with --layout.
+// layout has already been applied to d and is written ahead of the new adjustments.
+int OptimizeKeyLayout(KeyData& d,
+                      const Layout& layout,
+                      const std::string& output_file,
+                      const std::vector<std::string>& key_names) {
+  TRACE_SCOPE("OptimizeKeyLayout");
+  AllocationPhase allocation_phase("OptimizeKeyLayout");
+  LayoutOptimizerOptions options;
+  options.key_names = key_names;
+  options.base_layout = layout;
+  auto start = std::chrono::steady_clock::now();
+  LayoutOptimizerResult result = OptimizeLayout(d, options);
+  auto end = std::chrono::steady_clock::now();
+  printf("optimized %d keys with %d evaluations in %.3f s, cost %.4f -> %.4f\n",
+         result.moved_keys,
+         result.evaluations,
+         std::chrono::duration<double>(end - start).count(),
+         result.initial_cost,
+         result.cost);
+  if (!result.layout.Save(output_file)) {
+    return 1;
   }
-  return UnionAll(shapes);
+
+  KeyData adjusted(GetKeyOrigin());
+  result.layout.Apply(adjusted.all_keys());
+  PrintClearanceReport(CheckClearance(GetNeighbourPairs(adjusted.grid, adjusted.thumb_keys())));
+  return 0;
 }
@@ -1,8 +1,10 @@
 #include "key_data.h"
 
 #include <glm/glm.hpp>
+#include "alloc_tracker.h"
 #include "key.h"
 #include "scad.h"
+#include "trace.h"
 #include "transform.h"
 
 namespace scad {
@@ -21,6 +23,7 @@ constexpr double kCapsColumnRadius = 60;
 
 // Rotates a key about the x axis until it has traveled the direct distance (not on the arc).
 Key GetRotatedKey(double radius, bool up) {
+  TRACE_SCOPE("GetRotatedKey");
   double distance = kBowlKeySpacing;
   double rotation_direction = up ? 1.0 : -1.0;
   double degrees = 1;
@@ -64,6 +67,8 @@ Key GetRotatedKey(double radius, bool up) {
 }  // namespace
 
 KeyData::KeyData(TransformList key_origin) {
+  TRACE_SCOPE("KeyData");
+  AllocationPhase allocation_phase("KeyData");
   //
   // Thumb keys
   //
@@ -0,0 +1,236 @@
+#include "layout_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "clearance.h"
+#include "key.h"
+#include "key_data.h"
+#include "layout.h"
+#include "optimize.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+// Home row in KeyData::grid.
+constexpr int kHomeRow = 1;
+
+double StandardDeviation(const std::vector<double>& values) {
+  if (values.empty()) {
+    return 0;
+  }
+  double mean = 0;
+  for (double v : values) {
+    mean += v / values.size();
+  }
+  double variance = 0;
+  for (double v : values) {
+    variance += (v - mean) * (v - mean) / values.size();
+  }
+  return std::sqrt(variance);
+}
+
+struct KeyVolumes {
+  explicit KeyVolumes(const Key& key)
+      : cap(GetCapPolytope(key)),
+        sweep(GetInverseCapPolytope(key)),
+        socket(GetSwitchPolytope(key)) {
+  }
+
+  Polytope cap;
+  Polytope sweep;
+  Polytope socket;
+};
+
+// A copy of the layout which can be evaluated from several threads at once. Keys are referred
+// to by their index in base_keys.
+class LayoutProblem {
+ public:
+  LayoutProblem(KeyData& d, const LayoutOptimizerOptions& options) : options_(options) {
+    std::unordered_map<const Key*, int> index;
+    for (Key* key : d.all_keys()) {
+      index[key] = base_keys_.size();
+      base_keys_.push_back(*key);
+    }
+    for (size_t r = 0; r < d.grid.num_rows(); ++r) {
+      std::vector<int> row;
+      for (size_t c = 0; c < d.grid.num_columns(); ++c) {
+        Key* key = d.grid.get_key(r, c);
+        row.push_back(key ? index[key] : -1);
+      }
+      grid_.push_back(row);
+    }
+
+    for (const Key& key : base_keys_) {
+      base_volumes_.push_back(KeyVolumes(key));
+    }
+
+    std::vector<KeyPair> pairs = GetNeighbourPairs(d.grid, d.thumb_keys());
+    std::vector<std::string> names = options.key_names;
+    if (names.empty()) {
+      for (const ClearanceResult& r : CheckClearance(pairs, options.clearance)) {
+        if (r.cap_violation || r.sweep_violation) {
+          names.push_back(r.a->name);
+          names.push_back(r.b->name);
+        }
+      }
+    }
+    for (size_t i = 0; i < base_keys_.size(); ++i) {
+      if (std::find(names.begin(), names.end(), base_keys_[i].name) != names.end()) {
+        variable_keys_.push_back(i);
+      }
+    }
+    // Only pairs touching a moving key can change.
+    for (const KeyPair& pair : pairs) {
+      int a = index[pair.a];
+      int b = index[pair.b];
+      if (IsVariable(a) || IsVariable(b)) {
+        pairs_.push_back({a, b});
+      }
+    }
+  }
+
+  size_t num_variables() const {
+    return variable_keys_.size() * 6;
+  }
+
+  // Variables are scaled so that +-1 is the largest allowed adjustment.
+  Transform GetAdjustment(const std::vector<double>& x, size_t variable_key) const {
+    auto clamp = [](double v) { return std::max(-1.0, std::min(1.0, v)); };
+    const double* v = &x[variable_key * 6];
+    Transform t(clamp(v[0]) * options_.max_translation,
+                clamp(v[1]) * options_.max_translation,
+                clamp(v[2]) * options_.max_translation);
+    t.SetRotation(clamp(v[3]) * options_.max_rotation,
+                  clamp(v[4]) * options_.max_rotation,
+                  clamp(v[5]) * options_.max_rotation);
+    return t;
+  }
+
+  double Cost(const std::vector<double>& x) const {
+    std::vector<Key> keys = base_keys_;
+    double cost = 0;
+    for (size_t i = 0; i < variable_keys_.size(); ++i) {
+      keys[variable_keys_[i]].local_transforms.AddTransformFront(GetAdjustment(x, i));
+      for (size_t j = i * 6; j < i * 6 + 6; ++j) {
+        double out_of_bounds = std::max(0.0, std::abs(x[j]) - 1);
+        cost += options_.violation_weight * out_of_bounds;
+      }
+    }
+
+    std::vector<glm::vec3> centers;
+    for (const Key& key : keys) {
+      centers.push_back(key.GetSwitchTransforms().Apply(kOrigin));
+    }
+    std::vector<double> travel;
+    std::vector<double> horizontal_spacing;
+    std::vector<double> vertical_spacing;
+    for (size_t r = 0; r < grid_.size(); ++r) {
+      for (size_t c = 0; c < grid_[r].size(); ++c) {
+        int key = grid_[r][c];
+        if (key < 0) {
+          continue;
+        }
+        int home = grid_[kHomeRow][c];
+        if (r != kHomeRow && home >= 0) {
+          travel.push_back(glm::length(centers[key] - centers[home]));
+        }
+        if (c + 1 < grid_[r].size() && grid_[r][c + 1] >= 0) {
+          horizontal_spacing.push_back(glm::length(centers[key] - centers[grid_[r][c + 1]]));
+        }
+        if (r + 1 < grid_.size() && grid_[r + 1][c] >= 0) {
+          vertical_spacing.push_back(glm::length(centers[key] - centers[grid_[r + 1][c]]));
+        }
+      }
+    }
+    double mean_travel = 0;
+    for (double t : travel) {
+      mean_travel += t / travel.size();
+    }
+    cost += options_.travel_weight * mean_travel;
+    cost += options_.irregularity_weight *
+            (StandardDeviation(horizontal_spacing) + StandardDeviation(vertical_spacing));
+
+    // Only the moving keys need new volumes.
+    std::vector<const KeyVolumes*> volumes;
+    for (const KeyVolumes& v : base_volumes_) {
+      volumes.push_back(&v);
+    }
+    std::vector<KeyVolumes> moved_volumes;
+    moved_volumes.reserve(variable_keys_.size());
+    for (int key : variable_keys_) {
+      moved_volumes.push_back(KeyVolumes(keys[key]));
+      volumes[key] = &moved_volumes.back();
+    }
+
+    double violation = 0;
+    for (const auto& pair : pairs_) {
+      const KeyVolumes& a = *volumes[pair.first];
+      const KeyVolumes& b = *volumes[pair.second];
+      double cap = Distance(a.cap, b.cap).distance;
+      double sweep =
+          std::min(Distance(a.cap, b.sweep).distance, Distance(b.cap, a.sweep).distance);
+      // The path of a cap must not run into the walls of a neighbouring switch socket.
+      double wall = std::min(Distance(a.sweep, b.socket).distance,
+                             Distance(b.sweep, a.socket).distance);
+      double margin = options_.margin;
+      violation += std::max(0.0, options_.clearance.min_cap_clearance + margin - cap);
+      violation += std::max(0.0, options_.clearance.min_sweep_clearance + margin - sweep);
+      violation += std::max(0.0, margin - wall);
+    }
+    return cost + options_.violation_weight * violation;
+  }
+
+  Layout MakeLayout(const std::vector<double>& x) const {
+    Layout layout;
+    for (size_t i = 0; i < variable_keys_.size(); ++i) {
+      layout.adjustments.push_back({base_keys_[variable_keys_[i]].name, GetAdjustment(x, i)});
+    }
+    return layout;
+  }
+
+ private:
+  bool IsVariable(int key) const {
+    return std::find(variable_keys_.begin(), variable_keys_.end(), key) != variable_keys_.end();
+  }
+
+  const LayoutOptimizerOptions& options_;
+  std::vector<Key> base_keys_;
+  std::vector<KeyVolumes> base_volumes_;
+  std::vector<std::vector<int>> grid_;
+  std::vector<int> variable_keys_;
+  std::vector<std::pair<int, int>> pairs_;
+};
+
+}  // namespace
+
+LayoutOptimizerResult OptimizeLayout(KeyData& d, const LayoutOptimizerOptions& options) {
+  LayoutProblem problem(d, options);
+  LayoutOptimizerResult result;
+  result.layout = options.base_layout;
+  std::vector<double> x0(problem.num_variables(), 0);
+  result.initial_cost = problem.Cost(x0);
+  result.cost = result.initial_cost;
+  if (x0.empty()) {
+    return result;
+  }
+
+  std::vector<double> steps(x0.size(), 0.25);
+  OptimizeResult best = MultiStartNelderMead(
+      [&](const std::vector<double>& x) { return problem.Cost(x); }, x0, steps, options.search);
+  Layout moved = problem.MakeLayout(best.x);
+  result.moved_keys = moved.adjustments.size();
+  result.layout.adjustments.insert(
+      result.layout.adjustments.end(), moved.adjustments.begin(), moved.adjustments.end());
+  result.cost = best.value;
+  result.evaluations = best.evaluations;
+  return result;
+}
+
+}  // namespace scad
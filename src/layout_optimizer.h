@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "clearance.h"
+#include "key_data.h"
+#include "layout.h"
+#include "optimize.h"
+
+namespace scad {
+
+struct LayoutOptimizerOptions {
+  // Names of the keys to move. Empty selects every key in a pair which violates the clearance
+  // limits.
+  std::vector<std::string> key_names;
+  // Bounds on the adjustment of each key.
+  double max_translation = 2;
+  double max_rotation = 5;
+  // Mean distance of each key from the home row key in its column, in mm.
+  double travel_weight = 1;
+  // Standard deviation of the spacing between neighbouring keys, in mm.
+  double irregularity_weight = 1;
+  // Cost per mm that a clearance limit is violated by.
+  double violation_weight = 100;
+  ClearanceOptions clearance;
+  // Extra clearance required during the search so the rounded values in the saved layout still
+  // pass the limits.
+  double margin = 0.01;
+  MultiStartOptions search = {{1000}, 4};
+  // Adjustments already applied to the keys, e.g. from --layout. They are kept ahead of the new
+  // ones in the result, so optimizing the output of an earlier run doesn't lose its adjustments.
+  Layout base_layout;
+};
+
+struct LayoutOptimizerResult {
+  // base_layout followed by the new adjustments, which reproduces the optimized keys when applied
+  // to keys without a layout.
+  Layout layout;
+  // Keys given a new adjustment.
+  int moved_keys = 0;
+  double initial_cost = 0;
+  double cost = 0;
+  int evaluations = 0;
+};
+
+// Searches for adjustments to the selected keys which minimize travel and bowl irregularity
+// while keeping caps clear of each other and cap paths clear of neighbouring switch sockets.
+// Every evaluation is done in memory against the polytopes from clearance.h.
+LayoutOptimizerResult OptimizeLayout(KeyData& d, const LayoutOptimizerOptions& options);
+
+}  // namespace scad
@@ -0,0 +1,869 @@
+#include "targets.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "alloc_tracker.h"
+#include "connector_plan.h"
+#include "key.h"
+#include "key_data.h"
+#include "layout.h"
+#include "mesh.h"
+#include "scad.h"
+#include "target_graph.h"
+#include "trace.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+enum class Direction { UP, DOWN, LEFT, RIGHT };
+
+void AddShapes(std::vector<Shape>* shapes, const std::vector<Shape>& to_add) {
+  shapes->insert(shapes->end(), to_add.begin(), to_add.end());
+}
+
+// Everything built by the targets. Each field is written by exactly one target.
+struct CaseParts {
+  std::unique_ptr<KeyData> keys;
+  Shape connectors;
+  std::vector<Shape> walls;
+  std::vector<Shape> switches;
+  std::vector<glm::vec3> screw_locations;
+  Shape screw_inserts;
+  std::vector<Shape> screw_holes;
+  std::vector<Shape> cutouts;
+  // result before the screw holes and cutouts are taken out.
+  Shape solid;
+  Shape result;
+  FlatPart bottom_plate;
+};
+
+bool ParseBool(const std::string& value, bool* b) {
+  if (value == "true" || value == "1") {
+    *b = true;
+  } else if (value == "false" || value == "0") {
+    *b = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool operator==(const BuildProfile& a, const BuildProfile& b) {
+  return a.name == b.name && a.add_caps == b.add_caps && a.subtract == b.subtract &&
+         a.full_walls == b.full_walls && a.cut_thumb_plate == b.cut_thumb_plate &&
+         a.simple_switches == b.simple_switches && a.side_nubs == b.side_nubs;
+}
+
+BuildProfile GetDraftProfile() {
+  BuildProfile profile;
+  profile.name = "draft";
+  profile.subtract = false;
+  profile.full_walls = false;
+  profile.simple_switches = true;
+  profile.side_nubs = false;
+  return profile;
+}
+
+BuildProfile GetFinalProfile() {
+  BuildProfile profile;
+  profile.name = "final";
+  return profile;
+}
+
+bool GetBuildProfile(const std::string& name, BuildProfile* profile) {
+  for (const BuildProfile& p : {GetDraftProfile(), GetFinalProfile()}) {
+    if (p.name == name) {
+      *profile = p;
+      return true;
+    }
+  }
+  fprintf(stderr, "Unknown profile %s\n", name.c_str());
+  return false;
+}
+
+bool LoadBuildProfile(const std::string& file_name, BuildProfile* profile) {
+  std::FILE* file = std::fopen(file_name.c_str(), "r");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open profile %s\n", file_name.c_str());
+    return false;
+  }
+  char line[512];
+  int line_number = 0;
+  bool ok = true;
+  while (std::fgets(line, sizeof(line), file)) {
+    ++line_number;
+    char field_buffer[256];
+    char value_buffer[256];
+    int read = sscanf(line, " %255s %255s", field_buffer, value_buffer);
+    if (read <= 0 || field_buffer[0] == '#') {
+      continue;
+    }
+    std::string field = field_buffer;
+    std::string value = read == 2 ? value_buffer : "";
+    bool* flag = nullptr;
+    if (field == "add_caps") {
+      flag = &profile->add_caps;
+    } else if (field == "subtract") {
+      flag = &profile->subtract;
+    } else if (field == "full_walls") {
+      flag = &profile->full_walls;
+    } else if (field == "cut_thumb_plate") {
+      flag = &profile->cut_thumb_plate;
+    } else if (field == "simple_switches") {
+      flag = &profile->simple_switches;
+    } else if (field == "side_nubs") {
+      flag = &profile->side_nubs;
+    }
+
+    if (field == "profile") {
+      ok = GetBuildProfile(value, profile) && ok;
+    } else if (flag == nullptr) {
+      fprintf(stderr, "%s:%d: unknown field %s\n", file_name.c_str(), line_number, field.c_str());
+      ok = false;
+    } else if (!ParseBool(value, flag)) {
+      fprintf(stderr, "%s:%d: expected true or false\n", file_name.c_str(), line_number);
+      ok = false;
+    }
+  }
+  std::fclose(file);
+  return ok;
+}
+
+TransformList GetKeyOrigin() {
+  TransformList key_origin;
+  key_origin.Translate(-20, -40, 3);
+  return key_origin;
+}
+
+FlatPart::FlatPart(Shape shape, double extrude_height)
+    : outline(std::move(shape)), height(extrude_height) {
+  TRACE_SCOPE("FlatPart");
+  if (!GetRegion(outline, &region)) {
+    region = Region();
+  }
+}
+
+FlatPart FlatPart::MirrorX() const {
+  FlatPart part;
+  part.outline = outline.MirrorX();
+  part.height = height;
+  part.region = TransformRegion(region, glm::dmat4(glm::dmat3(-1, 0, 0, 0, 1, 0, 0, 0, 1)));
+  return part;
+}
+
+void OutputReport::Write(const Shape& shape, const std::string& name) {
+  Output output;
+  output.name = name;
+  if (write_files_ && skip_unchanged_) {
+    std::string scad;
+    output.stats = shape.WriteToString(&scad);
+    size_t hash = std::hash<std::string>()(scad);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = hashes_.find(name);
+      output.unchanged = it != hashes_.end() && it->second == hash;
+      hashes_[name] = hash;
+    }
+    if (!output.unchanged) {
+      TRACE_SCOPE("WriteToFile", name);
+      std::FILE* file = std::fopen((name + ".scad").c_str(), "w");
+      if (file == nullptr) {
+        fprintf(stderr, "Could not open file %s.scad\n", name.c_str());
+      } else {
+        std::fwrite(scad.data(), 1, scad.size(), file);
+        std::fclose(file);
+      }
+    }
+  } else {
+    output.stats = write_files_ ? shape.WriteToFile(name + ".scad") : shape.GetScadStats();
+  }
+  if (analyze_top_n_ > 0) {
+    output.analysis = shape.Analyze();
+  }
+  if (keep_shapes_) {
+    output.shape = shape;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  outputs_.push_back(output);
+}
+
+void OutputReport::Write(const FlatPart& part, const std::string& name) {
+  bool resolved = !part.region.empty();
+  Write((resolved ? MakePolygon(part.region) : part.outline).LinearExtrude(part.height), name);
+  if (!write_files_ || !export_flat_) {
+    return;
+  }
+  if (!resolved) {
+    fprintf(stderr, "Could not resolve the outline of %s\n", name.c_str());
+    return;
+  }
+  TRACE_SCOPE("ExportFlat", name);
+  WriteRegionSvg(name + ".svg", part.region);
+  WriteRegionDxf(name + ".dxf", part.region);
+  WriteStl(name + ".stl", GetStlTriangles(ExtrudeRegion(part.region, part.height)));
+}
+
+std::map<std::string, Shape> OutputReport::GetShapes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<std::string, Shape> shapes;
+  for (const Output& output : outputs_) {
+    shapes[output.name] = output.shape;
+  }
+  return shapes;
+}
+
+void OutputReport::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  outputs_.clear();
+}
+
+void OutputReport::Print(const std::string& profile_name, std::FILE* file) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Output> outputs = outputs_;
+  std::sort(outputs.begin(), outputs.end(), [](const Output& a, const Output& b) {
+    return a.name < b.name;
+  });
+  ScadStats total;
+  for (const Output& output : outputs) {
+    fprintf(file,
+            "%-8s %-16s %8ld nodes %10ld bytes%s\n",
+            profile_name.c_str(),
+            output.name.c_str(),
+            output.stats.nodes,
+            output.stats.bytes,
+            output.unchanged ? " (unchanged)" : "");
+    total.nodes += output.stats.nodes;
+    total.bytes += output.stats.bytes;
+  }
+  fprintf(file,
+          "%-8s %-16s %8ld nodes %10ld bytes\n",
+          profile_name.c_str(),
+          "total",
+          total.nodes,
+          total.bytes);
+
+  if (analyze_top_n_ > 0) {
+    for (const Output& output : outputs) {
+      fprintf(file, "\n%s %s\n", profile_name.c_str(), output.name.c_str());
+      PrintShapeAnalysis(output.analysis, analyze_top_n_, file);
+    }
+  }
+}
+
+void ConfigureKeys(KeyData& d, const BuildProfile& profile) {
+  TRACE_SCOPE("ConfigureKeys");
+  AllocationPhase allocation_phase("ConfigureKeys");
+  for (Key* key : d.all_keys()) {
+    key->simple_switch = profile.simple_switches;
+    if (!profile.side_nubs) {
+      key->add_side_nub = false;
+    }
+  }
+
+
+  d.key_thumb1.extra_width_bottom = 2;
+  d.key_thumb1.extra_width_left = 2;
+  d.key_thumb2.extra_width_top = 2;
+  d.key_thumb2.extra_width_bottom = 2;
+  d.key_thumb3.extra_width_top = 2;
+  d.key_thumb3.extra_width_bottom = 2;
+  d.key_thumb4.extra_width_top = 2;
+  d.key_thumb4.extra_width_right = 2;
+  d.key_thumb4.extra_width_bottom = 2;
+
+  // left wall
+  for (Key* key : d.grid.column(0)) {
+    if (key) {
+      key->extra_width_left = 4;
+    }
+  }
+
+  d.key_t.extra_width_right = 2;
+  d.key_g.extra_width_right = 3;
+  d.key_b.extra_width_right = 3;
+
+  for (Key* key : d.grid.row(0)) {
+    // top row
+    if (key) {
+      key->extra_width_top = 2;
+    }
+  }
+  d.key_b.extra_width_bottom = 3;
+}
+
+ConnectorPlan MakeConnectorPlan(KeyData& d) {
+  // Every triangle connecting key corners goes into one plan so shared corners are only computed
+  // once and repeated triangles are dropped.
+  ConnectorPlan plan;
+  plan.AddGrid(d.grid);
+
+  //
+  // Thumb plate
+  //
+
+  plan.AddHorizontal(d.key_thumb1, d.key_thumb2);
+  plan.AddHorizontal(d.key_thumb2, d.key_thumb3);
+  plan.AddHorizontal(d.key_thumb3, d.key_thumb4);
+  plan.AddTriangle(
+      plan.TopLeft(d.key_thumb1), plan.TopRight(d.key_thumb1), plan.TopLeft(d.key_thumb2));
+  plan.AddTriangle(
+      plan.TopLeft(d.key_thumb2), plan.TopRight(d.key_thumb2), plan.TopLeft(d.key_thumb3));
+
+  plan.AddFan(plan.TopLeft(d.key_thumb2),
+              {
+                  plan.BottomRight(d.key_b),
+                  plan.TopRight(d.key_b),
+                  plan.BottomRight(d.key_g),
+              });
+
+  // These corners with a z offset are moved down to reduce the vertical jumps.
+  int slash_bottom_right = plan.BottomRight(d.key_slash, -1);
+  int right_bottom_right = plan.BottomRight(d.key_right_arrow, -3);
+
+  plan.AddFan(plan.TopLeft(d.key_thumb1),
+              {
+                  right_bottom_right,
+                  plan.BottomLeft(d.key_right_arrow, -1),
+                  plan.BottomRight(d.key_left_arrow, -1),
+                  plan.BottomLeft(d.key_left_arrow, -1),
+                  slash_bottom_right,
+                  plan.BottomLeft(d.key_thumb1),
+              });
+  plan.AddFan(plan.TopRight(d.key_thumb1),
+              {
+                  plan.TopLeft(d.key_thumb1),
+                  right_bottom_right,
+                  plan.BottomRight(d.key_b),
+                  plan.TopLeft(d.key_thumb2),
+              });
+  plan.AddFan(plan.TopRight(d.key_thumb2),
+              {
+                  plan.TopLeft(d.key_thumb2),
+                  plan.BottomRight(d.key_b),
+                  plan.TopLeft(d.key_thumb3),
+              });
+  plan.AddFan(plan.BottomLeft(d.key_b),
+              {
+                  plan.BottomRight(d.key_b),
+                  right_bottom_right,
+                  plan.TopRight(d.key_right_arrow),
+                  plan.BottomRight(d.key_v),
+              });
+  plan.AddFan(plan.BottomRight(d.key_tilde),
+              {
+                  plan.BottomLeft(d.key_slash),
+                  slash_bottom_right,
+              });
+
+  // Bottom right corner.
+  plan.AddFan(plan.BottomRight(d.key_shift),
+              {
+                  plan.BottomLeft(d.key_z),
+                  plan.TopLeft(d.key_tilde),
+                  plan.BottomLeft(d.key_tilde),
+                  plan.BottomLeft(d.key_shift),
+              });
+
+  return plan;
+}
+
+Shape MakeConnectors(KeyData& d) {
+  return MakeConnectorPlan(d).Build().Tag("connectors");
+}
+
+std::vector<WallSection> GetWallSections(KeyData& d) {
+  struct WallPoint {
+    WallPoint(TransformList transforms,
+              Direction out_direction,
+              float extra_distance = 0,
+              float extra_width = 0)
+        : transforms(transforms),
+          out_direction(out_direction),
+          extra_distance(extra_distance),
+          extra_width(extra_width) {
+    }
+    TransformList transforms;
+    Direction out_direction;
+    float extra_distance;
+    float extra_width;
+  };
+
+  Direction up = Direction::UP;
+  Direction down = Direction::DOWN;
+  Direction left = Direction::LEFT;
+  Direction right = Direction::RIGHT;
+
+  // The same corner as the thumb fan in MakeConnectors.
+  TransformList slash_bottom_right = d.key_slash.GetBottomRight().TranslateFront(0, 0, -1);
+
+  std::vector<WallPoint> wall_points = {
+      // Start top left and go clockwise
+      {d.key_tab.GetTopLeft(), up},
+      {d.key_tab.GetTopRight(), up, 0, .3},
+
+      {d.key_q.GetTopLeft(), up, 0, .5},
+      {d.key_q.GetTopRight().RotateFront(0, 0, 30), up, 0, 1},
+
+      {d.key_w.GetTopLeft(), up, 0, .3},
+      {d.key_w.GetTopRight(), up},
+
+      {d.key_e.GetTopLeft(), up},
+      {d.key_e.GetTopRight(), up},
+
+      {d.key_r.GetTopLeft(), up},
+      {d.key_r.GetTopRight(), up},
+      {d.key_t.GetTopRight(), up},
+      {d.key_t.GetTopRight(), right},
+      {d.key_t.GetBottomRight(), right},
+
+      {d.key_g.GetTopRight(), right},
+      {d.key_g.GetBottomRight(), right, 1, .5},
+
+      {d.key_b.GetTopRight(), right, 1, .5},
+      {d.key_b.GetBottomRight(), right, 1, .5},
+
+      // thumb plate
+      {d.key_thumb3.GetTopLeft().RotateFront(0, 0, -25), up, 1, .5},
+      {d.key_thumb3.GetTopRight(), up, 1, .5},
+      {d.key_thumb4.GetTopLeft(), up, 1, .5},
+
+      // round the corner
+      {d.key_thumb4.GetTopRight(), up, 1, .5},
+      {d.key_thumb4.GetTopRight(), right, 1, .5},
+      {d.key_thumb4.GetBottomRight(), right, 1, .5},
+      {d.key_thumb4.GetBottomRight(), down, 1, .5},
+      // bottom edge
+      {d.key_thumb4.GetBottomLeft(), down, 1, .5},
+      {d.key_thumb3.GetBottomRight(), down, 1, .5},
+      {d.key_thumb3.GetBottomLeft(), down, 1, .5},
+      {d.key_thumb2.GetBottomRight(), down, 1, .5},
+      {d.key_thumb2.GetBottomLeft(), down, 1, .5},
+      {d.key_thumb1.GetBottomRight(), down, 1, .5},
+      {d.key_thumb1.GetBottomLeft().RotateFront(0, 0, 15), down, 1, .5},
+      {d.key_thumb1.GetBottomLeft(), left, 1, .5},
+      // /thumb plate
+
+      {slash_bottom_right.RotateFront(0, 0, -25), down},
+
+      {d.key_tilde.GetBottomRight(), down},
+      {d.key_tilde.GetBottomLeft(), down},
+
+      {d.key_shift.GetBottomLeft(), down, 0, .75},
+      {d.key_shift.GetBottomLeft(), left, 0, .5},
+      {d.key_shift.GetTopLeft(), left, 0, .5},
+
+      {d.key_caps.GetBottomLeft(), left},
+      {d.key_caps.GetTopLeft(), left},
+
+      {d.key_tab.GetBottomLeft(), left},
+      {d.key_tab.GetTopLeft(), left},
+
+      {d.key_tab.GetBottomLeft(), left},
+      {d.key_tab.GetTopLeft(), left},
+  };
+
+  std::vector<WallSection> sections;
+  for (WallPoint point : wall_points) {
+    TransformList t = point.transforms;
+    glm::vec3 out_dir;
+    float distance = 4.8 + point.extra_distance;
+    switch (point.out_direction) {
+      case Direction::UP:
+        t.AppendFront(TransformList().Translate(0, distance, 0).RotateX(-20));
+        break;
+      case Direction::DOWN:
+        t.AppendFront(TransformList().Translate(0, -1 * distance, 0).RotateX(20));
+        break;
+      case Direction::LEFT:
+        t.AppendFront(TransformList().Translate(-1 * distance, 0, 0).RotateY(-20));
+        break;
+      case Direction::RIGHT:
+        t.AppendFront(TransformList().Translate(distance, 0, 0).RotateY(20));
+        break;
+    }
+
+    // Make sure the section extruded to the bottom is thick enough. With certain angles the
+    // projection is very small if you just use the post connector from the transform. Compute
+    // an explicit shape.
+    const glm::vec3 post_offset(0, 0, -4);
+    const glm::vec3 p = point.transforms.Apply(post_offset);
+    const glm::vec3 p2 = t.Apply(post_offset);
+
+    glm::vec3 out_v = p2 - p;
+    out_v.z = 0;
+    const glm::vec3 in_v = -1.f * glm::normalize(out_v);
+
+    float width = 3.3 + point.extra_width;
+    sections.push_back({point.transforms, p2, p2 + (width * in_v)});
+  }
+  return sections;
+}
+
+std::vector<Shape> MakeWalls(KeyData& d, const BuildProfile& profile) {
+  std::vector<std::vector<Shape>> wall_slices;
+  for (const WallSection& section : GetWallSections(d)) {
+    Shape s1 = section.transforms.Apply(GetPostConnector());
+    Shape s2 = Hull(Cube(.1).Translate(section.outer), Cube(.1).Translate(section.inner));
+
+    std::vector<Shape> slice;
+    slice.push_back(Hull(s1, s2));
+    slice.push_back(Hull(s2, s2.Projection().LinearExtrude(.1).TranslateZ(.05)));
+
+    wall_slices.push_back(slice);
+  }
+
+  std::vector<Shape> shapes;
+  for (size_t i = 0; i < wall_slices.size(); ++i) {
+    auto& slice = wall_slices[i];
+    auto& next_slice = wall_slices[(i + 1) % wall_slices.size()];
+    for (size_t j = 0; j < slice.size(); ++j) {
+      if (profile.full_walls) {
+        shapes.push_back(Hull(slice[j], next_slice[j]).Tag("walls"));
+      } else {
+        shapes.push_back(slice[j].Tag("walls"));
+      }
+    }
+  }
+  return shapes;
+}
+
+std::vector<Shape> MakeSwitches(KeyData& d, const BuildProfile& profile) {
+  std::vector<Shape> shapes;
+  for (Key* key : d.all_keys()) {
+    shapes.push_back(key->GetSwitch().Tag("switches"));
+    if (profile.add_caps) {
+      shapes.push_back(key->GetCap().Color("red").Tag("caps"));
+    }
+  }
+  return shapes;
+}
+
+std::vector<glm::vec3> GetScrewLocations(KeyData& d) {
+  glm::vec3 screw_left_bottom = d.key_shift.GetBottomLeft().Apply(kOrigin);
+  screw_left_bottom.z = 0;
+  screw_left_bottom.x += 3.2;
+
+  glm::vec3 screw_left_top = d.key_tab.GetTopLeft().Apply(kOrigin);
+  screw_left_top.z = 0;
+  screw_left_top.x += 2.8;
+  screw_left_top.y += -.5;
+
+  glm::vec3 screw_right_top = d.key_t.GetTopRight().Apply(kOrigin);
+  screw_right_top.z = 0;
+  screw_right_top.x -= .8;
+  screw_right_top.y += -.5;
+
+  glm::vec3 screw_right_bottom = d.key_thumb1.GetBottomLeft().Apply(kOrigin);
+  screw_right_bottom.z = 0;
+  screw_right_bottom.y += 2.3;
+  screw_right_bottom.x += 1.4;
+
+  glm::vec3 screw_right_mid = d.key_thumb3.GetTopLeft().Apply(kOrigin);
+  screw_right_mid.z = 0;
+  screw_right_mid.y += -.9;
+
+  return {screw_left_top, screw_right_top, screw_right_mid, screw_right_bottom, screw_left_bottom};
+}
+
+const double kScrewHeight = 5;
+const double kScrewRadius = 4.4 / 2.0;
+
+Shape MakeScrewInserts(const std::vector<glm::vec3>& locations) {
+  Shape screw_insert =
+      Cylinder(kScrewHeight, kScrewRadius + 1.65, 30).TranslateZ(kScrewHeight / 2);
+  std::vector<Shape> inserts;
+  for (const glm::vec3& location : locations) {
+    inserts.push_back(screw_insert.Translate(location));
+  }
+  return UnionAll(inserts).Tag("screw_inserts");
+}
+
+std::vector<Shape> MakeScrewHoles(const std::vector<glm::vec3>& locations) {
+  Shape screw_hole = Cylinder(kScrewHeight + 2, kScrewRadius, 30);
+  std::vector<Shape> holes;
+  for (const glm::vec3& location : locations) {
+    holes.push_back(screw_hole.Translate(location).Tag("screw_holes"));
+  }
+  return holes;
+}
+
+std::vector<SocketObstacle> GetCaseObstacles(KeyData& d, const BuildProfile& profile) {
+  std::vector<SocketObstacle> obstacles = GetSocketObstacles(d.all_keys());
+  auto add = [&](const std::string& name, const std::vector<glm::dvec3>& points) {
+    obstacles.push_back({name, ConvexHull(points)});
+  };
+  auto add_box = [](const glm::vec3& center, double size, std::vector<glm::dvec3>* points) {
+    for (double x : {-size / 2, size / 2}) {
+      for (double y : {-size / 2, size / 2}) {
+        for (double z : {-size / 2, size / 2}) {
+          points->push_back(glm::dvec3(center) + glm::dvec3(x, y, z));
+        }
+      }
+    }
+  };
+
+  // The post connectors are treated as lines, they are only .01 wide.
+  const glm::vec3 post_top(0, 0, 0);
+  const glm::vec3 post_bottom(0, 0, -3.5);
+
+  // The same pieces as MakeWalls: the post hulled with the outer section, and the outer section
+  // hulled with its footprint on the ground.
+  std::vector<std::array<std::vector<glm::dvec3>, 2>> slices;
+  for (const WallSection& section : GetWallSections(d)) {
+    std::array<std::vector<glm::dvec3>, 2> slice;
+    slice[0].push_back(section.transforms.Apply(post_top));
+    slice[0].push_back(section.transforms.Apply(post_bottom));
+    add_box(section.outer, .1, &slice[0]);
+    add_box(section.inner, .1, &slice[0]);
+    add_box(section.outer, .1, &slice[1]);
+    add_box(section.inner, .1, &slice[1]);
+    for (const glm::vec3& p : {section.outer, section.inner}) {
+      for (double z : {.05, .15}) {
+        slice[1].push_back(glm::dvec3(p.x, p.y, z));
+      }
+    }
+    slices.push_back(slice);
+  }
+  for (size_t i = 0; i < slices.size(); ++i) {
+    for (size_t j = 0; j < 2; ++j) {
+      std::vector<glm::dvec3> points = slices[i][j];
+      if (profile.full_walls) {
+        const std::vector<glm::dvec3>& next = slices[(i + 1) % slices.size()][j];
+        points.insert(points.end(), next.begin(), next.end());
+      }
+      add("wall " + std::to_string(i) + (j == 0 ? " top" : " bottom"), points);
+    }
+  }
+
+  ConnectorPlan plan = MakeConnectorPlan(d);
+  for (size_t i = 0; i < plan.triangles().size(); ++i) {
+    std::vector<glm::dvec3> points;
+    for (int corner : plan.triangles()[i]) {
+      points.push_back(plan.GetTransforms(corner).Apply(post_top));
+      points.push_back(plan.GetTransforms(corner).Apply(post_bottom));
+    }
+    add("plate " + std::to_string(i), points);
+  }
+
+  std::vector<glm::vec3> screw_locations = GetScrewLocations(d);
+  for (size_t i = 0; i < screw_locations.size(); ++i) {
+    std::vector<glm::dvec3> points;
+    for (int k = 0; k < 30; ++k) {
+      double angle = glm::radians(360.0 * k / 30);
+      glm::dvec3 p = glm::dvec3(screw_locations[i]) +
+                     (kScrewRadius + 1.65) * glm::dvec3(std::cos(angle), std::sin(angle), 0);
+      points.push_back(p);
+      points.push_back(p + glm::dvec3(0, 0, kScrewHeight));
+    }
+    add("screw insert " + std::to_string(i), points);
+  }
+  return obstacles;
+}
+
+std::vector<Shape> MakeCutouts(KeyData& d, const BuildProfile& profile) {
+  std::vector<Shape> negative_shapes;
+  if (profile.cut_thumb_plate) {
+    Shape thumb_plate_cut = Cube(50, 50, 6).TranslateZ(3).Color("red");
+    negative_shapes.push_back(d.key_thumb1.GetTopLeft().Apply(thumb_plate_cut).Tag("cutouts"));
+  }
+
+  // Cut out holes for cords. Inserts can be printed to fit in.
+  Shape connector_hole = Cube(10, 20, 10).TranslateZ(12 / 2);
+  glm::vec3 connector_location1 = d.key_r.GetTopLeft().Apply(kOrigin);
+  connector_location1.z = 6;
+  connector_location1.x += 9.75;
+  glm::vec3 connector_location2 = d.key_t.GetTopLeft().Apply(kOrigin);
+  connector_location2.z = 6;
+  connector_location2.x += 10.5;
+  negative_shapes.push_back(connector_hole.Translate(connector_location1).Tag("cutouts"));
+  negative_shapes.push_back(connector_hole.Translate(connector_location2).Tag("cutouts"));
+  return negative_shapes;
+}
+
+FlatPart MakeBottomPlate(KeyData& d,
+                         const BuildProfile& profile,
+                         const Shape& solid,
+                         const std::vector<Shape>& screw_holes) {
+  std::vector<Shape> bottom_plate_shapes = {solid};
+  for (Key* key : d.all_keys()) {
+    bottom_plate_shapes.push_back(Hull(key->GetSwitch()).Tag("switch_hulls"));
+  }
+
+  Shape outline = UnionAll(bottom_plate_shapes).Projection();
+  if (profile.subtract) {
+    // The screw holes go right through the plate.
+    outline = outline.Subtract(UnionAll(screw_holes).Projection());
+  }
+  return {outline, 1.5};
+}
+
+Shape MakeTestKeys(KeyData& d, const BuildProfile& profile) {
+  std::vector<Shape> test_shapes;
+  std::vector<Key*> test_keys = {&d.key_e, &d.key_d, &d.key_r, &d.key_t, &d.key_d};
+  for (Key* test_key : test_keys) {
+    // Work on a copy since other targets may be reading the keys. The test keys are shown
+    // without the case widths.
+    Key key = *test_key;
+    key.extra_width_top = 0;
+    key.extra_width_bottom = 0;
+    key.extra_width_left = 0;
+    key.extra_width_right = 0;
+    key.add_side_nub = false;
+    key.extra_z = 4;
+    test_shapes.push_back(key.GetSwitch());
+    if (profile.add_caps) {
+      test_shapes.push_back(key.GetCap().Color("red"));
+    }
+  }
+  return UnionAll(test_shapes);
+}
+
+Shape MakeTrrsHolder() {
+  double depth = 13;
+  double width = 10;
+  double top_width = width;
+  double mid_width = 6;
+  double mid_height = 5.75;
+  // Height of the bottom plate on the trrs jack.
+  double bottom_plate_height = 2;
+
+  Shape bottom_plate =
+      Cube(width, 2, depth).TranslateY(-1 - bottom_plate_height).TranslateZ(depth / 2);
+  Shape bottom_face = Cube(width, 5, 2).Translate(0, -(5 / 2 + 3), 1);
+  Shape top_face = Cube(top_width, 5, 2).Translate(0, 5 / 2 + mid_height + 1, 1);
+
+  Shape top_plate = Cube(top_width, 2, depth).TranslateY(1 + mid_height).TranslateZ(depth / 2);
+  double back_height = mid_height + 6;
+  Shape back_plate = Cube(top_width, back_height, 2).Translate(0, back_height / 2 - 4, 1 + depth);
+
+  return Union(top_face, bottom_plate, bottom_face, top_plate, back_plate);
+}
+
+FlatPart MakeTrrsFront() {
+  // trrs front plate
+  double inner_radius = 9.8 / 2;
+  double width = 3;
+  double depth = 1;
+  double fn = 20;
+
+  return {Circle(inner_radius + width, fn).Subtract(Circle(inner_radius, fn)), depth};
+}
+
+FlatPart MakeCover() {
+  double depth = 1;
+  return {Square(13), depth};
+}
+
+FlatPart MakeUsbcAdapter() {
+  double width = 11.8;
+  double height = 7.4;
+
+  double thickness = 4;
+  double depth = 7;
+
+  return {Square(width + thickness * 2, height + thickness * 2).Subtract(Square(width, height)),
+          depth};
+}
+
+void AddTargets(const TargetInputs& inputs, OutputReport* report, TargetGraph* graph) {
+  auto parts = std::make_shared<CaseParts>();
+  const BuildProfile& profile = inputs.profile;
+
+  // Every other target reads the keys through parts->keys, which stays the same until "keys" is
+  // built again.
+  graph->AddTarget("keys", {}, [&inputs, parts]() {
+    parts->keys = std::make_unique<KeyData>(GetKeyOrigin());
+    inputs.layout.Apply(parts->keys->all_keys());
+    ConfigureKeys(*parts->keys, inputs.profile);
+  });
+
+  graph->AddTarget(
+      "connectors", {"keys"}, [parts]() { parts->connectors = MakeConnectors(*parts->keys); });
+  graph->AddTarget("walls", {"keys"}, [&profile, parts]() {
+    parts->walls = MakeWalls(*parts->keys, profile);
+  });
+  graph->AddTarget("switches", {"keys"}, [&profile, parts]() {
+    parts->switches = MakeSwitches(*parts->keys, profile);
+  });
+  graph->AddTarget("screw_locations", {"keys"}, [parts]() {
+    parts->screw_locations = GetScrewLocations(*parts->keys);
+  });
+  graph->AddTarget("screw_inserts", {"screw_locations"}, [parts]() {
+    parts->screw_inserts = MakeScrewInserts(parts->screw_locations);
+  });
+  graph->AddTarget("screw_holes", {"screw_locations"}, [parts]() {
+    parts->screw_holes = MakeScrewHoles(parts->screw_locations);
+  });
+  graph->AddTarget("cutouts", {"keys"}, [&profile, parts]() {
+    parts->cutouts = MakeCutouts(*parts->keys, profile);
+  });
+
+  graph->AddTarget(
+      "result",
+      {"connectors", "walls", "switches", "screw_inserts", "screw_holes", "cutouts"},
+      [&profile, parts]() {
+        std::vector<Shape> shapes;
+        shapes.reserve(parts->walls.size() + parts->switches.size() + 2);
+        shapes.push_back(parts->connectors);
+        AddShapes(&shapes, parts->walls);
+        AddShapes(&shapes, parts->switches);
+        shapes.push_back(parts->screw_inserts);
+
+        parts->solid = UnionAll(std::move(shapes));
+        parts->result = parts->solid;
+        if (profile.subtract) {
+          std::vector<Shape> negative_shapes;
+          negative_shapes.reserve(parts->screw_holes.size() + parts->cutouts.size());
+          AddShapes(&negative_shapes, parts->screw_holes);
+          AddShapes(&negative_shapes, parts->cutouts);
+          parts->result = parts->result.Subtract(UnionAll(std::move(negative_shapes)));
+        }
+      });
+
+  graph->AddOutput(
+      "v1_left", {"result"}, [report, parts]() { report->Write(parts->result, "v1_left"); });
+  graph->AddOutput("v1_right", {"result"}, [report, parts]() {
+    report->Write(parts->result.MirrorX(), "v1_right");
+  });
+
+  graph->AddOutput("trrs", {}, [report]() { report->Write(MakeTrrsHolder(), "trrs"); });
+  graph->AddOutput(
+      "trrs_front", {}, [report]() { report->Write(MakeTrrsFront(), "trrs_front"); });
+  graph->AddOutput("cover", {}, [report]() { report->Write(MakeCover(), "cover"); });
+  graph->AddOutput("usbc", {}, [report]() { report->Write(MakeUsbcAdapter(), "usbc"); });
+
+  graph->AddTarget("bottom_plate", {"result", "screw_holes"}, [&profile, parts]() {
+    parts->bottom_plate =
+        MakeBottomPlate(*parts->keys, profile, parts->solid, parts->screw_holes);
+  });
+  graph->AddOutput("v1_bottom_left", {"bottom_plate"}, [report, parts]() {
+    report->Write(parts->bottom_plate, "v1_bottom_left");
+  });
+  graph->AddOutput("v1_bottom_right", {"bottom_plate"}, [report, parts]() {
+    report->Write(parts->bottom_plate.MirrorX(), "v1_bottom_right");
+  });
+
+  graph->AddGroup("left", {"v1_left", "v1_bottom_left"});
+  graph->AddGroup("right", {"v1_right", "v1_bottom_right"});
+  graph->AddGroup("bottom", {"v1_bottom_left", "v1_bottom_right"});
+
+  graph->AddTarget("test_keys", {"keys"}, [&profile, parts, report]() {
+    report->Write(MakeTestKeys(*parts->keys, profile), "test_keys");
+  });
+}
+
+}  // namespace scad
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "connector_plan.h"
+#include "key_data.h"
+#include "layout.h"
+#include "region.h"
+#include "scad.h"
+#include "socket_access.h"
+#include "target_graph.h"
+#include "transform.h"
+
+namespace scad {
+
+// Trades detail for speed when previewing. Selected by name with --profile.
+struct BuildProfile {
+  std::string name;
+  // Add the caps into the stl for testing.
+  bool add_caps = false;
+  // Subtracting is expensive to preview. Without it the screw holes and cutouts are left solid.
+  bool subtract = true;
+  // Hull each wall slice with the next. Otherwise only the slices are written which is much faster
+  // and easier to visualize.
+  bool full_walls = true;
+  // Cut off the parts sticking up into the thumb plate.
+  bool cut_thumb_plate = false;
+  // Plain blocks instead of switch sockets.
+  bool simple_switches = false;
+  bool side_nubs = true;
+};
+
+bool operator==(const BuildProfile& a, const BuildProfile& b);
+inline bool operator!=(const BuildProfile& a, const BuildProfile& b) {
+  return !(a == b);
+}
+
+BuildProfile GetDraftProfile();
+BuildProfile GetFinalProfile();
+// Returns false if there is no profile with the name.
+bool GetBuildProfile(const std::string& name, BuildProfile* profile);
+// Overrides fields of profile from a text file. Each line has the form "<field> <value>", e.g.
+// "add_caps true", and "profile draft" starts from a named profile. Lines starting with # are
+// comments.
+bool LoadBuildProfile(const std::string& file_name, BuildProfile* profile);
+
+// This is where all of the logic to position the keys is done. Everything else is cosmetic trying
+// to build the case.
+TransformList GetKeyOrigin();
+
+// A part extruded from a 2D outline, e.g. the bottom plate. The outline is resolved to a polygon
+// once when the part is made (see GetRegion), so OpenSCAD only has to extrude it.
+struct FlatPart {
+  FlatPart() = default;
+  FlatPart(Shape shape, double extrude_height);
+
+  Shape outline;
+  double height = 0;
+  // Empty if the outline couldn't be resolved, then the outline is written as it is.
+  Region region;
+
+  // Mirrors the resolved region rather than resolving the mirrored outline again.
+  FlatPart MirrorX() const;
+};
+
+// Sizes of everything written by the output targets.
+class OutputReport {
+ public:
+  // Without writing files the outputs are only measured.
+  explicit OutputReport(bool write_files = true) : write_files_(write_files) {
+  }
+
+  // Also rank the top_n most expensive labeled subtrees of every output (Shape::Analyze).
+  void SetAnalyze(int top_n) {
+    analyze_top_n_ = top_n;
+  }
+
+  // Keep a hash of everything written and only rewrite files whose content changed, so tools
+  // watching the outputs only reload what is new.
+  void SetSkipUnchanged(bool skip_unchanged) {
+    skip_unchanged_ = skip_unchanged;
+  }
+
+  // Keep every shape written so the outputs can be rendered once the targets are done.
+  void SetKeepShapes(bool keep_shapes) {
+    keep_shapes_ = keep_shapes;
+  }
+  // The kept shapes by output name.
+  std::map<std::string, Shape> GetShapes() const;
+
+  // Also write <name>.svg, <name>.dxf and <name>.stl for every flat part, without OpenSCAD.
+  void SetExportFlat(bool export_flat) {
+    export_flat_ = export_flat;
+  }
+
+  // Writes <name>.scad and records its size. Safe to call from several targets at once.
+  void Write(const Shape& shape, const std::string& name);
+  void Write(const FlatPart& part, const std::string& name);
+  void Print(const std::string& profile_name, std::FILE* file) const;
+  // Forgets the recorded outputs but not the hashes, before building again.
+  void Clear();
+
+ private:
+  struct Output {
+    std::string name;
+    ScadStats stats;
+    ShapeAnalysis analysis;
+    bool unchanged = false;
+    Shape shape;
+  };
+
+  bool write_files_;
+  bool skip_unchanged_ = false;
+  bool keep_shapes_ = false;
+  bool export_flat_ = false;
+  int analyze_top_n_ = 0;
+  mutable std::mutex mutex_;
+  std::vector<Output> outputs_;
+  std::map<std::string, size_t> hashes_;
+};
+
+// Set all of the widths here. This must be done before calling any of GetTopLeft etc.
+void ConfigureKeys(KeyData& d, const BuildProfile& profile);
+
+// Where the wall leaves a key corner. The wall runs down from the post at transforms and out to
+// the section from outer to inner, which is extruded down to the ground.
+struct WallSection {
+  TransformList transforms;
+  glm::vec3 outer;
+  glm::vec3 inner;
+};
+
+// The pieces of the case. Each one is built by a target of the same name.
+ConnectorPlan MakeConnectorPlan(KeyData& d);
+Shape MakeConnectors(KeyData& d);
+std::vector<WallSection> GetWallSections(KeyData& d);
+std::vector<Shape> MakeWalls(KeyData& d, const BuildProfile& profile);
+std::vector<Shape> MakeSwitches(KeyData& d, const BuildProfile& profile);
+std::vector<glm::vec3> GetScrewLocations(KeyData& d);
+Shape MakeScrewInserts(const std::vector<glm::vec3>& locations);
+std::vector<Shape> MakeScrewHoles(const std::vector<glm::vec3>& locations);
+std::vector<Shape> MakeCutouts(KeyData& d, const BuildProfile& profile);
+// The shadow of the case before the screw holes and cutouts are taken out, with the screw holes.
+FlatPart MakeBottomPlate(KeyData& d,
+                         const BuildProfile& profile,
+                         const Shape& solid,
+                         const std::vector<Shape>& screw_holes);
+
+// The sockets, wall slices, plate hulls and screw inserts as convex pieces, for CheckSocketAccess.
+std::vector<SocketObstacle> GetCaseObstacles(KeyData& d, const BuildProfile& profile);
+
+// Shows a few switches with their caps for checking clearances.
+Shape MakeTestKeys(KeyData& d, const BuildProfile& profile);
+
+Shape MakeTrrsHolder();
+FlatPart MakeTrrsFront();
+FlatPart MakeCover();
+FlatPart MakeUsbcAdapter();
+
+// What the keyboard is built from. The "keys" target builds the KeyData every part of the case
+// depends on, so after changing these invalidating "keys" rebuilds only what they affect.
+struct TargetInputs {
+  BuildProfile profile;
+  Layout layout;
+};
+
+// Adds a target for every part of the keyboard. Outputs are written through report. inputs and
+// report must outlive the graph and inputs must not be modified while it runs.
+void AddTargets(const TargetInputs& inputs, OutputReport* report, TargetGraph* graph);
+
+}  // namespace scad
@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "connector_plan.h"
+#include "key.h"
+#include "scad.h"
+#include "transform.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void Expect(const std::string& name, long actual, long expected) {
+  if (actual != expected) {
+    fprintf(stderr, "%s: %ld, expected %ld\n", name.c_str(), actual, expected);
+    ++failures;
+  }
+}
+
+}  // namespace
+
+// Connects a 2x2 grid of keys and checks the corners are shared and repeated or degenerate
+// triangles are dropped.
+int main() {
+  Key top_left(0, 20, 0);
+  Key top_right(20, 20, 0);
+  Key bottom_left(0, 0, 0);
+  Key bottom_right(20, 0, 0);
+  KeyGrid grid({{&top_left, &top_right}, {&bottom_left, &bottom_right}});
+
+  ConnectorPlan plan;
+  plan.AddGrid(grid);
+  // Two triangles for each of the 2 horizontal, 2 vertical and 1 diagonal gaps.
+  Expect("grid triangles", plan.triangles().size(), 10);
+  // The outer corner of each key isn't connected to anything.
+  Expect("grid corners", plan.num_corners(), 12);
+  Expect("grid dropped triangles", plan.num_dropped_triangles(), 0);
+
+  int corner = plan.TopRight(top_left);
+  Expect("corner id is reused", plan.TopRight(top_left), corner);
+  Expect("corner position",
+         glm::length(plan.GetTransforms(corner).Apply(kOrigin) -
+                     top_left.GetTopRight().Apply(kOrigin)) < 1e-5,
+         true);
+  Expect("corner with a z offset is new", plan.TopRight(top_left, -1) != corner, true);
+
+  plan.AddHorizontal(top_left, top_right);
+  plan.AddTriangle(corner, corner, plan.TopLeft(top_right));
+  Expect("triangles after repeats", plan.triangles().size(), 10);
+  Expect("dropped repeated and degenerate triangles", plan.num_dropped_triangles(), 3);
+
+  Expect("hulls built", plan.Build().Analyze().total.hulls, 10);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d connector plan checks failed\n", failures);
+    return 1;
+  }
+  printf("All connector plan checks passed\n");
+  return 0;
+}
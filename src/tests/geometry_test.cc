@@ -0,0 +1,71 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void ExpectNear(const std::string& name, double actual, double expected) {
+  if (std::abs(actual - expected) > 1e-6) {
+    fprintf(stderr, "%s: %.6f, expected %.6f\n", name.c_str(), actual, expected);
+    ++failures;
+  }
+}
+
+// The hull of the box from min to max, with a point inside which has to be dropped.
+Polytope Box(const glm::dvec3& min, const glm::dvec3& max) {
+  std::vector<glm::dvec3> points = {(min + max) / 2.0};
+  for (int i = 0; i < 8; ++i) {
+    points.push_back({i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z});
+  }
+  return ConvexHull(points);
+}
+
+}  // namespace
+
+// Checks the hull, GJK and SAT in geometry.h on boxes whose distances are known.
+int main() {
+  Polytope cube = Box(glm::dvec3(0), glm::dvec3(1));
+  ExpectNear("cube hull vertices", cube.vertices.size(), 8);
+  ExpectNear("cube hull faces", cube.faces.size(), 12);
+  for (size_t i = 0; i < cube.faces.size(); ++i) {
+    const glm::dvec3& corner = cube.vertices[cube.faces[i][0]];
+    if (glm::dot(cube.FaceNormal(i), corner - cube.Centroid()) <= 0) {
+      fprintf(stderr, "cube hull face %zu points inwards\n", i);
+      ++failures;
+    }
+  }
+
+  Polytope apart = Box(glm::dvec3(3, 0, 0), glm::dvec3(4, 1, 1));
+  DistanceResult result = Distance(cube, apart);
+  ExpectNear("separated cubes distance", result.distance, 2);
+  ExpectNear("separated cubes closest x on a", result.point_a.x, 1);
+  ExpectNear("separated cubes closest x on b", result.point_b.x, 3);
+  ExpectNear("separated cubes penetration", SatPenetrationDepth(cube, apart), 0);
+
+  Polytope diagonal = Box(glm::dvec3(2, 2, 0), glm::dvec3(3, 3, 1));
+  ExpectNear("diagonal cubes distance", Distance(cube, diagonal).distance, std::sqrt(2.0));
+
+  Polytope overlapping = Box(glm::dvec3(0.75, 0.25, 0.25), glm::dvec3(1.75, 1.25, 1.25));
+  result = Distance(cube, overlapping);
+  if (!result.overlapping()) {
+    fprintf(stderr, "overlapping cubes are not overlapping\n");
+    ++failures;
+  }
+  ExpectNear("overlapping cubes distance", result.distance, -0.25);
+  ExpectNear("overlapping cubes gjk distance", GjkDistance(cube, overlapping).distance, 0);
+  ExpectNear("overlapping cubes penetration", SatPenetrationDepth(cube, overlapping), 0.25);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d geometry checks failed\n", failures);
+    return 1;
+  }
+  printf("All geometry checks passed\n");
+  return 0;
+}
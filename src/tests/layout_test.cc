@@ -0,0 +1,77 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "key_data.h"
+#include "layout.h"
+#include "layout_optimizer.h"
+#include "targets.h"
+#include "transform.h"
+
+using namespace scad;
+
+// Optimizes a key on top of a loaded layout, saves the result and loads it into fresh keys. The
+// saved layout has to keep the loaded adjustment and reproduce the optimized keys on its own.
+int main() {
+  Layout base;
+  KeyAdjustment adjustment;
+  adjustment.key_name = "b";
+  adjustment.offset.x = 0.5;
+  adjustment.offset.rz = 1;
+  base.adjustments.push_back(adjustment);
+
+  KeyData d(GetKeyOrigin());
+  base.Apply(d.all_keys());
+  LayoutOptimizerOptions options;
+  options.key_names = {"b"};
+  options.search = {{200}, 1};
+  options.base_layout = base;
+  LayoutOptimizerResult result = OptimizeLayout(d, options);
+  if (result.moved_keys != 1 || result.layout.adjustments.size() != 2 ||
+      result.layout.adjustments[0].key_name != "b" ||
+      result.layout.adjustments[0].offset.x != 0.5) {
+    fprintf(stderr,
+            "expected the loaded adjustment followed by 1 new one, got %zu adjustments\n",
+            result.layout.adjustments.size());
+    return 1;
+  }
+
+  std::string file_name =
+      (std::filesystem::temp_directory_path() / "dactyl_layout_test.txt").string();
+  Layout loaded;
+  if (!result.layout.Save(file_name) || !loaded.Load(file_name)) {
+    return 1;
+  }
+  std::filesystem::remove(file_name);
+
+  // The keys the optimizer saw, with its new adjustment on top.
+  Layout moved;
+  moved.adjustments.push_back(result.layout.adjustments[1]);
+  moved.Apply(d.all_keys());
+  KeyData reloaded(GetKeyOrigin());
+  loaded.Apply(reloaded.all_keys());
+
+  std::vector<Key*> expected_keys = d.all_keys();
+  std::vector<Key*> actual_keys = reloaded.all_keys();
+  int failures = 0;
+  for (size_t i = 0; i < expected_keys.size(); ++i) {
+    Key* expected = expected_keys[i];
+    Key* actual = actual_keys[i];
+    // The layout is saved with 3 decimals.
+    for (const glm::vec3& p : {glm::vec3(0), glm::vec3(10, 10, 0)}) {
+      float distance = glm::length(expected->GetTransforms().Apply(p) -
+                                   actual->GetTransforms().Apply(p));
+      if (distance > 0.01) {
+        fprintf(stderr, "%s is %.4f mm off after reloading\n", expected->name.c_str(), distance);
+        ++failures;
+      }
+    }
+  }
+  if (failures > 0) {
+    return 1;
+  }
+  printf("All layout checks passed\n");
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "mesh.h"
+#include "mesh_compare.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void ExpectNear(const std::string& name, double actual, double expected) {
+  if (std::abs(actual - expected) > 1e-4) {
+    fprintf(stderr, "%s: %.6f, expected %.6f\n", name.c_str(), actual, expected);
+    ++failures;
+  }
+}
+
+// The box from min to max, two triangles a side.
+Mesh Box(const glm::vec3& min, const glm::vec3& max) {
+  Mesh mesh;
+  for (int i = 0; i < 8; ++i) {
+    mesh.vertices.push_back({i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z});
+  }
+  mesh.triangles = {{0, 2, 3}, {0, 3, 1}, {4, 5, 7}, {4, 7, 6}, {0, 1, 5}, {0, 5, 4},
+                    {2, 6, 7}, {2, 7, 3}, {0, 4, 6}, {0, 6, 2}, {1, 3, 7}, {1, 7, 5}};
+  return mesh;
+}
+
+}  // namespace
+
+// Compares a cube with the same cube grown by 0.5 on every side. The corners of the larger cube
+// are 0.5 * sqrt(3) from the smaller one, while the smaller cube is only 0.5 inside the larger.
+int main() {
+  Mesh golden = Box(glm::vec3(0), glm::vec3(10));
+  Mesh grown = Box(glm::vec3(-0.5f), glm::vec3(10.5f));
+
+  MeshBvh bvh(golden);
+  glm::vec3 closest;
+  if (!bvh.FindClosest(glm::vec3(5, 5, 12), &closest)) {
+    fprintf(stderr, "closest point above the cube not found\n");
+    ++failures;
+  }
+  ExpectNear("closest point above the cube", glm::length(closest - glm::vec3(5, 5, 10)), 0);
+  if (bvh.FindClosest(glm::vec3(5, 5, 12), &closest, 1)) {
+    fprintf(stderr, "closest point found beyond max_distance\n");
+    ++failures;
+  }
+
+  MeshCompareOptions options;
+  options.max_distance = 1;
+  options.max_volume_change = 0.5;
+  options.jobs = 2;
+  MeshCompareResult result = CompareMeshes(grown, golden, options);
+  ExpectNear("grown to golden", result.new_to_golden, 0.5 * std::sqrt(3.0));
+  ExpectNear("golden to grown", result.golden_to_new, 0.5);
+  ExpectNear("hausdorff distance", result.hausdorff_distance(), 0.5 * std::sqrt(3.0));
+  ExpectNear("worst point is a corner", std::abs(result.worst_point.x - 5), 5.5);
+  ExpectNear("volume change", result.volume_change(), 0.331);
+  if (!result.ok) {
+    fprintf(stderr, "grown cube within the limits isn't ok\n");
+    ++failures;
+  }
+
+  options.max_distance = 0.5;
+  if (CompareMeshes(grown, golden, options).ok) {
+    fprintf(stderr, "grown cube beyond max_distance is ok\n");
+    ++failures;
+  }
+  result = CompareMeshes(golden, golden, options);
+  ExpectNear("same mesh distance", result.hausdorff_distance(), 0);
+  ExpectNear("same mesh volume change", result.volume_change(), 0);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d mesh compare checks failed\n", failures);
+    return 1;
+  }
+  printf("All mesh compare checks passed\n");
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "mesh_simplify.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void Expect(const std::string& name, bool ok) {
+  if (!ok) {
+    fprintf(stderr, "%s failed\n", name.c_str());
+    ++failures;
+  }
+}
+
+// A cube from 0 to size with each face split into a grid of divisions x divisions squares, like
+// the flat faces OpenSCAD leaves split into many triangles.
+Mesh GridCube(float size, int divisions) {
+  std::vector<StlTriangle> triangles;
+  for (int axis = 0; axis < 3; ++axis) {
+    for (int side : {-1, 1}) {
+      glm::vec3 normal(0);
+      normal[axis] = side;
+      glm::vec3 u(0);
+      glm::vec3 v(0);
+      u[(axis + (side > 0 ? 1 : 2)) % 3] = size / divisions;
+      v[(axis + (side > 0 ? 2 : 1)) % 3] = size / divisions;
+      glm::vec3 origin(0);
+      origin[axis] = side > 0 ? size : 0;
+      for (int i = 0; i < divisions; ++i) {
+        for (int j = 0; j < divisions; ++j) {
+          glm::vec3 p00 = origin + float(i) * u + float(j) * v;
+          glm::vec3 p10 = p00 + u;
+          glm::vec3 p11 = p00 + u + v;
+          glm::vec3 p01 = p00 + v;
+          triangles.push_back({normal, {p00, p10, p11}});
+          triangles.push_back({normal, {p00, p11, p01}});
+        }
+      }
+    }
+  }
+  return WeldTriangles(triangles);
+}
+
+}  // namespace
+
+// Simplifies a cube whose flat faces are split into many triangles and checks far fewer are left,
+// and the cube is still closed with the same bounds and volume.
+int main() {
+  Mesh mesh = GridCube(10, 8);
+  MeshStats before = GetMeshStats(mesh);
+  Expect("grid cube is watertight", before.watertight());
+
+  SimplifyOptions options;
+  SimplifyResult result = SimplifyMesh(options, &mesh);
+  MeshStats after = GetMeshStats(mesh);
+  Expect("input triangles counted", result.input_triangles == 6 * 8 * 8 * 2);
+  Expect("output triangles counted", result.output_triangles == after.triangles);
+  // Each side is flat, so little more than the 12 triangles of a plain cube should be left.
+  Expect("at most 24 triangles left", after.triangles <= 24);
+  Expect("two triangles per collapsed edge",
+         result.input_triangles - result.output_triangles == 2 * result.collapsed_edges);
+  Expect("still watertight", after.watertight());
+  Expect("no degenerate triangles", after.degenerate_triangles == 0);
+  Expect("same volume", std::abs(after.volume - 1000) < 1e-3);
+  Expect("same min", glm::length(after.bounds.min - before.bounds.min) < 1e-5f);
+  Expect("same max", glm::length(after.bounds.max - before.bounds.max) < 1e-5f);
+
+  // With no deviation allowed and no slivers to remove nothing is collapsed.
+  Mesh exact = GridCube(10, 4);
+  options.max_deviation = 0;
+  options.sliver_height = 0;
+  result = SimplifyMesh(options, &exact);
+  MeshStats exact_stats = GetMeshStats(exact);
+  Expect("exact collapses nothing", result.collapsed_edges == 0 && exact_stats.triangles == 192);
+  Expect("exact still watertight", exact_stats.watertight());
+  Expect("exact same volume", std::abs(exact_stats.volume - 1000) < 1e-3);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d mesh simplify checks failed\n", failures);
+    return 1;
+  }
+  printf("All mesh simplify checks passed\n");
+  return 0;
+}
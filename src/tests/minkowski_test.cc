@@ -0,0 +1,110 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "minkowski.h"
+#include "scad.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void Expect(const std::string& name, bool ok) {
+  if (!ok) {
+    fprintf(stderr, "%s failed\n", name.c_str());
+    ++failures;
+  }
+}
+
+// The bounds of the points of every polyhedron the shape writes.
+bool GetPolyhedronBounds(const Shape& shape, glm::dvec3* min, glm::dvec3* max, int* count) {
+  std::string scad;
+  shape.WriteToString(&scad);
+  *min = glm::dvec3(1e30);
+  *max = glm::dvec3(-1e30);
+  *count = 0;
+  const char* prefix = "polyhedron (points = [";
+  for (const char* s = std::strstr(scad.c_str(), prefix); s; s = std::strstr(s, prefix)) {
+    s += std::strlen(prefix);
+    glm::dvec3 p;
+    int length = 0;
+    while (sscanf(s, "[%lf, %lf, %lf]%n", &p.x, &p.y, &p.z, &length) == 3 && length > 0) {
+      *min = glm::min(*min, p);
+      *max = glm::max(*max, p);
+      s += length;
+      if (*s == ',') {
+        ++s;
+      }
+    }
+    ++*count;
+  }
+  return *count > 0;
+}
+
+void ExpectBounds(const std::string& name,
+                  const Shape& shape,
+                  const glm::dvec3& min,
+                  const glm::dvec3& max,
+                  int polyhedra) {
+  glm::dvec3 actual_min;
+  glm::dvec3 actual_max;
+  int count;
+  if (!GetPolyhedronBounds(shape, &actual_min, &actual_max, &count) || count != polyhedra ||
+      glm::length(actual_min - min) > 1e-3 || glm::length(actual_max - max) > 1e-3) {
+    fprintf(stderr,
+            "%s: %d polyhedra from [%.3f, %.3f, %.3f] to [%.3f, %.3f, %.3f]\n",
+            name.c_str(),
+            count,
+            actual_min.x,
+            actual_min.y,
+            actual_min.z,
+            actual_max.x,
+            actual_max.y,
+            actual_max.z);
+    ++failures;
+  }
+}
+
+}  // namespace
+
+// The sum of two boxes is the box with the sizes added, wherever they are. Unions are summed piece
+// by piece and shapes which aren't convex are left to OpenSCAD.
+int main() {
+  Shape cube = Cube(2, false);
+  Shape small = Cube(1);
+  ExpectBounds("cube + cube", MinkowskiSum(cube, small), glm::dvec3(-0.5), glm::dvec3(2.5), 1);
+  ExpectBounds("moved cube + cube",
+               MinkowskiSum(cube.Translate(10, 0, 0), small.Translate(0, 0, 5)),
+               glm::dvec3(9.5, -0.5, 4.5),
+               glm::dvec3(12.5, 2.5, 7.5),
+               1);
+  ExpectBounds("cube + rotated cube",
+               MinkowskiSum(cube, small.RotateZ(90)),
+               glm::dvec3(-0.5),
+               glm::dvec3(2.5),
+               1);
+  ExpectBounds("union + cube",
+               MinkowskiSum(Union(cube, cube.Translate(5, 0, 0)), small, 2),
+               glm::dvec3(-0.5),
+               glm::dvec3(7.5, 2.5, 2.5),
+               2);
+
+  std::vector<glm::dvec3> points;
+  Expect("cube points", GetConvexPoints(cube, &points) && points.size() == 8);
+  Shape hollow = cube.Subtract(small);
+  Expect("hollow cube is not convex", !GetConvexPoints(hollow, &points));
+  std::string scad;
+  MinkowskiSum(hollow, small).WriteToString(&scad);
+  Expect("hollow cube left to OpenSCAD", scad.find("minkowski") != std::string::npos);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d minkowski checks failed\n", failures);
+    return 1;
+  }
+  printf("All minkowski checks passed\n");
+  return 0;
+}
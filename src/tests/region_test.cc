@@ -0,0 +1,178 @@
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "mesh.h"
+#include "region.h"
+#include "scad.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+// The area of a regular polygon with fragments corners on a circle of radius r.
+double PolygonArea(double r, long fragments) {
+  return 0.5 * fragments * r * r * std::sin(2 * M_PI / fragments);
+}
+
+void ExpectArea(const std::string& name, const Region& region, double area, size_t contours) {
+  double actual = GetArea(region);
+  if (std::abs(actual - area) > 1e-6 * std::max(1.0, area) || region.contours.size() != contours) {
+    fprintf(stderr,
+            "%s: area %.6f with %zu contours, expected %.6f with %zu\n",
+            name.c_str(),
+            actual,
+            region.contours.size(),
+            area,
+            contours);
+    ++failures;
+  }
+}
+
+void ExpectArea(const std::string& name, const Shape& shape, double area, size_t contours) {
+  Region region;
+  if (!GetRegion(shape, &region)) {
+    fprintf(stderr, "%s: could not resolve the shape\n", name.c_str());
+    ++failures;
+    return;
+  }
+  ExpectArea(name, region, area, contours);
+}
+
+Region Combine(const Region& first, const Region& second, RegionOp op) {
+  Region result;
+  if (!CombineRegions(first, second, op, &result)) {
+    fprintf(stderr, "CombineRegions failed\n");
+    ++failures;
+  }
+  return result;
+}
+
+Region Translate(const Region& region, double x, double y) {
+  Region result = region;
+  for (std::vector<glm::dvec2>& contour : result.contours) {
+    for (glm::dvec2& p : contour) {
+      p += glm::dvec2(x, y);
+    }
+  }
+  return result;
+}
+
+// Occurrences of word in the file.
+int CountInFile(const std::string& file_name, const std::string& word) {
+  std::ifstream file(file_name);
+  std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  int count = 0;
+  for (size_t i = text.find(word); i != std::string::npos; i = text.find(word, i + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+void Expect(const std::string& name, bool ok) {
+  if (!ok) {
+    fprintf(stderr, "%s failed\n", name.c_str());
+    ++failures;
+  }
+}
+
+}  // namespace
+
+// Checks the 2D booleans, offsets and projections in region.h against areas worked out by hand.
+// Prints every case which is off and exits with 1 if there are any.
+int main() {
+  ExpectArea("circle minus circle",
+             Circle(10, 40).Subtract(Circle(5, 40)),
+             PolygonArea(10, 40) - PolygonArea(5, 40),
+             2);
+
+  Region square = SquareRegion(10, 10, false);
+  Region moved = Translate(square, 5, 5);
+  ExpectArea("overlapping squares union", Combine(square, moved, RegionOp::UNION), 175, 1);
+  ExpectArea(
+      "overlapping squares intersection", Combine(square, moved, RegionOp::INTERSECTION), 25, 1);
+  ExpectArea(
+      "overlapping squares difference", Combine(square, moved, RegionOp::DIFFERENCE), 75, 1);
+
+  Region corner = Translate(square, 10, 10);
+  ExpectArea("squares touching at a corner", Combine(square, corner, RegionOp::UNION), 200, 2);
+  ExpectArea("squares touching at a corner intersection",
+             Combine(square, corner, RegionOp::INTERSECTION),
+             0,
+             0);
+  ExpectArea("squares sharing an edge",
+             Combine(square, Translate(square, 10, 0), RegionOp::UNION),
+             200,
+             1);
+  ExpectArea("square in a square",
+             Combine(square, Translate(SquareRegion(2, 2, true), 5, 5), RegionOp::UNION),
+             100,
+             1);
+
+  ExpectArea("square frame", Square(20).Subtract(Square(10)), 300, 2);
+  ExpectArea("offset delta", Square(10).OffsetDelta(1), 144, 1);
+  ExpectArea("offset chamfer", Square(10).OffsetDelta(1, true), 144 - 2, 1);
+  ExpectArea("offset delta inwards", Square(10).OffsetDelta(-1), 64, 1);
+
+  // A polygon with a multiple of 4 corners reaches exactly r along the axes, so the straight sides
+  // move by r and the corners add up to one polygon.
+  for (double fn : {4.0, 40.0}) {
+    CircleParams params;
+    params.r = 1;
+    params.fn = fn;
+    ExpectArea("offset radius with $fn = " + std::to_string((int)fn),
+               Square(10).OffsetRadius(params),
+               100 + 40 + PolygonArea(1, fn),
+               1);
+    params.r = -1;
+    ExpectArea("offset radius inwards with $fn = " + std::to_string((int)fn),
+               Square(10).OffsetRadius(params),
+               64,
+               1);
+  }
+
+  // Mirrored contours are reversed, so the mirror image still unions with the original.
+  Region mirrored = TransformRegion(square, glm::scale(glm::dmat4(1), glm::dvec3(-1, 1, 1)));
+  ExpectArea("mirrored square", mirrored, 100, 1);
+  ExpectArea("square and its mirror image", Combine(square, mirrored, RegionOp::UNION), 200, 1);
+
+  Region frame;
+  Expect("square frame region", GetRegion(Square(20).Subtract(Square(10)), &frame));
+  MeshStats stats = GetMeshStats(ExtrudeRegion(frame, 2));
+  Expect("extruded frame is watertight", stats.watertight());
+  Expect("extruded frame volume", std::abs(stats.volume - 600) < 1e-3);
+  Expect("extruded frame height", std::abs(stats.bounds.max.z - 1) < 1e-6);
+
+  std::string svg = (std::filesystem::temp_directory_path() / "dactyl_region_test.svg").string();
+  std::string dxf = (std::filesystem::temp_directory_path() / "dactyl_region_test.dxf").string();
+  Expect("write svg", WriteRegionSvg(svg, frame));
+  Expect("svg has a path per contour", CountInFile(svg, "M") == 2 && CountInFile(svg, "Z") == 2);
+  Expect("svg size", CountInFile(svg, "width=\"20.000mm\" height=\"20.000mm\"") == 1);
+  Expect("write dxf", WriteRegionDxf(dxf, frame));
+  Expect("dxf has a polyline per contour",
+         CountInFile(dxf, "POLYLINE") == 2 && CountInFile(dxf, "SEQEND") == 2);
+  Expect("dxf has every corner", CountInFile(dxf, "VERTEX") == 8);
+  std::filesystem::remove(svg);
+  std::filesystem::remove(dxf);
+
+  // Pieces inside others are left out of the projection, which must not change it.
+  ExpectArea("projection of nested cubes",
+             Union(Cube(10), Cube(2), Cube(10).TranslateX(5), Cube(2).TranslateX(5))
+                 .Projection(),
+             150,
+             1);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d region checks failed\n", failures);
+    return 1;
+  }
+  printf("All region checks passed\n");
+  return 0;
+}
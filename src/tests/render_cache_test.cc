@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "chunked_render.h"
+#include "render_cache.h"
+#include "scad.h"
+
+using namespace scad;
+
+namespace {
+
+// Stands in for OpenSCAD: fails like it does when an import doesn't resolve relative to the scad
+// file, otherwise writes a single triangle.
+const char kFakeRenderer[] = R"script(#!/bin/sh
+stl="$2"
+scad="$3"
+dir=$(dirname "$scad")
+for file in $(grep -o 'file = "[^"]*"' "$scad" | sed 's/file = "\(.*\)"/\1/'); do
+  case "$file" in
+    /*) path="$file" ;;
+    *) path="$dir/$file" ;;
+  esac
+  if [ ! -f "$path" ]; then
+    echo "missing import $path"
+    exit 1
+  fi
+done
+printf 'solid fake\nfacet normal 0 0 1\nouter loop\nvertex 0 0 0\nvertex 1 0 0\nvertex 0 1 0\nendloop\nendfacet\nendsolid fake\n' > "$stl"
+)script";
+
+// Enough nodes to be worth caching.
+Shape MakeLabeledPart(const std::string& label, double x) {
+  std::vector<Shape> cubes;
+  for (int i = 0; i < 12; ++i) {
+    cubes.push_back(Cube(1).Translate(x, i * 2, 0));
+  }
+  return UnionAll(cubes).Comment(label);
+}
+
+}  // namespace
+
+// Renders a shape whose labeled subtrees were cached through the chunked renderer, which writes
+// its scad files into a subdirectory. Every import has to resolve from there.
+int main() {
+  namespace fs = std::filesystem;
+  fs::path directory = fs::temp_directory_path() / "dactyl_render_cache_test";
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+  fs::current_path(directory);
+
+  std::string renderer = (directory / "fake_openscad.sh").string();
+  {
+    std::ofstream script(renderer);
+    script << kFakeRenderer;
+  }
+  fs::permissions(renderer, fs::perms::owner_all);
+
+  Shape shape = Union(MakeLabeledPart("first", 0), MakeLabeledPart("second", 10));
+
+  RenderCacheOptions cache_options;
+  cache_options.renderer = renderer;
+  RenderCache cache(cache_options);
+  if (!cache.Update({shape})) {
+    fprintf(stderr, "rendering the cached subtrees failed\n");
+    return 1;
+  }
+  Shape substituted = cache.Substitute(shape);
+  if (cache.stats().misses != 2) {
+    fprintf(stderr, "expected 2 cached subtrees, got %d\n", cache.stats().misses);
+    return 1;
+  }
+
+  ChunkedRenderOptions chunk_options;
+  chunk_options.renderer = renderer;
+  chunk_options.chunks = 2;
+  ChunkedRenderResult result = RenderChunked(substituted, "cached", chunk_options);
+  if (!result.ok || result.chunks != 2) {
+    fprintf(stderr, "chunked render of the cached shape failed with %d chunks\n", result.chunks);
+    return 1;
+  }
+
+  fs::current_path(fs::temp_directory_path());
+  fs::remove_all(directory);
+  printf("All render cache checks passed\n");
+  return 0;
+}
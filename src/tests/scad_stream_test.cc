@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "scad.h"
+#include "scad_stream.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void Expect(const std::string& name, bool ok) {
+  if (!ok) {
+    fprintf(stderr, "%s failed\n", name.c_str());
+    ++failures;
+  }
+}
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file(file_name);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+}  // namespace
+
+// Streams a polyhedron inside a union with calls which would nest nodes inside the polyhedron or
+// leave it open. Those are ignored, so the scad stays well formed.
+int main() {
+  std::string file_name =
+      (std::filesystem::temp_directory_path() / "dactyl_scad_stream_test.scad").string();
+  ScadStream stream;
+  Expect("open", stream.Open(file_name));
+  stream.Begin("union ()");
+  stream.BeginPolyhedron();
+  stream.AddPoint(0, 0, 0);
+  stream.BeginPolyhedron();
+  stream.Begin("translate ([1, 0, 0])");
+  stream.Write(Cube(1));
+  stream.Comment("ignored");
+  stream.AddPoint(1, 0, 0);
+  stream.AddPoint(0, 1, 0);
+  stream.AddFace({0, 1, 2});
+  stream.End();
+  Expect("still in the union", stream.depth() == 1);
+  stream.EndPolyhedron();
+  stream.Write(Cube(1));
+  stream.BeginPolyhedron();
+  stream.AddPoint(0, 0, 0);
+  ScadStats stats = stream.Close();
+  Expect("nodes", stats.nodes == 4);
+
+  std::string expected =
+      "union () {\n"
+      "  polyhedron (points = [[0.000, 0.000, 0.000],[1.000, 0.000, 0.000],[0.000, 1.000, "
+      "0.000]], faces = [[0,1,2]], convexity = 1);\n"
+      "  cube (size = [ 1.000, 1.000, 1.000], center = true);\n"
+      "  polyhedron (points = [[0.000, 0.000, 0.000]], faces = [], convexity = 1);\n"
+      "}\n";
+  std::string actual = ReadFile(file_name);
+  std::filesystem::remove(file_name);
+  if (actual != expected) {
+    fprintf(stderr, "scad:\n%s\nexpected:\n%s\n", actual.c_str(), expected.c_str());
+    ++failures;
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d scad stream checks failed\n", failures);
+    return 1;
+  }
+  printf("All scad stream checks passed\n");
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "slicer.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void ExpectNear(const std::string& name, double actual, double expected) {
+  if (std::abs(actual - expected) > 1e-4) {
+    fprintf(stderr, "%s: %.6f, expected %.6f\n", name.c_str(), actual, expected);
+    ++failures;
+  }
+}
+
+// The box from min to max, two triangles a side.
+Mesh Box(const glm::vec3& min, const glm::vec3& max) {
+  Mesh mesh;
+  for (int i = 0; i < 8; ++i) {
+    mesh.vertices.push_back({i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z});
+  }
+  mesh.triangles = {{0, 2, 3}, {0, 3, 1}, {4, 5, 7}, {4, 7, 6}, {0, 1, 5}, {0, 5, 4},
+                    {2, 6, 7}, {2, 7, 3}, {0, 4, 6}, {0, 6, 2}, {1, 3, 7}, {1, 7, 5}};
+  return mesh;
+}
+
+// The signed area of a closed loop, positive if it runs counter clockwise.
+double LoopArea(const std::vector<glm::vec2>& loop) {
+  double area = 0;
+  for (size_t i = 0; i < loop.size(); ++i) {
+    const glm::vec2& a = loop[i];
+    const glm::vec2& b = loop[(i + 1) % loop.size()];
+    area += (a.x * b.y - b.x * a.y) / 2.0;
+  }
+  return area;
+}
+
+}  // namespace
+
+// Slices a unit cube, which gives one counter clockwise unit square per layer and nothing to
+// print badly, then a slab overhanging the cube and a wall thinner than the nozzle.
+int main() {
+  SliceOptions options;
+  options.jobs = 2;
+  SliceResult result = SliceMesh(Box(glm::vec3(0), glm::vec3(1)), options);
+  ExpectNear("unit cube layers", result.layers.size(), 5);
+  for (const SliceLayer& layer : result.layers) {
+    std::string name = "unit cube layer at " + std::to_string(layer.z);
+    ExpectNear(name + " contours", layer.contours.size(), 1);
+    ExpectNear(name + " area", layer.area, 1);
+    if (!layer.contours.empty()) {
+      ExpectNear(name + " outline area", LoopArea(layer.contours[0]), 1);
+    }
+  }
+  ExpectNear("first layer height", result.layers.empty() ? 0 : result.layers[0].z, 0.1);
+  ExpectNear("unit cube open contours", result.open_contours, 0);
+  ExpectNear("unit cube overhangs", result.overhang_faces, 0);
+  ExpectNear("unit cube thin points", result.thin_points, 0);
+  ExpectNear("unit cube ok", result.ok(), 1);
+
+  // A slab on top of the cube, whose bottom overhangs since the cube holds the part on the bed.
+  Mesh table = Box(glm::vec3(0), glm::vec3(1));
+  Mesh slab = Box(glm::vec3(0, 0, 1), glm::vec3(3, 1, 2));
+  for (const std::array<int, 3>& t : slab.triangles) {
+    table.triangles.push_back({t[0] + 8, t[1] + 8, t[2] + 8});
+  }
+  table.vertices.insert(table.vertices.end(), slab.vertices.begin(), slab.vertices.end());
+  result = SliceMesh(table, options);
+  ExpectNear("slab overhangs", result.overhang_faces, 2);
+  ExpectNear("slab overhang area", result.overhang_area, 3);
+
+  result = SliceMesh(Box(glm::vec3(0), glm::vec3(0.2f, 1, 1)), options);
+  ExpectNear("thin wall ok", result.ok(), 0);
+  if (result.thin_points == 0 || result.min_thickness > options.nozzle_width) {
+    fprintf(stderr, "thin wall: %ld thin points, %.3f thick\n", result.thin_points,
+            result.min_thickness);
+    ++failures;
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d slicer checks failed\n", failures);
+    return 1;
+  }
+  printf("All slicer checks passed\n");
+  return 0;
+}
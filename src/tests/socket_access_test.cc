@@ -0,0 +1,97 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "key.h"
+#include "socket_access.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void Expect(const std::string& name, bool ok) {
+  if (!ok) {
+    fprintf(stderr, "%s failed\n", name.c_str());
+    ++failures;
+  }
+}
+
+struct Box {
+  glm::dvec3 min = glm::dvec3(1e30);
+  glm::dvec3 max = glm::dvec3(-1e30);
+};
+
+Box GetBox(const Polytope& polytope) {
+  Box box;
+  for (const glm::dvec3& v : polytope.vertices) {
+    box.min = glm::min(box.min, v);
+    box.max = glm::max(box.max, v);
+  }
+  return box;
+}
+
+Polytope MakeBox(const glm::dvec3& min, const glm::dvec3& max) {
+  std::vector<glm::dvec3> points;
+  for (int i = 0; i < 8; ++i) {
+    points.push_back({i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z});
+  }
+  return ConvexHull(points);
+}
+
+}  // namespace
+
+// Checks the PCB under a flat key against blocks placed around it: one beside the PCB closer
+// than the clearance, one below it in the way of the iron, and the key's own socket, which is
+// ignored.
+int main() {
+  Key key(0, 0, 50);
+  key.name = "key";
+  SocketAccessOptions options;
+  Box pcb = GetBox(GetPcbPolytope(key, options));
+  Expect("pcb width", std::abs(pcb.max.x - pcb.min.x - options.pcb_width) < 1e-4);
+  Expect("pcb thickness", std::abs(pcb.max.z - pcb.min.z - options.pcb_thickness) < 1e-4);
+  Box access = GetBox(GetAccessPolytope(key, options));
+  Expect("access depth",
+         std::abs(access.min.z - (pcb.min.z - options.iron_depth)) < 1e-4 &&
+             std::abs(access.max.z - pcb.max.z) < 1e-4);
+  Key low(0, 0, 25);
+  Expect("access clipped at the ground",
+         std::abs(GetBox(GetAccessPolytope(low, options)).min.z) < 1e-4);
+
+  std::vector<Key*> keys = {&key};
+  std::vector<SocketObstacle> obstacles = GetSocketObstacles(keys);
+  Expect("own socket ignored", !CheckSocketAccess(keys, obstacles, options)[0].pcb_violation);
+
+  // Beside the PCB but 0.2 away, with nothing below it.
+  obstacles.push_back({"beside",
+                       MakeBox(glm::dvec3(pcb.max.x + 0.2, pcb.min.y, pcb.min.z),
+                               glm::dvec3(pcb.max.x + 2, pcb.max.y, pcb.max.z)),
+                       nullptr});
+  std::vector<SocketAccessResult> results = CheckSocketAccess(keys, obstacles, options);
+  Expect("beside found", results[0].pcb_obstacle == "beside");
+  Expect("beside distance", std::abs(results[0].pcb.distance - 0.2) < 1e-4);
+  Expect("beside too close", results[0].pcb_violation);
+  Expect("beside out of the way", !results[0].access_violation);
+
+  // Below the PCB, within reach of the iron but clear of the PCB itself.
+  obstacles.pop_back();
+  obstacles.push_back({"below",
+                       MakeBox(glm::dvec3(-2, -2, pcb.min.z - 6), glm::dvec3(2, 2, pcb.min.z - 4)),
+                       nullptr});
+  results = CheckSocketAccess(keys, obstacles, options);
+  Expect("below distance", std::abs(results[0].pcb.distance - 4) < 1e-4);
+  Expect("below clear of the pcb", !results[0].pcb_violation);
+  Expect("below in the way", results[0].access_violation && results[0].access_obstacle == "below");
+  Expect("one key fails", PrintSocketAccessReport(results, stdout) == 1);
+
+  if (failures > 0) {
+    fprintf(stderr, "%d socket access checks failed\n", failures);
+    return 1;
+  }
+  printf("All socket access checks passed\n");
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "target_graph.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+void Expect(const std::string& name, bool ok) {
+  if (!ok) {
+    fprintf(stderr, "%s failed\n", name.c_str());
+    ++failures;
+  }
+}
+
+// Records the order targets are built in, from any thread.
+class BuildLog {
+ public:
+  TargetGraph::BuildFn Build(const std::string& name) {
+    return [this, name]() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      order_[name] = next_++;
+      ++builds_[name];
+    };
+  }
+
+  bool Before(const std::string& first, const std::string& second) const {
+    return order_.count(first) && order_.count(second) && order_.at(first) < order_.at(second);
+  }
+  int Builds(const std::string& name) const {
+    return builds_.count(name) ? builds_.at(name) : 0;
+  }
+  int TotalBuilds() const {
+    int total = 0;
+    for (const auto& entry : builds_) {
+      total += entry.second;
+    }
+    return total;
+  }
+
+ private:
+  std::mutex mutex_;
+  int next_ = 0;
+  std::map<std::string, int> order_;
+  std::map<std::string, int> builds_;
+};
+
+}  // namespace
+
+// Builds a diamond of targets on several threads, then invalidates part of it and builds again.
+int main() {
+  BuildLog log;
+  TargetGraph graph;
+  graph.AddTarget("keys", {}, log.Build("keys"));
+  graph.AddTarget("walls", {"keys"}, log.Build("walls"));
+  graph.AddTarget("plate", {"keys"}, log.Build("plate"));
+  graph.AddOutput("case", {"walls", "plate"}, log.Build("case"));
+  graph.AddOutput("caps", {}, log.Build("caps"));
+  graph.AddGroup("all", {"case", "caps"});
+
+  Expect("run every output", graph.Run({}, 4));
+  for (const char* name : {"keys", "walls", "plate", "case", "caps"}) {
+    Expect(std::string(name) + " built once", log.Builds(name) == 1);
+  }
+  Expect("keys before walls", log.Before("keys", "walls"));
+  Expect("keys before plate", log.Before("keys", "plate"));
+  Expect("walls before case", log.Before("walls", "case"));
+  Expect("plate before case", log.Before("plate", "case"));
+
+  Expect("run again", graph.Run({"all"}, 4));
+  Expect("nothing built again", log.TotalBuilds() == 5);
+
+  // The all group depends on case so it is invalidated too.
+  Expect("invalidate walls, case and all", graph.Invalidate("walls") == 3);
+  Expect("run after invalidating", graph.Run({}, 4));
+  Expect("walls built again", log.Builds("walls") == 2);
+  Expect("case built again", log.Builds("case") == 2);
+  Expect("keys kept", log.Builds("keys") == 1);
+  Expect("plate kept", log.Builds("plate") == 1);
+  Expect("caps kept", log.Builds("caps") == 1);
+
+  Expect("unknown target", !graph.Run({"missing"}, 4));
+  TargetGraph cycle;
+  cycle.AddTarget("a", {"b"}, log.Build("a"));
+  cycle.AddTarget("b", {"a"}, log.Build("b"));
+  std::vector<std::string> order;
+  Expect("cycle", !cycle.Resolve({"a"}, &order));
+
+  if (failures > 0) {
+    fprintf(stderr, "%d target graph checks failed\n", failures);
+    return 1;
+  }
+  printf("All target graph checks passed\n");
+  return 0;
+}
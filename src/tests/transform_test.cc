@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <string>
+
+#include "transform.h"
+
+using namespace scad;
+
+namespace {
+
+int failures = 0;
+
+bool SameTransforms(const TransformList& a, const TransformList& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  const Transform* t = b.begin();
+  for (const Transform& s : a) {
+    if (s.x != t->x || s.y != t->y || s.z != t->z || s.rx != t->rx || s.ry != t->ry ||
+        s.rz != t->rz) {
+      return false;
+    }
+    ++t;
+  }
+  return true;
+}
+
+TransformList MakeList(int size) {
+  TransformList list;
+  for (int i = 0; i < size; ++i) {
+    list.Translate(i, 0, 0).RotateZ(i);
+  }
+  return list;
+}
+
+void ExpectSame(const std::string& name,
+                const TransformList& actual,
+                const TransformList& expected) {
+  if (!SameTransforms(actual, expected)) {
+    fprintf(
+        stderr, "%s: %d transforms, expected %d\n", name.c_str(), actual.size(), expected.size());
+    ++failures;
+  }
+}
+
+}  // namespace
+
+// Appending a list to itself has to read the transforms before they are moved. Doubling 4
+// transforms stays inline and doubling 10 grows onto the heap.
+int main() {
+  for (int size : {2, 5}) {
+    TransformList list = MakeList(size);
+    TransformList copy = list;
+    TransformList expected = list;
+    expected.AppendFront(copy);
+    list.AppendFront(list);
+    ExpectSame("AppendFront itself with " + std::to_string(2 * size), list, expected);
+
+    list = MakeList(size);
+    expected = list;
+    expected.Append(copy);
+    list.Append(list);
+    ExpectSame("Append itself with " + std::to_string(2 * size), list, expected);
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d transform checks failed\n", failures);
+    return 1;
+  }
+  printf("All transform checks passed\n");
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh.h"
+#include "mesh_compare.h"
+
+using namespace scad;
+
+// Usage: mesh_diff [--golden_dir ../things] [--max_distance mm] [--max_volume_change fraction]
+// [--sample_spacing mm] [--jobs n] new.stl... Compares each rendered stl with the file of the same
+// name in --golden_dir and exits with 1 if any moved further than --max_distance or changed volume
+// by more than --max_volume_change, e.g. after "dactyl --render" in a scratch directory.
+int main(int argc, char** argv) {
+  MeshCompareOptions options;
+  options.jobs = std::max(1, (int)std::thread::hardware_concurrency());
+  std::string golden_dir = "../things";
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--golden_dir" && has_value) {
+      golden_dir = argv[++i];
+    } else if (arg == "--max_distance" && has_value) {
+      options.max_distance = std::atof(argv[++i]);
+    } else if (arg == "--max_volume_change" && has_value) {
+      options.max_volume_change = std::atof(argv[++i]);
+    } else if (arg == "--sample_spacing" && has_value) {
+      options.sample_spacing = std::atof(argv[++i]);
+    } else if (arg == "--jobs" && has_value) {
+      options.jobs = std::max(1, std::atoi(argv[++i]));
+    } else if (arg.empty() || arg[0] != '-') {
+      files.push_back(arg);
+    } else {
+      fprintf(stderr, "Unknown argument %s\n", arg.c_str());
+      return 1;
+    }
+  }
+  if (files.empty() || options.sample_spacing <= 0) {
+    fprintf(stderr, "Usage: mesh_diff [--golden_dir dir] [flags] new.stl...\n");
+    return 1;
+  }
+
+  int failed = 0;
+  for (const std::string& file_name : files) {
+    std::string golden_file = golden_dir + "/" + file_name.substr(file_name.rfind('/') + 1);
+    auto start = std::chrono::steady_clock::now();
+    Mesh new_mesh;
+    Mesh golden_mesh;
+    if (!ReadMesh(file_name, &new_mesh, options.jobs) ||
+        !ReadMesh(golden_file, &golden_mesh, options.jobs)) {
+      ++failed;
+      continue;
+    }
+    MeshCompareResult result = CompareMeshes(new_mesh, golden_mesh, options);
+    auto end = std::chrono::steady_clock::now();
+    PrintMeshCompareResult(file_name, result, stdout);
+    printf("  compared with %s in %.3f s\n",
+           golden_file.c_str(),
+           std::chrono::duration<double>(end - start).count());
+    failed += result.ok ? 0 : 1;
+  }
+  return failed > 0 ? 1 : 0;
+}
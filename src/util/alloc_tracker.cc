@@ -0,0 +1,208 @@
+#include "alloc_tracker.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace scad {
+
+#ifdef SCAD_TRACK_ALLOCATIONS
+
+namespace {
+
+constexpr int kMaxPhases = 256;
+
+struct PhaseCounters {
+  std::atomic<long long> count;
+  std::atomic<long long> bytes;
+  std::atomic<long long> live_bytes;
+  std::atomic<long long> peak_live_bytes;
+};
+
+// Zero initialized before anything can allocate. None of the bookkeeping allocates with operator
+// new so it can be used from inside it.
+PhaseCounters phase_counters[kMaxPhases];
+const char* phase_names[kMaxPhases] = {"other"};
+std::atomic<int> num_phases(1);
+std::mutex phase_names_mutex;
+
+thread_local int current_phase = 0;
+
+// Stored in front of every allocation. Keeps the returned pointer aligned for any type.
+struct alignas(alignof(std::max_align_t)) AllocationHeader {
+  std::size_t size;
+  int phase;
+};
+
+int GetPhaseId(const char* name) {
+  std::lock_guard<std::mutex> lock(phase_names_mutex);
+  int n = num_phases.load();
+  for (int i = 0; i < n; ++i) {
+    if (std::strcmp(phase_names[i], name) == 0) {
+      return i;
+    }
+  }
+  if (n == kMaxPhases) {
+    return 0;
+  }
+  // strdup uses malloc directly.
+  phase_names[n] = strdup(name);
+  num_phases = n + 1;
+  return n;
+}
+
+void* Allocate(std::size_t size) {
+  void* base = std::malloc(sizeof(AllocationHeader) + size);
+  if (base == nullptr) {
+    return nullptr;
+  }
+  AllocationHeader* header = static_cast<AllocationHeader*>(base);
+  header->size = size;
+  header->phase = current_phase;
+
+  PhaseCounters& counters = phase_counters[header->phase];
+  counters.count.fetch_add(1, std::memory_order_relaxed);
+  counters.bytes.fetch_add(size, std::memory_order_relaxed);
+  long long live = counters.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  long long peak = counters.peak_live_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !counters.peak_live_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+  return header + 1;
+}
+
+void Free(void* p) {
+  if (p == nullptr) {
+    return;
+  }
+  AllocationHeader* header = static_cast<AllocationHeader*>(p) - 1;
+  phase_counters[header->phase].live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+  std::free(header);
+}
+
+}  // namespace
+
+AllocationPhase::AllocationPhase(const char* name) : previous_phase_(current_phase) {
+  current_phase = GetPhaseId(name);
+}
+
+AllocationPhase::~AllocationPhase() {
+  current_phase = previous_phase_;
+}
+
+std::vector<AllocationStats> GetAllocationStats() {
+  std::vector<AllocationStats> stats;
+  int n = num_phases.load();
+  for (int i = 0; i < n; ++i) {
+    const PhaseCounters& counters = phase_counters[i];
+    if (counters.count == 0) {
+      continue;
+    }
+    AllocationStats s;
+    s.phase = phase_names[i];
+    s.count = counters.count;
+    s.bytes = counters.bytes;
+    s.peak_live_bytes = counters.peak_live_bytes;
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+long long GetAllocationCount() {
+  long long count = 0;
+  int n = num_phases.load();
+  for (int i = 0; i < n; ++i) {
+    count += phase_counters[i].count.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+#else
+
+std::vector<AllocationStats> GetAllocationStats() {
+  return {};
+}
+
+long long GetAllocationCount() {
+  return 0;
+}
+
+#endif
+
+void PrintAllocationReport(std::FILE* file) {
+  if (!IsAllocationTrackingEnabled()) {
+    fprintf(file,
+            "Allocation tracking is not built in. Configure with -DDACTYL_TRACK_ALLOCATIONS=ON\n");
+    return;
+  }
+  std::vector<AllocationStats> stats = GetAllocationStats();
+  AllocationStats total;
+  fprintf(file, "%-24s %12s %14s %14s\n", "phase", "allocations", "bytes", "peak live");
+  for (const AllocationStats& s : stats) {
+    fprintf(file,
+            "%-24s %12lld %14lld %14lld\n",
+            s.phase.c_str(),
+            s.count,
+            s.bytes,
+            s.peak_live_bytes);
+    total.count += s.count;
+    total.bytes += s.bytes;
+  }
+  fprintf(file, "%-24s %12lld %14lld\n", "total", total.count, total.bytes);
+}
+
+}  // namespace scad
+
+#ifdef SCAD_TRACK_ALLOCATIONS
+
+void* operator new(std::size_t size) {
+  void* p = scad::Allocate(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return scad::Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return scad::Allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+  scad::Free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  scad::Free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  scad::Free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  scad::Free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  scad::Free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  scad::Free(p);
+}
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace scad {
+
+// Counts heap allocations per named phase by replacing the global operator new and delete. This is
+// only compiled in when SCAD_TRACK_ALLOCATIONS is defined (cmake -DDACTYL_TRACK_ALLOCATIONS=ON)
+// since every allocation pays for the bookkeeping. Otherwise phases are no-ops and there are no
+// stats.
+//
+// Allocations are attributed to the innermost phase on the allocating thread and frees to the
+// phase which made the allocation.
+constexpr bool IsAllocationTrackingEnabled() {
+#ifdef SCAD_TRACK_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+class AllocationPhase {
+ public:
+#ifdef SCAD_TRACK_ALLOCATIONS
+  explicit AllocationPhase(const char* name);
+  ~AllocationPhase();
+#else
+  explicit AllocationPhase(const char*) {
+  }
+#endif
+
+  AllocationPhase(const AllocationPhase&) = delete;
+  AllocationPhase& operator=(const AllocationPhase&) = delete;
+
+#ifdef SCAD_TRACK_ALLOCATIONS
+ private:
+  int previous_phase_ = 0;
+#endif
+};
+
+struct AllocationStats {
+  std::string phase;
+  long long count = 0;
+  long long bytes = 0;
+  // The most memory allocated in the phase which was live at once.
+  long long peak_live_bytes = 0;
+};
+
+// Every phase which has allocated, in the order the phases were first entered. Allocations made
+// outside of any phase are reported as "other".
+std::vector<AllocationStats> GetAllocationStats();
+// Allocations made so far in every phase. Doesn't allocate, so it can be read around a small piece
+// of code to count what it allocates.
+long long GetAllocationCount();
+void PrintAllocationReport(std::FILE* file);
+
+}  // namespace scad
@@ -0,0 +1,166 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <glm/glm.hpp>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace scad {
+namespace {
+
+constexpr int kLeafSize = 4;
+
+float GetSquaredDistance(const Bounds& bounds, const glm::vec3& p) {
+  glm::vec3 d = glm::max(glm::max(bounds.min - p, p - bounds.max), glm::vec3(0));
+  return glm::dot(d, d);
+}
+
+}  // namespace
+
+// From Real-Time Collision Detection (Ericson), 5.1.5. In double, since the products below cancel
+// badly in float for the long thin triangles the rendered parts are full of, which put points on
+// the surface a few hundredths of a mm off it.
+glm::vec3 GetClosestPointOnTriangle(const glm::vec3& p,
+                                    const glm::vec3& a,
+                                    const glm::vec3& b,
+                                    const glm::vec3& c) {
+  glm::dvec3 ab = glm::dvec3(b) - glm::dvec3(a);
+  glm::dvec3 ac = glm::dvec3(c) - glm::dvec3(a);
+  glm::dvec3 ap = glm::dvec3(p) - glm::dvec3(a);
+  double d1 = glm::dot(ab, ap);
+  double d2 = glm::dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) {
+    return a;
+  }
+  glm::dvec3 bp = glm::dvec3(p) - glm::dvec3(b);
+  double d3 = glm::dot(ab, bp);
+  double d4 = glm::dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) {
+    return b;
+  }
+  double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    return glm::dvec3(a) + ab * (d1 / (d1 - d3));
+  }
+  glm::dvec3 cp = glm::dvec3(p) - glm::dvec3(c);
+  double d5 = glm::dot(ab, cp);
+  double d6 = glm::dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) {
+    return c;
+  }
+  double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    return glm::dvec3(a) + ac * (d2 / (d2 - d6));
+  }
+  double va = d3 * d6 - d5 * d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+    return glm::dvec3(b) + (glm::dvec3(c) - glm::dvec3(b)) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  }
+  double denominator = va + vb + vc;
+  if (denominator == 0) {
+    // Degenerate, all three corners in a line.
+    return a;
+  }
+  return glm::dvec3(a) + ab * (vb / denominator) + ac * (vc / denominator);
+}
+
+MeshBvh::MeshBvh(const Mesh& mesh) {
+  std::vector<glm::vec3> centroids;
+  for (const std::array<int, 3>& t : mesh.triangles) {
+    triangles_.push_back({mesh.vertices[t[0]], mesh.vertices[t[1]], mesh.vertices[t[2]]});
+    centroids.push_back((triangles_.back()[0] + triangles_.back()[1] + triangles_.back()[2]) / 3.f);
+  }
+  if (!triangles_.empty()) {
+    nodes_.reserve(2 * triangles_.size() / kLeafSize + 1);
+    Build(0, triangles_.size(), &centroids);
+  }
+}
+
+// Splits the triangles at the median centroid along the longest axis.
+int MeshBvh::Build(int begin, int end, std::vector<glm::vec3>* centroids) {
+  int index = nodes_.size();
+  nodes_.emplace_back();
+  Bounds bounds;
+  Bounds centroid_bounds;
+  for (int i = begin; i < end; ++i) {
+    for (const glm::vec3& v : triangles_[i]) {
+      bounds.Add(v);
+    }
+    centroid_bounds.Add((*centroids)[i]);
+  }
+  nodes_[index].bounds = bounds;
+  if (end - begin <= kLeafSize) {
+    nodes_[index].first = begin;
+    nodes_[index].count = end - begin;
+    return index;
+  }
+
+  glm::vec3 size = centroid_bounds.max - centroid_bounds.min;
+  int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+  // Sort an index so the triangles and their centroids move together.
+  std::vector<int> order(end - begin);
+  std::iota(order.begin(), order.end(), begin);
+  int middle = (end - begin) / 2;
+  std::nth_element(order.begin(), order.begin() + middle, order.end(), [&](int a, int b) {
+    return (*centroids)[a][axis] < (*centroids)[b][axis];
+  });
+  std::vector<std::array<glm::vec3, 3>> triangles;
+  std::vector<glm::vec3> sorted_centroids;
+  for (int i : order) {
+    triangles.push_back(triangles_[i]);
+    sorted_centroids.push_back((*centroids)[i]);
+  }
+  std::copy(triangles.begin(), triangles.end(), triangles_.begin() + begin);
+  std::copy(sorted_centroids.begin(), sorted_centroids.end(), centroids->begin() + begin);
+
+  int left = Build(begin, begin + middle, centroids);
+  int right = Build(begin + middle, end, centroids);
+  nodes_[index].left = left;
+  nodes_[index].right = right;
+  return index;
+}
+
+bool MeshBvh::FindClosest(const glm::vec3& p, glm::vec3* closest, float max_distance) const {
+  if (nodes_.empty()) {
+    return false;
+  }
+  float best = max_distance == std::numeric_limits<float>::max()
+                   ? std::numeric_limits<float>::max()
+                   : max_distance * max_distance;
+  bool found = false;
+  int stack[64];
+  int depth = 0;
+  stack[depth++] = 0;
+  while (depth > 0) {
+    const Node& node = nodes_[stack[--depth]];
+    if (GetSquaredDistance(node.bounds, p) > best) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        const std::array<glm::vec3, 3>& t = triangles_[i];
+        glm::vec3 q = GetClosestPointOnTriangle(p, t[0], t[1], t[2]);
+        float distance = glm::dot(q - p, q - p);
+        if (distance <= best) {
+          best = distance;
+          *closest = q;
+          found = true;
+        }
+      }
+      continue;
+    }
+    // Visit the nearer child first so the farther one is more likely to be skipped.
+    int left = node.left;
+    int right = node.right;
+    if (GetSquaredDistance(nodes_[left].bounds, p) < GetSquaredDistance(nodes_[right].bounds, p)) {
+      std::swap(left, right);
+    }
+    stack[depth++] = left;
+    stack[depth++] = right;
+  }
+  return found;
+}
+
+}  // namespace scad
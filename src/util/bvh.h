@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+#include <limits>
+#include <vector>
+
+#include "mesh.h"
+#include "stl.h"
+
+namespace scad {
+
+// A bounding volume hierarchy over the triangles of a mesh, for finding the closest point of the
+// mesh to a point. Built once and then safe to query from any number of threads.
+class MeshBvh {
+ public:
+  explicit MeshBvh(const Mesh& mesh);
+
+  // The closest point of the mesh to p, or false if the mesh is empty or nothing is closer than
+  // max_distance. Giving a max_distance skips most of the tree.
+  bool FindClosest(const glm::vec3& p,
+                   glm::vec3* closest,
+                   float max_distance = std::numeric_limits<float>::max()) const;
+
+  const Bounds& bounds() const {
+    return nodes_.empty() ? empty_bounds_ : nodes_[0].bounds;
+  }
+
+ private:
+  struct Node {
+    Bounds bounds;
+    // Leaves hold count triangles from first. Inner nodes have count 0.
+    int first = 0;
+    int count = 0;
+    int left = -1;
+    int right = -1;
+  };
+
+  int Build(int begin, int end, std::vector<glm::vec3>* centroids);
+
+  std::vector<std::array<glm::vec3, 3>> triangles_;
+  std::vector<Node> nodes_;
+  Bounds empty_bounds_;
+};
+
+// The closest point of the triangle abc to p.
+glm::vec3 GetClosestPointOnTriangle(const glm::vec3& p,
+                                    const glm::vec3& a,
+                                    const glm::vec3& b,
+                                    const glm::vec3& c);
+
+}  // namespace scad
@@ -0,0 +1,235 @@
+#include "chunked_render.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "scad.h"
+#include "stl.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+bool IsTransform(const std::string& op) {
+  return op == "translate" || op == "rotate" || op == "mirror" || op == "scale" ||
+         op == "multmatrix" || op == "color";
+}
+
+// Tags and comments don't change the geometry so they can be looked through.
+const ShapeNode* SkipLabels(const ShapeNode* node) {
+  while (node && (node->kind == ShapeKind::TAG || node->kind == ShapeKind::COMMENT) &&
+         node->children.size() == 1) {
+    node = node->children[0].node();
+  }
+  return node;
+}
+
+bool IsUnion(const ShapeNode* node) {
+  return node && node->kind == ShapeKind::COMPOSITE && node->op == "union";
+}
+
+// Collects the children of nested unions.
+void FlattenUnion(const ShapeNode& node, std::vector<Shape>* items) {
+  for (const Shape& child : node.children) {
+    const ShapeNode* child_node = SkipLabels(child.node());
+    if (IsUnion(child_node)) {
+      FlattenUnion(*child_node, items);
+    } else if (child.node()) {
+      items->push_back(child);
+    }
+  }
+}
+
+// Renders the jobs, returning false if any of them failed.
+bool RenderAll(const std::vector<RenderJob>& jobs,
+               const ChunkedRenderOptions& options,
+               double* max_seconds) {
+  bool ok = true;
+  for (const RenderJobResult& result : RenderAll(jobs, options.renderer, options.jobs)) {
+    ok = ok && result.ok;
+    *max_seconds = std::max(*max_seconds, result.seconds);
+  }
+  return ok;
+}
+
+int FindRoot(std::vector<int>& parents, int i) {
+  while (parents[i] != i) {
+    parents[i] = parents[parents[i]];
+    i = parents[i];
+  }
+  return i;
+}
+
+// Groups chunks whose bounds overlap, directly or through other chunks.
+std::vector<std::vector<int>> GroupOverlapping(const std::vector<Bounds>& bounds) {
+  std::vector<int> parents(bounds.size());
+  std::iota(parents.begin(), parents.end(), 0);
+  for (size_t i = 0; i < bounds.size(); ++i) {
+    for (size_t j = i + 1; j < bounds.size(); ++j) {
+      if (bounds[i].Overlaps(bounds[j])) {
+        parents[FindRoot(parents, i)] = FindRoot(parents, j);
+      }
+    }
+  }
+  std::vector<std::vector<int>> groups(bounds.size());
+  for (size_t i = 0; i < bounds.size(); ++i) {
+    groups[FindRoot(parents, i)].push_back(i);
+  }
+  groups.erase(std::remove_if(groups.begin(),
+                              groups.end(),
+                              [](const std::vector<int>& group) { return group.empty(); }),
+               groups.end());
+  return groups;
+}
+
+std::string GetFileName(const std::string& path) {
+  return path.substr(path.find_last_of("/\\") + 1);
+}
+
+}  // namespace
+
+std::vector<Shape> SplitTopLevelUnion(const Shape& shape, int chunks) {
+  // The operations above the union, outermost first. The first child of each leads to the union.
+  std::vector<const ShapeNode*> wrappers;
+  const ShapeNode* node = SkipLabels(shape.node());
+  while (node && !IsUnion(node)) {
+    bool is_difference = node->op == "difference" && !node->children.empty();
+    bool is_transform = IsTransform(node->op) && node->children.size() == 1;
+    if (node->kind != ShapeKind::COMPOSITE || !(is_difference || is_transform)) {
+      return {shape};
+    }
+    wrappers.push_back(node);
+    node = SkipLabels(node->children[0].node());
+  }
+  if (!node) {
+    return {shape};
+  }
+
+  std::vector<Shape> items;
+  FlattenUnion(*node, &items);
+  std::vector<double> costs;
+  double total_cost = 0;
+  for (const Shape& item : items) {
+    // Every item costs something even if it has no booleans.
+    SubtreeStats stats = item.Analyze().total;
+    costs.push_back(stats.boolean_cost + stats.facets);
+    total_cost += costs.back();
+  }
+
+  // Neighbouring items are usually close together in the case, so keep them in order and cut
+  // the list where each chunk reaches its share of the cost.
+  std::vector<std::vector<Shape>> chunk_items(1);
+  double chunk_cost = 0;
+  double target_cost = total_cost / std::max(1, chunks);
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (chunk_cost >= target_cost && (int)chunk_items.size() < chunks) {
+      chunk_items.emplace_back();
+      chunk_cost = 0;
+    }
+    chunk_items.back().push_back(items[i]);
+    chunk_cost += costs[i];
+  }
+
+  std::vector<Shape> result;
+  for (const std::vector<Shape>& shapes : chunk_items) {
+    Shape chunk = UnionAll(shapes);
+    for (auto it = wrappers.rbegin(); it != wrappers.rend(); ++it) {
+      std::vector<Shape> children = (*it)->children;
+      children[0] = std::move(chunk);
+      chunk = Shape::WithChildren(**it, std::move(children));
+    }
+    result.push_back(chunk);
+  }
+  return result;
+}
+
+ChunkedRenderResult RenderChunked(const Shape& shape,
+                                  const std::string& name,
+                                  const ChunkedRenderOptions& options) {
+  TRACE_SCOPE("RenderChunked", name);
+  auto start = std::chrono::steady_clock::now();
+  ChunkedRenderResult result;
+  std::error_code error;
+  std::filesystem::create_directories(options.directory, error);
+  if (error) {
+    fprintf(stderr, "Could not create %s\n", options.directory.c_str());
+    return result;
+  }
+
+  std::vector<Shape> chunks = SplitTopLevelUnion(shape, options.chunks);
+  result.chunks = chunks.size();
+  std::vector<RenderJob> chunk_jobs;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    std::string prefix = options.directory + "/" + name + "_chunk_" + std::to_string(i);
+    chunk_jobs.push_back({prefix + ".scad", prefix + ".stl"});
+    chunks[i].WriteToFile(chunk_jobs.back().scad);
+  }
+  if (!RenderAll(chunk_jobs, options, &result.max_chunk_seconds)) {
+    return result;
+  }
+
+  std::vector<std::vector<StlTriangle>> meshes(chunks.size());
+  std::vector<Bounds> bounds;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (!ReadStl(chunk_jobs[i].stl, &meshes[i])) {
+      return result;
+    }
+    bounds.push_back(GetBounds(meshes[i]));
+  }
+
+  std::vector<StlTriangle> merged;
+  std::vector<RenderJob> seam_jobs;
+  for (const std::vector<int>& group : GroupOverlapping(bounds)) {
+    if (group.size() == 1) {
+      merged.insert(merged.end(), meshes[group[0]].begin(), meshes[group[0]].end());
+      continue;
+    }
+    // Imports are relative to the scad file, which is next to the chunks.
+    std::vector<Shape> imports;
+    for (int i : group) {
+      imports.push_back(Import(GetFileName(chunk_jobs[i].stl)));
+    }
+    std::string prefix =
+        options.directory + "/" + name + "_seam_" + std::to_string(seam_jobs.size());
+    seam_jobs.push_back({prefix + ".scad", prefix + ".stl"});
+    UnionAll(imports).WriteToFile(seam_jobs.back().scad);
+  }
+  result.seams = seam_jobs.size();
+  double max_seam_seconds = 0;
+  if (!RenderAll(seam_jobs, options, &max_seam_seconds)) {
+    return result;
+  }
+  for (const RenderJob& job : seam_jobs) {
+    if (!ReadStl(job.stl, &merged)) {
+      return result;
+    }
+  }
+
+  result.triangles = merged.size();
+  result.ok = WriteStl(name + ".stl", merged);
+  auto end = std::chrono::steady_clock::now();
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  return result;
+}
+
+void PrintChunkedRenderResult(const std::string& name,
+                              const ChunkedRenderResult& result,
+                              std::FILE* file) {
+  fprintf(file,
+          "%-16s %3d chunks %3d seams %9ld triangles %8.2f s (slowest chunk %.2f s)%s\n",
+          name.c_str(),
+          result.chunks,
+          result.seams,
+          result.triangles,
+          result.seconds,
+          result.max_chunk_seconds,
+          result.ok ? "" : " FAILED");
+}
+
+}  // namespace scad
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+// Renders a shape to stl by splitting its top level union into chunks which OpenSCAD renders in
+// parallel. CGAL unions get much slower as the mesh grows, so several small renders followed by a
+// union of the results is faster than one big one, and the work spreads over several processes.
+//
+// The chunk stls are merged by bounding box. Chunks which don't touch any other chunk are copied
+// into the output as they are, and only the groups of chunks which overlap (the seams) are unioned
+// by a second render of their stls.
+struct ChunkedRenderOptions {
+  // See Render in renderer.h.
+  std::string renderer = "openscad";
+  // Renders running at once.
+  int jobs = 1;
+  int chunks = 8;
+  // Where the chunk scad and stl files are written, relative to the working directory.
+  std::string directory = "chunks";
+};
+
+struct ChunkedRenderResult {
+  bool ok = false;
+  int chunks = 0;
+  // Groups of overlapping chunks which had to be unioned.
+  int seams = 0;
+  long triangles = 0;
+  // The slowest chunk render and the whole render, to see how well the chunks balance.
+  double max_chunk_seconds = 0;
+  double seconds = 0;
+};
+
+// Splits the children of the first union found below any transforms or differences into at most
+// chunks shapes. A difference is distributed over the chunks, so the subtracted shapes are written
+// into every chunk. Returns just the shape if there is no union to split.
+std::vector<Shape> SplitTopLevelUnion(const Shape& shape, int chunks);
+
+// Writes <name>.stl.
+ChunkedRenderResult RenderChunked(const Shape& shape,
+                                  const std::string& name,
+                                  const ChunkedRenderOptions& options);
+
+void PrintChunkedRenderResult(const std::string& name,
+                              const ChunkedRenderResult& result,
+                              std::FILE* file);
+
+}  // namespace scad
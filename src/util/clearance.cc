@@ -0,0 +1,165 @@
+#include "clearance.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "geometry.h"
+#include "key.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+Polytope MakePolytope(const std::vector<glm::vec3>& points) {
+  std::vector<glm::dvec3> world_points;
+  for (const glm::vec3& p : points) {
+    world_points.push_back(p);
+  }
+  return ConvexHull(world_points);
+}
+
+std::string KeyName(const Key* key) {
+  return key->name.empty() ? "(unnamed)" : key->name;
+}
+
+}  // namespace
+
+Polytope GetCapPolytope(const Key& key) {
+  return MakePolytope(key.GetCapPoints());
+}
+
+Polytope GetInverseCapPolytope(const Key& key, double custom_vertical_length) {
+  return MakePolytope(key.GetInverseCapPoints(custom_vertical_length));
+}
+
+Polytope GetSwitchPolytope(const Key& key) {
+  TransformList transforms = key.GetSwitchTransforms();
+  std::vector<glm::vec3> points;
+  for (double x : {-1 * (kSwitchHorizontalOffset + key.extra_width_left),
+                   kSwitchHorizontalOffset + key.extra_width_right}) {
+    for (double y : {-1 * (kSwitchHorizontalOffset + key.extra_width_bottom),
+                     kSwitchHorizontalOffset + key.extra_width_top}) {
+      for (double z : {-1 * kSwitchThickness, key.extra_z}) {
+        points.push_back(transforms.Apply(glm::vec3(x, y, z)));
+      }
+    }
+  }
+  return MakePolytope(points);
+}
+
+std::vector<KeyPair> GetNeighbourPairs(KeyGrid& grid,
+                                       const std::vector<Key*>& extra_keys,
+                                       double max_distance) {
+  std::vector<KeyPair> pairs;
+  for (size_t r = 0; r < grid.num_rows(); ++r) {
+    for (size_t c = 0; c < grid.num_columns(); ++c) {
+      Key* key = grid.get_key(r, c);
+      if (!key) {
+        continue;
+      }
+      Key* neighbours[] = {
+          grid.get_key(r, c + 1),
+          c > 0 ? grid.get_key(r + 1, c - 1) : nullptr,
+          grid.get_key(r + 1, c),
+          grid.get_key(r + 1, c + 1),
+      };
+      for (Key* neighbour : neighbours) {
+        if (neighbour) {
+          pairs.push_back({key, neighbour});
+        }
+      }
+    }
+  }
+
+  std::vector<Key*> others = extra_keys;
+  for (Key* key : grid.keys()) {
+    others.push_back(key);
+  }
+  for (size_t i = 0; i < extra_keys.size(); ++i) {
+    glm::vec3 center = extra_keys[i]->GetSwitchTransforms().Apply(kOrigin);
+    for (size_t j = i + 1; j < others.size(); ++j) {
+      glm::vec3 other_center = others[j]->GetSwitchTransforms().Apply(kOrigin);
+      if (glm::length(center - other_center) < max_distance) {
+        pairs.push_back({extra_keys[i], others[j]});
+      }
+    }
+  }
+  return pairs;
+}
+
+std::vector<ClearanceResult> CheckClearance(const std::vector<KeyPair>& pairs,
+                                            const ClearanceOptions& options) {
+  // Build each polytope once since most keys show up in several pairs.
+  struct KeyVolumes {
+    Polytope cap;
+    Polytope sweep;
+  };
+  std::vector<std::pair<const Key*, KeyVolumes>> volumes;
+  auto get_volumes = [&](const Key* key) -> const KeyVolumes& {
+    for (const auto& entry : volumes) {
+      if (entry.first == key) {
+        return entry.second;
+      }
+    }
+    volumes.push_back({key, {GetCapPolytope(*key), GetInverseCapPolytope(*key)}});
+    return volumes.back().second;
+  };
+  for (const KeyPair& pair : pairs) {
+    get_volumes(pair.a);
+    get_volumes(pair.b);
+  }
+
+  std::vector<ClearanceResult> results;
+  for (const KeyPair& pair : pairs) {
+    const KeyVolumes& a = get_volumes(pair.a);
+    const KeyVolumes& b = get_volumes(pair.b);
+    ClearanceResult result;
+    result.a = pair.a;
+    result.b = pair.b;
+    result.cap = Distance(a.cap, b.cap);
+    DistanceResult a_into_b = Distance(a.cap, b.sweep);
+    DistanceResult b_into_a = Distance(b.cap, a.sweep);
+    result.sweep = a_into_b.distance < b_into_a.distance ? a_into_b : b_into_a;
+    result.cap_violation = result.cap.distance < options.min_cap_clearance;
+    result.sweep_violation = result.sweep.distance < options.min_sweep_clearance;
+    results.push_back(result);
+  }
+  return results;
+}
+
+int PrintClearanceReport(const std::vector<ClearanceResult>& results, std::FILE* file) {
+  std::vector<ClearanceResult> sorted = results;
+  std::sort(sorted.begin(), sorted.end(), [](const ClearanceResult& x, const ClearanceResult& y) {
+    return x.cap.distance < y.cap.distance;
+  });
+
+  int violations = 0;
+  fprintf(file, "%-14s %-14s %10s %10s  %s\n", "key", "neighbour", "cap mm", "path mm", "status");
+  for (const ClearanceResult& r : sorted) {
+    std::string status;
+    if (r.cap_violation) {
+      status += "CAP ";
+    }
+    if (r.sweep_violation) {
+      status += "PATH";
+    }
+    if (r.cap_violation || r.sweep_violation) {
+      ++violations;
+    } else {
+      status = "ok";
+    }
+    fprintf(file,
+            "%-14s %-14s %10.3f %10.3f  %s\n",
+            KeyName(r.a).c_str(),
+            KeyName(r.b).c_str(),
+            r.cap.distance,
+            r.sweep.distance,
+            status.c_str());
+  }
+  fprintf(file, "%d of %d pairs violate the clearance limits\n", violations, (int)sorted.size());
+  return violations;
+}
+
+}  // namespace scad
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "geometry.h"
+#include "key.h"
+
+namespace scad {
+
+// Convex world space volumes of a key. These match the shapes produced by Key::GetCap() and
+// Key::GetInverseCap() so they can be checked without rendering anything.
+Polytope GetCapPolytope(const Key& key);
+Polytope GetInverseCapPolytope(const Key& key, double custom_vertical_length = -1);
+// The box around the switch socket (GetSwitch) including any extra width and height.
+Polytope GetSwitchPolytope(const Key& key);
+
+struct KeyPair {
+  const Key* a;
+  const Key* b;
+};
+
+// Pairs of keys which are adjacent in the grid (including diagonals) plus every pair involving
+// one of the extra keys (thumb keys) where the switch centers are within max_distance.
+std::vector<KeyPair> GetNeighbourPairs(KeyGrid& grid,
+                                       const std::vector<Key*>& extra_keys,
+                                       double max_distance = 35);
+
+struct ClearanceOptions {
+  // Minimum gap between two caps at rest.
+  double min_cap_clearance = 0.5;
+  // Minimum gap between a cap and the path of a neighbouring cap (GetInverseCap).
+  double min_sweep_clearance = 0;
+};
+
+struct ClearanceResult {
+  const Key* a;
+  const Key* b;
+  DistanceResult cap;
+  // The smaller of cap a against the path of b and cap b against the path of a.
+  DistanceResult sweep;
+  bool cap_violation = false;
+  bool sweep_violation = false;
+};
+
+std::vector<ClearanceResult> CheckClearance(const std::vector<KeyPair>& pairs,
+                                            const ClearanceOptions& options = {});
+
+// Prints one row per pair sorted by cap clearance. Returns the number of violating pairs.
+int PrintClearanceReport(const std::vector<ClearanceResult>& results, std::FILE* file = stdout);
+
+}  // namespace scad
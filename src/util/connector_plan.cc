@@ -0,0 +1,131 @@
+#include "connector_plan.h"
+
+#include <algorithm>
+#include <array>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "key.h"
+#include "scad.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+// Triangles with less area than this are treated as degenerate.
+constexpr double kMinTriangleArea = 1e-6;
+
+}  // namespace
+
+int ConnectorPlan::AddCorner(const Key& key, Corner corner, double z_offset) {
+  auto id_key = std::make_tuple(&key, corner, z_offset);
+  auto it = corner_ids_.find(id_key);
+  if (it != corner_ids_.end()) {
+    return it->second;
+  }
+
+  TransformList transforms;
+  switch (corner) {
+    case Corner::TOP_LEFT:
+      transforms = key.GetTopLeft(offset_);
+      break;
+    case Corner::TOP_RIGHT:
+      transforms = key.GetTopRight(offset_);
+      break;
+    case Corner::BOTTOM_RIGHT:
+      transforms = key.GetBottomRight(offset_);
+      break;
+    case Corner::BOTTOM_LEFT:
+      transforms = key.GetBottomLeft(offset_);
+      break;
+  }
+  if (z_offset != 0) {
+    transforms.TranslateFront(0, 0, z_offset);
+  }
+
+  int id = corners_.size();
+  corner_points_.push_back(transforms.Apply(kOrigin));
+  corners_.push_back(transforms);
+  corner_ids_[id_key] = id;
+  return id;
+}
+
+void ConnectorPlan::AddTriangle(int a, int b, int c) {
+  glm::vec3 normal =
+      glm::cross(corner_points_[b] - corner_points_[a], corner_points_[c] - corner_points_[a]);
+  if (a == b || b == c || a == c || glm::length(normal) / 2 < kMinTriangleArea) {
+    ++dropped_triangles_;
+    return;
+  }
+  std::array<int, 3> sorted = {a, b, c};
+  std::sort(sorted.begin(), sorted.end());
+  if (triangle_ids_.count(sorted)) {
+    ++dropped_triangles_;
+    return;
+  }
+  triangle_ids_[sorted] = triangles_.size();
+  triangles_.push_back({a, b, c});
+}
+
+void ConnectorPlan::AddFan(int center, const std::vector<int>& corners) {
+  for (size_t i = 0; i + 1 < corners.size(); ++i) {
+    AddTriangle(center, corners[i], corners[i + 1]);
+  }
+}
+
+void ConnectorPlan::AddHorizontal(const Key& left, const Key& right) {
+  AddTriangle(TopRight(left), BottomRight(left), BottomLeft(right));
+  AddTriangle(BottomLeft(right), TopLeft(right), TopRight(left));
+}
+
+void ConnectorPlan::AddVertical(const Key& top, const Key& bottom) {
+  AddTriangle(BottomRight(top), BottomLeft(top), TopLeft(bottom));
+  AddTriangle(TopLeft(bottom), TopRight(bottom), BottomRight(top));
+}
+
+void ConnectorPlan::AddDiagonal(const Key& top_left,
+                                const Key& top_right,
+                                const Key& bottom_right,
+                                const Key& bottom_left) {
+  AddTriangle(BottomRight(top_left), BottomLeft(top_right), TopLeft(bottom_right));
+  AddTriangle(TopLeft(bottom_right), TopRight(bottom_left), BottomRight(top_left));
+}
+
+void ConnectorPlan::AddGrid(KeyGrid& grid) {
+  for (size_t r = 0; r < grid.num_rows(); ++r) {
+    for (size_t c = 0; c < grid.num_columns(); ++c) {
+      Key* key = grid.get_key(r, c);
+      if (!key) {
+        // No key at this location.
+        continue;
+      }
+      Key* left = c > 0 ? grid.get_key(r, c - 1) : nullptr;
+      Key* top_left = r > 0 && c > 0 ? grid.get_key(r - 1, c - 1) : nullptr;
+      Key* top = r > 0 ? grid.get_key(r - 1, c) : nullptr;
+
+      if (left) {
+        AddHorizontal(*left, *key);
+      }
+      if (top) {
+        AddVertical(*top, *key);
+        if (left && top_left) {
+          AddDiagonal(*top_left, *top, *key, *left);
+        }
+      }
+    }
+  }
+}
+
+Shape ConnectorPlan::Build(const Shape& connector) const {
+  std::vector<Shape> posts;
+  for (const TransformList& transforms : corners_) {
+    posts.push_back(transforms.Apply(connector));
+  }
+  std::vector<Shape> hulls;
+  for (const auto& t : triangles_) {
+    hulls.push_back(Hull(posts[t[0]], posts[t[1]], posts[t[2]]));
+  }
+  return UnionAll(hulls);
+}
+
+}  // namespace scad
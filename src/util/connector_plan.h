@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "key.h"
+#include "scad.h"
+#include "transform.h"
+
+namespace scad {
+
+enum class Corner { TOP_LEFT, TOP_RIGHT, BOTTOM_RIGHT, BOTTOM_LEFT };
+
+// Collects the triangles connecting key corners before any shapes are built. Every corner is
+// given an id the first time it is seen so its transforms are only computed once, repeated
+// triangles are only emitted once and degenerate triangles are dropped.
+//
+// The Add* methods produce the same triangles as ConnectHorizontal, ConnectVertical,
+// ConnectDiagonal and TriFan in key.h.
+class ConnectorPlan {
+ public:
+  // offset is passed to the key corner methods (GetTopLeft etc) for every corner.
+  explicit ConnectorPlan(double offset = 0) : offset_(offset) {
+  }
+
+  // Returns the id of the corner. z_offset moves the corner along the switch axis, the same as
+  // calling TranslateFront(0, 0, z_offset) on the corner transforms.
+  int AddCorner(const Key& key, Corner corner, double z_offset = 0);
+  int TopLeft(const Key& key, double z_offset = 0) {
+    return AddCorner(key, Corner::TOP_LEFT, z_offset);
+  }
+  int TopRight(const Key& key, double z_offset = 0) {
+    return AddCorner(key, Corner::TOP_RIGHT, z_offset);
+  }
+  int BottomRight(const Key& key, double z_offset = 0) {
+    return AddCorner(key, Corner::BOTTOM_RIGHT, z_offset);
+  }
+  int BottomLeft(const Key& key, double z_offset = 0) {
+    return AddCorner(key, Corner::BOTTOM_LEFT, z_offset);
+  }
+
+  const TransformList& GetTransforms(int corner) const {
+    return corners_[corner];
+  }
+
+  void AddTriangle(int a, int b, int c);
+  void AddFan(int center, const std::vector<int>& corners);
+
+  void AddHorizontal(const Key& left, const Key& right);
+  void AddVertical(const Key& top, const Key& bottom);
+  void AddDiagonal(const Key& top_left,
+                   const Key& top_right,
+                   const Key& bottom_right,
+                   const Key& bottom_left);
+  // Connects every key in the grid to its left, top and top left neighbours.
+  void AddGrid(KeyGrid& grid);
+
+  size_t num_corners() const {
+    return corners_.size();
+  }
+  const std::vector<std::array<int, 3>>& triangles() const {
+    return triangles_;
+  }
+  // Triangles which were not added because they were repeated or degenerate.
+  int num_dropped_triangles() const {
+    return dropped_triangles_;
+  }
+
+  // One hull of three connectors per triangle. The connector is placed at each corner once and
+  // shared by every hull that uses it.
+  Shape Build(const Shape& connector = GetPostConnector()) const;
+
+ private:
+  double offset_;
+  std::vector<TransformList> corners_;
+  // The top of the post at each corner.
+  std::vector<glm::vec3> corner_points_;
+  std::map<std::tuple<const Key*, Corner, double>, int> corner_ids_;
+  std::vector<std::array<int, 3>> triangles_;
+  std::map<std::array<int, 3>, int> triangle_ids_;
+  int dropped_triangles_ = 0;
+};
+
+}  // namespace scad
@@ -0,0 +1,158 @@
+#include "file_watcher.h"
+
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <filesystem>
+#endif
+
+namespace scad {
+namespace {
+
+void SplitPath(const std::string& file_name, std::string* directory, std::string* base_name) {
+  size_t slash = file_name.find_last_of("/\\");
+  if (slash == std::string::npos) {
+    *directory = ".";
+    *base_name = file_name;
+  } else {
+    *directory = slash == 0 ? "/" : file_name.substr(0, slash);
+    *base_name = file_name.substr(slash + 1);
+  }
+}
+
+#ifndef __linux__
+long long GetModifiedTime(const std::string& file_name) {
+  std::error_code error;
+  auto time = std::filesystem::last_write_time(file_name, error);
+  return error ? 0 : (long long)time.time_since_epoch().count();
+}
+#endif
+
+}  // namespace
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher() {
+  inotify_ = inotify_init1(IN_CLOEXEC);
+  if (inotify_ < 0) {
+    perror("inotify_init1");
+  }
+}
+
+FileWatcher::~FileWatcher() {
+  if (inotify_ >= 0) {
+    close(inotify_);
+  }
+}
+
+bool FileWatcher::Add(const std::string& file_name) {
+  WatchedFile file;
+  file.name = file_name;
+  SplitPath(file_name, &file.directory, &file.base_name);
+  if (inotify_ >= 0) {
+    // Watching the same directory twice returns the same watch.
+    file.watch = inotify_add_watch(
+        inotify_, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  }
+  if (file.watch < 0) {
+    fprintf(stderr, "Could not watch %s\n", file.directory.c_str());
+    return false;
+  }
+  files_.push_back(file);
+  return true;
+}
+
+std::vector<std::string> FileWatcher::Wait(int settle_ms) {
+  std::set<std::string> changed;
+  // Block for the first relevant event, then keep reading until the files settle.
+  int timeout = -1;
+  alignas(inotify_event) char buffer[4096];
+  while (inotify_ >= 0) {
+    pollfd fd = {inotify_, POLLIN, 0};
+    int ready = poll(&fd, 1, timeout);
+    if (ready == 0) {
+      break;
+    }
+    if (ready < 0) {
+      perror("poll");
+      break;
+    }
+    ssize_t length = read(inotify_, buffer, sizeof(buffer));
+    if (length <= 0) {
+      perror("read");
+      break;
+    }
+    for (char* p = buffer; p < buffer + length;) {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+      p += sizeof(inotify_event) + event->len;
+      if (event->len == 0) {
+        continue;
+      }
+      for (const WatchedFile& file : files_) {
+        if (file.watch == event->wd && file.base_name == event->name) {
+          changed.insert(file.name);
+        }
+      }
+    }
+    if (!changed.empty()) {
+      timeout = settle_ms;
+    }
+  }
+
+  std::vector<std::string> result;
+  for (const WatchedFile& file : files_) {
+    if (changed.count(file.name)) {
+      result.push_back(file.name);
+    }
+  }
+  return result;
+}
+
+#else
+
+FileWatcher::FileWatcher() {
+}
+
+FileWatcher::~FileWatcher() {
+}
+
+bool FileWatcher::Add(const std::string& file_name) {
+  WatchedFile file;
+  file.name = file_name;
+  SplitPath(file_name, &file.directory, &file.base_name);
+  file.modified = GetModifiedTime(file_name);
+  files_.push_back(file);
+  return true;
+}
+
+std::vector<std::string> FileWatcher::Wait(int settle_ms) {
+  std::vector<std::string> result;
+  while (result.empty()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    for (WatchedFile& file : files_) {
+      long long modified = GetModifiedTime(file.name);
+      if (modified != file.modified) {
+        file.modified = modified;
+        result.push_back(file.name);
+      }
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(settle_ms));
+  for (WatchedFile& file : files_) {
+    file.modified = GetModifiedTime(file.name);
+  }
+  return result;
+}
+
+#endif
+
+}  // namespace scad
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace scad {
+
+// Waits for a set of files to change. Uses inotify on Linux and polls modification times
+// elsewhere. The directory of each file is watched rather than the file itself so editors which
+// save by replacing the file are still seen.
+class FileWatcher {
+ public:
+  FileWatcher();
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  // Returns false if the file's directory can not be watched.
+  bool Add(const std::string& file_name);
+
+  // Blocks until at least one watched file changes and returns the names of the changed files as
+  // passed to Add. Changes within settle_ms of each other are reported together, so a save which
+  // writes a file in several steps only causes one rebuild.
+  std::vector<std::string> Wait(int settle_ms = 100);
+
+ private:
+  struct WatchedFile {
+    std::string name;
+    // The directory and file name within it, used to match inotify events.
+    std::string directory;
+    std::string base_name;
+    int watch = -1;
+    long long modified = 0;
+  };
+
+  std::vector<WatchedFile> files_;
+  int inotify_ = -1;
+};
+
+}  // namespace scad
@@ -0,0 +1,492 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace scad {
+namespace {
+
+struct HullFace {
+  int a;
+  int b;
+  int c;
+  glm::dvec3 normal;
+  double offset;
+  bool alive;
+};
+
+HullFace MakeHullFace(const std::vector<glm::dvec3>& points, int a, int b, int c) {
+  HullFace face;
+  face.a = a;
+  face.b = b;
+  face.c = c;
+  glm::dvec3 n = glm::cross(points[b] - points[a], points[c] - points[a]);
+  double length = glm::length(n);
+  face.normal = length > 0 ? n / length : n;
+  face.offset = glm::dot(face.normal, points[a]);
+  face.alive = true;
+  return face;
+}
+
+double DistanceToLine(const glm::dvec3& p, const glm::dvec3& a, const glm::dvec3& b) {
+  return glm::length(glm::cross(p - a, b - a)) / glm::length(b - a);
+}
+
+// A point in the Minkowski difference along with the points on each polytope that produced it.
+struct SimplexVertex {
+  glm::dvec3 w;
+  glm::dvec3 a;
+  glm::dvec3 b;
+};
+
+struct Simplex {
+  SimplexVertex vertices[4];
+  double weights[4];
+  int size = 0;
+
+  glm::dvec3 Point() const {
+    glm::dvec3 p(0);
+    for (int i = 0; i < size; ++i) {
+      p += weights[i] * vertices[i].w;
+    }
+    return p;
+  }
+
+  // Keeps only the vertices with the given indexes and weights.
+  void Reduce(std::initializer_list<int> keep, std::initializer_list<double> keep_weights) {
+    SimplexVertex kept[4];
+    int n = 0;
+    for (int i : keep) {
+      kept[n++] = vertices[i];
+    }
+    n = 0;
+    for (double weight : keep_weights) {
+      vertices[n] = kept[n];
+      weights[n] = weight;
+      ++n;
+    }
+    size = n;
+  }
+};
+
+void ClosestOnSegment(Simplex* s, int i0, int i1) {
+  const glm::dvec3& a = s->vertices[i0].w;
+  const glm::dvec3& b = s->vertices[i1].w;
+  glm::dvec3 ab = b - a;
+  double denom = glm::dot(ab, ab);
+  double t = denom > 0 ? glm::dot(-a, ab) / denom : 0;
+  if (t <= 0) {
+    s->Reduce({i0}, {1});
+  } else if (t >= 1) {
+    s->Reduce({i1}, {1});
+  } else {
+    s->Reduce({i0, i1}, {1 - t, t});
+  }
+}
+
+// Closest point on a triangle to the origin. From Real-Time Collision Detection 5.1.5.
+void ClosestOnTriangle(Simplex* s, int i0, int i1, int i2) {
+  const glm::dvec3& a = s->vertices[i0].w;
+  const glm::dvec3& b = s->vertices[i1].w;
+  const glm::dvec3& c = s->vertices[i2].w;
+  glm::dvec3 ab = b - a;
+  glm::dvec3 ac = c - a;
+  glm::dvec3 ap = -a;
+  double d1 = glm::dot(ab, ap);
+  double d2 = glm::dot(ac, ap);
+  if (d1 <= 0 && d2 <= 0) {
+    s->Reduce({i0}, {1});
+    return;
+  }
+  glm::dvec3 bp = -b;
+  double d3 = glm::dot(ab, bp);
+  double d4 = glm::dot(ac, bp);
+  if (d3 >= 0 && d4 <= d3) {
+    s->Reduce({i1}, {1});
+    return;
+  }
+  double vc = d1 * d4 - d3 * d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    double v = d1 / (d1 - d3);
+    s->Reduce({i0, i1}, {1 - v, v});
+    return;
+  }
+  glm::dvec3 cp = -c;
+  double d5 = glm::dot(ab, cp);
+  double d6 = glm::dot(ac, cp);
+  if (d6 >= 0 && d5 <= d6) {
+    s->Reduce({i2}, {1});
+    return;
+  }
+  double vb = d5 * d2 - d1 * d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    double w = d2 / (d2 - d6);
+    s->Reduce({i0, i2}, {1 - w, w});
+    return;
+  }
+  double va = d3 * d6 - d5 * d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+    double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    s->Reduce({i1, i2}, {1 - w, w});
+    return;
+  }
+  double sum = va + vb + vc;
+  if (sum <= 0) {
+    // Degenerate triangle, the closest point is on one of the edges.
+    ClosestOnSegment(s, i0, i1);
+    return;
+  }
+  double v = vb / sum;
+  double w = vc / sum;
+  s->Reduce({i0, i1, i2}, {1 - v - w, v, w});
+}
+
+bool OriginOutsideOfPlane(const glm::dvec3& a,
+                          const glm::dvec3& b,
+                          const glm::dvec3& c,
+                          const glm::dvec3& d) {
+  glm::dvec3 n = glm::cross(b - a, c - a);
+  double sign_origin = glm::dot(-a, n);
+  double sign_d = glm::dot(d - a, n);
+  // A flat tetrahedron has no inside, treat the origin as outside of every face.
+  return sign_d == 0 || sign_origin * sign_d < 0;
+}
+
+// Returns true if the origin is inside the tetrahedron. Otherwise reduces to the closest face.
+bool ClosestOnTetrahedron(Simplex* s) {
+  const int kFaces[4][4] = {{0, 1, 2, 3}, {0, 2, 3, 1}, {0, 3, 1, 2}, {1, 3, 2, 0}};
+  bool inside = true;
+  double best_distance = std::numeric_limits<double>::max();
+  Simplex best;
+  for (const auto& f : kFaces) {
+    if (!OriginOutsideOfPlane(
+            s->vertices[f[0]].w, s->vertices[f[1]].w, s->vertices[f[2]].w, s->vertices[f[3]].w)) {
+      continue;
+    }
+    inside = false;
+    Simplex candidate = *s;
+    ClosestOnTriangle(&candidate, f[0], f[1], f[2]);
+    glm::dvec3 p = candidate.Point();
+    double distance = glm::dot(p, p);
+    if (distance < best_distance) {
+      best_distance = distance;
+      best = candidate;
+    }
+  }
+  if (!inside) {
+    *s = best;
+  }
+  return inside;
+}
+
+// Reduces the simplex to the sub simplex closest to the origin. Returns true if the simplex
+// contains the origin.
+bool ReduceSimplex(Simplex* s) {
+  switch (s->size) {
+    case 1:
+      s->weights[0] = 1;
+      return false;
+    case 2:
+      ClosestOnSegment(s, 0, 1);
+      return false;
+    case 3:
+      ClosestOnTriangle(s, 0, 1, 2);
+      return false;
+    default:
+      return ClosestOnTetrahedron(s);
+  }
+}
+
+std::vector<std::pair<int, int>> UniqueEdges(const Polytope& p) {
+  std::vector<std::pair<int, int>> edges;
+  std::unordered_set<int64_t> seen;
+  for (const auto& face : p.faces) {
+    for (int i = 0; i < 3; ++i) {
+      int u = std::min(face[i], face[(i + 1) % 3]);
+      int v = std::max(face[i], face[(i + 1) % 3]);
+      if (seen.insert(int64_t(u) * p.vertices.size() + v).second) {
+        edges.push_back({u, v});
+      }
+    }
+  }
+  return edges;
+}
+
+// Overlap of the projections of the two polytopes onto the axis.
+double ProjectedOverlap(const Polytope& a, const Polytope& b, const glm::dvec3& axis) {
+  double min_a = std::numeric_limits<double>::max();
+  double max_a = -min_a;
+  double min_b = min_a;
+  double max_b = -min_a;
+  for (const glm::dvec3& v : a.vertices) {
+    double d = glm::dot(v, axis);
+    min_a = std::min(min_a, d);
+    max_a = std::max(max_a, d);
+  }
+  for (const glm::dvec3& v : b.vertices) {
+    double d = glm::dot(v, axis);
+    min_b = std::min(min_b, d);
+    max_b = std::max(max_b, d);
+  }
+  return std::min(max_a - min_b, max_b - min_a);
+}
+
+}  // namespace
+
+glm::dvec3 Polytope::Support(const glm::dvec3& direction) const {
+  size_t best = 0;
+  double best_dot = -std::numeric_limits<double>::max();
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    double d = glm::dot(vertices[i], direction);
+    if (d > best_dot) {
+      best_dot = d;
+      best = i;
+    }
+  }
+  return vertices[best];
+}
+
+glm::dvec3 Polytope::Centroid() const {
+  glm::dvec3 sum(0);
+  for (const glm::dvec3& v : vertices) {
+    sum += v;
+  }
+  return vertices.empty() ? sum : sum / double(vertices.size());
+}
+
+glm::dvec3 Polytope::FaceNormal(size_t face) const {
+  const auto& f = faces[face];
+  return glm::normalize(
+      glm::cross(vertices[f[1]] - vertices[f[0]], vertices[f[2]] - vertices[f[0]]));
+}
+
+Polytope ConvexHull(const std::vector<glm::dvec3>& points) {
+  Polytope result;
+  if (points.size() < 4) {
+    result.vertices = points;
+    return result;
+  }
+
+  glm::dvec3 lo = points[0];
+  glm::dvec3 hi = points[0];
+  for (const glm::dvec3& p : points) {
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+  const double eps = 1e-9 * (1 + glm::length(hi - lo));
+
+  // Find a non degenerate starting tetrahedron.
+  size_t i0 = 0;
+  for (size_t i = 1; i < points.size(); ++i) {
+    if (points[i].x < points[i0].x) {
+      i0 = i;
+    }
+  }
+  size_t i1 = i0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (glm::length(points[i] - points[i0]) > glm::length(points[i1] - points[i0])) {
+      i1 = i;
+    }
+  }
+  if (glm::length(points[i1] - points[i0]) <= eps) {
+    result.vertices = {points[i0]};
+    return result;
+  }
+  size_t i2 = i0;
+  double best = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    double d = DistanceToLine(points[i], points[i0], points[i1]);
+    if (d > best) {
+      best = d;
+      i2 = i;
+    }
+  }
+  if (best <= eps) {
+    result.vertices = {points[i0], points[i1]};
+    return result;
+  }
+  HullFace base = MakeHullFace(points, i0, i1, i2);
+  size_t i3 = i0;
+  best = 0;
+  for (size_t i = 0; i < points.size(); ++i) {
+    double d = std::abs(glm::dot(base.normal, points[i]) - base.offset);
+    if (d > best) {
+      best = d;
+      i3 = i;
+    }
+  }
+  if (best <= eps) {
+    // Coplanar points. Keep them all so the support function is still exact.
+    result.vertices = points;
+    return result;
+  }
+
+  std::vector<HullFace> faces;
+  glm::dvec3 inside = (points[i0] + points[i1] + points[i2] + points[i3]) / 4.0;
+  for (auto f : std::vector<std::array<size_t, 3>>{{i0, i1, i2}, {i0, i3, i1}, {i1, i3, i2}, {i2, i3, i0}}) {
+    HullFace face = MakeHullFace(points, f[0], f[1], f[2]);
+    if (glm::dot(face.normal, inside) - face.offset > 0) {
+      face = MakeHullFace(points, f[0], f[2], f[1]);
+    }
+    faces.push_back(face);
+  }
+
+  std::unordered_set<int64_t> visible_edges;
+  const int64_t n = points.size();
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (i == i0 || i == i1 || i == i2 || i == i3) {
+      continue;
+    }
+    const glm::dvec3& p = points[i];
+    visible_edges.clear();
+    std::vector<size_t> visible;
+    for (size_t f = 0; f < faces.size(); ++f) {
+      if (faces[f].alive && glm::dot(faces[f].normal, p) - faces[f].offset > eps) {
+        visible.push_back(f);
+        visible_edges.insert(faces[f].a * n + faces[f].b);
+        visible_edges.insert(faces[f].b * n + faces[f].c);
+        visible_edges.insert(faces[f].c * n + faces[f].a);
+      }
+    }
+    if (visible.empty()) {
+      continue;
+    }
+    // The horizon is every edge of the visible region whose twin belongs to a hidden face.
+    std::vector<std::pair<int, int>> horizon;
+    for (size_t f : visible) {
+      const HullFace& face = faces[f];
+      for (auto edge : {std::make_pair(face.a, face.b),
+                        std::make_pair(face.b, face.c),
+                        std::make_pair(face.c, face.a)}) {
+        if (!visible_edges.count(edge.second * n + edge.first)) {
+          horizon.push_back(edge);
+        }
+      }
+      faces[f].alive = false;
+    }
+    for (const auto& edge : horizon) {
+      faces.push_back(MakeHullFace(points, edge.first, edge.second, i));
+    }
+  }
+
+  std::unordered_map<int, int> remap;
+  for (const HullFace& face : faces) {
+    if (!face.alive) {
+      continue;
+    }
+    std::array<int, 3> out;
+    int corners[3] = {face.a, face.b, face.c};
+    for (int k = 0; k < 3; ++k) {
+      auto it = remap.find(corners[k]);
+      if (it == remap.end()) {
+        it = remap.emplace(corners[k], int(result.vertices.size())).first;
+        result.vertices.push_back(points[corners[k]]);
+      }
+      out[k] = it->second;
+    }
+    result.faces.push_back(out);
+  }
+  return result;
+}
+
+DistanceResult GjkDistance(const Polytope& a, const Polytope& b) {
+  DistanceResult result;
+  if (a.empty() || b.empty()) {
+    result.distance = std::numeric_limits<double>::max();
+    return result;
+  }
+
+  Simplex simplex;
+  glm::dvec3 v = a.vertices[0] - b.vertices[0];
+  simplex.vertices[0] = {v, a.vertices[0], b.vertices[0]};
+  simplex.weights[0] = 1;
+  simplex.size = 1;
+
+  const int kMaxIterations = 64;
+  for (int iteration = 0; iteration < kMaxIterations; ++iteration) {
+    double v_length2 = glm::dot(v, v);
+    if (v_length2 < 1e-18) {
+      result.distance = 0;
+      return result;
+    }
+    glm::dvec3 support_a = a.Support(-v);
+    glm::dvec3 support_b = b.Support(v);
+    glm::dvec3 w = support_a - support_b;
+    // No further progress towards the origin is possible.
+    if (v_length2 - glm::dot(v, w) <= 1e-12 * v_length2) {
+      break;
+    }
+    bool duplicate = false;
+    for (int i = 0; i < simplex.size; ++i) {
+      duplicate |= simplex.vertices[i].w == w;
+    }
+    if (duplicate) {
+      break;
+    }
+    simplex.vertices[simplex.size++] = {w, support_a, support_b};
+    if (ReduceSimplex(&simplex)) {
+      result.distance = 0;
+      return result;
+    }
+    v = simplex.Point();
+  }
+
+  result.distance = glm::length(v);
+  result.point_a = glm::dvec3(0);
+  result.point_b = glm::dvec3(0);
+  for (int i = 0; i < simplex.size; ++i) {
+    result.point_a += simplex.weights[i] * simplex.vertices[i].a;
+    result.point_b += simplex.weights[i] * simplex.vertices[i].b;
+  }
+  return result;
+}
+
+double SatPenetrationDepth(const Polytope& a, const Polytope& b) {
+  std::vector<glm::dvec3> axes;
+  for (size_t i = 0; i < a.faces.size(); ++i) {
+    axes.push_back(a.FaceNormal(i));
+  }
+  for (size_t i = 0; i < b.faces.size(); ++i) {
+    axes.push_back(b.FaceNormal(i));
+  }
+  std::vector<std::pair<int, int>> edges_a = UniqueEdges(a);
+  std::vector<std::pair<int, int>> edges_b = UniqueEdges(b);
+  for (const auto& ea : edges_a) {
+    glm::dvec3 da = a.vertices[ea.second] - a.vertices[ea.first];
+    for (const auto& eb : edges_b) {
+      glm::dvec3 axis = glm::cross(da, b.vertices[eb.second] - b.vertices[eb.first]);
+      double length = glm::length(axis);
+      if (length > 1e-9) {
+        axes.push_back(axis / length);
+      }
+    }
+  }
+
+  double depth = std::numeric_limits<double>::max();
+  for (const glm::dvec3& axis : axes) {
+    double overlap = ProjectedOverlap(a, b, axis);
+    if (overlap <= 0) {
+      return 0;
+    }
+    depth = std::min(depth, overlap);
+  }
+  return axes.empty() ? 0 : depth;
+}
+
+DistanceResult Distance(const Polytope& a, const Polytope& b) {
+  DistanceResult result = GjkDistance(a, b);
+  if (result.distance > 0) {
+    return result;
+  }
+  result.distance = -SatPenetrationDepth(a, b);
+  result.point_a = a.Centroid();
+  result.point_b = b.Centroid();
+  return result;
+}
+
+}  // namespace scad
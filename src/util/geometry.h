@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace scad {
+
+// A convex polytope in world space. The vertices are the hull vertices and the faces are wound
+// counter clockwise when viewed from outside. Flat or degenerate inputs have no faces, but can
+// still be used in distance queries since those only need the support function.
+struct Polytope {
+  std::vector<glm::dvec3> vertices;
+  std::vector<std::array<int, 3>> faces;
+
+  bool empty() const {
+    return vertices.empty();
+  }
+
+  // The vertex furthest in the given direction.
+  glm::dvec3 Support(const glm::dvec3& direction) const;
+  glm::dvec3 Centroid() const;
+  glm::dvec3 FaceNormal(size_t face) const;
+};
+
+// Computes the convex hull of the points. Interior points are dropped.
+Polytope ConvexHull(const std::vector<glm::dvec3>& points);
+
+struct DistanceResult {
+  // Separation of the two polytopes. Negative values are the penetration depth when they overlap.
+  double distance = 0;
+  // Closest points on each polytope. Only meaningful when the polytopes are separated.
+  glm::dvec3 point_a;
+  glm::dvec3 point_b;
+
+  bool overlapping() const {
+    return distance <= 0;
+  }
+};
+
+// Distance between two convex polytopes. Separated polytopes use GJK. Overlapping ones fall back
+// to a separating axis search over face normals and edge pairs to estimate the penetration depth.
+DistanceResult Distance(const Polytope& a, const Polytope& b);
+
+// GJK only. Returns 0 for overlapping polytopes.
+DistanceResult GjkDistance(const Polytope& a, const Polytope& b);
+
+// The minimum translation distance along any face normal or edge cross product that separates
+// the two polytopes. Returns 0 if they are already separated along one of those axes.
+double SatPenetrationDepth(const Polytope& a, const Polytope& b);
+
+}  // namespace scad
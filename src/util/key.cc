@@ -6,6 +6,7 @@
 #include <vector>
 
 #include "scad.h"
+#include "trace.h"
 #include "transform.h"
 
 namespace scad {
@@ -38,67 +39,230 @@ Shape MakeCap(const std::vector<CapSegment>& segments) {
   return UnionAll(shapes).TranslateZ(-1 * height_so_far);
 }
 
+// The corners of each segment in MakeCap. The cap is the convex hull of these points.
+std::vector<glm::vec3> MakeCapPoints(const std::vector<CapSegment>& segments) {
+  double total_height = 0;
+  for (const CapSegment& segment : segments) {
+    total_height += segment.height;
+  }
+  std::vector<glm::vec3> points;
+  double z = -1 * total_height;
+  for (const CapSegment& segment : segments) {
+    double half_width = segment.width / 2;
+    points.push_back({half_width, half_width, z});
+    points.push_back({-half_width, half_width, z});
+    points.push_back({-half_width, -half_width, z});
+    points.push_back({half_width, -half_width, z});
+    z += segment.height;
+  }
+  return points;
+}
+
+std::vector<CapSegment> GetDsaCapSegments() {
+  return {
+      {kDsaHeight / 2, kDsaBottomSize},
+      {kDsaHeight / 2, kDsaHalfSize},
+      {0, kDsaTopSize},
+  };
+}
+
+std::vector<CapSegment> GetSaCapSegments() {
+  return {
+      {kSaHeight / 2, kDsaBottomSize},
+      {kSaHeight / 2, kSaHalfSize},
+      {0, kDsaTopSize},
+  };
+}
+
+std::vector<CapSegment> GetSaTallCapSegments() {
+  return {
+      {kSaTallHeight / 2, kDsaBottomSize},
+      {kSaTallHeight / 2, kSaHalfSize},
+      {0, kDsaTopSize},
+  };
+}
+
 // Expects the edge to be on the bottom.
-Shape RotateCapEdge(Shape s, SaEdgeType edge_type) {
+double GetRotateCapEdgeDegrees(SaEdgeType edge_type) {
   switch (edge_type) {
     case SaEdgeType::LEFT:
-      return s.RotateZ(-90);
+      return -90;
     case SaEdgeType::RIGHT:
-      return s.RotateZ(90);
+      return 90;
     case SaEdgeType::TOP:
-      return s.RotateZ(180);
+      return 180;
     case SaEdgeType::BOTTOM:
     default:
-      return s;
+      return 0;
+  }
+}
+
+Shape RotateCapEdge(Shape s, SaEdgeType edge_type) {
+  double degrees = GetRotateCapEdgeDegrees(edge_type);
+  return degrees == 0 ? s : s.RotateZ(degrees);
+}
+
+// Adds the corners of the bars which are hulled with the cap in MakeSaEdgeCap.
+std::vector<glm::vec3> AddCapEdgePoints(std::vector<glm::vec3> points,
+                                        double edge_height,
+                                        SaEdgeType edge_type) {
+  double half_top = kDsaTopSize * .5;
+  double half_bar = .01 / 2;
+  glm::vec3 bar_centers[] = {
+      {0, -1 * half_top, 0},
+      {0, -1 * half_top, edge_height},
+      {0, half_top, 0},
+  };
+  for (const glm::vec3& center : bar_centers) {
+    for (double x : {-1 * half_top, half_top}) {
+      for (double y : {-1 * half_bar, half_bar}) {
+        for (double z : {-1 * half_bar, half_bar}) {
+          points.push_back(center + glm::vec3(x, y, z));
+        }
+      }
+    }
+  }
+  Transform rotation = Transform::Rotation(0, 0, GetRotateCapEdgeDegrees(edge_type));
+  for (glm::vec3& p : points) {
+    p = rotation.Apply(p);
+  }
+  return points;
+}
+
+std::vector<glm::vec3> GetCapPoints(KeyType type, SaEdgeType edge_type) {
+  switch (type) {
+    case KeyType::SA:
+      return MakeCapPoints(GetSaCapSegments());
+    case KeyType::SA_EDGE:
+      return AddCapEdgePoints(
+          MakeCapPoints(GetSaCapSegments()), kSaEdgeHeight - kSaHeight, edge_type);
+    case KeyType::SA_TALL_EDGE:
+      return AddCapEdgePoints(
+          MakeCapPoints(GetSaTallCapSegments()), kSaTallEdgeHeight - kSaTallHeight, edge_type);
+    case KeyType::DSA:
+    default:
+      return MakeCapPoints(GetDsaCapSegments());
   }
 }
 
 }  // namespace
 
-Shape MakeSwitch(bool add_side_nub) {
+namespace {
+
+// Geometry which is the same for every key, worked out at compile time. Copies turned by a quarter
+// turn around z swap their coordinates exactly rather than going through a rotate().
+struct Box {
+  double size[3];
+  double center[3];
+};
+
+// Keeps -0 out of the scad.
+constexpr double Negate(double value) {
+  return value == 0 ? 0 : -value;
+}
+
+// Counter clockwise around z, seen from above.
+constexpr Box TurnQuarters(const Box& box, int quarters) {
+  Box result = box;
+  for (int i = 0; i < quarters; ++i) {
+    result = {{result.size[1], result.size[0], result.size[2]},
+              {Negate(result.center[1]), result.center[0], result.center[2]}};
+  }
+  return result;
+}
+
+// The side nub is the hull of a block in the wall and a cylinder lying along the wall.
+struct Nub {
+  Box block;
+  double cylinder_center[3];
+  double cylinder_rotation[3];
+};
+
+constexpr Nub TurnHalf(const Nub& nub) {
+  return {TurnQuarters(nub.block, 2),
+          {Negate(nub.cylinder_center[0]), Negate(nub.cylinder_center[1]), nub.cylinder_center[2]},
+          {nub.cylinder_rotation[0], nub.cylinder_rotation[1], nub.cylinder_rotation[2] + 180}};
+}
+
+// The top of the socket is at z 0.
+constexpr Box kTopWall = {{kSwitchWidth + kWallWidth * 2, kWallWidth, kSwitchThickness},
+                          {0, kWallWidth / 2 + kSwitchWidth / 2, kSwitchThickness / -2}};
+constexpr Box kSocketWalls[] = {
+    kTopWall,
+    TurnQuarters(kTopWall, 1),
+    TurnQuarters(kTopWall, 2),
+    TurnQuarters(kTopWall, 3),
+};
+
+constexpr double kNubHeight = 2.75;
+constexpr double kNubRadius = 1;
+constexpr double kNubFragments = 30;
+// The axis of the cylinder is 1 above the bottom of the socket.
+constexpr double kNubCenterZ = 1 - kSwitchThickness;
+constexpr Nub kRightNub = {{{kWallWidth, kNubHeight, kSwitchThickness},
+                            {kWallWidth / 2 + kSwitchWidth / 2, 0, kSwitchThickness / -2}},
+                           {kSwitchWidth / 2, 0, kNubCenterZ},
+                           {90, 0, 0}};
+constexpr Nub kSideNubs[] = {kRightNub, TurnHalf(kRightNub)};
+
+constexpr Box kPostConnector = {{.01, .01, 3.5}, {0, 0, 3.5 / -2.0}};
+
+Shape MakeBox(const Box& box) {
+  return Cube(box.size[0], box.size[1], box.size[2])
+      .Translate(box.center[0], box.center[1], box.center[2]);
+}
+
+Shape MakeNub(const Nub& nub) {
+  const double* center = nub.cylinder_center;
+  const double* rotation = nub.cylinder_rotation;
+  return Hull(MakeBox(nub.block),
+              Cylinder(kNubHeight, kNubRadius, kNubFragments)
+                  .Rotate(rotation[0], rotation[1], rotation[2])
+                  .Translate(center[0], center[1], center[2]));
+}
+
+Shape BuildSwitch(bool add_side_nub) {
   std::vector<Shape> shapes;
-  Shape top_wall = Cube(kSwitchWidth + kWallWidth * 2, kWallWidth, kSwitchThickness)
-                       .Translate(0, kWallWidth / 2 + kSwitchWidth / 2, kSwitchThickness / 2);
+  for (const Box& wall : kSocketWalls) {
+    shapes.push_back(MakeBox(wall));
+  }
+  if (add_side_nub) {
+    for (const Nub& nub : kSideNubs) {
+      shapes.push_back(MakeNub(nub));
+    }
+  }
+  return UnionAll(std::move(shapes));
+}
 
-  shapes.push_back(top_wall);
-  shapes.push_back(top_wall.RotateZ(90));
-  shapes.push_back(top_wall.RotateZ(180));
-  shapes.push_back(top_wall.RotateZ(270));
+}  // namespace
 
+// The statics skip the lock in InternShape after the first call.
+Shape MakeSwitch(bool add_side_nub) {
   if (add_side_nub) {
-    Shape side_nub =
-        Hull(Cube(kWallWidth, 2.75, kSwitchThickness)
-                 .Translate(kWallWidth / 2 + kSwitchWidth / 2, 0, kSwitchThickness / 2),
-             Cylinder(2.75, 1, 30).RotateX(90).Translate(kSwitchWidth / 2, 0, 1));
-    shapes.push_back(side_nub);
-    shapes.push_back(side_nub.RotateZ(180));
+    static const Shape& with_nub =
+        InternShape("switch with side nub", []() { return BuildSwitch(true); });
+    return with_nub;
   }
+  static const Shape& without_nub = InternShape("switch", []() { return BuildSwitch(false); });
+  return without_nub;
+}
 
-  return UnionAll(shapes).TranslateZ(kSwitchThickness * -1);
+Shape MakeSwitchBlock(double extra_z) {
+  double width = kSwitchWidth + kWallWidth * 2;
+  double height = kSwitchThickness + extra_z;
+  return Cube(width, width, height).TranslateZ(height / 2 - kSwitchThickness);
 }
 
 Shape MakeDsaCap() {
-  return MakeCap({
-      {kDsaHeight / 2, kDsaBottomSize},
-      {kDsaHeight / 2, kDsaHalfSize},
-      {0, kDsaTopSize},
-  });
+  return MakeCap(GetDsaCapSegments());
 }
 
 Shape MakeSaCap() {
-  return MakeCap({
-      {kSaHeight / 2, kDsaBottomSize},
-      {kSaHeight / 2, kSaHalfSize},
-      {0, kDsaTopSize},
-  });
+  return MakeCap(GetSaCapSegments());
 }
 
 Shape MakeSaTallCap() {
-  return MakeCap({
-      {kSaTallHeight / 2, kDsaBottomSize},
-      {kSaTallHeight / 2, kSaHalfSize},
-      {0, kDsaTopSize},
-  });
+  return MakeCap(GetSaTallCapSegments());
 }
 
 Shape MakeSaEdgeCap(SaEdgeType edge_type) {
@@ -170,20 +334,45 @@ Shape Key::GetInverseSwitch() const {
 }
 
 Shape Key::GetInverseCap(double custom_vertical_length) const {
+  glm::vec3 size = GetInverseCapSize(custom_vertical_length);
+  return GetInverseCapTransforms().Apply(Cube(size.x, size.y, size.z).TranslateZ(size.z / 2));
+}
+
+std::vector<glm::vec3> Key::GetInverseCapPoints(double custom_vertical_length) const {
+  glm::vec3 size = GetInverseCapSize(custom_vertical_length);
+  TransformList transforms = GetInverseCapTransforms();
+  std::vector<glm::vec3> points;
+  for (double x : {-0.5, 0.5}) {
+    for (double y : {-0.5, 0.5}) {
+      for (double z : {0.0, 1.0}) {
+        points.push_back(transforms.Apply(glm::vec3(x * size.x, y * size.y, z * size.z)));
+      }
+    }
+  }
+  return points;
+}
+
+glm::vec3 Key::GetInverseCapSize(double custom_vertical_length) const {
   double width = kDsaBottomSize + .1;
   double height = width;
   if (custom_vertical_length > 0) {
     height = custom_vertical_length;
   }
+  return glm::vec3(width, height, 30);
+}
+
+TransformList Key::GetInverseCapTransforms() const {
   TransformList transforms;
   transforms.AddTransform().z = extra_z;
-  transforms.Append(GetSwitchTransforms());
-  return transforms.Apply(Cube(width, height, 30).TranslateZ(15));
+  return transforms.Append(GetSwitchTransforms());
 }
 
 Shape Key::GetSwitch() const {
+  TRACE_SCOPE("Key::GetSwitch", name);
   std::vector<Shape> shapes;
-  if (extra_z > 0) {
+  if (simple_switch) {
+    shapes.push_back(GetSwitchTransforms().Apply(MakeSwitchBlock(extra_z)));
+  } else if (extra_z > 0) {
     Shape s = Union(MakeSwitch(false), MakeSwitch(add_side_nub).TranslateZ(extra_z));
     if (extra_z > 4) {
       s += MakeSwitch(false).TranslateZ(4);
@@ -220,6 +409,7 @@ Shape Key::GetSwitch() const {
 }
 
 Shape Key::GetCap(bool fill_in_cap_path) const {
+  TRACE_SCOPE("Key::GetCap", name);
   Shape cap;
   double cap_height = 0;
   switch (type) {
@@ -245,14 +435,27 @@ Shape Key::GetCap(bool fill_in_cap_path) const {
     cap = cap.Add(bottom);
   }
 
+  return GetCapTransforms().Apply(cap);
+}
+
+TransformList Key::GetCapTransforms() const {
   if (disable_switch_z_offset) {
     // Need to move the cap up since the transforms are measured at the switch top.
     double switch_z_offset = type == KeyType::DSA ? kDsaSwitchZOffset : kSaSwitchZOffset;
     TransformList transforms;
     transforms.AddTransform().z = switch_z_offset;
-    return transforms.Append(GetTransforms()).Apply(cap);
+    return transforms.Append(GetTransforms());
+  }
+  return GetTransforms();
+}
+
+std::vector<glm::vec3> Key::GetCapPoints() const {
+  TransformList transforms = GetCapTransforms();
+  std::vector<glm::vec3> points = scad::GetCapPoints(type, sa_edge_type);
+  for (glm::vec3& p : points) {
+    p = transforms.Apply(p);
   }
-  return GetTransforms().Apply(cap);
+  return points;
 }
 
 TransformList Key::GetTopRight(double offset) const {
@@ -313,7 +516,9 @@ std::vector<TransformList> Key::GetCorners(double offset) const {
 }
 
 Shape GetPostConnector() {
-  return Cube(.01, .01, 3.5).TranslateZ(3.5 / -2.0);
+  static const Shape& connector =
+      InternShape("post connector", []() { return MakeBox(kPostConnector); });
+  return connector;
 }
 
 Shape ConnectVertical(const Key& top, const Key& bottom, Shape connector, double offset) {
@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "scad.h"
 #include "transform.h"
@@ -11,28 +12,28 @@
 namespace scad {
 
 // All sizes in mm.
-const double kSwitchWidth = 14.4;
-const double kSwitchThickness = 4;
-const double kWallWidth = 2;
+constexpr double kSwitchWidth = 14.4;
+constexpr double kSwitchThickness = 4;
+constexpr double kWallWidth = 2;
 
-const double kDsaHeight = 8;
-const double kSaHeight = 12.5;
+constexpr double kDsaHeight = 8;
+constexpr double kSaHeight = 12.5;
 // This is the height of the taller side on the key. The short side has kSaHeight.
-const double kSaEdgeHeight = 13.7;
-const double kDsaTopSize = 13.2;     // 0.5 * kMmPerInch;
-const double kDsaBottomSize = 18.4;  // 0.725 * kMmPerInch;
+constexpr double kSaEdgeHeight = 13.7;
+constexpr double kDsaTopSize = 13.2;     // 0.5 * kMmPerInch;
+constexpr double kDsaBottomSize = 18.4;  // 0.725 * kMmPerInch;
 // The size half way up the key used to generate the cap shape.
-const double kDsaHalfSize = 16.2;
-const double kSaHalfSize = 17.2;
+constexpr double kDsaHalfSize = 16.2;
+constexpr double kSaHalfSize = 17.2;
 
 // Size for the tall sa edged key.
-const double kSaTallHeight = 14;
-const double kSaTallEdgeHeight = 16.5;
+constexpr double kSaTallHeight = 14;
+constexpr double kSaTallEdgeHeight = 16.5;
 
-const double kSwitchHorizontalOffset = kSwitchWidth / 2 + kWallWidth;
+constexpr double kSwitchHorizontalOffset = kSwitchWidth / 2 + kWallWidth;
 
 // This is the distance between the top of the switch plate and the tip of the switch stem.
-const double kSwitchTipOffset = 10;
+constexpr double kSwitchTipOffset = 10;
 
 enum class KeyType {
   DSA,
@@ -73,6 +74,9 @@ struct Key {
 
   bool add_side_nub = true;
   bool disable_switch_z_offset = false;
+  // Use a solid block with the outer size of the socket instead of the socket. Much faster to
+  // render when previewing.
+  bool simple_switch = false;
 
   KeyType type = KeyType::DSA;
   SaEdgeType sa_edge_type = SaEdgeType::BOTTOM;
@@ -102,6 +106,11 @@ struct Key {
   // passed to support cutting out for long keys like enter on the kinesis.
   Shape GetInverseCap(double custom_vertical_length = -1) const;
   Shape GetCap(bool fill_in_cap_path = false) const;
+  TransformList GetCapTransforms() const;
+
+  // World space points whose convex hull is the cap (GetCap) or the cap path (GetInverseCap).
+  std::vector<glm::vec3> GetCapPoints() const;
+  std::vector<glm::vec3> GetInverseCapPoints(double custom_vertical_length = -1) const;
 
   // This is the outermost conner of the switch. You can specify an offset to scale the point back
   // by the specified x,y amount towards the center of the switch. If you had a centered 2x2 post
@@ -124,6 +133,9 @@ struct Key {
   TransformList GetTopLeftInternal() const;
   TransformList GetBottomRightInternal() const;
   TransformList GetBottomLeftInternal() const;
+
+  glm::vec3 GetInverseCapSize(double custom_vertical_length) const;
+  TransformList GetInverseCapTransforms() const;
 };
 
 struct KeyGrid {
@@ -178,7 +190,7 @@ struct KeyGrid {
 
 // Used to connect key corners together. It is thin so it can have width issues when the two
 // connectors being hulled don't have a large projection on one another. (keys close together with
-// vertical separation)
+// vertical separation) Built once and shared, see InternShape.
 Shape GetPostConnector();
 
 Shape ConnectVertical(const Key& top,
@@ -223,6 +235,9 @@ Shape MakeDsaCap();
 Shape MakeSaCap();
 Shape MakeSaEdgeCap(SaEdgeType edge_type = SaEdgeType::BOTTOM);
 Shape MakeSaTallEdgeCap(SaEdgeType edge_type = SaEdgeType::BOTTOM);
+// Built once for each value of add_side_nub and shared.
 Shape MakeSwitch(bool add_side_nub = true);
+// A solid block with the outer size of MakeSwitch, extended up by extra_z.
+Shape MakeSwitchBlock(double extra_z = 0);
 
 }  // namespace scad
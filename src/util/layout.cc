@@ -0,0 +1,103 @@
+#include "layout.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "key.h"
+#include "transform.h"
+
+namespace scad {
+
+bool Layout::Load(const std::string& file_name) {
+  std::FILE* file = std::fopen(file_name.c_str(), "r");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open layout %s\n", file_name.c_str());
+    return false;
+  }
+  adjustments.clear();
+  char line[512];
+  int line_number = 0;
+  bool ok = true;
+  while (std::fgets(line, sizeof(line), file)) {
+    ++line_number;
+    char name[256];
+    KeyAdjustment adjustment;
+    Transform& t = adjustment.offset;
+    int read =
+        sscanf(line, " %255s %lf %lf %lf %lf %lf %lf", name, &t.x, &t.y, &t.z, &t.rx, &t.ry, &t.rz);
+    if (read <= 0 || name[0] == '#') {
+      continue;
+    }
+    if (read != 7) {
+      fprintf(stderr, "%s:%d: expected \"key x y z rx ry rz\"\n", file_name.c_str(), line_number);
+      ok = false;
+      continue;
+    }
+    adjustment.key_name = name;
+    adjustments.push_back(adjustment);
+  }
+  std::fclose(file);
+  return ok;
+}
+
+bool Layout::Save(const std::string& file_name) const {
+  std::FILE* file = std::fopen(file_name.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  fprintf(file, "# key x y z rx ry rz\n");
+  for (const KeyAdjustment& adjustment : adjustments) {
+    const Transform& t = adjustment.offset;
+    fprintf(file,
+            "%s %.3f %.3f %.3f %.3f %.3f %.3f\n",
+            adjustment.key_name.c_str(),
+            t.x,
+            t.y,
+            t.z,
+            t.rx,
+            t.ry,
+            t.rz);
+  }
+  std::fclose(file);
+  return true;
+}
+
+bool Layout::Apply(const std::vector<Key*>& keys) const {
+  bool ok = true;
+  for (const KeyAdjustment& adjustment : adjustments) {
+    Key* found = nullptr;
+    for (Key* key : keys) {
+      if (key->name == adjustment.key_name) {
+        found = key;
+      }
+    }
+    if (!found) {
+      fprintf(stderr, "Layout adjusts unknown key %s\n", adjustment.key_name.c_str());
+      ok = false;
+      continue;
+    }
+    found->local_transforms.AddTransformFront(adjustment.offset);
+  }
+  return ok;
+}
+
+bool operator==(const Layout& a, const Layout& b) {
+  if (a.adjustments.size() != b.adjustments.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.adjustments.size(); ++i) {
+    const KeyAdjustment& x = a.adjustments[i];
+    const KeyAdjustment& y = b.adjustments[i];
+    const Transform& s = x.offset;
+    const Transform& t = y.offset;
+    if (x.key_name != y.key_name || s.x != t.x || s.y != t.y || s.z != t.z || s.rx != t.rx ||
+        s.ry != t.ry || s.rz != t.rz) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace scad
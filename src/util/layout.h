@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "key.h"
+#include "transform.h"
+
+namespace scad {
+
+// An adjustment to a single key. The offset is applied in the key's own frame before any of its
+// existing transforms, so rotations are about the top of the switch. Keys which were parented to
+// the adjusted key are not moved.
+struct KeyAdjustment {
+  std::string key_name;
+  Transform offset;
+};
+
+// A set of key adjustments which can be saved and loaded from a text file. Each line has the form
+// "<key name> x y z rx ry rz". Lines starting with # are comments.
+struct Layout {
+  std::vector<KeyAdjustment> adjustments;
+
+  bool Load(const std::string& file_name);
+  bool Save(const std::string& file_name) const;
+
+  // Applies every adjustment to the key with the matching name. Returns false if a key can not
+  // be found.
+  bool Apply(const std::vector<Key*>& keys) const;
+};
+
+// Same keys with the same offsets in the same order.
+bool operator==(const Layout& a, const Layout& b);
+inline bool operator!=(const Layout& a, const Layout& b) {
+  return !(a == b);
+}
+
+}  // namespace scad
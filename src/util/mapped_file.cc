@@ -0,0 +1,106 @@
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define SCAD_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace scad {
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool MappedFile::Open(const std::string& file_name) {
+  Close();
+#ifdef SCAD_HAVE_MMAP
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    fprintf(stderr, "Could not read file %s\n", file_name.c_str());
+    return false;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    // Pipes and fifos have no size and can't be mapped or opened again, so read what is there.
+    bool ok = ReadAll(fd);
+    close(fd);
+    if (!ok) {
+      fprintf(stderr, "Could not read file %s\n", file_name.c_str());
+    }
+    return ok;
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      data_ = static_cast<const char*>(data);
+      mapped_ = true;
+    }
+  }
+  close(fd);
+  if (mapped_ || size_ == 0) {
+    return true;
+  }
+#endif
+  // No mmap, or it failed.
+  std::ifstream file(file_name, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  contents_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  data_ = contents_.data();
+  size_ = contents_.size();
+  return true;
+}
+
+#ifdef SCAD_HAVE_MMAP
+bool MappedFile::ReadAll(int fd) {
+  char buffer[1 << 16];
+  while (true) {
+    ssize_t read_bytes = read(fd, buffer, sizeof(buffer));
+    if (read_bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      contents_.clear();
+      return false;
+    }
+    if (read_bytes == 0) {
+      break;
+    }
+    contents_.append(buffer, read_bytes);
+  }
+  data_ = contents_.data();
+  size_ = contents_.size();
+  return true;
+}
+#endif
+
+void MappedFile::Close() {
+#ifdef SCAD_HAVE_MMAP
+  if (mapped_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = false;
+  contents_.clear();
+}
+
+}  // namespace scad
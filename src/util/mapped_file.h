@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace scad {
+
+// A whole file, read only. Mapped into memory where mmap is available so large files are parsed
+// in place without a copy, and read into memory elsewhere, or for pipes.
+class MappedFile {
+ public:
+  MappedFile() {
+  }
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns false if the file can't be read.
+  bool Open(const std::string& file_name);
+  void Close();
+
+  const char* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  // Reads fd to the end into contents_.
+  bool ReadAll(int fd);
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+  // Holds the file where it can't be mapped.
+  std::string contents_;
+};
+
+}  // namespace scad
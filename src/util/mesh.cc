@@ -0,0 +1,294 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <glm/glm.hpp>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "scad.h"
+#include "stl.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// The weld grid cell a corner falls in.
+struct Cell {
+  int64_t x;
+  int64_t y;
+  int64_t z;
+
+  bool operator==(const Cell& other) const {
+    return x == other.x && y == other.y && z == other.z;
+  }
+};
+
+struct CellHash {
+  size_t operator()(const Cell& cell) const {
+    uint64_t h = (uint64_t)cell.x * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)cell.y * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= (uint64_t)cell.z * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    return h;
+  }
+};
+
+// Welds the corners of triangle_count triangles, where get_corner(i) is corner i % 3 of triangle
+// i / 3. Each thread owns the cells whose hash falls in its bucket, so no locks are needed and
+// the vertex order only depends on jobs.
+Mesh WeldCorners(size_t triangle_count,
+                 const std::function<glm::vec3(size_t)>& get_corner,
+                 float weld_distance,
+                 int jobs) {
+  TRACE_SCOPE("WeldCorners");
+  size_t corner_count = triangle_count * 3;
+  std::vector<glm::vec3> positions(corner_count);
+  std::vector<Cell> cells(corner_count);
+  std::vector<size_t> hashes(corner_count);
+  double scale = weld_distance > 0 ? 1.0 / weld_distance : 1e6;
+  ParallelFor(corner_count, jobs, "mesh worker", [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i < end; ++i) {
+      positions[i] = get_corner(i);
+      cells[i] = {(int64_t)std::llround(positions[i].x * scale),
+                  (int64_t)std::llround(positions[i].y * scale),
+                  (int64_t)std::llround(positions[i].z * scale)};
+      hashes[i] = CellHash()(cells[i]);
+    }
+  });
+
+  int buckets = std::max(1, jobs);
+  std::vector<int> local_index(corner_count);
+  std::vector<std::vector<glm::vec3>> bucket_vertices(buckets);
+  ParallelFor(buckets, jobs, "mesh worker", [&](size_t begin, size_t end, int) {
+    for (size_t bucket = begin; bucket < end; ++bucket) {
+      std::unordered_map<Cell, int, CellHash> indices;
+      std::vector<glm::vec3>& vertices = bucket_vertices[bucket];
+      for (size_t i = 0; i < corner_count; ++i) {
+        if (hashes[i] % buckets != bucket) {
+          continue;
+        }
+        auto inserted = indices.emplace(cells[i], (int)vertices.size());
+        if (inserted.second) {
+          vertices.push_back(positions[i]);
+        }
+        local_index[i] = inserted.first->second;
+      }
+    }
+  });
+
+  Mesh mesh;
+  std::vector<int> offsets(buckets + 1, 0);
+  for (int bucket = 0; bucket < buckets; ++bucket) {
+    offsets[bucket + 1] = offsets[bucket] + bucket_vertices[bucket].size();
+    mesh.vertices.insert(
+        mesh.vertices.end(), bucket_vertices[bucket].begin(), bucket_vertices[bucket].end());
+  }
+  mesh.triangles.resize(triangle_count);
+  ParallelFor(triangle_count, jobs, "mesh worker", [&](size_t begin, size_t end, int) {
+    for (size_t t = begin; t < end; ++t) {
+      for (int j = 0; j < 3; ++j) {
+        size_t i = t * 3 + j;
+        mesh.triangles[t][j] = offsets[hashes[i] % buckets] + local_index[i];
+      }
+    }
+  });
+  return mesh;
+}
+
+// Both ends of an edge in one number, smallest index first so both directions match.
+uint64_t GetEdgeKey(int a, int b) {
+  if (a > b) {
+    std::swap(a, b);
+  }
+  return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+}
+
+}  // namespace
+
+Mesh WeldTriangles(const std::vector<StlTriangle>& triangles, int jobs, float weld_distance) {
+  return WeldCorners(
+      triangles.size(),
+      [&triangles](size_t i) { return triangles[i / 3].vertices[i % 3]; },
+      weld_distance,
+      jobs);
+}
+
+Mesh WeldMesh(const Mesh& mesh, int jobs, float weld_distance) {
+  return WeldCorners(
+      mesh.triangles.size(),
+      [&mesh](size_t i) { return mesh.vertices[mesh.triangles[i / 3][i % 3]]; },
+      weld_distance,
+      jobs);
+}
+
+bool ReadMesh(const std::string& file_name, Mesh* mesh, int jobs, float weld_distance) {
+  TRACE_SCOPE("ReadMesh", file_name);
+  MappedFile file;
+  if (!file.Open(file_name)) {
+    return false;
+  }
+  if (IsBinaryStl(file.data(), file.size())) {
+    const char* data = file.data();
+    *mesh = WeldCorners(
+        GetBinaryStlCount(data),
+        [data](size_t i) { return GetBinaryStlTriangle(data, i / 3).vertices[i % 3]; },
+        weld_distance,
+        jobs);
+    return true;
+  }
+  std::vector<StlTriangle> triangles;
+  if (!ParseStl(file.data(), file.size(), &triangles)) {
+    fprintf(stderr, "Could not parse %s\n", file_name.c_str());
+    return false;
+  }
+  *mesh = WeldTriangles(triangles, jobs, weld_distance);
+  return true;
+}
+
+std::vector<StlTriangle> GetStlTriangles(const Mesh& mesh) {
+  std::vector<StlTriangle> triangles(mesh.triangles.size());
+  for (size_t t = 0; t < mesh.triangles.size(); ++t) {
+    StlTriangle& triangle = triangles[t];
+    for (int j = 0; j < 3; ++j) {
+      triangle.vertices[j] = mesh.vertices[mesh.triangles[t][j]];
+    }
+    glm::vec3 normal = glm::cross(triangle.vertices[1] - triangle.vertices[0],
+                                  triangle.vertices[2] - triangle.vertices[0]);
+    float length = glm::length(normal);
+    triangle.normal = length > 0 ? normal / length : glm::vec3(0);
+  }
+  return triangles;
+}
+
+MeshStats GetMeshStats(const Mesh& mesh, int jobs) {
+  TRACE_SCOPE("GetMeshStats");
+  int parts = std::max(1, jobs);
+  std::vector<MeshStats> part_stats(parts);
+  std::vector<std::vector<uint64_t>> part_edges(parts);
+  ParallelFor(mesh.triangles.size(), jobs, "mesh worker", [&](size_t begin, size_t end, int part) {
+    MeshStats& stats = part_stats[part];
+    std::vector<uint64_t>& edges = part_edges[part];
+    edges.reserve((end - begin) * 3);
+    for (size_t t = begin; t < end; ++t) {
+      const std::array<int, 3>& triangle = mesh.triangles[t];
+      glm::dvec3 a = mesh.vertices[triangle[0]];
+      glm::dvec3 b = mesh.vertices[triangle[1]];
+      glm::dvec3 c = mesh.vertices[triangle[2]];
+      stats.bounds.Add(mesh.vertices[triangle[0]]);
+      stats.bounds.Add(mesh.vertices[triangle[1]]);
+      stats.bounds.Add(mesh.vertices[triangle[2]]);
+      stats.area += glm::length(glm::cross(b - a, c - a)) / 2;
+      stats.volume += glm::dot(a, glm::cross(b, c)) / 6;
+      if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0]) {
+        ++stats.degenerate_triangles;
+        continue;
+      }
+      for (int j = 0; j < 3; ++j) {
+        edges.push_back(GetEdgeKey(triangle[j], triangle[(j + 1) % 3]));
+      }
+    }
+  });
+
+  MeshStats stats;
+  stats.triangles = mesh.triangles.size();
+  stats.vertices = mesh.vertices.size();
+  std::vector<uint64_t> edges;
+  for (int part = 0; part < parts; ++part) {
+    const MeshStats& p = part_stats[part];
+    if (!p.bounds.empty()) {
+      stats.bounds.Add(p.bounds.min);
+      stats.bounds.Add(p.bounds.max);
+    }
+    stats.area += p.area;
+    stats.volume += p.volume;
+    stats.degenerate_triangles += p.degenerate_triangles;
+    edges.insert(edges.end(), part_edges[part].begin(), part_edges[part].end());
+  }
+  std::sort(edges.begin(), edges.end());
+  for (size_t i = 0; i < edges.size();) {
+    size_t j = i;
+    while (j < edges.size() && edges[j] == edges[i]) {
+      ++j;
+    }
+    if (j - i == 1) {
+      ++stats.boundary_edges;
+    } else if (j - i > 2) {
+      ++stats.non_manifold_edges;
+    }
+    i = j;
+  }
+  return stats;
+}
+
+void PrintMeshStats(const std::string& name, const MeshStats& stats, std::FILE* file) {
+  glm::vec3 size = stats.bounds.empty() ? glm::vec3(0) : stats.bounds.max - stats.bounds.min;
+  fprintf(file,
+          "%-24s %9ld triangles %9ld vertices %7.1f x %7.1f x %7.1f mm %12.1f mm2 %12.1f mm3",
+          name.c_str(),
+          stats.triangles,
+          stats.vertices,
+          size.x,
+          size.y,
+          size.z,
+          stats.area,
+          stats.volume);
+  if (stats.watertight()) {
+    fprintf(file, " watertight");
+  } else {
+    fprintf(file,
+            " %ld boundary edges %ld non-manifold edges",
+            stats.boundary_edges,
+            stats.non_manifold_edges);
+  }
+  if (stats.degenerate_triangles > 0) {
+    fprintf(file, " %ld degenerate", stats.degenerate_triangles);
+  }
+  fprintf(file, "\n");
+}
+
+Bounds GetImportBounds(const Shape& shape) {
+  const ShapeNode* node = shape.node();
+  if (node == nullptr || node->kind != ShapeKind::PRIMITIVE || node->op != "import") {
+    return {};
+  }
+  struct CachedBounds {
+    std::filesystem::file_time_type modified;
+    Bounds bounds;
+  };
+  static std::mutex mutex;
+  static std::map<std::string, CachedBounds> cache;
+
+  std::error_code error;
+  std::filesystem::file_time_type modified = std::filesystem::last_write_time(node->label, error);
+  if (error) {
+    return {};
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(node->label);
+    if (it != cache.end() && it->second.modified == modified) {
+      return it->second.bounds;
+    }
+  }
+  std::vector<StlTriangle> triangles;
+  if (!ReadStl(node->label, &triangles)) {
+    return {};
+  }
+  Bounds bounds = GetBounds(triangles);
+  std::lock_guard<std::mutex> lock(mutex);
+  cache[node->label] = {modified, bounds};
+  return bounds;
+}
+
+}  // namespace scad
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "scad.h"
+#include "stl.h"
+
+namespace scad {
+
+// An indexed triangle mesh. Triangles wind counter clockwise seen from outside.
+struct Mesh {
+  std::vector<glm::vec3> vertices;
+  std::vector<std::array<int, 3>> triangles;
+};
+
+struct MeshStats {
+  Bounds bounds;
+  long triangles = 0;
+  long vertices = 0;
+  double area = 0;
+  // Signed, negative if the triangles wind inwards. Only meaningful for a closed mesh.
+  double volume = 0;
+  // Triangles with two corners welded together.
+  long degenerate_triangles = 0;
+  // Edges used by only one triangle, i.e. holes.
+  long boundary_edges = 0;
+  // Edges shared by more than two triangles.
+  long non_manifold_edges = 0;
+
+  // Every edge is shared by exactly two triangles, which is what slicers and CGAL need.
+  bool watertight() const {
+    return triangles > 0 && boundary_edges == 0 && non_manifold_edges == 0;
+  }
+};
+
+// Merges corners which snap to the same point of a weld_distance grid so triangles which share a
+// corner share the index. The corners are split between jobs threads by position. OpenSCAD writes
+// shared corners identically, so the default only has to absorb float rounding; a larger one
+// collapses thin slivers.
+Mesh WeldTriangles(const std::vector<StlTriangle>& triangles,
+                   int jobs = 1,
+                   float weld_distance = 1e-6f);
+
+// Welds the vertices of a mesh again, e.g. with a larger weld_distance.
+Mesh WeldMesh(const Mesh& mesh, int jobs = 1, float weld_distance = 1e-6f);
+
+// Reads binary or ASCII STL into a welded mesh. The file is memory mapped and binary files are
+// read straight from the mapping by jobs threads.
+bool ReadMesh(const std::string& file_name,
+              Mesh* mesh,
+              int jobs = 1,
+              float weld_distance = 1e-6f);
+
+// The triangles with their normals, to write with WriteStl.
+std::vector<StlTriangle> GetStlTriangles(const Mesh& mesh);
+
+MeshStats GetMeshStats(const Mesh& mesh, int jobs = 1);
+void PrintMeshStats(const std::string& name, const MeshStats& stats, std::FILE* file);
+
+// The bounds of the file read by an Import shape. Empty if the shape isn't an Import or the file
+// can't be read. Files are only read again if they change.
+Bounds GetImportBounds(const Shape& shape);
+
+}  // namespace scad
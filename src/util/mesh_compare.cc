@@ -0,0 +1,113 @@
+#include "mesh_compare.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "mesh.h"
+#include "parallel.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+struct DirectedDistance {
+  float distance = 0;
+  glm::vec3 worst_point = glm::vec3(0);
+  long samples = 0;
+};
+
+// The furthest any sample of from is from to.
+DirectedDistance GetDirectedDistance(const Mesh& from,
+                                     const MeshBvh& to,
+                                     const MeshCompareOptions& options) {
+  std::vector<DirectedDistance> parts(std::max(1, options.jobs));
+  ParallelFor(from.triangles.size(), options.jobs, "compare worker", [&](size_t begin,
+                                                                          size_t end,
+                                                                          int part) {
+    DirectedDistance& result = parts[part];
+    for (size_t t = begin; t < end; ++t) {
+      glm::vec3 a = from.vertices[from.triangles[t][0]];
+      glm::vec3 ab = from.vertices[from.triangles[t][1]] - a;
+      glm::vec3 ac = from.vertices[from.triangles[t][2]] - a;
+      float longest = std::max({glm::length(ab), glm::length(ac), glm::length(ac - ab)});
+      int n = std::max(1, (int)std::ceil(longest / options.sample_spacing));
+      for (int i = 0; i <= n; ++i) {
+        for (int j = 0; i + j <= n; ++j) {
+          glm::vec3 p = a + ab * ((float)i / n) + ac * ((float)j / n);
+          ++result.samples;
+          // Most samples are within the tolerance, or closer than the worst so far, which the
+          // bounded search finds quickly. Only the others need a full search.
+          glm::vec3 closest;
+          if (!to.FindClosest(p, &closest, std::max(result.distance, options.max_distance)) &&
+              !to.FindClosest(p, &closest)) {
+            continue;
+          }
+          float distance = glm::length(closest - p);
+          if (distance > result.distance) {
+            result.distance = distance;
+            result.worst_point = p;
+          }
+        }
+      }
+    }
+  });
+  DirectedDistance result;
+  for (const DirectedDistance& part : parts) {
+    result.samples += part.samples;
+    if (part.distance > result.distance) {
+      result.distance = part.distance;
+      result.worst_point = part.worst_point;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+MeshCompareResult CompareMeshes(const Mesh& new_mesh,
+                                const Mesh& golden_mesh,
+                                const MeshCompareOptions& options) {
+  TRACE_SCOPE("CompareMeshes");
+  MeshCompareResult result;
+  MeshBvh new_bvh(new_mesh);
+  MeshBvh golden_bvh(golden_mesh);
+  DirectedDistance forward = GetDirectedDistance(new_mesh, golden_bvh, options);
+  DirectedDistance backward = GetDirectedDistance(golden_mesh, new_bvh, options);
+  result.new_to_golden = forward.distance;
+  result.golden_to_new = backward.distance;
+  result.worst_point =
+      forward.distance >= backward.distance ? forward.worst_point : backward.worst_point;
+  result.samples = forward.samples + backward.samples;
+  result.new_volume = GetMeshStats(new_mesh, options.jobs).volume;
+  result.golden_volume = GetMeshStats(golden_mesh, options.jobs).volume;
+  result.ok = !new_mesh.triangles.empty() && !golden_mesh.triangles.empty() &&
+              result.hausdorff_distance() <= options.max_distance &&
+              std::abs(result.volume_change()) <= options.max_volume_change;
+  return result;
+}
+
+void PrintMeshCompareResult(const std::string& name,
+                            const MeshCompareResult& result,
+                            std::FILE* file) {
+  fprintf(file,
+          "%-24s hausdorff %8.4f mm (new->golden %.4f, golden->new %.4f) at [%.2f, %.2f, %.2f] "
+          "volume %+.4f%% %9ld samples %s\n",
+          name.c_str(),
+          result.hausdorff_distance(),
+          result.new_to_golden,
+          result.golden_to_new,
+          result.worst_point.x,
+          result.worst_point.y,
+          result.worst_point.z,
+          100 * result.volume_change(),
+          result.samples,
+          result.ok ? "ok" : "CHANGED");
+}
+
+}  // namespace scad
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+
+#include "mesh.h"
+
+namespace scad {
+
+struct MeshCompareOptions {
+  // The largest distance between the surfaces which still counts as the same geometry, in mm.
+  float max_distance = 0.01f;
+  // The largest change in volume, as a fraction of the golden volume.
+  double max_volume_change = 0.001;
+  // Each triangle is sampled on a grid this fine, in addition to its corners.
+  float sample_spacing = 0.5f;
+  int jobs = 1;
+};
+
+struct MeshCompareResult {
+  // The furthest any sample of one mesh is from the other mesh, in both directions. The Hausdorff
+  // distance is the larger of the two.
+  float new_to_golden = 0;
+  float golden_to_new = 0;
+  // Where the largest distance was found.
+  glm::vec3 worst_point = glm::vec3(0);
+  double new_volume = 0;
+  double golden_volume = 0;
+  long samples = 0;
+  bool ok = false;
+
+  float hausdorff_distance() const {
+    return glm::max(new_to_golden, golden_to_new);
+  }
+  double volume_change() const {
+    return golden_volume != 0 ? (new_volume - golden_volume) / golden_volume : 0;
+  }
+};
+
+// Measures how far a new mesh is from a golden one. The samples of each mesh are checked against
+// a MeshBvh of the other, split over jobs threads.
+MeshCompareResult CompareMeshes(const Mesh& new_mesh,
+                                const Mesh& golden_mesh,
+                                const MeshCompareOptions& options);
+
+void PrintMeshCompareResult(const std::string& name,
+                            const MeshCompareResult& result,
+                            std::FILE* file);
+
+}  // namespace scad
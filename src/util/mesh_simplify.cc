@@ -0,0 +1,366 @@
+#include "mesh_simplify.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <iterator>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mesh.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// The sum of squared distances to a set of planes (Garland and Heckbert). Stored as the upper half
+// of the symmetric 4x4 matrix.
+struct Quadric {
+  double a[10] = {};
+
+  void AddPlane(const glm::dvec3& n, double d) {
+    double p[4] = {n.x, n.y, n.z, d};
+    int k = 0;
+    for (int i = 0; i < 4; ++i) {
+      for (int j = i; j < 4; ++j) {
+        a[k++] += p[i] * p[j];
+      }
+    }
+  }
+
+  void Add(const Quadric& other) {
+    for (int i = 0; i < 10; ++i) {
+      a[i] += other.a[i];
+    }
+  }
+
+  double Evaluate(const glm::dvec3& v) const {
+    double x = v.x, y = v.y, z = v.z;
+    return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x + a[4] * y * y +
+           2 * a[5] * y * z + 2 * a[6] * y + a[7] * z * z + 2 * a[8] * z + a[9];
+  }
+};
+
+// A collapse waiting in the queue. It is stale once either vertex has changed since.
+struct Candidate {
+  double cost;
+  int from;
+  int to;
+  int from_stamp;
+  int to_stamp;
+
+  bool operator>(const Candidate& other) const {
+    return cost > other.cost;
+  }
+};
+
+class Simplifier {
+ public:
+  Simplifier(const SimplifyOptions& options, Mesh* mesh) : options_(options), mesh_(mesh) {
+    size_t vertex_count = mesh->vertices.size();
+    quadrics_.resize(vertex_count);
+    vertex_faces_.resize(vertex_count);
+    locked_.resize(vertex_count, false);
+    stamps_.resize(vertex_count, 0);
+    removed_.resize(mesh->triangles.size(), false);
+
+    std::vector<std::pair<int, int>> edges;
+    for (size_t f = 0; f < mesh->triangles.size(); ++f) {
+      const std::array<int, 3>& t = mesh->triangles[f];
+      glm::dvec3 a = mesh->vertices[t[0]];
+      glm::dvec3 normal = GetNormal(t);
+      double length = glm::length(normal);
+      for (int j = 0; j < 3; ++j) {
+        vertex_faces_[t[j]].push_back(f);
+        edges.push_back(std::minmax(t[j], t[(j + 1) % 3]));
+        if (length > 0) {
+          quadrics_[t[j]].AddPlane(normal / length, -glm::dot(normal / length, a));
+        }
+      }
+    }
+    // Vertices on holes or non-manifold edges stay where they are.
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();) {
+      size_t j = i;
+      while (j < edges.size() && edges[j] == edges[i]) {
+        ++j;
+      }
+      if (j - i != 2) {
+        locked_[edges[i].first] = true;
+        locked_[edges[i].second] = true;
+      }
+      i = j;
+    }
+  }
+
+  void RemoveSlivers(SimplifyResult* result) {
+    TRACE_SCOPE("RemoveSlivers");
+    double max_error = std::max(options_.max_deviation, options_.sliver_height);
+    result->slivers = CountSlivers();
+    // Removing one sliver changes the faces around it, so go over them a few times.
+    for (int pass = 0; pass < 4; ++pass) {
+      long collapsed = 0;
+      for (size_t f = 0; f < mesh_->triangles.size(); ++f) {
+        if (removed_[f] || !IsSliver(mesh_->triangles[f])) {
+          continue;
+        }
+        const std::array<int, 3>& t = mesh_->triangles[f];
+        int shortest = 0;
+        for (int j = 1; j < 3; ++j) {
+          if (GetEdgeLength(t, j) < GetEdgeLength(t, shortest)) {
+            shortest = j;
+          }
+        }
+        int a = t[shortest];
+        int b = t[(shortest + 1) % 3];
+        if (GetCost(a, b) > GetCost(b, a)) {
+          std::swap(a, b);
+        }
+        if (TryCollapse(a, b, max_error) || TryCollapse(b, a, max_error)) {
+          ++collapsed;
+        }
+      }
+      result->collapsed_edges += collapsed;
+      if (collapsed == 0) {
+        break;
+      }
+    }
+    result->remaining_slivers = CountSlivers();
+  }
+
+  // Collapses the cheapest edges first until every remaining collapse would move the surface
+  // further than max_deviation.
+  void Decimate(SimplifyResult* result) {
+    TRACE_SCOPE("Decimate");
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+    for (size_t f = 0; f < mesh_->triangles.size(); ++f) {
+      if (removed_[f]) {
+        continue;
+      }
+      const std::array<int, 3>& t = mesh_->triangles[f];
+      for (int j = 0; j < 3; ++j) {
+        Push(t[j], t[(j + 1) % 3], &queue);
+        Push(t[(j + 1) % 3], t[j], &queue);
+      }
+    }
+    double max_error = options_.max_deviation;
+    while (!queue.empty()) {
+      Candidate candidate = queue.top();
+      queue.pop();
+      if (candidate.cost > max_error * max_error) {
+        break;
+      }
+      if (stamps_[candidate.from] != candidate.from_stamp ||
+          stamps_[candidate.to] != candidate.to_stamp) {
+        continue;
+      }
+      if (!TryCollapse(candidate.from, candidate.to, max_error)) {
+        continue;
+      }
+      ++result->collapsed_edges;
+      for (int neighbour : GetNeighbours(candidate.to)) {
+        Push(candidate.to, neighbour, &queue);
+        Push(neighbour, candidate.to, &queue);
+      }
+    }
+  }
+
+  // Drops the removed faces and unused vertices.
+  void Compact() {
+    std::vector<int> indices(mesh_->vertices.size(), -1);
+    Mesh compact;
+    for (size_t f = 0; f < mesh_->triangles.size(); ++f) {
+      if (removed_[f]) {
+        continue;
+      }
+      std::array<int, 3> t = mesh_->triangles[f];
+      for (int& v : t) {
+        if (indices[v] < 0) {
+          indices[v] = compact.vertices.size();
+          compact.vertices.push_back(mesh_->vertices[v]);
+        }
+        v = indices[v];
+      }
+      compact.triangles.push_back(t);
+    }
+    *mesh_ = std::move(compact);
+  }
+
+ private:
+  glm::dvec3 GetNormal(const std::array<int, 3>& t) const {
+    glm::dvec3 a = mesh_->vertices[t[0]];
+    glm::dvec3 b = mesh_->vertices[t[1]];
+    glm::dvec3 c = mesh_->vertices[t[2]];
+    return glm::cross(b - a, c - a);
+  }
+
+  double GetEdgeLength(const std::array<int, 3>& t, int j) const {
+    return glm::length(mesh_->vertices[t[j]] - mesh_->vertices[t[(j + 1) % 3]]);
+  }
+
+  bool IsSliver(const std::array<int, 3>& t) const {
+    double longest = std::max({GetEdgeLength(t, 0), GetEdgeLength(t, 1), GetEdgeLength(t, 2)});
+    return longest > 0 && glm::length(GetNormal(t)) / longest < options_.sliver_height;
+  }
+
+  long CountSlivers() const {
+    long slivers = 0;
+    for (size_t f = 0; f < mesh_->triangles.size(); ++f) {
+      if (!removed_[f] && IsSliver(mesh_->triangles[f])) {
+        ++slivers;
+      }
+    }
+    return slivers;
+  }
+
+  // The squared distance from the planes around both vertices if from is moved onto to.
+  double GetCost(int from, int to) const {
+    Quadric quadric = quadrics_[from];
+    quadric.Add(quadrics_[to]);
+    return std::max(0.0, quadric.Evaluate(mesh_->vertices[to]));
+  }
+
+  std::vector<int> GetNeighbours(int vertex) const {
+    std::vector<int> neighbours;
+    for (int f : vertex_faces_[vertex]) {
+      for (int v : mesh_->triangles[f]) {
+        if (v != vertex) {
+          neighbours.push_back(v);
+        }
+      }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    return neighbours;
+  }
+
+  void Push(int from,
+            int to,
+            std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>>* queue) {
+    if (!locked_[from]) {
+      queue->push({GetCost(from, to), from, to, stamps_[from], stamps_[to]});
+    }
+  }
+
+  bool TryCollapse(int from, int to, double max_error) {
+    if (from == to || locked_[from] || GetCost(from, to) > max_error * max_error) {
+      return false;
+    }
+    // The edge must be shared by exactly two faces, and the vertices may only have the two
+    // opposite corners of those faces as common neighbours, or the mesh would pinch.
+    std::vector<int> opposite;
+    for (int f : vertex_faces_[from]) {
+      const std::array<int, 3>& t = mesh_->triangles[f];
+      if (std::find(t.begin(), t.end(), to) != t.end()) {
+        for (int v : t) {
+          if (v != from && v != to) {
+            opposite.push_back(v);
+          }
+        }
+      }
+    }
+    if (opposite.size() != 2 || opposite[0] == opposite[1]) {
+      return false;
+    }
+    std::sort(opposite.begin(), opposite.end());
+    std::vector<int> from_neighbours = GetNeighbours(from);
+    std::vector<int> to_neighbours = GetNeighbours(to);
+    std::vector<int> common;
+    std::set_intersection(from_neighbours.begin(),
+                          from_neighbours.end(),
+                          to_neighbours.begin(),
+                          to_neighbours.end(),
+                          std::back_inserter(common));
+    if (common != opposite) {
+      return false;
+    }
+
+    // None of the faces which stay may flip over or become a new sliver.
+    for (int f : vertex_faces_[from]) {
+      std::array<int, 3> t = mesh_->triangles[f];
+      if (std::find(t.begin(), t.end(), to) != t.end()) {
+        continue;
+      }
+      glm::dvec3 old_normal = GetNormal(t);
+      bool was_sliver = IsSliver(t);
+      std::replace(t.begin(), t.end(), from, to);
+      glm::dvec3 new_normal = GetNormal(t);
+      if (glm::dot(old_normal, new_normal) <= 0 || (!was_sliver && IsSliver(t))) {
+        return false;
+      }
+    }
+
+    for (int f : vertex_faces_[from]) {
+      std::array<int, 3>& t = mesh_->triangles[f];
+      if (std::find(t.begin(), t.end(), to) != t.end()) {
+        removed_[f] = true;
+        for (int v : t) {
+          if (v != from) {
+            std::vector<int>& faces = vertex_faces_[v];
+            faces.erase(std::remove(faces.begin(), faces.end(), f), faces.end());
+          }
+        }
+      } else {
+        std::replace(t.begin(), t.end(), from, to);
+        vertex_faces_[to].push_back(f);
+      }
+    }
+    vertex_faces_[from].clear();
+    quadrics_[to].Add(quadrics_[from]);
+    ++stamps_[from];
+    ++stamps_[to];
+    return true;
+  }
+
+  const SimplifyOptions& options_;
+  Mesh* mesh_;
+  std::vector<Quadric> quadrics_;
+  std::vector<std::vector<int>> vertex_faces_;
+  std::vector<bool> locked_;
+  std::vector<int> stamps_;
+  std::vector<bool> removed_;
+};
+
+}  // namespace
+
+SimplifyResult SimplifyMesh(const SimplifyOptions& options, Mesh* mesh) {
+  TRACE_SCOPE("SimplifyMesh");
+  SimplifyResult result;
+  result.input_triangles = mesh->triangles.size();
+  *mesh = WeldMesh(*mesh, options.jobs, options.weld_distance);
+
+  auto is_degenerate = [](const std::array<int, 3>& t) {
+    return t[0] == t[1] || t[1] == t[2] || t[2] == t[0];
+  };
+  auto end = std::remove_if(mesh->triangles.begin(), mesh->triangles.end(), is_degenerate);
+  result.degenerate_triangles = mesh->triangles.end() - end;
+  mesh->triangles.erase(end, mesh->triangles.end());
+
+  Simplifier simplifier(options, mesh);
+  simplifier.RemoveSlivers(&result);
+  if (options.max_deviation > 0) {
+    simplifier.Decimate(&result);
+  }
+  simplifier.Compact();
+  result.output_triangles = mesh->triangles.size();
+  return result;
+}
+
+void PrintSimplifyResult(const std::string& name, const SimplifyResult& result, std::FILE* file) {
+  fprintf(file,
+          "%-24s %9ld -> %9ld triangles (%.0f%%), %ld degenerate, %ld of %ld slivers removed, "
+          "%ld edges collapsed\n",
+          name.c_str(),
+          result.input_triangles,
+          result.output_triangles,
+          result.input_triangles > 0 ? 100.0 * result.output_triangles / result.input_triangles : 0,
+          result.degenerate_triangles,
+          result.slivers - result.remaining_slivers,
+          result.slivers,
+          result.collapsed_edges);
+}
+
+}  // namespace scad
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+#include "mesh.h"
+
+namespace scad {
+
+// Shrinks rendered meshes. Hulling the 0.01 mm post connectors and the small wall markers leaves
+// OpenSCAD output full of sliver triangles and flat regions split into many faces, which make the
+// stl big and slow to slice.
+struct SimplifyOptions {
+  // Vertices closer than this are merged first.
+  float weld_distance = 1e-3f;
+  // Faces less than this high (twice the area over the longest edge) are slivers, and are removed
+  // by collapsing their shortest edge. The default catches the faces left by the post connectors.
+  // Removing a sliver may move the surface by up to the larger of this and max_deviation.
+  float sliver_height = 0.02f;
+  // Otherwise no collapse may move the surface further than this from any of the original faces
+  // around it, so mostly coplanar faces are merged. 0 only removes slivers.
+  float max_deviation = 0.01f;
+  int jobs = 1;
+};
+
+struct SimplifyResult {
+  long input_triangles = 0;
+  long output_triangles = 0;
+  // Triangles with two corners welded together, which are dropped.
+  long degenerate_triangles = 0;
+  long slivers = 0;
+  // Slivers left because removing them would move the surface too far or break the mesh.
+  long remaining_slivers = 0;
+  // Edges collapsed, each one removing two triangles.
+  long collapsed_edges = 0;
+};
+
+// Edges are collapsed onto one of their vertices, so no new points are made, and only if the mesh
+// stays manifold and no face flips over. Vertices on holes are kept where they are.
+SimplifyResult SimplifyMesh(const SimplifyOptions& options, Mesh* mesh);
+
+void PrintSimplifyResult(const std::string& name, const SimplifyResult& result, std::FILE* file);
+
+}  // namespace scad
@@ -0,0 +1,302 @@
+#include "minkowski.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+
+#include "geometry.h"
+#include "parallel.h"
+#include "scad.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+using Matrix = glm::dmat4;
+
+void AddCircle(double r,
+               double z,
+               long fragments,
+               const Matrix& matrix,
+               std::vector<glm::dvec3>* points) {
+  if (r == 0) {
+    points->push_back(glm::dvec3(matrix * glm::dvec4(0, 0, z, 1)));
+    return;
+  }
+  for (long i = 0; i < fragments; ++i) {
+    double angle = glm::radians(360.0 * i / fragments);
+    glm::dvec4 point(r * std::cos(angle), r * std::sin(angle), z, 1);
+    points->push_back(glm::dvec3(matrix * point));
+  }
+}
+
+// The vertices OpenSCAD tessellates the primitive into.
+bool AddPrimitivePoints(const ShapeNode& node,
+                        const Matrix& matrix,
+                        std::vector<glm::dvec3>* points) {
+  const double* p = node.params;
+  if (node.op == "cube" && node.write_params) {
+    if (p[0] <= 0 || p[1] <= 0 || p[2] <= 0) {
+      return false;
+    }
+    glm::dvec3 size(p[0], p[1], p[2]);
+    glm::dvec3 start = p[3] != 0 ? -size / 2.0 : glm::dvec3(0);
+    for (int i = 0; i < 8; ++i) {
+      glm::dvec3 corner = start + size * glm::dvec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+      points->push_back(glm::dvec3(matrix * glm::dvec4(corner, 1)));
+    }
+    return true;
+  }
+  if (node.op == "sphere" && node.write_params) {
+    double r = p[0];
+    if (r <= 0) {
+      return false;
+    }
+    long fragments =
+        GetFragments(r, GetOptionalParam(p[2]), GetOptionalParam(p[3]), GetOptionalParam(p[1]));
+    long rings = (fragments + 1) / 2;
+    for (long i = 0; i < rings; ++i) {
+      double phi = glm::radians(180.0 * (i + 0.5) / rings);
+      AddCircle(r * std::sin(phi), r * std::cos(phi), fragments, matrix, points);
+    }
+    return true;
+  }
+  if (node.op == "cylinder" && node.write_params) {
+    double h = p[0];
+    double r1 = p[1];
+    double r2 = p[2];
+    if (h <= 0 || r1 < 0 || r2 < 0 || (r1 == 0 && r2 == 0)) {
+      return false;
+    }
+    long fragments = GetFragments(std::max(r1, r2), GetOptionalParam(p[4]));
+    double z = p[3] != 0 ? -h / 2 : 0;
+    AddCircle(r1, z, fragments, matrix, points);
+    AddCircle(r2, z + h, fragments, matrix, points);
+    return true;
+  }
+  if (node.op == "circle" && node.write_params) {
+    double r = p[0];
+    if (r <= 0) {
+      return false;
+    }
+    long fragments =
+        GetFragments(r, GetOptionalParam(p[2]), GetOptionalParam(p[3]), GetOptionalParam(p[1]));
+    AddCircle(r, 0, fragments, matrix, points);
+    return true;
+  }
+  if (node.op == "square" && node.write_params) {
+    if (p[0] <= 0 || p[1] <= 0) {
+      return false;
+    }
+    glm::dvec2 size(p[0], p[1]);
+    glm::dvec2 start = p[2] != 0 ? -size / 2.0 : glm::dvec2(0);
+    for (int i = 0; i < 4; ++i) {
+      glm::dvec2 corner = start + size * glm::dvec2(i & 1, (i >> 1) & 1);
+      points->push_back(glm::dvec3(matrix * glm::dvec4(corner, 0, 1)));
+    }
+    return true;
+  }
+  return false;
+}
+
+bool AddConvexPoints(const ShapeNode& node,
+                     const Matrix& matrix,
+                     bool in_hull,
+                     std::vector<glm::dvec3>* points);
+
+// projection() and linear_extrude() without twist, of a convex shape. The 2D points are read in
+// the child's own space and flattened before the matrix is applied.
+bool AddFlatPoints(const ShapeNode& node,
+                   const Matrix& matrix,
+                   bool in_hull,
+                   std::vector<glm::dvec3>* points) {
+  const double* p = node.params;
+  bool is_projection = node.op == "projection" && p[0] == 0;
+  bool is_extrude = node.op == "linear_extrude" && p[0] > 0 && p[2] == 0;
+  if (!node.write_params || (!is_projection && !is_extrude) || node.children.empty()) {
+    return false;
+  }
+  std::vector<glm::dvec3> flat;
+  for (const Shape& child : node.children) {
+    if (!child.node() || !AddConvexPoints(*child.node(), Matrix(1), in_hull, &flat)) {
+      return false;
+    }
+  }
+  if (is_projection) {
+    for (const glm::dvec3& v : flat) {
+      points->push_back(glm::dvec3(matrix * glm::dvec4(v.x, v.y, 0, 1)));
+    }
+    return true;
+  }
+  double z = p[1] != 0 ? -p[0] / 2 : 0;
+  double scale = p[4];
+  for (const glm::dvec3& v : flat) {
+    points->push_back(glm::dvec3(matrix * glm::dvec4(v.x, v.y, z, 1)));
+    points->push_back(glm::dvec3(matrix * glm::dvec4(v.x * scale, v.y * scale, z + p[0], 1)));
+  }
+  return true;
+}
+
+// Unions only count inside a hull, where they make no difference.
+bool AddConvexPoints(const ShapeNode& node,
+                     const Matrix& matrix,
+                     bool in_hull,
+                     std::vector<glm::dvec3>* points) {
+  if (node.kind == ShapeKind::PRIMITIVE) {
+    return AddPrimitivePoints(node, matrix, points);
+  }
+  Matrix child_matrix = matrix;
+  Matrix transform;
+  if (GetNodeTransform(node, &transform)) {
+    if (!in_hull && node.children.size() != 1) {
+      return false;
+    }
+    child_matrix = matrix * transform;
+  } else if (node.op == "hull") {
+    in_hull = true;
+  } else if (node.op == "projection" || node.op == "linear_extrude") {
+    return AddFlatPoints(node, matrix, in_hull, points);
+  } else if (node.op != "union" || !in_hull) {
+    return false;
+  }
+  for (const Shape& child : node.children) {
+    if (!child.node() || !AddConvexPoints(*child.node(), child_matrix, in_hull, points)) {
+      return false;
+    }
+  }
+  return !node.children.empty();
+}
+
+// Splits the shape into convex pieces, moving transforms down to them.
+bool AddConvexPieces(const ShapeNode& node,
+                     const Matrix& matrix,
+                     std::vector<std::vector<glm::dvec3>>* pieces) {
+  Matrix transform;
+  bool is_transform = GetNodeTransform(node, &transform);
+  if (is_transform || (node.kind == ShapeKind::COMPOSITE && node.op == "union")) {
+    Matrix child_matrix = is_transform ? matrix * transform : matrix;
+    for (const Shape& child : node.children) {
+      if (!child.node() || !AddConvexPieces(*child.node(), child_matrix, pieces)) {
+        return false;
+      }
+    }
+    return !node.children.empty();
+  }
+  std::vector<glm::dvec3> points;
+  if (!AddConvexPoints(node, matrix, false, &points)) {
+    return false;
+  }
+  pieces->push_back(std::move(points));
+  return true;
+}
+
+bool GetConvexHulls(const Shape& shape, std::vector<Polytope>* hulls) {
+  std::vector<std::vector<glm::dvec3>> pieces;
+  if (!GetConvexPieces(shape, &pieces)) {
+    return false;
+  }
+  for (const std::vector<glm::dvec3>& piece : pieces) {
+    hulls->push_back(ConvexHull(piece));
+    // Flat pieces have no faces.
+    if (hulls->back().faces.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool GetNodeTransform(const ShapeNode& node, Matrix* matrix) {
+  *matrix = Matrix(1);
+  if (node.kind == ShapeKind::COMMENT || node.kind == ShapeKind::TAG) {
+    return true;
+  }
+  if (node.kind != ShapeKind::COMPOSITE) {
+    return false;
+  }
+  const double* p = node.params;
+  if (node.op == "translate") {
+    *matrix = glm::translate(Matrix(1), glm::dvec3(p[0], p[1], p[2]));
+  } else if (node.op == "rotate" && IsAxisRotation(node)) {
+    glm::dvec3 axis(p[1], p[2], p[3]);
+    if (glm::length(axis) == 0) {
+      axis = glm::dvec3(0, 0, 1);
+    }
+    *matrix = glm::rotate(Matrix(1), glm::radians(p[0]), glm::normalize(axis));
+  } else if (node.op == "rotate") {
+    // Around x, then y, then z.
+    *matrix = glm::rotate(Matrix(1), glm::radians(p[2]), glm::dvec3(0, 0, 1));
+    *matrix = glm::rotate(*matrix, glm::radians(p[1]), glm::dvec3(0, 1, 0));
+    *matrix = glm::rotate(*matrix, glm::radians(p[0]), glm::dvec3(1, 0, 0));
+  } else if (node.op == "mirror") {
+    glm::dvec3 normal(p[0], p[1], p[2]);
+    if (glm::length(normal) > 0) {
+      normal = glm::normalize(normal);
+      *matrix = Matrix(glm::dmat3(1) - 2.0 * glm::outerProduct(normal, normal));
+    }
+  } else if (node.op == "scale") {
+    *matrix = glm::scale(Matrix(1), glm::dvec3(p[0], p[1], p[2]));
+  } else if (node.op != "color") {
+    return false;
+  }
+  return true;
+}
+
+bool GetConvexPoints(const Shape& shape, std::vector<glm::dvec3>* points) {
+  return shape.node() && AddConvexPoints(*shape.node(), Matrix(1), false, points);
+}
+
+bool GetConvexPieces(const Shape& shape, std::vector<std::vector<glm::dvec3>>* pieces) {
+  return shape.node() && AddConvexPieces(*shape.node(), Matrix(1), pieces);
+}
+
+Shape MinkowskiSum(const Shape& first, const Shape& second, int jobs) {
+  TRACE_SCOPE("MinkowskiSum");
+  std::vector<Polytope> first_hulls;
+  std::vector<Polytope> second_hulls;
+  if (!GetConvexHulls(first, &first_hulls) || !GetConvexHulls(second, &second_hulls)) {
+    return Minkowski(first, second);
+  }
+
+  size_t count = first_hulls.size() * second_hulls.size();
+  std::vector<Polytope> sums(count);
+  ParallelFor(count, jobs, "minkowski worker", [&](size_t begin, size_t end, int) {
+    std::vector<glm::dvec3> points;
+    for (size_t i = begin; i < end; ++i) {
+      const Polytope& a = first_hulls[i / second_hulls.size()];
+      const Polytope& b = second_hulls[i % second_hulls.size()];
+      points.clear();
+      for (const glm::dvec3& u : a.vertices) {
+        for (const glm::dvec3& v : b.vertices) {
+          points.push_back(u + v);
+        }
+      }
+      sums[i] = ConvexHull(points);
+    }
+  });
+
+  // Shapes are only made on the calling thread.
+  std::vector<Shape> shapes;
+  for (const Polytope& sum : sums) {
+    std::vector<Point3d> points;
+    for (const glm::dvec3& v : sum.vertices) {
+      points.push_back({v.x, v.y, v.z});
+    }
+    // The hull faces are counter clockwise from outside, OpenSCAD wants them clockwise.
+    std::vector<std::vector<int>> faces;
+    for (const std::array<int, 3>& face : sum.faces) {
+      faces.push_back({face[0], face[2], face[1]});
+    }
+    shapes.push_back(Polyhedron(std::move(points), std::move(faces)));
+  }
+  if (shapes.size() == 1) {
+    return shapes[0];
+  }
+  return UnionAll(std::move(shapes));
+}
+
+}  // namespace scad
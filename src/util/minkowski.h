@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+// The transform of a translate, rotate, mirror or scale node. Colors and labels are the identity.
+// False for any other node.
+bool GetNodeTransform(const ShapeNode& node, glm::dmat4* matrix);
+
+// The points whose convex hull is the shape, with the same tessellation as OpenSCAD, or false if
+// the shape isn't convex or can't be read. Cubes, spheres, cylinders and hulls of those count, as
+// do transforms, colors and labels of a single convex shape. Circles, squares and projections of
+// convex shapes are read as flat pieces, and linear_extrude without twist of those too.
+bool GetConvexPoints(const Shape& shape, std::vector<glm::dvec3>* points);
+
+// Splits a union of convex shapes into the points of each piece, with the transforms above them
+// applied. False if any piece can't be read.
+bool GetConvexPieces(const Shape& shape, std::vector<std::vector<glm::dvec3>>* pieces);
+
+// minkowski() computed here rather than by OpenSCAD, which takes hours on the case. The sum of two
+// convex shapes is the hull of the sums of their points, written as a polyhedron. Unions are split
+// into their convex pieces, since the sum distributes over them, and the pieces are summed on jobs
+// threads. Anything else is left to OpenSCAD with Minkowski().
+Shape MinkowskiSum(const Shape& first, const Shape& second, int jobs = 1);
+
+}  // namespace scad
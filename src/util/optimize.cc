@@ -0,0 +1,144 @@
+#include "optimize.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+struct Vertex {
+  std::vector<double> x;
+  double value;
+};
+
+std::vector<double> Blend(const std::vector<double>& a, const std::vector<double>& b, double t) {
+  std::vector<double> result(a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    result[i] = a[i] + t * (b[i] - a[i]);
+  }
+  return result;
+}
+
+}  // namespace
+
+OptimizeResult NelderMead(const Objective& f,
+                          const std::vector<double>& x0,
+                          const std::vector<double>& steps,
+                          const NelderMeadOptions& options) {
+  const size_t n = x0.size();
+  int evaluations = 0;
+  auto evaluate = [&](const std::vector<double>& x) {
+    ++evaluations;
+    return Vertex{x, f(x)};
+  };
+
+  std::vector<Vertex> simplex;
+  simplex.push_back(evaluate(x0));
+  for (size_t i = 0; i < n; ++i) {
+    std::vector<double> x = x0;
+    x[i] += steps[i];
+    simplex.push_back(evaluate(x));
+  }
+
+  auto by_value = [](const Vertex& a, const Vertex& b) { return a.value < b.value; };
+  while (evaluations < options.max_evaluations) {
+    std::sort(simplex.begin(), simplex.end(), by_value);
+    if (std::abs(simplex.back().value - simplex.front().value) <= options.tolerance) {
+      break;
+    }
+
+    std::vector<double> centroid(n, 0);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        centroid[j] += simplex[i].x[j] / n;
+      }
+    }
+
+    Vertex& worst = simplex.back();
+    Vertex reflected = evaluate(Blend(centroid, worst.x, -1));
+    if (reflected.value < simplex.front().value) {
+      Vertex expanded = evaluate(Blend(centroid, worst.x, -2));
+      worst = expanded.value < reflected.value ? expanded : reflected;
+    } else if (reflected.value < simplex[n - 1].value) {
+      worst = reflected;
+    } else {
+      bool outside = reflected.value < worst.value;
+      Vertex contracted = evaluate(Blend(centroid, outside ? reflected.x : worst.x, 0.5));
+      if (contracted.value < std::min(reflected.value, worst.value)) {
+        worst = contracted;
+      } else {
+        // Shrink everything towards the best vertex.
+        for (size_t i = 1; i <= n; ++i) {
+          simplex[i] = evaluate(Blend(simplex[0].x, simplex[i].x, 0.5));
+        }
+      }
+    }
+  }
+
+  std::sort(simplex.begin(), simplex.end(), by_value);
+  OptimizeResult result;
+  result.x = simplex.front().x;
+  result.value = simplex.front().value;
+  result.evaluations = evaluations;
+  return result;
+}
+
+OptimizeResult MultiStartNelderMead(const Objective& f,
+                                    const std::vector<double>& x0,
+                                    const std::vector<double>& steps,
+                                    const MultiStartOptions& options) {
+  std::vector<std::vector<double>> starts = {x0};
+  std::mt19937 rng(options.seed);
+  std::uniform_real_distribution<double> offset(-1, 1);
+  for (int s = 1; s < options.starts; ++s) {
+    std::vector<double> x = x0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      x[i] += offset(rng) * steps[i];
+    }
+    starts.push_back(x);
+  }
+
+  int num_threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+  num_threads = std::max(1, std::min(num_threads, (int)starts.size()));
+
+  std::vector<OptimizeResult> results(starts.size());
+  std::atomic<size_t> next_start(0);
+  auto worker = [&]() {
+    for (size_t s = next_start++; s < starts.size(); s = next_start++) {
+      TRACE_SCOPE("NelderMead", "start " + std::to_string(s));
+      results[s] = NelderMead(f, starts[s], steps, options.nelder_mead);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; ++t) {
+    threads.emplace_back([&worker, t]() {
+      SetTraceThreadName("optimizer worker " + std::to_string(t));
+      worker();
+    });
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  OptimizeResult best = results[0];
+  int evaluations = 0;
+  for (const OptimizeResult& result : results) {
+    evaluations += result.evaluations;
+    if (result.value < best.value) {
+      best = result;
+    }
+  }
+  best.evaluations = evaluations;
+  return best;
+}
+
+}  // namespace scad
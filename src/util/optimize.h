@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+namespace scad {
+
+// A function to minimize. Must be safe to call from several threads at once.
+using Objective = std::function<double(const std::vector<double>& x)>;
+
+struct NelderMeadOptions {
+  int max_evaluations = 2000;
+  // Stop once the spread of values across the simplex drops below this.
+  double tolerance = 1e-7;
+};
+
+struct OptimizeResult {
+  std::vector<double> x;
+  double value = 0;
+  int evaluations = 0;
+};
+
+// Derivative free minimization. steps is the size of the initial simplex along each axis.
+OptimizeResult NelderMead(const Objective& f,
+                          const std::vector<double>& x0,
+                          const std::vector<double>& steps,
+                          const NelderMeadOptions& options = {});
+
+struct MultiStartOptions {
+  NelderMeadOptions nelder_mead;
+  // Number of independent searches. The first one starts at x0, the rest at random points within
+  // one step of x0.
+  int starts = 8;
+  // 0 uses the number of hardware threads.
+  int threads = 0;
+  unsigned int seed = 1;
+};
+
+// Runs several Nelder-Mead searches in parallel and returns the best result.
+OptimizeResult MultiStartNelderMead(const Objective& f,
+                                    const std::vector<double>& x0,
+                                    const std::vector<double>& steps,
+                                    const MultiStartOptions& options = {});
+
+}  // namespace scad
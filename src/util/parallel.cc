@@ -0,0 +1,30 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+namespace scad {
+
+void ParallelFor(size_t count,
+                 int jobs,
+                 const std::string& name,
+                 const std::function<void(size_t begin, size_t end, int part)>& fn) {
+  int parts = std::max<int>(1, std::min<size_t>(std::max(jobs, 1), count));
+  std::vector<std::thread> threads;
+  for (int part = 1; part < parts; ++part) {
+    threads.emplace_back([&fn, &name, count, parts, part]() {
+      SetTraceThreadName(name + " " + std::to_string(part));
+      fn(count * part / parts, count * (part + 1) / parts, part);
+    });
+  }
+  fn(0, count / parts, 0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace scad
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace scad {
+
+// Calls fn(begin, end, part) for up to jobs contiguous parts of [0, count), each on its own thread
+// (the first on the calling thread), and waits for them all. Threads are named "<name> <part>" in
+// traces. Parts are numbered from 0 so fn can keep per part results without locking.
+void ParallelFor(size_t count,
+                 int jobs,
+                 const std::string& name,
+                 const std::function<void(size_t begin, size_t end, int part)>& fn);
+
+}  // namespace scad
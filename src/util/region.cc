@@ -0,0 +1,1192 @@
+#include "region.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "minkowski.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// Booleans are computed on a grid of this size in mm so the orientation tests are exact and points
+// reached from different edges are equal.
+constexpr double kGrid = 1e-5;
+// Snapping crossings to the grid can make new ones, so edges are split again up to this many times.
+constexpr int kMaxSplitPasses = 8;
+
+struct GridPoint {
+  int64_t x = 0;
+  int64_t y = 0;
+
+  bool operator==(const GridPoint& other) const {
+    return x == other.x && y == other.y;
+  }
+  bool operator!=(const GridPoint& other) const {
+    return !(*this == other);
+  }
+  // Bottom to top, then left to right.
+  bool operator<(const GridPoint& other) const {
+    return y != other.y ? y < other.y : x < other.x;
+  }
+};
+
+GridPoint ToGrid(const glm::dvec2& p) {
+  return {std::llround(p.x / kGrid), std::llround(p.y / kGrid)};
+}
+
+glm::dvec2 FromGrid(const GridPoint& p) {
+  return glm::dvec2(p.x * kGrid, p.y * kGrid);
+}
+
+// Twice the signed area of o, a, b. Positive if they turn counter clockwise.
+int64_t Cross(const GridPoint& o, const GridPoint& a, const GridPoint& b) {
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+int64_t Dot(const GridPoint& o, const GridPoint& a, const GridPoint& b) {
+  return (a.x - o.x) * (b.x - o.x) + (a.y - o.y) * (b.y - o.y);
+}
+
+double Length(const GridPoint& a, const GridPoint& b) {
+  return std::hypot((double)(b.x - a.x), (double)(b.y - a.y));
+}
+
+// An edge of the input. operand is 0 for the first regions and 1 for the second.
+struct Segment {
+  GridPoint a;
+  GridPoint b;
+  int operand = 0;
+};
+
+// Whether p is within a grid step of the inside of s, given cross = Cross(s.a, s.b, p).
+bool IsOnSegment(const Segment& s, const GridPoint& p, int64_t cross) {
+  if (p == s.a || p == s.b || Dot(s.a, s.b, p) <= 0 || Dot(s.b, s.a, p) <= 0) {
+    return false;
+  }
+  // The distance from the line is cross over the length of s.
+  return (double)cross * (double)cross <= (double)Dot(s.a, s.b, s.b);
+}
+
+bool HaveOppositeSigns(int64_t a, int64_t b) {
+  return (a > 0 && b < 0) || (a < 0 && b > 0);
+}
+
+// Adds the points where s and t touch or cross to their splits. Returns false if there are none.
+bool AddSplits(const Segment& s,
+               const Segment& t,
+               std::vector<GridPoint>* s_splits,
+               std::vector<GridPoint>* t_splits) {
+  int64_t d1 = Cross(s.a, s.b, t.a);
+  int64_t d2 = Cross(s.a, s.b, t.b);
+  int64_t d3 = Cross(t.a, t.b, s.a);
+  int64_t d4 = Cross(t.a, t.b, s.b);
+  bool found = false;
+  if (IsOnSegment(s, t.a, d1)) {
+    s_splits->push_back(t.a);
+    found = true;
+  }
+  if (IsOnSegment(s, t.b, d2)) {
+    s_splits->push_back(t.b);
+    found = true;
+  }
+  if (IsOnSegment(t, s.a, d3)) {
+    t_splits->push_back(s.a);
+    found = true;
+  }
+  if (IsOnSegment(t, s.b, d4)) {
+    t_splits->push_back(s.b);
+    found = true;
+  }
+  if (found) {
+    return true;
+  }
+  if (!HaveOppositeSigns(d1, d2) || !HaveOppositeSigns(d3, d4)) {
+    return false;
+  }
+  double f = (double)d3 / (double)(d3 - d4);
+  GridPoint p = {std::llround(s.a.x + (s.b.x - s.a.x) * f),
+                 std::llround(s.a.y + (s.b.y - s.a.y) * f)};
+  if (p != s.a && p != s.b) {
+    s_splits->push_back(p);
+    found = true;
+  }
+  if (p != t.a && p != t.b) {
+    t_splits->push_back(p);
+    found = true;
+  }
+  return found;
+}
+
+// The bounds of the segments, grown by a grid step, bucketed in a uniform grid with about as many
+// cells as segments.
+class SegmentGrid {
+ public:
+  explicit SegmentGrid(const std::vector<Segment>& segments) {
+    lo_ = {std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::max()};
+    GridPoint hi = {std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::min()};
+    bounds_.reserve(segments.size());
+    for (const Segment& s : segments) {
+      Bounds b = {{std::min(s.a.x, s.b.x) - 1, std::min(s.a.y, s.b.y) - 1},
+                  {std::max(s.a.x, s.b.x) + 1, std::max(s.a.y, s.b.y) + 1}};
+      lo_ = {std::min(lo_.x, b.lo.x), std::min(lo_.y, b.lo.y)};
+      hi = {std::max(hi.x, b.hi.x), std::max(hi.y, b.hi.y)};
+      bounds_.push_back(b);
+    }
+    if (segments.empty()) {
+      return;
+    }
+    int64_t cells_per_side =
+        std::max<int64_t>(1, std::sqrt(static_cast<double>(segments.size())));
+    cell_size_ = std::max(hi.x - lo_.x, hi.y - lo_.y) / cells_per_side + 1;
+    columns_ = Column(hi.x) + 1;
+
+    // Counted first so every cell is a range of one array.
+    starts_.assign(columns_ * (Row(hi.y) + 1) + 1, 0);
+    for (const Bounds& b : bounds_) {
+      ForEachCell(b, [&](size_t cell) { ++starts_[cell + 1]; });
+    }
+    std::partial_sum(starts_.begin(), starts_.end(), starts_.begin());
+    entries_.resize(starts_.back());
+    std::vector<size_t> next(starts_.begin(), starts_.end() - 1);
+    for (size_t i = 0; i < bounds_.size(); ++i) {
+      ForEachCell(bounds_[i], [&](size_t cell) { entries_[next[cell]++] = i; });
+    }
+  }
+
+  // Calls f(j) once for every other segment whose bounds overlap those of segment i. A pair is
+  // only reported by the cell holding the low corner of where their bounds overlap.
+  template <typename F>
+  void ForEachNearby(size_t i, F f) const {
+    const Bounds& s = bounds_[i];
+    ForEachCell(s, [&](size_t cell) {
+      for (size_t k = starts_[cell]; k < starts_[cell + 1]; ++k) {
+        size_t j = entries_[k];
+        const Bounds& t = bounds_[j];
+        if (j == i || s.hi.x < t.lo.x || t.hi.x < s.lo.x || s.hi.y < t.lo.y || t.hi.y < s.lo.y) {
+          continue;
+        }
+        int64_t x = std::max(s.lo.x, t.lo.x);
+        int64_t y = std::max(s.lo.y, t.lo.y);
+        if (static_cast<size_t>(Row(y) * columns_ + Column(x)) == cell) {
+          f(j);
+        }
+      }
+    });
+  }
+
+ private:
+  struct Bounds {
+    GridPoint lo;
+    GridPoint hi;
+  };
+
+  int64_t Column(int64_t x) const {
+    return (x - lo_.x) / cell_size_;
+  }
+  int64_t Row(int64_t y) const {
+    return (y - lo_.y) / cell_size_;
+  }
+
+  template <typename F>
+  void ForEachCell(const Bounds& b, F f) const {
+    for (int64_t y = Row(b.lo.y); y <= Row(b.hi.y); ++y) {
+      for (int64_t x = Column(b.lo.x); x <= Column(b.hi.x); ++x) {
+        f(static_cast<size_t>(y * columns_ + x));
+      }
+    }
+  }
+
+  GridPoint lo_;
+  int64_t cell_size_ = 1;
+  int64_t columns_ = 1;
+  std::vector<Bounds> bounds_;
+  std::vector<size_t> starts_;
+  std::vector<size_t> entries_;
+};
+
+// Splits the segments wherever they touch or cross so they only meet at their ends. Returns false
+// if snapping still made new crossings after kMaxSplitPasses, since the sweep needs them gone.
+bool SplitSegments(std::vector<Segment>* segments) {
+  // Segments which weren't split by the last pass have already been tested against each other.
+  std::vector<bool> changed(segments->size(), true);
+  for (int pass = 0; pass < kMaxSplitPasses; ++pass) {
+    std::vector<std::vector<GridPoint>> splits(segments->size());
+    bool found = false;
+    SegmentGrid grid(*segments);
+    for (size_t i = 0; i < segments->size(); ++i) {
+      if (!changed[i]) {
+        continue;
+      }
+      grid.ForEachNearby(i, [&](size_t j) {
+        // Pairs which both changed are tested from the first one.
+        if (!changed[j] || j > i) {
+          found |= AddSplits((*segments)[i], (*segments)[j], &splits[i], &splits[j]);
+        }
+      });
+    }
+    if (!found) {
+      return true;
+    }
+
+    std::vector<Segment> split_segments;
+    std::vector<bool> split_changed;
+    for (size_t i = 0; i < segments->size(); ++i) {
+      const Segment& s = (*segments)[i];
+      std::vector<GridPoint>& points = splits[i];
+      std::sort(points.begin(), points.end(), [&](const GridPoint& p, const GridPoint& q) {
+        return Dot(s.a, s.b, p) < Dot(s.a, s.b, q);
+      });
+      points.erase(std::unique(points.begin(), points.end()), points.end());
+      GridPoint start = s.a;
+      for (const GridPoint& p : points) {
+        if (p != start) {
+          split_segments.push_back({start, p, s.operand});
+          start = p;
+        }
+      }
+      if (s.b != start) {
+        split_segments.push_back({start, s.b, s.operand});
+      }
+      split_changed.resize(split_segments.size(), !points.empty());
+    }
+    *segments = std::move(split_segments);
+    changed = std::move(split_changed);
+  }
+  return false;
+}
+
+// A split segment running up, or right if it is horizontal. Every input segment on it adds its
+// direction to count: 1 if it runs the same way, -1 otherwise.
+struct SweepEdge {
+  GridPoint lo;
+  GridPoint hi;
+  std::array<int, 2> count = {0, 0};
+
+  bool horizontal() const {
+    return lo.y == hi.y;
+  }
+  double XAt(double y) const {
+    if (horizontal()) {
+      return lo.x;
+    }
+    return lo.x + (double)(hi.x - lo.x) * (y - lo.y) / (double)(hi.y - lo.y);
+  }
+};
+
+std::vector<SweepEdge> MergeSegments(const std::vector<Segment>& segments) {
+  std::vector<std::pair<std::pair<GridPoint, GridPoint>, size_t>> keys;
+  keys.reserve(segments.size());
+  for (size_t i = 0; i < segments.size(); ++i) {
+    const Segment& s = segments[i];
+    keys.push_back({s.a < s.b ? std::make_pair(s.a, s.b) : std::make_pair(s.b, s.a), i});
+  }
+  std::sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+    return a.first.first != b.first.first ? a.first.first < b.first.first
+                                          : a.first.second < b.first.second;
+  });
+  std::vector<SweepEdge> edges;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const Segment& s = segments[keys[i].second];
+    if (i == 0 || keys[i].first.first != keys[i - 1].first.first ||
+        keys[i].first.second != keys[i - 1].first.second) {
+      edges.push_back({keys[i].first.first, keys[i].first.second});
+    }
+    edges.back().count[s.operand] += s.a == edges.back().lo ? 1 : -1;
+  }
+  edges.erase(std::remove_if(edges.begin(),
+                             edges.end(),
+                             [](const SweepEdge& e) { return e.count[0] == 0 && e.count[1] == 0; }),
+              edges.end());
+  return edges;
+}
+
+bool IsInside(const std::array<int, 2>& winding, RegionOp op) {
+  switch (op) {
+    case RegionOp::UNION:
+      return winding[0] != 0 || winding[1] != 0;
+    case RegionOp::DIFFERENCE:
+      return winding[0] != 0 && winding[1] == 0;
+    case RegionOp::INTERSECTION:
+      return winding[0] != 0 && winding[1] != 0;
+  }
+  return false;
+}
+
+// The edges between inside and outside, directed with the inside on the left. Sweeps the slabs
+// between the distinct y of the edges. Within a slab no edges cross, so sorting them by x gives
+// the winding numbers on either side of each.
+std::vector<std::pair<GridPoint, GridPoint>> GetBoundary(const std::vector<SweepEdge>& edges,
+                                                         RegionOp op) {
+  std::vector<int64_t> ys;
+  std::vector<size_t> sloped;
+  std::vector<size_t> horizontal;
+  for (size_t i = 0; i < edges.size(); ++i) {
+    ys.push_back(edges[i].lo.y);
+    ys.push_back(edges[i].hi.y);
+    (edges[i].horizontal() ? horizontal : sloped).push_back(i);
+  }
+  std::sort(ys.begin(), ys.end());
+  ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+  std::sort(sloped.begin(), sloped.end(), [&](size_t i, size_t j) {
+    return edges[i].lo.y < edges[j].lo.y;
+  });
+  std::sort(horizontal.begin(), horizontal.end(), [&](size_t i, size_t j) {
+    return edges[i].lo.y < edges[j].lo.y;
+  });
+
+  std::vector<std::pair<GridPoint, GridPoint>> boundary;
+  auto add = [&](const SweepEdge& e, bool inside_left, bool inside_right) {
+    if (inside_left != inside_right) {
+      boundary.push_back(inside_left ? std::make_pair(e.lo, e.hi) : std::make_pair(e.hi, e.lo));
+    }
+  };
+
+  // Left to right in the current slab, with the winding numbers left of each.
+  std::vector<size_t> active;
+  std::vector<std::array<int, 2>> prefix = {{0, 0}};
+  auto winding_at = [&](double x, double y) {
+    auto it = std::partition_point(
+        active.begin(), active.end(), [&](size_t i) { return edges[i].XAt(y) < x; });
+    return prefix[it - active.begin()];
+  };
+
+  size_t next_sloped = 0;
+  size_t next_horizontal = 0;
+  std::vector<std::array<int, 2>> below;
+  for (size_t k = 0; k < ys.size(); ++k) {
+    double y = ys[k];
+    size_t horizontal_begin = next_horizontal;
+    while (next_horizontal < horizontal.size() &&
+           edges[horizontal[next_horizontal]].lo.y == ys[k]) {
+      ++next_horizontal;
+    }
+    below.clear();
+    for (size_t h = horizontal_begin; h < next_horizontal; ++h) {
+      const SweepEdge& e = edges[horizontal[h]];
+      below.push_back(winding_at(0.5 * (e.lo.x + e.hi.x), y));
+    }
+
+    active.erase(std::remove_if(active.begin(),
+                                active.end(),
+                                [&](size_t i) { return edges[i].hi.y <= ys[k]; }),
+                 active.end());
+    if (k + 1 < ys.size()) {
+      double mid_y = 0.5 * (ys[k] + ys[k + 1]);
+      for (; next_sloped < sloped.size() && edges[sloped[next_sloped]].lo.y == ys[k];
+           ++next_sloped) {
+        double x = edges[sloped[next_sloped]].XAt(mid_y);
+        auto it = std::partition_point(
+            active.begin(), active.end(), [&](size_t i) { return edges[i].XAt(mid_y) < x; });
+        active.insert(it, sloped[next_sloped]);
+      }
+      prefix.resize(active.size() + 1);
+      for (size_t i = 0; i < active.size(); ++i) {
+        const SweepEdge& e = edges[active[i]];
+        prefix[i + 1] = {prefix[i][0] - e.count[0], prefix[i][1] - e.count[1]};
+        if (e.lo.y == ys[k]) {
+          add(e, IsInside(prefix[i], op), IsInside(prefix[i + 1], op));
+        }
+      }
+    } else {
+      active.clear();
+      prefix.assign(1, {0, 0});
+    }
+
+    for (size_t h = horizontal_begin; h < next_horizontal; ++h) {
+      const SweepEdge& e = edges[horizontal[h]];
+      std::array<int, 2> above = winding_at(0.5 * (e.lo.x + e.hi.x), y);
+      add(e, IsInside(above, op), IsInside(below[h - horizontal_begin], op));
+    }
+  }
+  return boundary;
+}
+
+// The angle turning clockwise from from to to, in (0, 2 pi].
+double GetClockwiseAngle(const GridPoint& from, const GridPoint& to) {
+  double angle =
+      std::atan2((double)from.y, (double)from.x) - std::atan2((double)to.y, (double)to.x);
+  while (angle <= 0) {
+    angle += 2 * M_PI;
+  }
+  return angle;
+}
+
+// Removes points in line with their neighbours, to within a grid step.
+std::vector<GridPoint> RemoveCollinearPoints(std::vector<GridPoint> contour) {
+  bool removed = true;
+  while (removed && contour.size() >= 3) {
+    removed = false;
+    std::vector<GridPoint> kept;
+    size_t n = contour.size();
+    for (size_t i = 0; i < n; ++i) {
+      const GridPoint& prev = kept.empty() ? contour[n - 1] : kept.back();
+      const GridPoint& p = contour[i];
+      const GridPoint& next = contour[(i + 1) % n];
+      bool collinear = Dot(p, prev, next) < 0 &&
+                       std::abs((double)Cross(prev, p, next)) <= Length(prev, next);
+      if (collinear || p == prev) {
+        removed = true;
+      } else {
+        kept.push_back(p);
+      }
+    }
+    contour = std::move(kept);
+  }
+  return contour;
+}
+
+// Joins the boundary edges into contours. Where several leave the same point the sharpest left
+// turn is taken, so regions which touch at a point get a contour each.
+Region JoinBoundary(std::vector<std::pair<GridPoint, GridPoint>> boundary) {
+  std::sort(boundary.begin(), boundary.end());
+  std::vector<bool> used(boundary.size(), false);
+  Region region;
+  for (size_t first = 0; first < boundary.size(); ++first) {
+    if (used[first]) {
+      continue;
+    }
+    std::vector<GridPoint> contour;
+    GridPoint start = boundary[first].first;
+    size_t e = first;
+    while (true) {
+      used[e] = true;
+      contour.push_back(boundary[e].first);
+      GridPoint at = boundary[e].second;
+      if (at == start) {
+        break;
+      }
+      GridPoint back = {boundary[e].first.x - at.x, boundary[e].first.y - at.y};
+      auto range = std::equal_range(
+          boundary.begin(),
+          boundary.end(),
+          std::make_pair(at, GridPoint()),
+          [](const auto& a, const auto& b) { return a.first < b.first; });
+      size_t next = boundary.size();
+      double best = std::numeric_limits<double>::max();
+      for (auto it = range.first; it != range.second; ++it) {
+        size_t i = it - boundary.begin();
+        if (used[i]) {
+          continue;
+        }
+        double angle =
+            GetClockwiseAngle(back, {it->second.x - at.x, it->second.y - at.y});
+        if (angle < best) {
+          best = angle;
+          next = i;
+        }
+      }
+      if (next == boundary.size()) {
+        break;
+      }
+      e = next;
+    }
+    contour = RemoveCollinearPoints(std::move(contour));
+    if (contour.size() < 3) {
+      continue;
+    }
+    std::vector<glm::dvec2> points;
+    for (const GridPoint& p : contour) {
+      points.push_back(FromGrid(p));
+    }
+    region.contours.push_back(std::move(points));
+  }
+  return region;
+}
+
+void AddSegments(const Region& region, int operand, std::vector<Segment>* segments) {
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    for (size_t i = 0; i < contour.size(); ++i) {
+      GridPoint a = ToGrid(contour[i]);
+      GridPoint b = ToGrid(contour[(i + 1) % contour.size()]);
+      if (a != b) {
+        segments->push_back({a, b, operand});
+      }
+    }
+  }
+}
+
+double GetContourArea(const std::vector<glm::dvec2>& contour) {
+  double area = 0;
+  for (size_t i = 0; i < contour.size(); ++i) {
+    const glm::dvec2& a = contour[i];
+    const glm::dvec2& b = contour[(i + 1) % contour.size()];
+    area += a.x * b.y - a.y * b.x;
+  }
+  return area / 2;
+}
+
+// Counter clockwise, without collinear points.
+std::vector<glm::dvec2> ConvexHull2d(std::vector<glm::dvec2> points) {
+  std::sort(points.begin(), points.end(), [](const glm::dvec2& a, const glm::dvec2& b) {
+    return a.x != b.x ? a.x < b.x : a.y < b.y;
+  });
+  auto cross = [](const glm::dvec2& o, const glm::dvec2& a, const glm::dvec2& b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+  };
+  std::vector<glm::dvec2> hull;
+  for (int pass = 0; pass < 2; ++pass) {
+    size_t start = hull.size();
+    for (const glm::dvec2& p : points) {
+      while (hull.size() >= start + 2 && cross(hull[hull.size() - 2], hull.back(), p) <= 0) {
+        hull.pop_back();
+      }
+      hull.push_back(p);
+    }
+    hull.pop_back();
+    std::reverse(points.begin(), points.end());
+  }
+  return hull;
+}
+
+// Makes a convex piece counter clockwise so it adds to the winding number.
+std::vector<glm::dvec2> MakeCounterClockwise(std::vector<glm::dvec2> contour) {
+  if (GetContourArea(contour) < 0) {
+    std::reverse(contour.begin(), contour.end());
+  }
+  return contour;
+}
+
+std::vector<glm::dvec2> GetCirclePoints(const glm::dvec2& center, double r, long fragments) {
+  std::vector<glm::dvec2> points;
+  for (long i = 0; i < fragments; ++i) {
+    double angle = glm::radians(360.0 * i / fragments);
+    points.push_back(center + r * glm::dvec2(std::cos(angle), std::sin(angle)));
+  }
+  return points;
+}
+
+// Whether every point of inner is inside or on the counter clockwise convex polygon outer.
+bool IsInsideConvex(const std::vector<glm::dvec2>& inner, const std::vector<glm::dvec2>& outer) {
+  for (size_t i = 0; i < outer.size(); ++i) {
+    const glm::dvec2& a = outer[i];
+    const glm::dvec2& b = outer[(i + 1) % outer.size()];
+    for (const glm::dvec2& p : inner) {
+      if ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x) < 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// The shadow of a union of convex pieces: the union of the 2D hulls of their points. Most of the
+// connectors are inside a bigger piece once flattened, and leaving them out of the union halves
+// the edges to split.
+bool GetProjection(const Shape& shape, std::vector<Region>* regions) {
+  std::vector<std::vector<glm::dvec3>> pieces;
+  if (!GetConvexPieces(shape, &pieces)) {
+    return false;
+  }
+  struct Hull {
+    std::vector<glm::dvec2> points;
+    glm::dvec2 lo;
+    glm::dvec2 hi;
+    double area;
+  };
+  std::vector<Hull> hulls;
+  for (const std::vector<glm::dvec3>& piece : pieces) {
+    std::vector<glm::dvec2> points;
+    for (const glm::dvec3& p : piece) {
+      points.push_back(glm::dvec2(p));
+    }
+    Hull hull;
+    hull.points = ConvexHull2d(std::move(points));
+    if (hull.points.size() < 3) {
+      continue;
+    }
+    hull.lo = hull.hi = hull.points[0];
+    for (const glm::dvec2& p : hull.points) {
+      hull.lo = glm::min(hull.lo, p);
+      hull.hi = glm::max(hull.hi, p);
+    }
+    hull.area = GetContourArea(hull.points);
+    hulls.push_back(std::move(hull));
+  }
+
+  // Biggest first, so of two equal pieces the second is left out.
+  std::stable_sort(hulls.begin(), hulls.end(), [](const Hull& a, const Hull& b) {
+    return a.area > b.area;
+  });
+  std::vector<const Hull*> kept;
+  for (const Hull& hull : hulls) {
+    bool inside = std::any_of(kept.begin(), kept.end(), [&](const Hull* other) {
+      return glm::all(glm::greaterThanEqual(hull.lo, other->lo)) &&
+             glm::all(glm::lessThanEqual(hull.hi, other->hi)) &&
+             IsInsideConvex(hull.points, other->points);
+    });
+    if (!inside) {
+      kept.push_back(&hull);
+    }
+  }
+  for (const Hull* hull : kept) {
+    regions->push_back({{hull->points}});
+  }
+  return true;
+}
+
+bool AddRegion(const ShapeNode& node, Region* region);
+
+bool GetChildRegions(const ShapeNode& node, std::vector<Region>* regions) {
+  for (const Shape& child : node.children) {
+    Region child_region;
+    if (!child.node() || !AddRegion(*child.node(), &child_region)) {
+      return false;
+    }
+    regions->push_back(std::move(child_region));
+  }
+  return true;
+}
+
+bool UnionRegions(const std::vector<Region>& regions, Region* result) {
+  if (regions.size() == 1) {
+    *result = regions[0];
+    return true;
+  }
+  return CombineRegions(regions, {}, RegionOp::UNION, result);
+}
+
+// Sets region to the region of node, in the coordinates of node.
+bool AddRegion(const ShapeNode& node, Region* region) {
+  const double* p = node.params;
+  if (node.kind == ShapeKind::PRIMITIVE) {
+    if (node.op == "circle" && node.write_params) {
+      if (p[0] > 0) {
+        long fragments = GetFragments(
+            p[0], GetOptionalParam(p[2]), GetOptionalParam(p[3]), GetOptionalParam(p[1]));
+        *region = CircleRegion(p[0], fragments);
+      }
+      return true;
+    }
+    if (node.op == "square" && node.write_params) {
+      if (p[0] > 0 && p[1] > 0) {
+        *region = SquareRegion(p[0], p[1], p[2] != 0);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<Region> children;
+  glm::dmat4 matrix;
+  if (node.op == "projection" && node.write_params) {
+    if (p[0] != 0) {
+      return false;
+    }
+    for (const Shape& child : node.children) {
+      if (!GetProjection(child, &children)) {
+        return false;
+      }
+    }
+    return UnionRegions(children, region);
+  }
+  if (!GetChildRegions(node, &children)) {
+    return false;
+  }
+  if (children.empty()) {
+    return true;
+  }
+  if (GetNodeTransform(node, &matrix)) {
+    // The shape has to stay flat.
+    if (matrix[0][2] != 0 || matrix[1][2] != 0 ||
+        matrix[0][0] * matrix[1][1] - matrix[1][0] * matrix[0][1] == 0) {
+      return false;
+    }
+    Region child;
+    if (!UnionRegions(children, &child)) {
+      return false;
+    }
+    *region = TransformRegion(child, matrix);
+    return true;
+  }
+  if (node.op == "union") {
+    return UnionRegions(children, region);
+  }
+  if (node.op == "difference") {
+    std::vector<Region> rest(children.begin() + 1, children.end());
+    return CombineRegions({children[0]}, rest, RegionOp::DIFFERENCE, region);
+  }
+  if (node.op == "intersection") {
+    *region = children[0];
+    for (size_t i = 1; i < children.size(); ++i) {
+      if (!CombineRegions(*region, children[i], RegionOp::INTERSECTION, region)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (node.op == "offset" && node.write_params) {
+    Region child;
+    if (!UnionRegions(children, &child)) {
+      return false;
+    }
+    if (p[2] != 0) {
+      return OffsetDelta(child, p[0], p[1] != 0, region);
+    }
+    long fragments = GetFragments(
+        std::abs(p[0]), GetOptionalParam(p[4]), GetOptionalParam(p[5]), GetOptionalParam(p[3]));
+    return OffsetRadius(child, p[0], fragments, region);
+  }
+  return false;
+}
+
+bool IsInsideContour(const glm::dvec2& p, const std::vector<glm::dvec2>& contour) {
+  bool inside = false;
+  for (size_t i = 0, j = contour.size() - 1; i < contour.size(); j = i++) {
+    const glm::dvec2& a = contour[i];
+    const glm::dvec2& b = contour[j];
+    if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (b.x - a.x) * (p.y - a.y) / (b.y - a.y)) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+double Cross2d(const glm::dvec2& o, const glm::dvec2& a, const glm::dvec2& b) {
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+bool IsInsideTriangle(const glm::dvec2& p,
+                      const glm::dvec2& a,
+                      const glm::dvec2& b,
+                      const glm::dvec2& c) {
+  return Cross2d(a, b, p) >= 0 && Cross2d(b, c, p) >= 0 && Cross2d(c, a, p) >= 0;
+}
+
+// Whether the direction from corner to p is inside the polygon at the corner between prev and next.
+bool IsInsideCorner(const glm::dvec2& prev,
+                    const glm::dvec2& corner,
+                    const glm::dvec2& next,
+                    const glm::dvec2& p) {
+  if (Cross2d(prev, corner, next) > 0) {
+    return Cross2d(corner, p, next) <= 0 && Cross2d(corner, prev, p) <= 0;
+  }
+  return Cross2d(corner, p, prev) > 0 || Cross2d(corner, next, p) > 0;
+}
+
+// Joins a hole into the outline with a pair of edges from its rightmost point to a point of the
+// outline it can see (Eberly, "Triangulation by Ear Clipping").
+void BridgeHole(const std::vector<glm::dvec2>& points,
+                const std::vector<int>& hole,
+                std::vector<int>* polygon) {
+  size_t m = 0;
+  for (size_t i = 1; i < hole.size(); ++i) {
+    if (points[hole[i]].x > points[hole[m]].x) {
+      m = i;
+    }
+  }
+  glm::dvec2 mp = points[hole[m]];
+
+  // The closest edge to the right of m, and its end furthest right.
+  std::vector<int>& outline = *polygon;
+  size_t n = outline.size();
+  size_t visible = n;
+  double closest_x = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < n; ++i) {
+    const glm::dvec2& a = points[outline[i]];
+    const glm::dvec2& b = points[outline[(i + 1) % n]];
+    // Outlines run counter clockwise, so the edges right of a hole run up.
+    if (a.y > mp.y || b.y < mp.y || a.y == b.y) {
+      continue;
+    }
+    double x = a.x + (b.x - a.x) * (mp.y - a.y) / (b.y - a.y);
+    if (x >= mp.x && x < closest_x) {
+      closest_x = x;
+      visible = a.x > b.x ? i : (i + 1) % n;
+    }
+  }
+  if (visible == n) {
+    return;
+  }
+  // Points inside the triangle between m, the crossing and the end may hide the end. The one at
+  // the smallest angle from the ray is visible.
+  glm::dvec2 crossing(closest_x, mp.y);
+  glm::dvec2 end = points[outline[visible]];
+  if (end != crossing) {
+    double best_angle = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < n; ++i) {
+      const glm::dvec2& q = points[outline[i]];
+      if (i == visible || q == mp) {
+        continue;
+      }
+      bool inside = end.y < mp.y ? IsInsideTriangle(q, mp, end, crossing)
+                                 : IsInsideTriangle(q, mp, crossing, end);
+      if (!inside) {
+        continue;
+      }
+      double angle = std::atan2(std::abs(q.y - mp.y), q.x - mp.x);
+      if (angle < best_angle) {
+        best_angle = angle;
+        visible = i;
+      }
+    }
+  }
+
+  // Bridges of earlier holes visit the point more than once. Join the visit whose corner the
+  // bridge leaves through.
+  for (size_t i = 0; i < n; ++i) {
+    if (points[outline[i]] == points[outline[visible]] &&
+        IsInsideCorner(points[outline[(i + n - 1) % n]],
+                       points[outline[i]],
+                       points[outline[(i + 1) % n]],
+                       mp)) {
+      visible = i;
+      break;
+    }
+  }
+
+  std::vector<int> bridged(outline.begin(), outline.begin() + visible + 1);
+  for (size_t i = 0; i <= hole.size(); ++i) {
+    bridged.push_back(hole[(m + i) % hole.size()]);
+  }
+  bridged.insert(bridged.end(), outline.begin() + visible, outline.end());
+  outline = std::move(bridged);
+}
+
+// Triangulates a counter clockwise polygon, which may visit a point twice where holes are bridged.
+void ClipEars(const std::vector<glm::dvec2>& points,
+              std::vector<int> polygon,
+              std::vector<std::array<int, 3>>* triangles) {
+  size_t i = 0;
+  size_t misses = 0;
+  while (polygon.size() > 3) {
+    size_t n = polygon.size();
+    i %= n;
+    int a = polygon[(i + n - 1) % n];
+    int b = polygon[i];
+    int c = polygon[(i + 1) % n];
+    const glm::dvec2& pa = points[a];
+    const glm::dvec2& pb = points[b];
+    const glm::dvec2& pc = points[c];
+    double turn = Cross2d(pa, pb, pc);
+    bool is_ear = turn > 0;
+    for (size_t j = 0; is_ear && j < n; ++j) {
+      const glm::dvec2& q = points[polygon[j]];
+      if (q != pa && q != pb && q != pc && IsInsideTriangle(q, pa, pb, pc)) {
+        is_ear = false;
+      }
+    }
+    // Points in line with their neighbours, and anything left when the polygon isn't quite
+    // simple, are clipped anyway.
+    if (is_ear || (turn == 0 && misses >= n) || misses >= 2 * n) {
+      if (turn > 0) {
+        triangles->push_back({a, b, c});
+      }
+      polygon.erase(polygon.begin() + i);
+      misses = 0;
+    } else {
+      ++i;
+      ++misses;
+    }
+  }
+  if (polygon.size() == 3 &&
+      Cross2d(points[polygon[0]], points[polygon[1]], points[polygon[2]]) > 0) {
+    triangles->push_back({polygon[0], polygon[1], polygon[2]});
+  }
+}
+
+void WriteContourPath(std::FILE* file, const std::vector<glm::dvec2>& contour) {
+  for (size_t i = 0; i < contour.size(); ++i) {
+    fprintf(file, "%s%.4f %.4f ", i == 0 ? "M" : "L", contour[i].x, contour[i].y);
+  }
+  fprintf(file, "Z ");
+}
+
+}  // namespace
+
+Region CircleRegion(double r, long fragments) {
+  return {{GetCirclePoints(glm::dvec2(0), r, fragments)}};
+}
+
+Region SquareRegion(double x, double y, bool center) {
+  glm::dvec2 start = center ? glm::dvec2(-x / 2, -y / 2) : glm::dvec2(0);
+  return {{{start, start + glm::dvec2(x, 0), start + glm::dvec2(x, y), start + glm::dvec2(0, y)}}};
+}
+
+Region TransformRegion(const Region& region, const glm::dmat4& m) {
+  Region result;
+  bool mirrored = m[0][0] * m[1][1] - m[1][0] * m[0][1] < 0;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    std::vector<glm::dvec2> points;
+    for (const glm::dvec2& p : contour) {
+      points.push_back(glm::dvec2(m[0][0] * p.x + m[1][0] * p.y + m[3][0],
+                                  m[0][1] * p.x + m[1][1] * p.y + m[3][1]));
+    }
+    if (mirrored) {
+      std::reverse(points.begin(), points.end());
+    }
+    result.contours.push_back(std::move(points));
+  }
+  return result;
+}
+
+bool CombineRegions(const std::vector<Region>& first,
+                    const std::vector<Region>& second,
+                    RegionOp op,
+                    Region* result) {
+  TRACE_SCOPE("CombineRegions");
+  std::vector<Segment> segments;
+  for (const Region& region : first) {
+    AddSegments(region, 0, &segments);
+  }
+  for (const Region& region : second) {
+    AddSegments(region, 1, &segments);
+  }
+  if (!SplitSegments(&segments)) {
+    return false;
+  }
+  *result = JoinBoundary(GetBoundary(MergeSegments(segments), op));
+  return true;
+}
+
+bool CombineRegions(const Region& first, const Region& second, RegionOp op, Region* result) {
+  return CombineRegions(std::vector<Region>{first}, std::vector<Region>{second}, op, result);
+}
+
+bool OffsetRadius(const Region& region, double r, long fragments, Region* result) {
+  if (r == 0 || region.empty()) {
+    *result = region;
+    return true;
+  }
+  // Grows by the union with a capsule around every edge, or shrinks by taking them away.
+  std::vector<Region> capsules;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    for (size_t i = 0; i < contour.size(); ++i) {
+      std::vector<glm::dvec2> points = GetCirclePoints(contour[i], std::abs(r), fragments);
+      std::vector<glm::dvec2> next =
+          GetCirclePoints(contour[(i + 1) % contour.size()], std::abs(r), fragments);
+      points.insert(points.end(), next.begin(), next.end());
+      capsules.push_back({{ConvexHull2d(std::move(points))}});
+    }
+  }
+  if (r > 0) {
+    capsules.push_back(region);
+    return CombineRegions(capsules, {}, RegionOp::UNION, result);
+  }
+  return CombineRegions({region}, capsules, RegionOp::DIFFERENCE, result);
+}
+
+bool OffsetDelta(const Region& region, double delta, bool chamfer, Region* result) {
+  if (delta == 0 || region.empty()) {
+    *result = region;
+    return true;
+  }
+  // A strip along every edge, and a wedge filling the gap between the strips at corners pointing
+  // the way the outline moves.
+  double d = std::abs(delta);
+  double side = delta > 0 ? 1 : -1;
+  std::vector<Region> pieces;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    size_t n = contour.size();
+    std::vector<glm::dvec2> normals;
+    for (size_t i = 0; i < n; ++i) {
+      glm::dvec2 t = glm::normalize(contour[(i + 1) % n] - contour[i]);
+      // Outwards is right of the edge.
+      normals.push_back(side * glm::dvec2(t.y, -t.x));
+    }
+    for (size_t i = 0; i < n; ++i) {
+      const glm::dvec2& a = contour[i];
+      const glm::dvec2& b = contour[(i + 1) % n];
+      pieces.push_back(
+          {{MakeCounterClockwise({a, b, b + normals[i] * d, a + normals[i] * d})}});
+
+      const glm::dvec2& n1 = normals[(i + n - 1) % n];
+      const glm::dvec2& n2 = normals[i];
+      double turn = n1.x * n2.y - n1.y * n2.x;
+      if (turn * side <= 0) {
+        continue;
+      }
+      std::vector<glm::dvec2> wedge = {a, a + n1 * d};
+      if (!chamfer) {
+        wedge.push_back(a + (n1 + n2) * d / (1 + glm::dot(n1, n2)));
+      }
+      wedge.push_back(a + n2 * d);
+      pieces.push_back({{MakeCounterClockwise(std::move(wedge))}});
+    }
+  }
+  if (delta > 0) {
+    pieces.push_back(region);
+    return CombineRegions(pieces, {}, RegionOp::UNION, result);
+  }
+  return CombineRegions({region}, pieces, RegionOp::DIFFERENCE, result);
+}
+
+double GetArea(const Region& region) {
+  double area = 0;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    area += GetContourArea(contour);
+  }
+  return area;
+}
+
+bool GetRegion(const Shape& shape, Region* region) {
+  TRACE_SCOPE("GetRegion");
+  *region = Region();
+  return shape.node() && AddRegion(*shape.node(), region);
+}
+
+Shape MakePolygon(const Region& region) {
+  std::vector<std::vector<Point2d>> paths;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    paths.emplace_back();
+    for (const glm::dvec2& p : contour) {
+      paths.back().push_back({p.x, p.y});
+    }
+  }
+  if (paths.size() == 1) {
+    return Polygon(paths[0]);
+  }
+  return Polygon(paths);
+}
+
+Mesh ExtrudeRegion(const Region& region, double height, bool center) {
+  TRACE_SCOPE("ExtrudeRegion");
+  std::vector<glm::dvec2> points;
+  std::vector<std::vector<int>> outlines;
+  std::vector<std::vector<int>> holes;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    std::vector<int> indexes;
+    for (const glm::dvec2& p : contour) {
+      indexes.push_back(points.size());
+      points.push_back(p);
+    }
+    (GetContourArea(contour) > 0 ? outlines : holes).push_back(std::move(indexes));
+  }
+
+  // Each hole belongs to the smallest outline around it, and is bridged into it rightmost first.
+  std::vector<std::vector<const std::vector<int>*>> outline_holes(outlines.size());
+  for (const std::vector<int>& hole : holes) {
+    int owner = -1;
+    double owner_area = 0;
+    for (size_t i = 0; i < outlines.size(); ++i) {
+      std::vector<glm::dvec2> outline;
+      for (int index : outlines[i]) {
+        outline.push_back(points[index]);
+      }
+      double area = GetContourArea(outline);
+      if (IsInsideContour(points[hole[0]], outline) && (owner < 0 || area < owner_area)) {
+        owner = i;
+        owner_area = area;
+      }
+    }
+    if (owner >= 0) {
+      outline_holes[owner].push_back(&hole);
+    }
+  }
+  auto max_x = [&](const std::vector<int>* contour) {
+    double x = -std::numeric_limits<double>::max();
+    for (int index : *contour) {
+      x = std::max(x, points[index].x);
+    }
+    return x;
+  };
+  std::vector<std::array<int, 3>> caps;
+  for (size_t i = 0; i < outlines.size(); ++i) {
+    std::vector<const std::vector<int>*>& contour_holes = outline_holes[i];
+    std::sort(contour_holes.begin(), contour_holes.end(), [&](const auto* a, const auto* b) {
+      return max_x(a) > max_x(b);
+    });
+    std::vector<int> polygon = outlines[i];
+    for (const std::vector<int>* hole : contour_holes) {
+      BridgeHole(points, *hole, &polygon);
+    }
+    ClipEars(points, std::move(polygon), &caps);
+  }
+
+  // The bottom points, then the top ones.
+  Mesh mesh;
+  float z0 = center ? -height / 2 : 0;
+  float z1 = z0 + height;
+  int count = points.size();
+  for (float z : {z0, z1}) {
+    for (const glm::dvec2& p : points) {
+      mesh.vertices.push_back(glm::vec3(p.x, p.y, z));
+    }
+  }
+  for (const std::array<int, 3>& t : caps) {
+    mesh.triangles.push_back({t[0] + count, t[1] + count, t[2] + count});
+    mesh.triangles.push_back({t[0], t[2], t[1]});
+  }
+  int start = 0;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    int n = contour.size();
+    for (int i = 0; i < n; ++i) {
+      int a = start + i;
+      int b = start + (i + 1) % n;
+      mesh.triangles.push_back({a, b, b + count});
+      mesh.triangles.push_back({a, b + count, a + count});
+    }
+    start += n;
+  }
+  return mesh;
+}
+
+bool WriteRegionSvg(const std::string& file_name, const Region& region) {
+  Bounds bounds;
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    for (const glm::dvec2& p : contour) {
+      bounds.Add(glm::vec3(p, 0));
+    }
+  }
+  if (bounds.empty()) {
+    bounds.Add(glm::vec3(0));
+  }
+  std::FILE* file = std::fopen(file_name.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  float width = bounds.max.x - bounds.min.x;
+  float height = bounds.max.y - bounds.min.y;
+  fprintf(file,
+          "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.3fmm\" height=\"%.3fmm\" "
+          "viewBox=\"%.3f %.3f %.3f %.3f\">\n",
+          width,
+          height,
+          bounds.min.x,
+          -bounds.max.y,
+          width,
+          height);
+  // Flip y so the part is seen from above.
+  fprintf(file,
+          "<path transform=\"scale(1 -1)\" fill=\"none\" stroke=\"#000\" stroke-width=\"0.1\" "
+          "d=\"");
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    WriteContourPath(file, contour);
+  }
+  fprintf(file, "\"/>\n</svg>\n");
+  std::fclose(file);
+  return true;
+}
+
+bool WriteRegionDxf(const std::string& file_name, const Region& region) {
+  std::FILE* file = std::fopen(file_name.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  // R12, which everything reads. Each contour is a closed polyline on layer 0.
+  fprintf(file, "0\nSECTION\n2\nHEADER\n9\n$ACADVER\n1\nAC1009\n9\n$INSUNITS\n70\n4\n0\nENDSEC\n");
+  fprintf(file, "0\nSECTION\n2\nENTITIES\n");
+  for (const std::vector<glm::dvec2>& contour : region.contours) {
+    fprintf(file, "0\nPOLYLINE\n8\n0\n66\n1\n70\n1\n10\n0.0\n20\n0.0\n30\n0.0\n");
+    for (const glm::dvec2& p : contour) {
+      fprintf(file, "0\nVERTEX\n8\n0\n10\n%.4f\n20\n%.4f\n30\n0.0\n", p.x, p.y);
+    }
+    fprintf(file, "0\nSEQEND\n8\n0\n");
+  }
+  fprintf(file, "0\nENDSEC\n0\nEOF\n");
+  std::fclose(file);
+  return true;
+}
+
+}  // namespace scad
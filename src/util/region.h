@@ -0,0 +1,72 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "scad.h"
+
+namespace scad {
+
+// 2D geometry computed here rather than by OpenSCAD, for the parts which are extruded from an
+// outline: booleans, offsets and projections of convex pieces, extruded to a mesh or exported for
+// a laser cutter.
+
+// Closed contours with the inside on the left, so outlines run counter clockwise and holes
+// clockwise. Contours don't cross, they may touch at a point.
+struct Region {
+  std::vector<std::vector<glm::dvec2>> contours;
+
+  bool empty() const {
+    return contours.empty();
+  }
+};
+
+enum class RegionOp {
+  UNION,
+  DIFFERENCE,
+  INTERSECTION,
+};
+
+// The same points as OpenSCAD's circle() and square().
+Region CircleRegion(double r, long fragments);
+Region SquareRegion(double x, double y, bool center);
+
+// Combines the regions of first and second with the nonzero rule. Contours of one side may overlap
+// each other, e.g. many pieces to union at once. Returns false if the edges couldn't be split
+// where they cross, which snapping to the grid can in theory keep doing.
+bool CombineRegions(const std::vector<Region>& first,
+                    const std::vector<Region>& second,
+                    RegionOp op,
+                    Region* result);
+bool CombineRegions(const Region& first, const Region& second, RegionOp op, Region* result);
+
+// offset(r) and offset(delta) in OpenSCAD. Round corners have fragments per full turn, see
+// GetFragments.
+bool OffsetRadius(const Region& region, double r, long fragments, Region* result);
+bool OffsetDelta(const Region& region, double delta, bool chamfer, Region* result);
+
+// m must keep the region flat. Mirrored contours are reversed so they still have the inside on
+// the left.
+Region TransformRegion(const Region& region, const glm::dmat4& m);
+
+// Signed, negative if the outlines run clockwise.
+double GetArea(const Region& region);
+
+// Evaluates a 2D shape: circles, squares, their booleans, offsets and 2D transforms, and
+// projections of what GetConvexPieces can read. Returns false for anything else, e.g. polygons
+// and text, or if a boolean fails (see CombineRegions).
+bool GetRegion(const Shape& shape, Region* region);
+
+// A polygon with a path per contour, so OpenSCAD has no 2D booleans left to do.
+Shape MakePolygon(const Region& region);
+
+// linear_extrude(height, center) of the region. The caps are ear clipped.
+Mesh ExtrudeRegion(const Region& region, double height, bool center = true);
+
+// Outlines for laser cutting, in mm.
+bool WriteRegionSvg(const std::string& file_name, const Region& region);
+bool WriteRegionDxf(const std::string& file_name, const Region& region);
+
+}  // namespace scad
@@ -0,0 +1,216 @@
+#include "render_cache.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "scad.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// FNV-1a, which unlike std::hash is the same in every build so the cache survives rebuilding.
+uint64_t HashString(const std::string& s) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : s) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+bool IsLabel(const ShapeNode* node) {
+  return node && (node->kind == ShapeKind::TAG || node->kind == ShapeKind::COMMENT) &&
+         node->children.size() == 1;
+}
+
+}  // namespace
+
+RenderCache::RenderCache(const RenderCacheOptions& options) : options_(options) {
+  std::error_code error;
+  std::filesystem::create_directories(options_.directory, error);
+  if (error) {
+    fprintf(stderr, "Could not create %s\n", options_.directory.c_str());
+  }
+}
+
+std::string RenderCache::GetKey(const Shape& subtree) {
+  auto it = keys_.find(subtree.node());
+  if (it != keys_.end()) {
+    return it->second;
+  }
+  std::string scad;
+  ScadStats stats = subtree.WriteToString(&scad);
+  std::string key;
+  if (stats.nodes >= options_.min_nodes) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016" PRIx64, HashString(scad));
+    key = buffer;
+  }
+  keys_[subtree.node()] = key;
+  return key;
+}
+
+std::string RenderCache::GetPath(const std::string& key, const std::string& extension) const {
+  return options_.directory + "/" + key + extension;
+}
+
+bool RenderCache::IsCached(const std::string& key) const {
+  std::error_code error;
+  return std::filesystem::exists(GetPath(key, ".stl"), error);
+}
+
+void RenderCache::CollectSubtrees(const Shape& shape, std::map<std::string, Shape>* misses) {
+  const ShapeNode* node = shape.node();
+  if (node == nullptr) {
+    return;
+  }
+  if (IsLabel(node)) {
+    const Shape& subtree = node->children[0];
+    std::string key = GetKey(subtree);
+    if (!key.empty()) {
+      used_.insert(key);
+      if (IsCached(key)) {
+        ++stats_.hits;
+      } else if (!misses->count(key)) {
+        ++stats_.misses;
+        (*misses)[key] = subtree;
+      }
+      return;
+    }
+  }
+  for (const Shape& child : node->children) {
+    CollectSubtrees(child, misses);
+  }
+}
+
+bool RenderCache::Update(const std::vector<Shape>& shapes) {
+  TRACE_SCOPE("RenderCache::Update");
+  std::map<std::string, Shape> misses;
+  for (const Shape& shape : shapes) {
+    CollectSubtrees(shape, &misses);
+  }
+
+  std::vector<RenderJob> jobs;
+  for (const auto& [key, subtree] : misses) {
+    jobs.push_back({GetPath(key, ".scad"), GetPath(key, ".stl")});
+    subtree.WriteToFile(jobs.back().scad);
+  }
+  bool ok = true;
+  std::vector<RenderJobResult> results = RenderAll(jobs, options_.renderer, options_.jobs);
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (!results[i].ok) {
+      // Don't leave a partial stl which would look cached next time.
+      std::error_code error;
+      std::filesystem::remove(jobs[i].stl, error);
+      ++stats_.failed;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+Shape RenderCache::SubstituteNode(const Shape& shape, bool* changed) {
+  const ShapeNode* node = shape.node();
+  if (node == nullptr) {
+    return shape;
+  }
+  if (IsLabel(node)) {
+    std::string key = GetKey(node->children[0]);
+    if (!key.empty() && IsCached(key)) {
+      *changed = true;
+      // OpenSCAD resolves imports relative to the scad file, which may be written anywhere (e.g.
+      // under chunks/), so the import gets an absolute path.
+      std::error_code error;
+      std::filesystem::path path = std::filesystem::absolute(GetPath(key, ".stl"), error);
+      Shape import = Import(error ? GetPath(key, ".stl") : path.string());
+      return node->kind == ShapeKind::TAG ? import.Tag(node->label) : import.Comment(node->label);
+    }
+  }
+
+  bool children_changed = false;
+  std::vector<Shape> children;
+  for (const Shape& child : node->children) {
+    children.push_back(SubstituteNode(child, &children_changed));
+  }
+  if (!children_changed) {
+    return shape;
+  }
+  *changed = true;
+  switch (node->kind) {
+    case ShapeKind::TAG:
+      return children[0].Tag(node->label);
+    case ShapeKind::COMMENT:
+      return children[0].Comment(node->label);
+    default:
+      return Shape::WithChildren(*node, std::move(children));
+  }
+}
+
+Shape RenderCache::Substitute(const Shape& shape) {
+  TRACE_SCOPE("RenderCache::Substitute");
+  bool changed = false;
+  return SubstituteNode(shape, &changed);
+}
+
+void RenderCache::Trim() {
+  TRACE_SCOPE("RenderCache::Trim");
+  namespace fs = std::filesystem;
+  struct Entry {
+    std::string key;
+    fs::file_time_type used;
+    long long bytes;
+  };
+  std::vector<Entry> entries;
+  std::error_code error;
+  stats_.bytes = 0;
+  for (const fs::directory_entry& file : fs::directory_iterator(options_.directory, error)) {
+    if (file.path().extension() != ".stl") {
+      continue;
+    }
+    Entry entry;
+    entry.key = file.path().stem().string();
+    if (used_.count(entry.key)) {
+      // Mark it as recently used.
+      fs::last_write_time(file.path(), fs::file_time_type::clock::now(), error);
+      entry.used = fs::file_time_type::max();
+    } else {
+      entry.used = file.last_write_time(error);
+    }
+    entry.bytes = file.file_size(error);
+    stats_.bytes += entry.bytes;
+    entries.push_back(entry);
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.used < b.used;
+  });
+  for (const Entry& entry : entries) {
+    if (stats_.bytes <= options_.max_bytes || used_.count(entry.key)) {
+      break;
+    }
+    for (const char* extension : {".stl", ".scad", ".stl.log"}) {
+      fs::remove(GetPath(entry.key, extension), error);
+    }
+    stats_.bytes -= entry.bytes;
+    ++stats_.evicted;
+  }
+}
+
+void RenderCache::PrintStats(std::FILE* file) const {
+  fprintf(file,
+          "render cache: %d hits %d misses %d failed %d evicted %.1f MB\n",
+          stats_.hits,
+          stats_.misses,
+          stats_.failed,
+          stats_.evicted,
+          stats_.bytes / 1e6);
+}
+
+}  // namespace scad
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+// Keeps rendered stls of labeled subtrees (Shape::Tag or Shape::Comment) on disk, keyed by a hash
+// of the subtree's scad. Outputs written with the cache import the stl in place of any subtree
+// which has been rendered before, so OpenSCAD only has to render what changed.
+//
+//   RenderCache cache(options);
+//   cache.Update(shapes);
+//   cache.Substitute(shape).WriteToFile("v1_left.scad");
+//   cache.Trim();
+struct RenderCacheOptions {
+  std::string directory = "cache";
+  // Least recently used stls are removed past this size.
+  long long max_bytes = 1LL << 30;
+  // Smaller subtrees aren't worth an import.
+  long min_nodes = 10;
+  // See Render in renderer.h.
+  std::string renderer = "openscad";
+  int jobs = 1;
+};
+
+struct RenderCacheStats {
+  int hits = 0;
+  int misses = 0;
+  int failed = 0;
+  int evicted = 0;
+  long long bytes = 0;
+};
+
+class RenderCache {
+ public:
+  explicit RenderCache(const RenderCacheOptions& options);
+
+  // Renders the outermost labeled subtrees of the shapes which aren't cached yet, up to
+  // options.jobs at a time. Returns false if any render failed.
+  bool Update(const std::vector<Shape>& shapes);
+
+  // The shape with every cached subtree replaced by an import of the absolute path of its stl,
+  // keeping the label, so the result can be written to a scad file in any directory.
+  Shape Substitute(const Shape& shape);
+
+  // Removes the least recently used stls until the cache fits in options.max_bytes. Anything used
+  // since the cache was created is kept.
+  void Trim();
+
+  const RenderCacheStats& stats() const {
+    return stats_;
+  }
+  void PrintStats(std::FILE* file) const;
+
+ private:
+  // Empty for subtrees which are too small to cache.
+  std::string GetKey(const Shape& subtree);
+  std::string GetPath(const std::string& key, const std::string& extension) const;
+  bool IsCached(const std::string& key) const;
+  void CollectSubtrees(const Shape& shape, std::map<std::string, Shape>* misses);
+  Shape SubstituteNode(const Shape& shape, bool* changed);
+
+  RenderCacheOptions options_;
+  RenderCacheStats stats_;
+  // Nodes are immutable and shared, so the key of a node never changes.
+  std::map<const ShapeNode*, std::string> keys_;
+  std::set<std::string> used_;
+};
+
+}  // namespace scad
@@ -0,0 +1,170 @@
+#include "render_profile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "scad.h"
+#include "stl.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// Every subtree under a label, in the order they are written.
+void CollectLabeled(const Shape& shape,
+                    std::vector<std::string>* labels,
+                    std::map<std::string, std::vector<Shape>>* subtrees) {
+  const ShapeNode* node = shape.node();
+  if (node == nullptr) {
+    return;
+  }
+  if (node->kind == ShapeKind::TAG || node->kind == ShapeKind::COMMENT) {
+    std::vector<Shape>& shapes = (*subtrees)[node->label];
+    if (shapes.empty()) {
+      labels->push_back(node->label);
+    }
+    shapes.insert(shapes.end(), node->children.begin(), node->children.end());
+  }
+  for (const Shape& child : node->children) {
+    CollectLabeled(child, labels, subtrees);
+  }
+}
+
+std::string GetFileSafeName(const std::string& label) {
+  std::string name = label;
+  for (char& c : name) {
+    if (!isalnum((unsigned char)c) && c != '_' && c != '-') {
+      c = '_';
+    }
+  }
+  return name;
+}
+
+}  // namespace
+
+bool ParseRenderSeconds(const std::string& log, double* seconds) {
+  std::istringstream in(log);
+  std::string line;
+  const std::string prefix = "Total rendering time:";
+  while (std::getline(in, line)) {
+    size_t start = line.find(prefix);
+    if (start == std::string::npos) {
+      continue;
+    }
+    const char* value = line.c_str() + start + prefix.size();
+    int hours = 0;
+    int minutes = 0;
+    double s = 0;
+    // Newer versions print h:mm:ss.sss, older ones "0 hours, 0 minutes, 1 seconds".
+    if (sscanf(value, " %d:%d:%lf", &hours, &minutes, &s) == 3 ||
+        sscanf(value, " %d hours, %d minutes, %lf seconds", &hours, &minutes, &s) == 3) {
+      *seconds = hours * 3600 + minutes * 60 + s;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseFacets(const std::string& log, long* facets) {
+  std::istringstream in(log);
+  std::string line;
+  bool found = false;
+  while (std::getline(in, line)) {
+    long value = 0;
+    // The last one is the final mesh.
+    if (sscanf(line.c_str(), " Facets: %ld", &value) == 1) {
+      *facets = value;
+      found = true;
+    }
+  }
+  return found;
+}
+
+std::vector<SubtreeRenderProfile> ProfileSubtreeRenders(const Shape& shape,
+                                                        const std::string& name,
+                                                        const RenderProfileOptions& options) {
+  TRACE_SCOPE("ProfileSubtreeRenders", name);
+  std::error_code error;
+  std::filesystem::create_directories(options.directory, error);
+  if (error) {
+    fprintf(stderr, "Could not create %s\n", options.directory.c_str());
+    return {};
+  }
+
+  std::vector<std::string> labels;
+  std::map<std::string, std::vector<Shape>> subtrees;
+  CollectLabeled(shape, &labels, &subtrees);
+  std::map<std::string, double> estimates;
+  for (const SubtreeStats& stats : shape.Analyze().subtrees) {
+    estimates[stats.label] = stats.boolean_cost;
+  }
+
+  std::vector<SubtreeRenderProfile> profiles;
+  std::vector<RenderJob> jobs;
+  for (const std::string& label : labels) {
+    const std::vector<Shape>& shapes = subtrees[label];
+    std::string prefix = options.directory + "/" + name + "_" + GetFileSafeName(label);
+    jobs.push_back({prefix + ".scad", prefix + ".stl"});
+    SubtreeRenderProfile profile;
+    profile.label = label;
+    profile.occurrences = shapes.size();
+    profile.nodes = UnionAll(shapes).WriteToFile(jobs.back().scad).nodes;
+    profile.boolean_cost = estimates[label];
+    profiles.push_back(profile);
+  }
+
+  std::vector<RenderJobResult> results = RenderAll(jobs, options.renderer, options.jobs);
+  for (size_t i = 0; i < profiles.size(); ++i) {
+    SubtreeRenderProfile& profile = profiles[i];
+    profile.ok = results[i].ok;
+    profile.wall_seconds = results[i].seconds;
+    if (!ParseRenderSeconds(results[i].log, &profile.seconds)) {
+      profile.seconds = profile.wall_seconds;
+    }
+    if (profile.ok && !ParseFacets(results[i].log, &profile.facets)) {
+      std::vector<StlTriangle> triangles;
+      ReadStl(jobs[i].stl, &triangles);
+      profile.facets = triangles.size();
+    }
+  }
+
+  std::sort(profiles.begin(),
+            profiles.end(),
+            [](const SubtreeRenderProfile& a, const SubtreeRenderProfile& b) {
+              return a.seconds > b.seconds;
+            });
+  return profiles;
+}
+
+void PrintRenderProfile(const std::vector<SubtreeRenderProfile>& profiles, std::FILE* file) {
+  fprintf(file,
+          "%-24s %5s %8s %14s %10s %10s %10s\n",
+          "label",
+          "count",
+          "nodes",
+          "est. cost",
+          "render s",
+          "wall s",
+          "facets");
+  for (const SubtreeRenderProfile& p : profiles) {
+    fprintf(file,
+            "%-24s %5d %8ld %14.0f %10.2f %10.2f %10ld%s\n",
+            p.label.c_str(),
+            p.occurrences,
+            p.nodes,
+            p.boolean_cost,
+            p.seconds,
+            p.wall_seconds,
+            p.facets,
+            p.ok ? "" : " FAILED");
+  }
+}
+
+}  // namespace scad
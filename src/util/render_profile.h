@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+// Measures what each labeled subtree (Shape::Tag or Shape::Comment) really costs to render, to
+// check the estimates from Shape::Analyze. Every subtree with the same label is written to one
+// scad file and rendered on its own.
+struct RenderProfileOptions {
+  // See Render in renderer.h.
+  std::string renderer = "openscad";
+  // Renders running at once. Running several at once is faster but the times get noisier.
+  int jobs = 1;
+  // Where the scad and stl files are written.
+  std::string directory = "profile";
+};
+
+struct SubtreeRenderProfile {
+  std::string label;
+  int occurrences = 0;
+  long nodes = 0;
+  // Shape::Analyze's estimate.
+  double boolean_cost = 0;
+  bool ok = false;
+  // The rendering time printed by OpenSCAD, or the wall time if it didn't print one.
+  double seconds = 0;
+  double wall_seconds = 0;
+  // The facets OpenSCAD reported, or the triangles in the stl if it didn't report them.
+  long facets = 0;
+};
+
+// The subtrees of shape, slowest first.
+std::vector<SubtreeRenderProfile> ProfileSubtreeRenders(const Shape& shape,
+                                                        const std::string& name,
+                                                        const RenderProfileOptions& options);
+
+void PrintRenderProfile(const std::vector<SubtreeRenderProfile>& profiles, std::FILE* file);
+
+// Reads "Total rendering time" and "Facets" from OpenSCAD's output. Returns false for values it
+// can't find.
+bool ParseRenderSeconds(const std::string& log, double* seconds);
+bool ParseFacets(const std::string& log, long* facets);
+
+}  // namespace scad
@@ -0,0 +1,88 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stl.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// A small tetrahedron written by the stub renderer.
+std::vector<StlTriangle> GetStubMesh() {
+  glm::vec3 p[4] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+  int faces[4][3] = {{0, 2, 1}, {0, 1, 3}, {0, 3, 2}, {1, 2, 3}};
+  std::vector<StlTriangle> triangles;
+  for (const auto& face : faces) {
+    StlTriangle triangle;
+    for (int i = 0; i < 3; ++i) {
+      triangle.vertices[i] = p[face[i]];
+    }
+    triangle.normal = glm::normalize(glm::cross(triangle.vertices[1] - triangle.vertices[0],
+                                                triangle.vertices[2] - triangle.vertices[0]));
+    triangles.push_back(triangle);
+  }
+  return triangles;
+}
+
+}  // namespace
+
+RenderJobResult Render(const std::string& renderer, const RenderJob& job) {
+  TRACE_SCOPE("Render", job.scad);
+  RenderJobResult result;
+  auto start = std::chrono::steady_clock::now();
+  if (renderer == "stub") {
+    result.ok = WriteStl(job.stl, GetStubMesh());
+  } else {
+    std::string log_file = job.stl + ".log";
+    std::string command =
+        renderer + " -o \"" + job.stl + "\" \"" + job.scad + "\" > \"" + log_file + "\" 2>&1";
+    result.ok = std::system(command.c_str()) == 0;
+    std::ifstream log(log_file);
+    result.log.assign(std::istreambuf_iterator<char>(log), std::istreambuf_iterator<char>());
+    if (!result.ok) {
+      fprintf(stderr, "Rendering %s failed, see %s\n", job.scad.c_str(), log_file.c_str());
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  return result;
+}
+
+std::vector<RenderJobResult> RenderAll(const std::vector<RenderJob>& jobs,
+                                       const std::string& renderer,
+                                       int max_jobs) {
+  std::vector<RenderJobResult> results(jobs.size());
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < jobs.size(); i = next++) {
+      results[i] = Render(renderer, jobs[i]);
+    }
+  };
+
+  int thread_count = std::max(1, std::min(max_jobs, (int)jobs.size()));
+  std::vector<std::thread> threads;
+  for (int i = 1; i < thread_count; ++i) {
+    threads.emplace_back([&worker, i]() {
+      SetTraceThreadName("render worker " + std::to_string(i));
+      worker();
+    });
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return results;
+}
+
+}  // namespace scad
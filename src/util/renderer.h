@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace scad {
+
+// Renders scad files to stl with OpenSCAD.
+struct RenderJob {
+  std::string scad;
+  std::string stl;
+};
+
+struct RenderJobResult {
+  bool ok = false;
+  // Wall time of the render.
+  double seconds = 0;
+  // What OpenSCAD printed, which is also kept next to the stl as <stl>.log.
+  std::string log;
+};
+
+// renderer is called as "<renderer> -o <stl> <scad>". "stub" skips rendering and writes a
+// placeholder tetrahedron, for trying the pipeline without OpenSCAD.
+RenderJobResult Render(const std::string& renderer, const RenderJob& job);
+
+// Renders every job with up to max_jobs renders running at once.
+std::vector<RenderJobResult> RenderAll(const std::vector<RenderJob>& jobs,
+                                       const std::string& renderer,
+                                       int max_jobs);
+
+}  // namespace scad
@@ -6,12 +6,430 @@
 #endif
 
 #include <math.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "trace.h"
+
 namespace scad {
+namespace {
+
+// Nodes written by AppendScad on this thread. Targets write files on several threads at once.
+thread_local long nodes_written = 0;
+
+// Told about every node as it is written.
+class WriteObserver {
+ public:
+  virtual ~WriteObserver() = default;
+  virtual void Enter(const ShapeNode& node) = 0;
+  virtual void Exit(const ShapeNode& node) = 0;
+};
+
+void WriteShape(const Shape& shape, std::FILE* file, int indent_level, WriteObserver* observer);
+
+void WriteName(const ShapeNode& node, std::FILE* file) {
+  if (node.write_params) {
+    node.write_params(file, node);
+  } else {
+    node.write_name(file);
+  }
+}
+
+void WriteNode(const ShapeNode& node, std::FILE* file, int indent_level, WriteObserver* observer) {
+  switch (node.kind) {
+    case ShapeKind::PRIMITIVE:
+      WriteIndent(file, indent_level);
+      WriteName(node, file);
+      fprintf(file, "\n");
+      break;
+    case ShapeKind::COMPOSITE:
+      WriteIndent(file, indent_level);
+      WriteName(node, file);
+      fprintf(file, " {\n");
+      for (const Shape& child : node.children) {
+        WriteShape(child, file, indent_level + 1, observer);
+      }
+      WriteIndent(file, indent_level);
+      fprintf(file, "}\n");
+      break;
+    case ShapeKind::COMMENT:
+      WriteIndent(file, indent_level);
+      fprintf(file, "/* %s */\n", node.label.c_str());
+      WriteShape(node.children[0], file, indent_level, observer);
+      break;
+    case ShapeKind::TAG:
+      WriteShape(node.children[0], file, indent_level, observer);
+      break;
+    case ShapeKind::CUSTOM:
+      node.custom_writer(file, indent_level);
+      break;
+  }
+}
+
+void WriteShape(const Shape& shape, std::FILE* file, int indent_level, WriteObserver* observer) {
+  const ShapeNode* node = shape.node();
+  if (node == nullptr) {
+    return;
+  }
+  if (node->kind != ShapeKind::TAG) {
+    ++nodes_written;
+  }
+  if (observer) {
+    observer->Enter(*node);
+  }
+  WriteNode(*node, file, indent_level, observer);
+  if (observer) {
+    observer->Exit(*node);
+  }
+}
+
+ScadStats WriteStats(const Shape& shape, std::FILE* file) {
+  ScadStats stats;
+  stats.nodes = shape.AppendScad(file, 0);
+  stats.bytes = std::ftell(file);
+  return stats;
+}
+
+// A FILE which keeps what is written to it in memory instead of on disk, or only counts it if text
+// is null. Where stdio can't be given custom writes it falls back to a temporary file.
+class MemoryFile {
+ public:
+  explicit MemoryFile(std::string* text = nullptr) : text_(text) {
+#ifdef __GLIBC__
+    cookie_io_functions_t functions = {};
+    functions.write = &MemoryFile::Write;
+    functions.seek = &MemoryFile::Seek;
+    file_ = fopencookie(this, "w", functions);
+#else
+    file_ = std::tmpfile();
+#endif
+    if (file_ == nullptr) {
+      fprintf(stderr, "Could not open memory file\n");
+    }
+  }
+  ~MemoryFile() {
+    Close();
+  }
+
+  MemoryFile(const MemoryFile&) = delete;
+  MemoryFile& operator=(const MemoryFile&) = delete;
+
+  // Null if the file couldn't be opened.
+  std::FILE* get() const {
+    return file_;
+  }
+
+  // Flushes everything written into text.
+  void Close() {
+    if (file_ == nullptr) {
+      return;
+    }
+#ifndef __GLIBC__
+    if (text_) {
+      text_->resize(std::ftell(file_));
+      std::rewind(file_);
+      text_->resize(std::fread(&(*text_)[0], 1, text_->size(), file_));
+    }
+#endif
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+
+ private:
+#ifdef __GLIBC__
+  static ssize_t Write(void* cookie, const char* data, size_t size) {
+    MemoryFile* file = static_cast<MemoryFile*>(cookie);
+    file->bytes_ += size;
+    if (file->text_) {
+      file->text_->append(data, size);
+    }
+    return size;
+  }
+
+  // Only reports the position, which is all ftell needs.
+  static int Seek(void* cookie, off64_t* offset, int whence) {
+    long bytes = static_cast<MemoryFile*>(cookie)->bytes_;
+    if (whence == SEEK_CUR ? *offset != 0 : whence != SEEK_SET || *offset != bytes) {
+      return -1;
+    }
+    *offset = bytes;
+    return 0;
+  }
+
+  long bytes_ = 0;
+#endif
+  std::string* text_;
+  std::FILE* file_ = nullptr;
+};
+
+// The name up to the first space or bracket, e.g. "hull" for "hull ()".
+std::string GetOp(const std::string& name) {
+  return name.substr(0, name.find_first_of(" ([{"));
+}
+
+// The operations without arguments, e.g. "hull ()".
+void WriteOpName(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "%s ()", node.op.c_str());
+}
+
+void WriteTranslate(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "translate ([%.3f, %.3f, %.3f])", node.params[0], node.params[1], node.params[2]);
+}
+
+void WriteMirror(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "mirror ([%.3f, %.3f, %.3f])", node.params[0], node.params[1], node.params[2]);
+}
+
+void WriteRotate(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "rotate ([%.3f, %.3f, %.3f])", node.params[0], node.params[1], node.params[2]);
+}
+
+void WriteRotateAxis(std::FILE* file, const ShapeNode& node) {
+  fprintf(file,
+          "rotate (a = %.3f, v = [%.3f, %.3f, %.3f])",
+          node.params[0],
+          node.params[1],
+          node.params[2],
+          node.params[3]);
+}
+
+void WriteScale(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "scale ([%.3f, %.3f, %.3f])", node.params[0], node.params[1], node.params[2]);
+}
+
+void WriteColor(std::FILE* file, const ShapeNode& node) {
+  fprintf(file,
+          "color (c = [%.3f, %.3f, %.3f, %.3f])",
+          node.params[0],
+          node.params[1],
+          node.params[2],
+          node.params[3]);
+}
+
+void WriteCube(std::FILE* file, const ShapeNode& node) {
+  fprintf(file,
+          "cube (size = [ %.3f, %.3f, %.3f], center = %s);",
+          node.params[0],
+          node.params[1],
+          node.params[2],
+          BoolStr(node.params[3] != 0));
+}
+
+// Unset optional params are NaN.
+double GetParam(Optional<double> value) {
+  return value.has_value() ? value.value() : std::numeric_limits<double>::quiet_NaN();
+}
+
+// $fs, $fn and $fa, unless they are NaN.
+void WriteFragmentParams(std::FILE* file, const double* params) {
+  if (!std::isnan(params[0])) {
+    fprintf(file, ", $fs = %.3f", params[0]);
+  }
+  if (!std::isnan(params[1])) {
+    fprintf(file, ", $fn = %.3f", params[1]);
+  }
+  if (!std::isnan(params[2])) {
+    fprintf(file, ", $fa = %.3f", params[2]);
+  }
+}
+
+void WriteSphere(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "sphere (r = %.3f", node.params[0]);
+  WriteFragmentParams(file, node.params + 1);
+  fprintf(file, ");");
+}
+
+void WriteCircle(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "circle (r = %.3f", node.params[0]);
+  WriteFragmentParams(file, node.params + 1);
+  fprintf(file, ");");
+}
+
+void WriteSquare(std::FILE* file, const ShapeNode& node) {
+  fprintf(file,
+          "square (size = [%.3f, %.3f], center = %s);",
+          node.params[0],
+          node.params[1],
+          BoolStr(node.params[2] != 0));
+}
+
+void WriteCylinder(std::FILE* file, const ShapeNode& node) {
+  fprintf(file,
+          "cylinder(h = %.3f, r1 = %.3f, r2 = %.3f, center = %s",
+          node.params[0],
+          node.params[1],
+          node.params[2],
+          BoolStr(node.params[3] != 0));
+  if (!std::isnan(node.params[4])) {
+    fprintf(file, ", $fn = %.3f", node.params[4]);
+  }
+  fprintf(file, ");");
+}
+
+// params[2] is 1 for a delta offset. A radius offset has $fs, $fn and $fa after it.
+void WriteOffset(std::FILE* file, const ShapeNode& node) {
+  bool delta = node.params[2] != 0;
+  fprintf(file,
+          "offset (%s = %.3f, chamfer = %s",
+          delta ? "delta" : "r",
+          node.params[0],
+          BoolStr(node.params[1] != 0));
+  if (!delta) {
+    WriteFragmentParams(file, node.params + 3);
+  }
+  fprintf(file, ")");
+}
+
+// params is height, center, twist, slices and scale. The convexity is always the default.
+void WriteLinearExtrude(std::FILE* file, const ShapeNode& node) {
+  fprintf(file,
+          "linear_extrude (height = %.3f, center = %s, convexity = %.3f, "
+          "twist = %.3f, slices = %d, scale = %.3f)",
+          node.params[0],
+          BoolStr(node.params[1] != 0),
+          LinearExtrudeParams().convexity,
+          node.params[2],
+          static_cast<int>(node.params[3]),
+          node.params[4]);
+}
+
+void WriteProjection(std::FILE* file, const ShapeNode& node) {
+  fprintf(file, "projection (cut = %s)", BoolStr(node.params[0] != 0));
+}
+
+// The file name is kept in the label so it can be read back, see GetImportBounds.
+void WriteImport(std::FILE* file, const ShapeNode& node) {
+  int convexity = node.params[0];
+  if (convexity > 0) {
+    fprintf(file, "import (file = \"%s\", convexity = %d);", node.label.c_str(), convexity);
+  } else {
+    fprintf(file, "import (file = \"%s\");", node.label.c_str());
+  }
+}
+
+ShapeNode* NewParamsNode(ShapeKind kind,
+                         const char* op,
+                         void (*write_params)(std::FILE*, const ShapeNode&),
+                         std::initializer_list<double> params) {
+  ShapeNode* node = Shape::NewNode();
+  node->kind = kind;
+  node->op = op;
+  node->write_params = write_params;
+  std::copy(params.begin(), params.end(), node->params);
+  return node;
+}
+
+struct PrimitiveKey {
+  void (*write_params)(std::FILE*, const ShapeNode&);
+  double params[ShapeNode::kMaxParams];
+
+  bool operator==(const PrimitiveKey& other) const {
+    // Compared bitwise so -0 and 0, which are written differently, stay apart.
+    return write_params == other.write_params &&
+           std::memcmp(params, other.params, sizeof(params)) == 0;
+  }
+};
+
+struct PrimitiveKeyHash {
+  size_t operator()(const PrimitiveKey& key) const {
+    size_t hash = std::hash<uintptr_t>()(reinterpret_cast<uintptr_t>(key.write_params));
+    for (double param : key.params) {
+      uint64_t bits;
+      std::memcpy(&bits, &param, sizeof(bits));
+      hash = hash * 31 + std::hash<uint64_t>()(bits);
+    }
+    return hash;
+  }
+};
+
+// Primitives with the same parameters share one node, so the cubes repeated for every wall marker
+// and connector are only allocated once. Each thread keeps its own table so targets built in
+// parallel don't wait on a lock; the nodes are reference counted so the shapes can still be
+// shared between threads.
+Shape InternPrimitive(const char* op,
+                      void (*write_params)(std::FILE*, const ShapeNode&),
+                      std::initializer_list<double> params,
+                      long facets) {
+  thread_local std::unordered_map<PrimitiveKey, Shape, PrimitiveKeyHash> primitives;
+  PrimitiveKey key = {write_params, {}};
+  std::copy(params.begin(), params.end(), key.params);
+  auto it = primitives.find(key);
+  if (it == primitives.end()) {
+    ShapeNode* node = NewParamsNode(ShapeKind::PRIMITIVE, op, write_params, params);
+    node->facets = facets;
+    it = primitives.emplace(key, Shape(node)).first;
+  }
+  return it->second;
+}
+
+// Takes over child rather than copying it into a temporary vector first.
+Shape WrapParams(const char* op,
+                 void (*write_params)(std::FILE*, const ShapeNode&),
+                 std::initializer_list<double> params,
+                 Shape&& child) {
+  ShapeNode* node = NewParamsNode(ShapeKind::COMPOSITE, op, write_params, params);
+  node->children.reserve(1);
+  node->children.push_back(std::move(child));
+  return Shape(node);
+}
+
+template <typename Iterator>
+Shape NamedComposite(const std::string& name, Iterator begin, Iterator end) {
+  ShapeNode* node = Shape::NewNode();
+  node->kind = ShapeKind::COMPOSITE;
+  node->op = GetOp(name);
+  if (name.size() == node->op.size() + 3 && name.compare(node->op.size(), 3, " ()") == 0) {
+    node->write_params = WriteOpName;
+  } else {
+    node->write_name = [=](std::FILE* file) { fprintf(file, "%s", name.c_str()); };
+  }
+  node->children.assign(begin, end);
+  return Shape(node);
+}
+
+Shape WrapLabel(ShapeKind kind, const std::string& label, Shape&& child) {
+  ShapeNode* node = Shape::NewNode();
+  node->kind = kind;
+  node->label = label;
+  node->children.reserve(1);
+  node->children.push_back(std::move(child));
+  return Shape(node);
+}
+
+}  // namespace
+
+// get_fragments_from_r in OpenSCAD.
+long GetFragments(double r, Optional<double> fn, Optional<double> fa, Optional<double> fs) {
+  if (fn.has_value() && fn.value() > 0) {
+    return std::max(3L, (long)fn.value());
+  }
+  double fa_value = fa.has_value() ? fa.value() : 12;
+  double fs_value = fs.has_value() ? fs.value() : 2;
+  return (long)std::ceil(std::max(std::min(360.0 / fa_value, r * 2 * M_PI / fs_value), 5.0));
+}
+
+Optional<double> GetOptionalParam(double param) {
+  if (std::isnan(param)) {
+    return {};
+  }
+  return param;
+}
+
+bool IsAxisRotation(const ShapeNode& node) {
+  return node.write_params == WriteRotateAxis;
+}
 
 const char* BoolStr(bool b) {
   return b ? "true" : "false";
@@ -37,41 +455,90 @@ void WriteComposite(std::FILE* file,
   fprintf(file, "}\n");
 }
 
+Shape::Shape(std::shared_ptr<ScadWriter> scad) : Shape(*scad) {
+}
+
+Shape::Shape(ScadWriter scad) {
+  ShapeNode* node = NewNode();
+  node->kind = ShapeKind::CUSTOM;
+  node->custom_writer = std::move(scad);
+  node_ = node;
+}
+
+ShapeNode* Shape::NewNode() {
+  return new ShapeNode();
+}
+
+Shape Shape::Composite(const std::string& op,
+                       const std::function<void(std::FILE*)>& write_name,
+                       const std::vector<Shape>& shapes) {
+  ShapeNode* node = NewNode();
+  node->kind = ShapeKind::COMPOSITE;
+  node->op = op;
+  node->write_name = write_name;
+  node->children.assign(shapes.begin(), shapes.end());
+  return Shape(node);
+}
+
+Shape Shape::Composite(const std::string& op,
+                       const std::function<void(std::FILE*)>& write_name,
+                       std::vector<Shape>&& shapes) {
+  ShapeNode* node = NewNode();
+  node->kind = ShapeKind::COMPOSITE;
+  node->op = op;
+  node->write_name = write_name;
+  node->children.assign(std::make_move_iterator(shapes.begin()),
+                        std::make_move_iterator(shapes.end()));
+  return Shape(node);
+}
+
 Shape Shape::Composite(const std::function<void(std::FILE*)>& write_name,
                        const std::vector<Shape>& shapes) {
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteComposite(file, write_name, shapes, indent_level);
-  });
+  return Composite("", write_name, shapes);
 }
 
 Shape Shape::LiteralComposite(const std::string& name, const std::vector<Shape>& shapes) {
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteComposite(
-        file, [=](std::FILE*) { fprintf(file, "%s", name.c_str()); }, shapes, indent_level);
-  });
+  return NamedComposite(name, shapes.begin(), shapes.end());
+}
+
+Shape Shape::WithChildren(const ShapeNode& node, std::vector<Shape>&& children) {
+  ShapeNode* copy = NewNode();
+  copy->kind = node.kind;
+  copy->op = node.op;
+  copy->write_name = node.write_name;
+  copy->write_params = node.write_params;
+  std::copy(std::begin(node.params), std::end(node.params), copy->params);
+  copy->label = node.label;
+  copy->facets = node.facets;
+  copy->custom_writer = node.custom_writer;
+  copy->children.assign(std::make_move_iterator(children.begin()),
+                        std::make_move_iterator(children.end()));
+  return Shape(copy);
+}
+
+Shape Shape::Primitive(const std::string& op,
+                       long facets,
+                       const std::function<void(std::FILE*)>& scad_writer) {
+  ShapeNode* node = NewNode();
+  node->kind = ShapeKind::PRIMITIVE;
+  node->op = op;
+  node->facets = facets;
+  node->write_name = scad_writer;
+  return Shape(node);
 }
 
 Shape Shape::Primitive(const std::function<void(std::FILE*)>& scad_writer) {
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteIndent(file, indent_level);
-    scad_writer(file);
-    fprintf(file, "\n");
-  });
+  return Primitive("", 0, scad_writer);
 }
 
 Shape Shape::LiteralPrimitive(const std::string& primitive) {
-  return Primitive([=](std::FILE* file) { fprintf(file, "%s", primitive.c_str()); });
+  return Primitive(
+      GetOp(primitive), 0, [=](std::FILE* file) { fprintf(file, "%s", primitive.c_str()); });
 }
 
 Shape Cube(const CubeParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file,
-            "cube (size = [ %.3f, %.3f, %.3f], center = %s);",
-            params.x,
-            params.y,
-            params.z,
-            BoolStr(params.center));
-  });
+  return InternPrimitive(
+      "cube", WriteCube, {params.x, params.y, params.z, params.center ? 1.0 : 0.0}, 12);
 }
 
 Shape Cube(double x, double y, double z, bool center) {
@@ -88,13 +555,8 @@ Shape Cube(double size, bool center) {
 }
 
 Shape Square(const SquareParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file,
-            "square (size = [%.3f, %.3f], center = %s);",
-            params.x,
-            params.y,
-            BoolStr(params.center));
-  });
+  return InternPrimitive(
+      "square", WriteSquare, {params.x, params.y, params.center ? 1.0 : 0.0}, 4);
 }
 
 Shape Square(double x, double y, bool center) {
@@ -110,19 +572,12 @@ Shape Square(double size, bool center) {
 }
 
 Shape Sphere(const SphereParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file, "sphere (r = %.3f", params.r);
-    if (params.fs.has_value()) {
-      fprintf(file, ", $fs = %.3f", params.fs.value());
-    }
-    if (params.fn.has_value()) {
-      fprintf(file, ", $fn = %.3f", params.fn.value());
-    }
-    if (params.fa.has_value()) {
-      fprintf(file, ", $fa = %.3f", params.fa.value());
-    }
-    fprintf(file, ");");
-  });
+  long fragments = GetFragments(params.r, params.fn, params.fa, params.fs);
+  long rings = (fragments + 1) / 2;
+  return InternPrimitive("sphere",
+                         WriteSphere,
+                         {params.r, GetParam(params.fs), GetParam(params.fn), GetParam(params.fa)},
+                         2 * fragments * (rings - 1) + 2 * (fragments - 2));
 }
 
 Shape Sphere(double radius) {
@@ -139,19 +594,10 @@ Shape Sphere(double radius, double fn) {
 }
 
 Shape Circle(const CircleParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file, "circle (r = %.3f", params.r);
-    if (params.fs.has_value()) {
-      fprintf(file, ", $fs = %.3f", params.fs.value());
-    }
-    if (params.fn.has_value()) {
-      fprintf(file, ", $fn = %.3f", params.fn.value());
-    }
-    if (params.fa.has_value()) {
-      fprintf(file, ", $fa = %.3f", params.fa.value());
-    }
-    fprintf(file, ");");
-  });
+  return InternPrimitive("circle",
+                         WriteCircle,
+                         {params.r, GetParam(params.fs), GetParam(params.fn), GetParam(params.fa)},
+                         GetFragments(params.r, params.fn, params.fa, params.fs));
 }
 
 Shape Circle(double radius) {
@@ -168,18 +614,12 @@ Shape Circle(double radius, double fn) {
 }
 
 Shape Cylinder(const CylinderParams& params) {
-  return Shape::Primitive([=](std::FILE* file) {
-    fprintf(file,
-            "cylinder(h = %.3f, r1 = %.3f, r2 = %.3f, center = %s",
-            params.h,
-            params.r1,
-            params.r2,
-            BoolStr(params.center));
-    if (params.fn.has_value()) {
-      fprintf(file, ", $fn = %.3f", params.fn.value());
-    }
-    fprintf(file, ");");
-  });
+  long fragments = GetFragments(std::max(params.r1, params.r2), params.fn, {}, {});
+  return InternPrimitive(
+      "cylinder",
+      WriteCylinder,
+      {params.h, params.r1, params.r2, params.center ? 1.0 : 0.0, GetParam(params.fn)},
+      4 * fragments - 4);
 }
 
 Shape Cylinder(double height, double radius, Optional<double> fn) {
@@ -192,7 +632,7 @@ Shape Cylinder(double height, double radius, Optional<double> fn) {
 }
 
 Shape Polygon(const std::vector<Point2d>& points) {
-  return Shape::Primitive([=](std::FILE* file) {
+  return Shape::Primitive("polygon", points.size(), [=](std::FILE* file) {
     fprintf(file, "polygon (points = [");
     for (size_t i = 0; i < points.size(); ++i) {
       const Point2d& p = points[i];
@@ -205,6 +645,33 @@ Shape Polygon(const std::vector<Point2d>& points) {
   });
 }
 
+Shape Polygon(const std::vector<std::vector<Point2d>>& paths) {
+  long facets = 0;
+  for (const std::vector<Point2d>& path : paths) {
+    facets += path.size();
+  }
+  return Shape::Primitive("polygon", facets, [=](std::FILE* file) {
+    fprintf(file, "polygon (points = [");
+    bool first = true;
+    for (const std::vector<Point2d>& path : paths) {
+      for (const Point2d& p : path) {
+        fprintf(file, "%s[%.3f, %.3f]", first ? "" : ",", p.x, p.y);
+        first = false;
+      }
+    }
+    fprintf(file, "], paths = [");
+    int index = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      fprintf(file, "%s[", i == 0 ? "" : ",");
+      for (size_t j = 0; j < paths[i].size(); ++j) {
+        fprintf(file, "%s%d", j == 0 ? "" : ",", index++);
+      }
+      fputc(']', file);
+    }
+    fprintf(file, "]);");
+  });
+}
+
 Shape RegularPolygon(int n, double r) {
   std::vector<Point2d> points;
   for (int i = 0; i < n; ++i) {
@@ -214,10 +681,15 @@ Shape RegularPolygon(int n, double r) {
   return Polygon(points);
 }
 
-Shape Polyhedron(const std::vector<Point3d>& points,
-                 const std::vector<std::vector<int>>& faces,
+Shape Polyhedron(std::vector<Point3d> points,
+                 std::vector<std::vector<int>> faces,
                  int convexity) {
-  return Shape::Primitive([=](std::FILE* file) {
+  long facets = 0;
+  for (const auto& face : faces) {
+    facets += std::max<long>(face.size() - 2, 0);
+  }
+  auto write_name = [points = std::move(points), faces = std::move(faces), convexity](
+                        std::FILE* file) {
     fprintf(file, "polyhedron (points = [");
     for (size_t i = 0; i < points.size(); ++i) {
       const Point3d& p = points[i];
@@ -242,76 +714,157 @@ Shape Polyhedron(const std::vector<Point3d>& points,
       fprintf(file, "]");
     }
     fprintf(file, "], convexity = %d);", convexity);
-  });
+  };
+  return Shape::Primitive("polyhedron", facets, std::move(write_name));
 }
 
 Shape HullAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("hull ()", shapes);
+  return NamedComposite("hull ()", shapes.begin(), shapes.end());
+}
+
+Shape HullAll(std::vector<Shape>&& shapes) {
+  return NamedComposite("hull ()",
+                        std::make_move_iterator(shapes.begin()),
+                        std::make_move_iterator(shapes.end()));
+}
+
+Shape HullAll(std::initializer_list<Shape> shapes) {
+  return NamedComposite("hull ()", shapes.begin(), shapes.end());
 }
 
 Shape UnionAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("union ()", shapes);
+  return NamedComposite("union ()", shapes.begin(), shapes.end());
+}
+
+Shape UnionAll(std::vector<Shape>&& shapes) {
+  return NamedComposite("union ()",
+                        std::make_move_iterator(shapes.begin()),
+                        std::make_move_iterator(shapes.end()));
+}
+
+Shape UnionAll(std::initializer_list<Shape> shapes) {
+  return NamedComposite("union ()", shapes.begin(), shapes.end());
 }
 
 Shape DifferenceAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("difference ()", shapes);
+  return NamedComposite("difference ()", shapes.begin(), shapes.end());
+}
+
+Shape DifferenceAll(std::vector<Shape>&& shapes) {
+  return NamedComposite("difference ()",
+                        std::make_move_iterator(shapes.begin()),
+                        std::make_move_iterator(shapes.end()));
+}
+
+Shape DifferenceAll(std::initializer_list<Shape> shapes) {
+  return NamedComposite("difference ()", shapes.begin(), shapes.end());
 }
 
 Shape IntersectionAll(const std::vector<Shape>& shapes) {
-  return Shape::LiteralComposite("intersection ()", shapes);
+  return NamedComposite("intersection ()", shapes.begin(), shapes.end());
 }
 
-Shape Shape::Translate(double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "translate ([%.3f, %.3f, %.3f])", x, y, z);
-  };
-  return Shape::Composite(write_name, {*this});
+Shape IntersectionAll(std::vector<Shape>&& shapes) {
+  return NamedComposite("intersection ()",
+                        std::make_move_iterator(shapes.begin()),
+                        std::make_move_iterator(shapes.end()));
 }
 
-Shape Shape::TranslateX(double x) const {
+Shape IntersectionAll(std::initializer_list<Shape> shapes) {
+  return NamedComposite("intersection ()", shapes.begin(), shapes.end());
+}
+
+Shape Shape::Translate(double x, double y, double z) const& {
+  return Shape(*this).Translate(x, y, z);
+}
+
+Shape Shape::Translate(double x, double y, double z) && {
+  return WrapParams("translate", WriteTranslate, {x, y, z}, std::move(*this));
+}
+
+Shape Shape::TranslateX(double x) const& {
   return Translate(x, 0, 0);
 }
 
-Shape Shape::TranslateY(double y) const {
+Shape Shape::TranslateX(double x) && {
+  return std::move(*this).Translate(x, 0, 0);
+}
+
+Shape Shape::TranslateY(double y) const& {
   return Translate(0, y, 0);
 }
 
-Shape Shape::TranslateZ(double z) const {
+Shape Shape::TranslateY(double y) && {
+  return std::move(*this).Translate(0, y, 0);
+}
+
+Shape Shape::TranslateZ(double z) const& {
   return Translate(0, 0, z);
 }
 
-Shape Shape::Mirror(double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "mirror ([%.3f, %.3f, %.3f])", x, y, z); };
-  return Shape::Composite(write_name, {*this});
+Shape Shape::TranslateZ(double z) && {
+  return std::move(*this).Translate(0, 0, z);
 }
 
-Shape Shape::Rotate(double rx, double ry, double rz) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "rotate ([%.3f, %.3f, %.3f])", rx, ry, rz);
-  };
-  return Shape::Composite(write_name, {*this});
+Shape Shape::Mirror(double x, double y, double z) const& {
+  return Shape(*this).Mirror(x, y, z);
 }
 
-Shape Shape::Rotate(double degrees, double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "rotate (a = %.3f, v = [%.3f, %.3f, %.3f])", degrees, x, y, z);
-  };
-  return Shape::Composite(write_name, {*this});
+Shape Shape::Mirror(double x, double y, double z) && {
+  return WrapParams("mirror", WriteMirror, {x, y, z}, std::move(*this));
 }
 
-Shape Shape::RotateX(double degrees) const {
+Shape Shape::Rotate(double rx, double ry, double rz) const& {
+  return Shape(*this).Rotate(rx, ry, rz);
+}
+
+Shape Shape::Rotate(double rx, double ry, double rz) && {
+  return WrapParams("rotate", WriteRotate, {rx, ry, rz}, std::move(*this));
+}
+
+Shape Shape::Rotate(double degrees, double x, double y, double z) const& {
+  return Shape(*this).Rotate(degrees, x, y, z);
+}
+
+Shape Shape::Rotate(double degrees, double x, double y, double z) && {
+  return WrapParams("rotate", WriteRotateAxis, {degrees, x, y, z}, std::move(*this));
+}
+
+Shape Shape::RotateX(double degrees) const& {
   return Rotate(degrees, 1, 0, 0);
 }
 
-Shape Shape::RotateY(double degrees) const {
+Shape Shape::RotateX(double degrees) && {
+  return std::move(*this).Rotate(degrees, 1, 0, 0);
+}
+
+Shape Shape::RotateY(double degrees) const& {
   return Rotate(degrees, 0, 1, 0);
 }
 
-Shape Shape::RotateZ(double degrees) const {
+Shape Shape::RotateY(double degrees) && {
+  return std::move(*this).Rotate(degrees, 0, 1, 0);
+}
+
+Shape Shape::RotateZ(double degrees) const& {
   return Rotate(degrees, 0, 0, 1);
 }
 
+Shape Shape::RotateZ(double degrees) && {
+  return std::move(*this).Rotate(degrees, 0, 0, 1);
+}
+
 Shape Shape::LinearExtrude(const LinearExtrudeParams& params) const {
+  if (params.convexity == LinearExtrudeParams().convexity) {
+    return WrapParams("linear_extrude",
+                      WriteLinearExtrude,
+                      {params.height,
+                       params.center ? 1.0 : 0.0,
+                       params.twist,
+                       static_cast<double>(params.slices),
+                       params.scale},
+                      Shape(*this));
+  }
   auto write_name = [=](std::FILE* file) {
     fprintf(file,
             "linear_extrude (height = %.3f, center = %s, convexity = %.3f, "
@@ -323,7 +876,7 @@ Shape Shape::LinearExtrude(const LinearExtrudeParams& params) const {
             params.slices,
             params.scale);
   };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite("linear_extrude", write_name, {*this});
 }
 
 Shape Shape::LinearExtrude(double height) const {
@@ -332,26 +885,30 @@ Shape Shape::LinearExtrude(double height) const {
   return LinearExtrude(params);
 }
 
-Shape Shape::Color(double r, double g, double b, double a) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "color (c = [%.3f, %.3f, %.3f, %.3f])", r, g, b, a);
-  };
-  return Shape::Composite(write_name, {*this});
+Shape Shape::Color(double r, double g, double b, double a) const& {
+  return Shape(*this).Color(r, g, b, a);
+}
+
+Shape Shape::Color(double r, double g, double b, double a) && {
+  return WrapParams("color", WriteColor, {r, g, b, a}, std::move(*this));
 }
 
 Shape Shape::Color(const std::string& color, double a) const {
   auto write_name = [=](std::FILE* file) { fprintf(file, "color (\"%s\", %f)", color.c_str(), a); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite("color", write_name, {*this});
 }
 
 Shape Shape::Alpha(double a) const {
   auto write_name = [=](std::FILE* file) { fprintf(file, "color (alpha = %.3f)", a); };
-  return Shape::Composite(write_name, {*this});
+  return Shape::Composite("color", write_name, {*this});
 }
 
-Shape Shape::Scale(double x, double y, double z) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "scale ([%.3f, %.3f, %.3f])", x, y, z); };
-  return Shape::Composite(write_name, {*this});
+Shape Shape::Scale(double x, double y, double z) const& {
+  return Shape(*this).Scale(x, y, z);
+}
+
+Shape Shape::Scale(double x, double y, double z) && {
+  return WrapParams("scale", WriteScale, {x, y, z}, std::move(*this));
 }
 
 Shape Shape::Scale(double s) const {
@@ -359,17 +916,21 @@ Shape Shape::Scale(double s) const {
 }
 
 Shape Shape::OffsetRadius(double r, bool chamfer) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "offset (r = %.3f, chamfer = %s)", r, BoolStr(chamfer));
-  };
-  return Shape::Composite(write_name, {*this});
+  double unset = GetParam({});
+  return WrapParams(
+      "offset", WriteOffset, {r, chamfer ? 1.0 : 0.0, 0.0, unset, unset, unset}, Shape(*this));
+}
+
+Shape Shape::OffsetRadius(const CircleParams& params) const {
+  return WrapParams(
+      "offset",
+      WriteOffset,
+      {params.r, 0.0, 0.0, GetParam(params.fs), GetParam(params.fn), GetParam(params.fa)},
+      Shape(*this));
 }
 
 Shape Shape::OffsetDelta(double delta, bool chamfer) const {
-  auto write_name = [=](std::FILE* file) {
-    fprintf(file, "offset (delta = %.3f, chamfer = %s)", delta, BoolStr(chamfer));
-  };
-  return Shape::Composite(write_name, {*this});
+  return WrapParams("offset", WriteOffset, {delta, chamfer ? 1.0 : 0.0, 1.0}, Shape(*this));
 }
 
 Shape Shape::Subtract(const Shape& other) const {
@@ -398,28 +959,34 @@ Shape& Shape::operator+=(const Shape& other) {
   return *this;
 }
 
-Shape Shape::Comment(const std::string& comment) const {
-  Shape shape_copy = *this;
-  return Shape([=](std::FILE* file, int indent_level) {
-    WriteIndent(file, indent_level);
-    fprintf(file, "/* %s */\n", comment.c_str());
-    shape_copy.AppendScad(file, indent_level);
-  });
+Shape Shape::Comment(const std::string& comment) const& {
+  return Shape(*this).Comment(comment);
+}
+
+Shape Shape::Comment(const std::string& comment) && {
+  return WrapLabel(ShapeKind::COMMENT, comment, std::move(*this));
+}
+
+Shape Shape::Tag(const std::string& tag) const& {
+  return Shape(*this).Tag(tag);
+}
+
+Shape Shape::Tag(const std::string& tag) && {
+  return WrapLabel(ShapeKind::TAG, tag, std::move(*this));
 }
 
 Shape Shape::Projection(bool cut) const {
-  auto write_name = [=](std::FILE* file) { fprintf(file, "projection (cut = %s)", BoolStr(cut)); };
-  return Shape::Composite(write_name, {*this});
+  return WrapParams("projection", WriteProjection, {cut ? 1.0 : 0.0}, Shape(*this));
 }
 
-void Shape::AppendScad(std::FILE* file, int indent_level) const {
-  if (!scad_) {
-    return;
-  }
-  (*scad_)(file, indent_level);
+long Shape::AppendScad(std::FILE* file, int indent_level) const {
+  long start_nodes = nodes_written;
+  WriteShape(*this, file, indent_level, nullptr);
+  return nodes_written - start_nodes;
 }
 
-void Shape::WriteToFile(const std::string& file_name) const {
+ScadStats Shape::WriteToFile(const std::string& file_name) const {
+  TRACE_SCOPE("WriteToFile", file_name);
   std::FILE* file = nullptr;
   bool opened = false;
 #ifdef _WIN32
@@ -431,24 +998,238 @@ void Shape::WriteToFile(const std::string& file_name) const {
 
   if (!opened || file == nullptr) {
     fprintf(stderr, "Could not open file %s\n", file_name.c_str());
-    return;
+    return {};
   }
-  AppendScad(file, 0);
+  ScadStats stats = WriteStats(*this, file);
   std::fclose(file);
+  return stats;
 }
 
-Shape Import(const std::string& file_name, int convexity) {
-  return Shape::Primitive([=](std::FILE* file) {
-    if (convexity > 0) {
-      fprintf(file, "import (file = \"%s\", convexity = %d);", file_name.c_str(), convexity);
-    } else {
-      fprintf(file, "import (file = \"%s\");", file_name.c_str());
+ScadStats Shape::GetScadStats() const {
+  TRACE_SCOPE("GetScadStats");
+  MemoryFile file;
+  if (file.get() == nullptr) {
+    return {};
+  }
+  return WriteStats(*this, file.get());
+}
+
+ScadStats Shape::WriteToString(std::string* scad) const {
+  TRACE_SCOPE("WriteToString");
+  scad->clear();
+  MemoryFile file(scad);
+  if (file.get() == nullptr) {
+    return {};
+  }
+  ScadStats stats = WriteStats(*this, file.get());
+  file.Close();
+  return stats;
+}
+
+namespace {
+
+// OpenSCAD does hulls natively but the other booleans go through CGAL which is much slower.
+constexpr double kCgalBooleanWeight = 10;
+
+double SortCost(double facets) {
+  return facets * std::log2(facets + 2);
+}
+
+void AddLabeledStats(SubtreeStats* to, const SubtreeStats& from) {
+  ++to->occurrences;
+  to->nodes += from.nodes;
+  to->bytes += from.bytes;
+  to->depth = std::max(to->depth, from.depth);
+  to->hulls += from.hulls;
+  to->unions += from.unions;
+  to->differences += from.differences;
+  to->intersections += from.intersections;
+  to->minkowskis += from.minkowskis;
+  to->facets += from.facets;
+  to->boolean_cost += from.boolean_cost;
+}
+
+// Builds up the stats of every node from its children as the tree is written.
+class AnalysisObserver : public WriteObserver {
+ public:
+  explicit AnalysisObserver(std::FILE* file) : file_(file) {
+    frames_.emplace_back();
+  }
+
+  void Enter(const ShapeNode&) override {
+    frames_.emplace_back();
+    frames_.back().start = std::ftell(file_);
+  }
+
+  void Exit(const ShapeNode& node) override {
+    Frame frame = frames_.back();
+    frames_.pop_back();
+    SubtreeStats& stats = frame.stats;
+    stats.bytes = std::ftell(file_) - frame.start;
+    if (node.kind != ShapeKind::TAG) {
+      ++stats.nodes;
+      ++stats.depth;
     }
-  });
+    if (node.kind == ShapeKind::PRIMITIVE) {
+      stats.facets += node.facets;
+    }
+
+    bool is_boolean = frame.num_children > 1;
+    if (node.op == "hull") {
+      ++stats.hulls;
+      stats.boolean_cost += SortCost(stats.facets);
+    } else if (node.op == "union") {
+      ++stats.unions;
+      stats.boolean_cost += is_boolean ? kCgalBooleanWeight * SortCost(stats.facets) : 0;
+    } else if (node.op == "difference") {
+      ++stats.differences;
+      stats.boolean_cost += is_boolean ? kCgalBooleanWeight * SortCost(stats.facets) : 0;
+    } else if (node.op == "intersection") {
+      ++stats.intersections;
+      stats.boolean_cost += is_boolean ? kCgalBooleanWeight * SortCost(stats.facets) : 0;
+    } else if (node.op == "minkowski") {
+      // The result has a face for every pair of faces.
+      ++stats.minkowskis;
+      stats.boolean_cost += kCgalBooleanWeight * frame.facet_product;
+    }
+
+    if ((node.kind == ShapeKind::COMMENT || node.kind == ShapeKind::TAG) && !node.label.empty()) {
+      SubtreeStats& labeled = labels_[node.label];
+      labeled.label = node.label;
+      AddLabeledStats(&labeled, stats);
+    }
+
+    Frame& parent = frames_.back();
+    SubtreeStats& parent_stats = parent.stats;
+    parent_stats.nodes += stats.nodes;
+    parent_stats.depth = std::max(parent_stats.depth, stats.depth);
+    parent_stats.hulls += stats.hulls;
+    parent_stats.unions += stats.unions;
+    parent_stats.differences += stats.differences;
+    parent_stats.intersections += stats.intersections;
+    parent_stats.minkowskis += stats.minkowskis;
+    parent_stats.facets += stats.facets;
+    parent_stats.boolean_cost += stats.boolean_cost;
+    parent.facet_product *= std::max(1L, stats.facets);
+    ++parent.num_children;
+  }
+
+  ShapeAnalysis Finish() {
+    ShapeAnalysis analysis;
+    analysis.total = frames_[0].stats;
+    analysis.total.label = "total";
+    analysis.total.occurrences = 1;
+    analysis.total.bytes = std::ftell(file_);
+    for (const auto& entry : labels_) {
+      analysis.subtrees.push_back(entry.second);
+    }
+    std::stable_sort(analysis.subtrees.begin(),
+                     analysis.subtrees.end(),
+                     [](const SubtreeStats& a, const SubtreeStats& b) {
+                       if (a.boolean_cost != b.boolean_cost) {
+                         return a.boolean_cost > b.boolean_cost;
+                       }
+                       return a.bytes > b.bytes;
+                     });
+    return analysis;
+  }
+
+ private:
+  struct Frame {
+    SubtreeStats stats;
+    long start = 0;
+    int num_children = 0;
+    double facet_product = 1;
+  };
+
+  std::FILE* file_;
+  std::vector<Frame> frames_;
+  std::map<std::string, SubtreeStats> labels_;
+};
+
+}  // namespace
+
+ShapeAnalysis Shape::Analyze() const {
+  TRACE_SCOPE("Analyze");
+  MemoryFile file;
+  if (file.get() == nullptr) {
+    return {};
+  }
+  AnalysisObserver observer(file.get());
+  WriteShape(*this, file.get(), 0, &observer);
+  return observer.Finish();
+}
+
+void PrintShapeAnalysis(const ShapeAnalysis& analysis, int top_n, std::FILE* file) {
+  fprintf(file,
+          "%-4s %-24s %5s %7s %9s %5s %5s %5s %5s %5s %5s %9s %12s %6s\n",
+          "rank",
+          "subtree",
+          "count",
+          "nodes",
+          "bytes",
+          "depth",
+          "hull",
+          "union",
+          "diff",
+          "inter",
+          "mink",
+          "facets",
+          "cost",
+          "cost%");
+  auto print_row = [&](const std::string& rank, const SubtreeStats& s) {
+    double percent =
+        analysis.total.boolean_cost > 0 ? 100 * s.boolean_cost / analysis.total.boolean_cost : 0;
+    fprintf(file,
+            "%-4s %-24s %5d %7ld %9ld %5d %5d %5d %5d %5d %5d %9ld %12.0f %5.1f%%\n",
+            rank.c_str(),
+            s.label.c_str(),
+            s.occurrences,
+            s.nodes,
+            s.bytes,
+            s.depth,
+            s.hulls,
+            s.unions,
+            s.differences,
+            s.intersections,
+            s.minkowskis,
+            s.facets,
+            s.boolean_cost,
+            percent);
+  };
+  for (int i = 0; i < top_n && i < (int)analysis.subtrees.size(); ++i) {
+    print_row(std::to_string(i + 1), analysis.subtrees[i]);
+  }
+  print_row("", analysis.total);
+}
+
+Shape Import(const std::string& file_name, int convexity) {
+  ShapeNode* node =
+      NewParamsNode(ShapeKind::PRIMITIVE, "import", WriteImport, {(double)convexity});
+  node->label = file_name;
+  return Shape(node);
 }
 
 Shape Minkowski(const Shape& first, const Shape& second) {
-  return Shape::LiteralComposite("minkowski ()", {first, second});
+  std::initializer_list<Shape> shapes = {first, second};
+  return NamedComposite("minkowski ()", shapes.begin(), shapes.end());
+}
+
+const Shape& InternShape(const char* key, Shape (*build)()) {
+  static std::mutex mutex;
+  static std::map<std::string, Shape, std::less<>> shapes;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = shapes.find(std::string_view(key));
+    if (it != shapes.end()) {
+      return it->second;
+    }
+  }
+  // Built without the lock so build can intern the shapes it uses. If two threads race the first
+  // one to finish wins.
+  Shape shape = build();
+  std::lock_guard<std::mutex> lock(mutex);
+  return shapes.emplace(key, std::move(shape)).first->second;
 }
 
 }  // namespace scad
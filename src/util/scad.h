@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdio>
 #include <functional>
+#include <initializer_list>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #if defined(__GNUC__) || defined(__GNUG__)
@@ -48,51 +52,176 @@ struct LinearExtrudeParams {
   bool center = true;
 };
 
+// Size of the scad written for a shape. Every primitive, operation and comment is a node.
+struct ScadStats {
+  long nodes = 0;
+  long bytes = 0;
+};
+
+// Render cost of a subtree, see Shape::Analyze.
+struct SubtreeStats {
+  std::string label;
+  // How many times a subtree with this label was written.
+  int occurrences = 0;
+  long nodes = 0;
+  long bytes = 0;
+  int depth = 0;
+  int hulls = 0;
+  int unions = 0;
+  int differences = 0;
+  int intersections = 0;
+  int minkowskis = 0;
+  // Triangles (or edges for 2d shapes) of the primitives as OpenSCAD would tessellate them.
+  long facets = 0;
+  // Relative estimate of the time OpenSCAD spends on the booleans. Only useful for comparing
+  // subtrees.
+  double boolean_cost = 0;
+};
+
+struct ShapeAnalysis {
+  SubtreeStats total;
+  // One entry per label, most expensive first.
+  std::vector<SubtreeStats> subtrees;
+};
+
+void PrintShapeAnalysis(const ShapeAnalysis& analysis, int top_n, std::FILE* file);
+
+enum class ShapeKind {
+  PRIMITIVE,
+  COMPOSITE,
+  COMMENT,
+  // Labels a subtree for Analyze without writing anything.
+  TAG,
+  // Written by a ScadWriter and can't be inspected.
+  CUSTOM,
+};
+
+struct ShapeNode;
+struct CircleParams;
+
 class Shape {
  public:
   Shape() {
   }
-  explicit Shape(std::shared_ptr<ScadWriter> scad) : scad_(std::move(scad)) {
-  }
-  explicit Shape(ScadWriter scad) : scad_(std::make_shared<ScadWriter>(std::move(scad))) {
+  // Takes over a node from NewNode.
+  explicit Shape(ShapeNode* node) : node_(node) {
   }
+  explicit Shape(std::shared_ptr<ScadWriter> scad);
+  explicit Shape(ScadWriter scad);
 
+  // op is the OpenSCAD name of the operation, e.g. "translate". It is only used by Analyze.
+  static Shape Composite(const std::string& op,
+                         const std::function<void(std::FILE*)>& write_name,
+                         const std::vector<Shape>& shapes);
+  static Shape Composite(const std::string& op,
+                         const std::function<void(std::FILE*)>& write_name,
+                         std::vector<Shape>&& shapes);
   static Shape Composite(const std::function<void(std::FILE*)>& write_name,
                          const std::vector<Shape>& shapes);
   static Shape LiteralComposite(const std::string& name, const std::vector<Shape>& shapes);
+  // facets is the size of the primitive once tessellated, see SubtreeStats::facets.
+  static Shape Primitive(const std::string& op,
+                         long facets,
+                         const std::function<void(std::FILE*)>& scad_writer);
   static Shape Primitive(const std::function<void(std::FILE*)>& scad_writer);
   static Shape LiteralPrimitive(const std::string& primitive);
+  // A copy of the composite node with different children, keeping how it is written.
+  static Shape WithChildren(const ShapeNode& node, std::vector<Shape>&& children);
+
+  // A node with one reference, for the Shape constructor to take over.
+  static ShapeNode* NewNode();
+
+  Shape(const Shape& other) : node_(other.node_) {
+    AddReference();
+  }
+  Shape(Shape&& other) noexcept : node_(other.node_) {
+    other.node_ = nullptr;
+  }
+  Shape& operator=(const Shape& other) {
+    other.AddReference();
+    RemoveReference();
+    node_ = other.node_;
+    return *this;
+  }
+  Shape& operator=(Shape&& other) noexcept {
+    if (this != &other) {
+      RemoveReference();
+      node_ = other.node_;
+      other.node_ = nullptr;
+    }
+    return *this;
+  }
+  ~Shape() {
+    RemoveReference();
+  }
 
-  void WriteToFile(const std::string& file_name) const;
-  void AppendScad(std::FILE* file, int indent_level) const;
+  // Null for the empty shape.
+  const ShapeNode* node() const {
+    return node_;
+  }
 
-  Shape SCAD_WARN_UNUSED_RESULT Translate(double x, double y, double z) const;
-  Shape SCAD_WARN_UNUSED_RESULT TranslateX(double x) const;
-  Shape SCAD_WARN_UNUSED_RESULT TranslateY(double y) const;
-  Shape SCAD_WARN_UNUSED_RESULT TranslateZ(double z) const;
+  ScadStats WriteToFile(const std::string& file_name) const;
+  // Returns the number of nodes written.
+  long AppendScad(std::FILE* file, int indent_level) const;
+  // The stats WriteToFile would return without keeping the output.
+  ScadStats GetScadStats() const;
+  // Same as WriteToFile but keeps the output in memory.
+  ScadStats WriteToString(std::string* scad) const;
+  // Measures every labeled subtree (Comment or Tag) by writing the scad to a file which only
+  // counts the bytes.
+  ShapeAnalysis Analyze() const;
+
+  // The transforms have an overload for temporaries which moves the shape into the new node
+  // instead of copying it, so chains like Cube(1).Translate(1, 2, 3).RotateZ(90) don't touch the
+  // reference counts.
+  Shape SCAD_WARN_UNUSED_RESULT Translate(double x, double y, double z) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Translate(double x, double y, double z) &&;
+  Shape SCAD_WARN_UNUSED_RESULT TranslateX(double x) const&;
+  Shape SCAD_WARN_UNUSED_RESULT TranslateX(double x) &&;
+  Shape SCAD_WARN_UNUSED_RESULT TranslateY(double y) const&;
+  Shape SCAD_WARN_UNUSED_RESULT TranslateY(double y) &&;
+  Shape SCAD_WARN_UNUSED_RESULT TranslateZ(double z) const&;
+  Shape SCAD_WARN_UNUSED_RESULT TranslateZ(double z) &&;
   template <typename Vec3>
-  Shape SCAD_WARN_UNUSED_RESULT Translate(const Vec3& v) const {
+  Shape SCAD_WARN_UNUSED_RESULT Translate(const Vec3& v) const& {
     return Translate(v.x, v.y, v.z);
   }
+  template <typename Vec3>
+  Shape SCAD_WARN_UNUSED_RESULT Translate(const Vec3& v) && {
+    return std::move(*this).Translate(v.x, v.y, v.z);
+  }
 
-  Shape SCAD_WARN_UNUSED_RESULT Mirror(double x, double y, double z) const;
-  Shape SCAD_WARN_UNUSED_RESULT MirrorY() const {
+  Shape SCAD_WARN_UNUSED_RESULT Mirror(double x, double y, double z) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Mirror(double x, double y, double z) &&;
+  Shape SCAD_WARN_UNUSED_RESULT MirrorY() const& {
     return Mirror(0, 1, 0);
   }
-  Shape SCAD_WARN_UNUSED_RESULT MirrorX() const {
+  Shape SCAD_WARN_UNUSED_RESULT MirrorY() && {
+    return std::move(*this).Mirror(0, 1, 0);
+  }
+  Shape SCAD_WARN_UNUSED_RESULT MirrorX() const& {
     return Mirror(1, 0, 0);
   }
+  Shape SCAD_WARN_UNUSED_RESULT MirrorX() && {
+    return std::move(*this).Mirror(1, 0, 0);
+  }
 
-  Shape SCAD_WARN_UNUSED_RESULT Rotate(double rx, double ry, double rz) const;
-  Shape SCAD_WARN_UNUSED_RESULT Rotate(double degrees, double x, double y, double z) const;
-  Shape SCAD_WARN_UNUSED_RESULT RotateX(double degrees) const;
-  Shape SCAD_WARN_UNUSED_RESULT RotateY(double degrees) const;
-  Shape SCAD_WARN_UNUSED_RESULT RotateZ(double degrees) const;
+  Shape SCAD_WARN_UNUSED_RESULT Rotate(double rx, double ry, double rz) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Rotate(double rx, double ry, double rz) &&;
+  Shape SCAD_WARN_UNUSED_RESULT Rotate(double degrees, double x, double y, double z) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Rotate(double degrees, double x, double y, double z) &&;
+  Shape SCAD_WARN_UNUSED_RESULT RotateX(double degrees) const&;
+  Shape SCAD_WARN_UNUSED_RESULT RotateX(double degrees) &&;
+  Shape SCAD_WARN_UNUSED_RESULT RotateY(double degrees) const&;
+  Shape SCAD_WARN_UNUSED_RESULT RotateY(double degrees) &&;
+  Shape SCAD_WARN_UNUSED_RESULT RotateZ(double degrees) const&;
+  Shape SCAD_WARN_UNUSED_RESULT RotateZ(double degrees) &&;
 
   Shape SCAD_WARN_UNUSED_RESULT LinearExtrude(const LinearExtrudeParams& params) const;
   Shape SCAD_WARN_UNUSED_RESULT LinearExtrude(double height) const;
 
-  Shape SCAD_WARN_UNUSED_RESULT Color(double r, double g, double b, double a = 1.0) const;
+  Shape SCAD_WARN_UNUSED_RESULT Color(double r, double g, double b, double a = 1.0) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Color(double r, double g, double b, double a = 1.0) &&;
   Shape SCAD_WARN_UNUSED_RESULT Color(const std::string& color, double a = 1) const;
   Shape SCAD_WARN_UNUSED_RESULT Alpha(double a) const;
 
@@ -104,20 +233,67 @@ class Shape {
   Shape operator+(const Shape& other) const;
   Shape& operator+=(const Shape& other);
 
-  Shape SCAD_WARN_UNUSED_RESULT Scale(double x, double y, double z) const;
+  Shape SCAD_WARN_UNUSED_RESULT Scale(double x, double y, double z) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Scale(double x, double y, double z) &&;
   Shape SCAD_WARN_UNUSED_RESULT Scale(double s) const;
 
   Shape SCAD_WARN_UNUSED_RESULT OffsetRadius(double r, bool chamfer = false) const;
+  // Round corners have the fragments of Circle(params), like offset (r, $fn, $fa, $fs).
+  Shape SCAD_WARN_UNUSED_RESULT OffsetRadius(const CircleParams& params) const;
   Shape SCAD_WARN_UNUSED_RESULT OffsetDelta(double delta, bool chamfer = false) const;
 
-  Shape SCAD_WARN_UNUSED_RESULT Comment(const std::string& comment) const;
+  Shape SCAD_WARN_UNUSED_RESULT Comment(const std::string& comment) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Comment(const std::string& comment) &&;
+  // Labels the shape for Analyze. Does not change the scad.
+  Shape SCAD_WARN_UNUSED_RESULT Tag(const std::string& tag) const&;
+  Shape SCAD_WARN_UNUSED_RESULT Tag(const std::string& tag) &&;
 
   Shape SCAD_WARN_UNUSED_RESULT Projection(bool cut = false) const;
 
  private:
-  std::shared_ptr<const ScadWriter> scad_;
+  inline void AddReference() const;
+  inline void RemoveReference();
+
+  const ShapeNode* node_ = nullptr;
+};
+
+// Nodes are immutable once built and shared between every shape using them.
+struct ShapeNode {
+  ShapeKind kind = ShapeKind::CUSTOM;
+  // The OpenSCAD name of the primitive or operation, e.g. "cube" or "hull".
+  std::string op;
+  // Writes a primitive, or a composite up to the opening brace.
+  std::function<void(std::FILE*)> write_name;
+  // Used instead of write_name if set. The built in operations write themselves from params so
+  // they don't need a closure, which std::function would allocate.
+  void (*write_params)(std::FILE* file, const ShapeNode& node) = nullptr;
+  static constexpr int kMaxParams = 6;
+  double params[kMaxParams] = {};
+  std::vector<Shape> children;
+  // The comment or tag, or the file read by an import.
+  std::string label;
+  long facets = 0;
+  ScadWriter custom_writer;
+
+  // Shapes using the node.
+  mutable std::atomic<int> references{1};
 };
 
+void Shape::AddReference() const {
+  if (node_) {
+    node_->references.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Shape::RemoveReference() {
+  if (node_ && node_->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete node_;
+  }
+}
+
+// Whether a "rotate" node is Rotate(degrees, x, y, z) rather than Rotate(rx, ry, rz).
+bool IsAxisRotation(const ShapeNode& node);
+
 struct CubeParams {
   double x = 1;
   double y = 1;
@@ -128,6 +304,14 @@ Shape SCAD_WARN_UNUSED_RESULT Cube(const CubeParams& params);
 Shape SCAD_WARN_UNUSED_RESULT Cube(double x, double y, double z, bool center = true);
 Shape SCAD_WARN_UNUSED_RESULT Cube(double size, bool center = true);
 
+// The number of fragments OpenSCAD uses for a circle of radius r.
+long GetFragments(double r,
+                  Optional<double> fn,
+                  Optional<double> fa = {},
+                  Optional<double> fs = {});
+// Primitives keep unset optional params as NaN.
+Optional<double> GetOptionalParam(double param);
+
 struct SphereParams {
   double r = 1;
   Optional<double> fn;
@@ -172,6 +356,8 @@ struct Point2d {
   double y = 0;
 };
 Shape SCAD_WARN_UNUSED_RESULT Polygon(const std::vector<Point2d>& points);
+// A polygon with holes, one path per outline or hole.
+Shape SCAD_WARN_UNUSED_RESULT Polygon(const std::vector<std::vector<Point2d>>& paths);
 
 Shape SCAD_WARN_UNUSED_RESULT RegularPolygon(int n, double radius);
 
@@ -180,11 +366,15 @@ struct Point3d {
   double y = 0;
   double z = 0;
 };
-Shape SCAD_WARN_UNUSED_RESULT Polyhedron(const std::vector<Point3d>& points,
-                                         const std::vector<std::vector<int>>& faces,
+// The points and faces are kept until the shape is released. Pass them with std::move to avoid a
+// copy, or write very large meshes with ScadStream instead.
+Shape SCAD_WARN_UNUSED_RESULT Polyhedron(std::vector<Point3d> points,
+                                         std::vector<std::vector<int>> faces,
                                          int convexity = 1);
 
 Shape SCAD_WARN_UNUSED_RESULT HullAll(const std::vector<Shape>& shapes);
+Shape SCAD_WARN_UNUSED_RESULT HullAll(std::vector<Shape>&& shapes);
+Shape SCAD_WARN_UNUSED_RESULT HullAll(std::initializer_list<Shape> shapes);
 
 template <typename... Shapes>
 Shape SCAD_WARN_UNUSED_RESULT Hull(const Shape& shape, const Shapes&... more_shapes) {
@@ -192,6 +382,8 @@ Shape SCAD_WARN_UNUSED_RESULT Hull(const Shape& shape, const Shapes&... more_sha
 }
 
 Shape SCAD_WARN_UNUSED_RESULT UnionAll(const std::vector<Shape>& shapes);
+Shape SCAD_WARN_UNUSED_RESULT UnionAll(std::vector<Shape>&& shapes);
+Shape SCAD_WARN_UNUSED_RESULT UnionAll(std::initializer_list<Shape> shapes);
 
 template <typename... Shapes>
 Shape SCAD_WARN_UNUSED_RESULT Union(const Shape& shape, const Shapes&... more_shapes) {
@@ -199,6 +391,8 @@ Shape SCAD_WARN_UNUSED_RESULT Union(const Shape& shape, const Shapes&... more_sh
 }
 
 Shape SCAD_WARN_UNUSED_RESULT DifferenceAll(const std::vector<Shape>& shapes);
+Shape SCAD_WARN_UNUSED_RESULT DifferenceAll(std::vector<Shape>&& shapes);
+Shape SCAD_WARN_UNUSED_RESULT DifferenceAll(std::initializer_list<Shape> shapes);
 
 template <typename... Shapes>
 Shape SCAD_WARN_UNUSED_RESULT Difference(const Shape& shape, const Shapes&... more_shapes) {
@@ -206,6 +400,8 @@ Shape SCAD_WARN_UNUSED_RESULT Difference(const Shape& shape, const Shapes&... mo
 }
 
 Shape SCAD_WARN_UNUSED_RESULT IntersectionAll(const std::vector<Shape>& shapes);
+Shape SCAD_WARN_UNUSED_RESULT IntersectionAll(std::vector<Shape>&& shapes);
+Shape SCAD_WARN_UNUSED_RESULT IntersectionAll(std::initializer_list<Shape> shapes);
 
 template <typename... Shapes>
 Shape SCAD_WARN_UNUSED_RESULT Intersection(const Shape& shape, const Shapes&... more_shapes) {
@@ -216,6 +412,11 @@ Shape SCAD_WARN_UNUSED_RESULT Import(const std::string& file_name, int convexity
 
 Shape SCAD_WARN_UNUSED_RESULT Minkowski(const Shape& first, const Shape& second);
 
+// Returns the shape build returned the first time it was called with key, so shapes which are the
+// same every time, like the post connector, are built once and shared by every caller. The shape
+// lives until the process exits.
+const Shape& InternShape(const char* key, Shape (*build)());
+
 const char* BoolStr(bool b);
 void WriteIndent(std::FILE* file, int indent_level);
 void WriteComposite(std::FILE* file,
@@ -0,0 +1,162 @@
+#include "scad_stream.h"
+
+#include <cstdio>
+#include <string>
+
+#include "scad.h"
+#include "trace.h"
+
+namespace scad {
+
+ScadStream::~ScadStream() {
+  Close();
+}
+
+bool ScadStream::CheckNoPolyhedron(const char* call) const {
+  if (polyhedron_ == PolyhedronState::NONE) {
+    return true;
+  }
+  fprintf(stderr, "ScadStream: %s called before EndPolyhedron\n", call);
+  return false;
+}
+
+bool ScadStream::Open(const std::string& file_name) {
+  Close();
+#ifdef _WIN32
+  if (fopen_s(&file_, file_name.c_str(), "w") != 0) {
+    file_ = nullptr;
+  }
+#else
+  file_ = std::fopen(file_name.c_str(), "w");
+#endif
+  if (file_ == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  nodes_ = 0;
+  return true;
+}
+
+ScadStats ScadStream::Close() {
+  if (file_ == nullptr) {
+    return {};
+  }
+  // Still ended so the file can be read, but the polyhedron is probably missing points or faces.
+  if (!CheckNoPolyhedron("Close")) {
+    EndPolyhedron();
+  }
+  while (depth_ > 0) {
+    End();
+  }
+  ScadStats result = stats();
+  std::fclose(file_);
+  file_ = nullptr;
+  return result;
+}
+
+void ScadStream::Begin(const std::string& name) {
+  if (file_ == nullptr || !CheckNoPolyhedron("Begin")) {
+    return;
+  }
+  WriteIndent(file_, depth_);
+  fprintf(file_, "%s {\n", name.c_str());
+  ++depth_;
+  ++nodes_;
+}
+
+void ScadStream::End() {
+  if (file_ == nullptr || depth_ == 0 || !CheckNoPolyhedron("End")) {
+    return;
+  }
+  --depth_;
+  WriteIndent(file_, depth_);
+  fprintf(file_, "}\n");
+}
+
+void ScadStream::Comment(const std::string& comment) {
+  if (file_ == nullptr || !CheckNoPolyhedron("Comment")) {
+    return;
+  }
+  WriteIndent(file_, depth_);
+  fprintf(file_, "/* %s */\n", comment.c_str());
+  ++nodes_;
+}
+
+void ScadStream::Write(Shape shape) {
+  if (file_ == nullptr || !CheckNoPolyhedron("Write")) {
+    return;
+  }
+  TRACE_SCOPE("ScadStream::Write");
+  nodes_ += shape.AppendScad(file_, depth_);
+}
+
+void ScadStream::BeginPolyhedron() {
+  if (file_ == nullptr || !CheckNoPolyhedron("BeginPolyhedron")) {
+    return;
+  }
+  WriteIndent(file_, depth_);
+  fprintf(file_, "polyhedron (points = [");
+  polyhedron_ = PolyhedronState::POINTS;
+  polyhedron_points_ = 0;
+  polyhedron_faces_ = 0;
+  ++nodes_;
+}
+
+void ScadStream::AddPoint(double x, double y, double z) {
+  if (file_ == nullptr) {
+    return;
+  }
+  if (polyhedron_ != PolyhedronState::POINTS) {
+    fprintf(stderr, "ScadStream: points must be added after BeginPolyhedron and before faces\n");
+    return;
+  }
+  if (polyhedron_points_++ > 0) {
+    fputc(',', file_);
+  }
+  fprintf(file_, "[%.3f, %.3f, %.3f]", x, y, z);
+}
+
+void ScadStream::AddFace(const int* indices, size_t count) {
+  if (file_ == nullptr) {
+    return;
+  }
+  if (polyhedron_ == PolyhedronState::NONE) {
+    fprintf(stderr, "ScadStream: faces must be added after BeginPolyhedron\n");
+    return;
+  }
+  if (polyhedron_ == PolyhedronState::POINTS) {
+    fprintf(file_, "], faces = [");
+    polyhedron_ = PolyhedronState::FACES;
+  }
+  if (polyhedron_faces_++ > 0) {
+    fputc(',', file_);
+  }
+  fprintf(file_, "[");
+  for (size_t i = 0; i < count; ++i) {
+    if (i != 0) {
+      fputc(',', file_);
+    }
+    fprintf(file_, "%d", indices[i]);
+  }
+  fprintf(file_, "]");
+}
+
+void ScadStream::EndPolyhedron(int convexity) {
+  if (file_ == nullptr || polyhedron_ == PolyhedronState::NONE) {
+    return;
+  }
+  if (polyhedron_ == PolyhedronState::POINTS) {
+    fprintf(file_, "], faces = [");
+  }
+  fprintf(file_, "], convexity = %d);\n", convexity);
+  polyhedron_ = PolyhedronState::NONE;
+}
+
+ScadStats ScadStream::stats() const {
+  ScadStats result;
+  result.nodes = nodes_;
+  result.bytes = file_ ? std::ftell(file_) : 0;
+  return result;
+}
+
+}  // namespace scad
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "scad.h"
+
+namespace scad {
+
+// Writes scad as it is produced instead of building the whole tree and writing it at the end, so
+// the memory needed is that of the subtree being built rather than the whole model. Composites are
+// opened and closed around their children, subtrees are written and released as soon as they are
+// pushed, and polyhedra are written a point and a face at a time.
+//
+//   ScadStream stream;
+//   stream.Open("case.scad");
+//   stream.Begin("union ()");
+//   for (const Key& key : keys) {
+//     stream.Write(key.GetSwitch());
+//   }
+//   stream.BeginPolyhedron();
+//   stream.AddPoint(0, 0, 0);
+//   ...
+//   stream.AddFace({0, 1, 2});
+//   stream.EndPolyhedron();
+//   stream.End();
+//   ScadStats stats = stream.Close();
+class ScadStream {
+ public:
+  ScadStream() {
+  }
+  ~ScadStream();
+
+  ScadStream(const ScadStream&) = delete;
+  ScadStream& operator=(const ScadStream&) = delete;
+
+  bool Open(const std::string& file_name);
+  // Closes every composite still open and the file. A polyhedron still open is reported and ended.
+  ScadStats Close();
+
+  // Opens a composite written as name, e.g. "union ()" or "translate ([1, 0, 0])".
+  void Begin(const std::string& name);
+  void End();
+  void Comment(const std::string& comment);
+
+  // Writes the subtree and drops the stream's reference so it can be freed right away.
+  void Write(Shape shape);
+
+  // Points must all be added before the first face. Faces index the points in the order added.
+  // Nothing else can be written until EndPolyhedron, and calls which would nest a node inside the
+  // polyhedron are reported and ignored.
+  void BeginPolyhedron();
+  void AddPoint(double x, double y, double z);
+  void AddFace(const int* indices, size_t count);
+  void AddFace(std::initializer_list<int> indices) {
+    AddFace(indices.begin(), indices.size());
+  }
+  void AddFace(const std::vector<int>& indices) {
+    AddFace(indices.data(), indices.size());
+  }
+  void EndPolyhedron(int convexity = 1);
+
+  // Open composites, not counting a polyhedron.
+  int depth() const {
+    return depth_;
+  }
+  // What has been written so far.
+  ScadStats stats() const;
+
+ private:
+  enum class PolyhedronState { NONE, POINTS, FACES };
+
+  // Reports the call if a polyhedron is open.
+  bool CheckNoPolyhedron(const char* call) const;
+
+  std::FILE* file_ = nullptr;
+  int depth_ = 0;
+  long nodes_ = 0;
+  PolyhedronState polyhedron_ = PolyhedronState::NONE;
+  long polyhedron_points_ = 0;
+  long polyhedron_faces_ = 0;
+};
+
+}  // namespace scad
@@ -0,0 +1,394 @@
+#include "slicer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "mesh.h"
+#include "parallel.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// Where a triangle crosses a layer. The ends are named by the mesh edges they lie on, which the
+// neighbouring triangles share, so the segments can be joined into loops without comparing points.
+struct Segment {
+  glm::vec2 start;
+  glm::vec2 end;
+  long long start_edge;
+  long long end_edge;
+};
+
+long long GetEdgeKey(int a, int b) {
+  return a < b ? ((long long)a << 32) | b : ((long long)b << 32) | a;
+}
+
+float Cross(const glm::vec2& a, const glm::vec2& b) {
+  return a.x * b.y - a.y * b.x;
+}
+
+std::vector<Segment> GetSegments(const Mesh& mesh, const std::vector<int>& triangles, float z) {
+  std::vector<Segment> segments;
+  for (int t : triangles) {
+    const std::array<int, 3>& corners = mesh.triangles[t];
+    Segment segment;
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+      const glm::vec3& p = mesh.vertices[corners[i]];
+      const glm::vec3& q = mesh.vertices[corners[(i + 1) % 3]];
+      // Corners on the plane count as above so every crossing is on exactly two edges.
+      if ((p.z > z) == (q.z > z)) {
+        continue;
+      }
+      // Going round the triangle, which winds counter clockwise from outside, the segment starts
+      // where the edges go down through the plane. That puts the material on its left.
+      glm::vec2 point = glm::vec2(p + (z - p.z) / (q.z - p.z) * (q - p));
+      long long edge = GetEdgeKey(corners[i], corners[(i + 1) % 3]);
+      if (p.z > z) {
+        segment.start = point;
+        segment.start_edge = edge;
+      } else {
+        segment.end = point;
+        segment.end_edge = edge;
+      }
+      ++count;
+    }
+    if (count == 2) {
+      segments.push_back(segment);
+    }
+  }
+  return segments;
+}
+
+// Joins the segments into loops, starting with the chains which have a loose end. Where the mesh
+// is non-manifold, more than one segment starts on an edge and any of them will do.
+void JoinSegments(const std::vector<Segment>& segments, SliceLayer* layer) {
+  std::unordered_map<long long, std::vector<int>> starts;
+  std::unordered_set<long long> ends;
+  for (int i = 0; i < (int)segments.size(); ++i) {
+    starts[segments[i].start_edge].push_back(i);
+    ends.insert(segments[i].end_edge);
+  }
+  std::vector<bool> used(segments.size());
+  auto follow = [&](int first) {
+    std::vector<glm::vec2> contour;
+    int i = first;
+    while (true) {
+      used[i] = true;
+      contour.push_back(segments[i].start);
+      if (segments[i].end_edge == segments[first].start_edge) {
+        break;
+      }
+      std::vector<int>& next = starts[segments[i].end_edge];
+      while (!next.empty() && used[next.back()]) {
+        next.pop_back();
+      }
+      if (next.empty()) {
+        ++layer->open_contours;
+        return;
+      }
+      i = next.back();
+    }
+    layer->contours.push_back(std::move(contour));
+  };
+  for (int i = 0; i < (int)segments.size(); ++i) {
+    if (!used[i] && ends.count(segments[i].start_edge) == 0) {
+      follow(i);
+    }
+  }
+  for (int i = 0; i < (int)segments.size(); ++i) {
+    if (!used[i]) {
+      follow(i);
+    }
+  }
+  for (const std::vector<glm::vec2>& contour : layer->contours) {
+    for (size_t i = 0; i < contour.size(); ++i) {
+      layer->area += 0.5 * Cross(contour[i], contour[(i + 1) % contour.size()]);
+    }
+  }
+}
+
+// Looks inwards from points along every segment for the other side of the material, up to
+// nozzle_width away. Segments are bucketed in a grid of nozzle_width cells so each look only
+// checks the segments nearby.
+void FindThinPoints(const std::vector<Segment>& segments,
+                    const SliceOptions& options,
+                    SliceLayer* layer,
+                    glm::vec2* thinnest_point) {
+  float width = options.nozzle_width;
+  auto get_cell = [&](const glm::vec2& p) {
+    return glm::ivec2(glm::floor(p / width));
+  };
+  auto get_cell_key = [](int x, int y) {
+    return ((long long)x << 32) | (unsigned int)y;
+  };
+  std::vector<std::pair<long long, int>> cells;
+  for (int i = 0; i < (int)segments.size(); ++i) {
+    glm::ivec2 min = get_cell(glm::min(segments[i].start, segments[i].end));
+    glm::ivec2 max = get_cell(glm::max(segments[i].start, segments[i].end));
+    for (int x = min.x; x <= max.x; ++x) {
+      for (int y = min.y; y <= max.y; ++y) {
+        cells.push_back({get_cell_key(x, y), i});
+      }
+    }
+  }
+  std::sort(cells.begin(), cells.end());
+
+  layer->min_thickness = width;
+  for (int i = 0; i < (int)segments.size(); ++i) {
+    const Segment& segment = segments[i];
+    glm::vec2 d = segment.end - segment.start;
+    float length = glm::length(d);
+    if (length == 0) {
+      continue;
+    }
+    glm::vec2 inwards = glm::vec2(-d.y, d.x) / length;
+    int samples = std::max(1, (int)std::ceil(2 * length / width));
+    for (int k = 0; k < samples; ++k) {
+      glm::vec2 p = segment.start + d * ((k + 0.5f) / samples);
+      float thickness = width;
+      glm::ivec2 min = get_cell(p - width);
+      glm::ivec2 max = get_cell(p + width);
+      for (int x = min.x; x <= max.x; ++x) {
+        for (int y = min.y; y <= max.y; ++y) {
+          auto range = std::equal_range(cells.begin(),
+                                        cells.end(),
+                                        std::make_pair(get_cell_key(x, y), 0),
+                                        [](const auto& a, const auto& b) {
+                                          return a.first < b.first;
+                                        });
+          for (auto it = range.first; it != range.second; ++it) {
+            const Segment& other = segments[it->second];
+            // The neighbours in the loop meet this segment at a corner, which is not a wall.
+            if (it->second == i || other.end_edge == segment.start_edge ||
+                other.start_edge == segment.end_edge) {
+              continue;
+            }
+            glm::vec2 e = other.end - other.start;
+            float denominator = Cross(inwards, e);
+            if (denominator == 0) {
+              continue;
+            }
+            float t = Cross(other.start - p, e) / denominator;
+            float s = Cross(other.start - p, inwards) / denominator;
+            if (s >= 0 && s <= 1 && t > 0 && t < thickness) {
+              thickness = t;
+            }
+          }
+        }
+      }
+      if (thickness < width) {
+        layer->thin_points.push_back(p);
+        if (thickness < layer->min_thickness) {
+          layer->min_thickness = thickness;
+          *thinnest_point = p;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+SliceResult SliceMesh(const Mesh& mesh, const SliceOptions& options) {
+  TRACE_SCOPE("SliceMesh");
+  SliceResult result;
+  Bounds bounds;
+  for (const glm::vec3& v : mesh.vertices) {
+    bounds.Add(v);
+  }
+  if (mesh.triangles.empty() || options.layer_height <= 0) {
+    return result;
+  }
+  float h = options.layer_height;
+  int layer_count = std::max(1, (int)std::ceil((bounds.max.z - bounds.min.z) / h));
+  result.layers.resize(layer_count);
+
+  // Hand each layer the triangles which span it, and find the overhangs.
+  std::vector<std::vector<int>> layer_triangles(layer_count);
+  float min_normal_z = -std::sin(glm::radians(options.overhang_angle));
+  for (int t = 0; t < (int)mesh.triangles.size(); ++t) {
+    const glm::vec3& a = mesh.vertices[mesh.triangles[t][0]];
+    const glm::vec3& b = mesh.vertices[mesh.triangles[t][1]];
+    const glm::vec3& c = mesh.vertices[mesh.triangles[t][2]];
+    float min_z = std::min({a.z, b.z, c.z});
+    float max_z = std::max({a.z, b.z, c.z});
+    int first = std::max(0, (int)std::floor((min_z - bounds.min.z) / h - 0.5f));
+    int last = std::min(layer_count - 1, (int)std::ceil((max_z - bounds.min.z) / h - 0.5f));
+    for (int i = first; i <= last; ++i) {
+      layer_triangles[i].push_back(t);
+    }
+
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float area = 0.5f * glm::length(normal);
+    if (area == 0 || normal.z / (2 * area) >= min_normal_z ||
+        max_z <= bounds.min.z + 0.5f * h) {
+      continue;
+    }
+    int layer = std::clamp((int)(((a.z + b.z + c.z) / 3 - bounds.min.z) / h), 0, layer_count - 1);
+    result.layers[layer].overhangs.push_back({glm::vec2(a), glm::vec2(b), glm::vec2(c)});
+    result.layers[layer].overhang_area += area;
+    result.overhang_area += area;
+    ++result.overhang_faces;
+  }
+
+  std::vector<glm::vec2> thinnest_points(layer_count);
+  ParallelFor(layer_count, options.jobs, "slice worker", [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i < end; ++i) {
+      SliceLayer& layer = result.layers[i];
+      layer.z = bounds.min.z + (i + 0.5f) * h;
+      std::vector<Segment> segments = GetSegments(mesh, layer_triangles[i], layer.z);
+      JoinSegments(segments, &layer);
+      FindThinPoints(segments, options, &layer, &thinnest_points[i]);
+    }
+  });
+
+  for (int i = 0; i < layer_count; ++i) {
+    const SliceLayer& layer = result.layers[i];
+    result.open_contours += layer.open_contours;
+    if (layer.thin_points.empty()) {
+      continue;
+    }
+    if (result.thin_points == 0 || layer.min_thickness < result.min_thickness) {
+      result.min_thickness = layer.min_thickness;
+      result.thinnest_point = glm::vec3(thinnest_points[i], layer.z);
+    }
+    result.thin_points += layer.thin_points.size();
+  }
+  for (int i = 0; i < layer_count; ++i) {
+    if (!result.layers[i].thin_points.empty() || !result.layers[i].overhangs.empty()) {
+      result.worst_layers.push_back(i);
+    }
+  }
+  std::stable_sort(result.worst_layers.begin(), result.worst_layers.end(), [&](int a, int b) {
+    const SliceLayer& x = result.layers[a];
+    const SliceLayer& y = result.layers[b];
+    if (x.thin_points.size() != y.thin_points.size()) {
+      return x.thin_points.size() > y.thin_points.size();
+    }
+    return x.overhang_area > y.overhang_area;
+  });
+  if ((int)result.worst_layers.size() > options.worst_layers) {
+    result.worst_layers.resize(std::max(0, options.worst_layers));
+  }
+  return result;
+}
+
+void PrintSliceResult(const std::string& name, const SliceResult& result, std::FILE* file) {
+  fprintf(file,
+          "%-24s %5d layers  overhangs %6ld faces %9.1f mm2  thin %6ld points",
+          name.c_str(),
+          (int)result.layers.size(),
+          result.overhang_faces,
+          result.overhang_area,
+          result.thin_points);
+  if (result.thin_points > 0) {
+    fprintf(file,
+            " down to %.3f mm at [%.2f, %.2f, %.2f]",
+            result.min_thickness,
+            result.thinnest_point.x,
+            result.thinnest_point.y,
+            result.thinnest_point.z);
+  }
+  if (result.open_contours > 0) {
+    fprintf(file, "  %ld open contours", result.open_contours);
+  }
+  fprintf(file, "  %s\n", result.ok() ? "ok" : "CHECK");
+  for (int i : result.worst_layers) {
+    const SliceLayer& layer = result.layers[i];
+    fprintf(file,
+            "  layer %4d z %7.2f  area %9.1f mm2  thin %5d points",
+            i,
+            layer.z,
+            layer.area,
+            (int)layer.thin_points.size());
+    if (!layer.thin_points.empty()) {
+      fprintf(file, " down to %.3f mm", layer.min_thickness);
+    }
+    fprintf(file, "  overhangs %8.1f mm2\n", layer.overhang_area);
+  }
+}
+
+bool WriteWorstLayersSvg(const std::string& file_name, const SliceResult& result) {
+  Bounds bounds;
+  for (int i : result.worst_layers) {
+    for (const std::vector<glm::vec2>& contour : result.layers[i].contours) {
+      for (const glm::vec2& p : contour) {
+        bounds.Add(glm::vec3(p, 0));
+      }
+    }
+    for (const std::array<glm::vec2, 3>& overhang : result.layers[i].overhangs) {
+      for (const glm::vec2& p : overhang) {
+        bounds.Add(glm::vec3(p, 0));
+      }
+    }
+  }
+  if (bounds.empty()) {
+    bounds.Add(glm::vec3(0));
+  }
+  std::FILE* file = std::fopen(file_name.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+
+  // Each layer gets a panel with room above it for the label. Units are mm.
+  const float margin = 10;
+  float panel_width = bounds.max.x - bounds.min.x + 2 * margin;
+  float panel_height = bounds.max.y - bounds.min.y + 2 * margin;
+  fprintf(file,
+          "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.1fmm\" height=\"%.1fmm\" "
+          "viewBox=\"0 0 %.1f %.1f\">\n",
+          panel_width * std::max<size_t>(1, result.worst_layers.size()),
+          panel_height,
+          panel_width * std::max<size_t>(1, result.worst_layers.size()),
+          panel_height);
+  for (size_t n = 0; n < result.worst_layers.size(); ++n) {
+    const SliceLayer& layer = result.layers[result.worst_layers[n]];
+    fprintf(file,
+            "<text x=\"%.1f\" y=\"%.1f\" font-size=\"4\">z %.2f</text>\n",
+            n * panel_width + margin,
+            0.6f * margin,
+            layer.z);
+    // Flip y so the layer is seen from above.
+    fprintf(file,
+            "<g transform=\"translate(%.2f %.2f) scale(1 -1)\">\n",
+            n * panel_width + margin - bounds.min.x,
+            bounds.max.y + margin);
+    fprintf(file, "<path fill=\"#ccc\" fill-rule=\"evenodd\" stroke=\"#000\" stroke-width=\"0.1\" d=\"");
+    for (const std::vector<glm::vec2>& contour : layer.contours) {
+      for (size_t i = 0; i < contour.size(); ++i) {
+        fprintf(file, "%s%.3f %.3f ", i == 0 ? "M" : "L", contour[i].x, contour[i].y);
+      }
+      fprintf(file, "Z ");
+    }
+    fprintf(file, "\"/>\n");
+    for (const std::array<glm::vec2, 3>& overhang : layer.overhangs) {
+      fprintf(file,
+              "<polygon fill=\"orange\" fill-opacity=\"0.6\" points=\"%.3f,%.3f %.3f,%.3f "
+              "%.3f,%.3f\"/>\n",
+              overhang[0].x,
+              overhang[0].y,
+              overhang[1].x,
+              overhang[1].y,
+              overhang[2].x,
+              overhang[2].y);
+    }
+    for (const glm::vec2& p : layer.thin_points) {
+      fprintf(file, "<circle fill=\"red\" cx=\"%.3f\" cy=\"%.3f\" r=\"0.3\"/>\n", p.x, p.y);
+    }
+    fprintf(file, "</g>\n");
+  }
+  fprintf(file, "</svg>\n");
+  return std::fclose(file) == 0;
+}
+
+}  // namespace scad
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+namespace scad {
+
+// Finds printability problems in a rendered part before it is sent to a slicer: faces which
+// overhang too far and walls too thin for the nozzle.
+struct SliceOptions {
+  float layer_height = 0.2f;
+  // Downward faces further than this from vertical, in degrees, need support.
+  float overhang_angle = 45;
+  // Material thinner than this in a layer can't be printed.
+  float nozzle_width = 0.4f;
+  // How many of the worst layers to keep for the report and svg.
+  int worst_layers = 4;
+  int jobs = 1;
+};
+
+struct SliceLayer {
+  float z = 0;
+  // Closed loops with the material on the left, so outlines run counter clockwise and holes
+  // clockwise.
+  std::vector<std::vector<glm::vec2>> contours;
+  // Loops which didn't close because of holes or non-manifold edges in the mesh.
+  long open_contours = 0;
+  double area = 0;
+  // Points on the contours where the material inwards is thinner than the nozzle.
+  std::vector<glm::vec2> thin_points;
+  float min_thickness = 0;
+  // The overhanging faces with their center in this layer, seen from above.
+  std::vector<std::array<glm::vec2, 3>> overhangs;
+  double overhang_area = 0;
+};
+
+struct SliceResult {
+  std::vector<SliceLayer> layers;
+  long overhang_faces = 0;
+  double overhang_area = 0;
+  long thin_points = 0;
+  // The thinnest material found and where, if there are any thin_points.
+  float min_thickness = 0;
+  glm::vec3 thinnest_point = glm::vec3(0);
+  long open_contours = 0;
+  // Indexes into layers, worst first: most thin points, then most overhang.
+  std::vector<int> worst_layers;
+
+  bool ok() const {
+    return overhang_faces == 0 && thin_points == 0;
+  }
+};
+
+// Cuts the mesh into layers at the middle of each layer_height from the bottom. The layers are
+// split between jobs threads. Faces lying on the bed don't count as overhangs.
+SliceResult SliceMesh(const Mesh& mesh, const SliceOptions& options);
+
+void PrintSliceResult(const std::string& name, const SliceResult& result, std::FILE* file);
+
+// Draws the worst layers side by side, with the thin points in red and overhangs in orange.
+bool WriteWorstLayersSvg(const std::string& file_name, const SliceResult& result);
+
+}  // namespace scad
@@ -0,0 +1,245 @@
+#include "socket_access.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "clearance.h"
+#include "geometry.h"
+#include "key.h"
+#include "parallel.h"
+#include "trace.h"
+#include "transform.h"
+
+namespace scad {
+namespace {
+
+struct Box {
+  glm::dvec3 min = glm::dvec3(1e30);
+  glm::dvec3 max = glm::dvec3(-1e30);
+};
+
+Box GetBox(const Polytope& polytope) {
+  Box box;
+  for (const glm::dvec3& v : polytope.vertices) {
+    box.min = glm::min(box.min, v);
+    box.max = glm::max(box.max, v);
+  }
+  return box;
+}
+
+// Buckets the obstacles by the cells of a uniform grid their bounds touch, so each key only
+// measures the obstacles around it.
+class ObstacleGrid {
+ public:
+  ObstacleGrid(const std::vector<SocketObstacle>& obstacles, double cell_size)
+      : cell_size_(cell_size) {
+    for (int i = 0; i < (int)obstacles.size(); ++i) {
+      if (obstacles[i].polytope.empty()) {
+        continue;
+      }
+      ForEachCell(GetBox(obstacles[i].polytope), [&](const std::array<int, 3>& cell) {
+        cells_[cell].push_back(i);
+      });
+    }
+  }
+
+  // The obstacles in the cells touched by the box, each once.
+  std::vector<int> Find(const Box& box) const {
+    std::vector<int> found;
+    ForEachCell(box, [&](const std::array<int, 3>& cell) {
+      auto it = cells_.find(cell);
+      if (it != cells_.end()) {
+        found.insert(found.end(), it->second.begin(), it->second.end());
+      }
+    });
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    return found;
+  }
+
+ private:
+  template <typename Fn>
+  void ForEachCell(const Box& box, Fn fn) const {
+    glm::ivec3 min = glm::ivec3(glm::floor(box.min / cell_size_));
+    glm::ivec3 max = glm::ivec3(glm::floor(box.max / cell_size_));
+    for (int x = min.x; x <= max.x; ++x) {
+      for (int y = min.y; y <= max.y; ++y) {
+        for (int z = min.z; z <= max.z; ++z) {
+          fn(std::array<int, 3>{x, y, z});
+        }
+      }
+    }
+  }
+
+  double cell_size_;
+  std::map<std::array<int, 3>, std::vector<int>> cells_;
+};
+
+// The part of the polytope above the ground. The clipped hull is spanned by the vertices above
+// the ground and the points where the lines between them and the vertices below cross it.
+Polytope ClipToGround(const Polytope& polytope) {
+  std::vector<glm::dvec3> points;
+  for (const glm::dvec3& a : polytope.vertices) {
+    if (a.z < 0) {
+      continue;
+    }
+    points.push_back(a);
+    for (const glm::dvec3& b : polytope.vertices) {
+      if (b.z < 0) {
+        points.push_back(a + (b - a) * (a.z / (a.z - b.z)));
+      }
+    }
+  }
+  return points.size() < 4 ? Polytope() : ConvexHull(points);
+}
+
+std::string KeyName(const Key* key) {
+  return key->name.empty() ? "(unnamed)" : key->name;
+}
+
+}  // namespace
+
+Polytope GetPcbPolytope(const Key& key, const SocketAccessOptions& options) {
+  TransformList transforms = key.GetSwitchTransforms();
+  // The top of the switch plate is at extra_z in the switch frame.
+  double top = key.extra_z - options.pcb_offset;
+  double bottom = top - options.pcb_thickness;
+  std::vector<glm::dvec3> points;
+  for (double x : {-options.pcb_width / 2, options.pcb_width / 2}) {
+    for (double y : {-options.pcb_length / 2, options.pcb_length / 2}) {
+      for (double z : {bottom, top}) {
+        points.push_back(transforms.Apply(glm::vec3(x, y, z)));
+      }
+    }
+  }
+  return ConvexHull(points);
+}
+
+Polytope GetAccessPolytope(const Key& key, const SocketAccessOptions& options) {
+  // Down in the world rather than along the tilted switch, which would run into the bottom of the
+  // walls for the keys at the edge.
+  std::vector<glm::dvec3> points;
+  for (const glm::dvec3& v : GetPcbPolytope(key, options).vertices) {
+    points.push_back(v);
+    points.push_back(v - glm::dvec3(0, 0, options.iron_depth));
+  }
+  return ClipToGround(ConvexHull(points));
+}
+
+std::vector<SocketObstacle> GetSocketObstacles(const std::vector<Key*>& keys) {
+  std::vector<SocketObstacle> obstacles;
+  for (const Key* key : keys) {
+    obstacles.push_back({"socket " + KeyName(key), GetSwitchPolytope(*key), key});
+  }
+  return obstacles;
+}
+
+std::vector<SocketAccessResult> CheckSocketAccess(const std::vector<Key*>& keys,
+                                                  const std::vector<SocketObstacle>& obstacles,
+                                                  const SocketAccessOptions& options) {
+  TRACE_SCOPE("CheckSocketAccess");
+  ObstacleGrid grid(obstacles, std::max(1.0, options.search_distance));
+  std::vector<SocketAccessResult> results(keys.size());
+  ParallelFor(keys.size(), options.jobs, "access worker", [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i < end; ++i) {
+      const Key* key = keys[i];
+      SocketAccessResult& result = results[i];
+      result.key = key;
+      result.pcb.distance = options.search_distance;
+      result.access.distance = options.search_distance;
+      Polytope pcb = GetPcbPolytope(*key, options);
+      Polytope access = GetAccessPolytope(*key, options);
+      if (access.empty()) {
+        access = pcb;
+      }
+      Box box = GetBox(access);
+      box.min -= options.search_distance;
+      box.max += options.search_distance;
+      const SocketObstacle* closest = nullptr;
+      for (int o : grid.Find(box)) {
+        const SocketObstacle& obstacle = obstacles[o];
+        if (obstacle.key == key) {
+          continue;
+        }
+        DistanceResult pcb_distance = Distance(pcb, obstacle.polytope);
+        if (pcb_distance.distance < result.pcb.distance) {
+          result.pcb = pcb_distance;
+          result.pcb_obstacle = obstacle.name;
+        }
+        DistanceResult access_distance = Distance(access, obstacle.polytope);
+        if (access_distance.distance < result.access.distance) {
+          result.access = access_distance;
+          result.access_obstacle = obstacle.name;
+          closest = &obstacle;
+        }
+      }
+      if (closest) {
+        // Closest points aren't meaningful for overlaps, so take the vertex of the obstacle
+        // furthest towards the middle of the access volume instead.
+        result.tightest_point =
+            result.access.overlapping()
+                ? closest->polytope.Support(access.Centroid() - closest->polytope.Centroid())
+                : result.access.point_b;
+      }
+      result.pcb_violation =
+          !result.pcb_obstacle.empty() && result.pcb.distance < options.min_clearance;
+      result.access_violation = !result.access_obstacle.empty() && result.access.overlapping();
+    }
+  });
+  return results;
+}
+
+int PrintSocketAccessReport(const std::vector<SocketAccessResult>& results, std::FILE* file) {
+  std::vector<SocketAccessResult> sorted = results;
+  std::sort(sorted.begin(),
+            sorted.end(),
+            [](const SocketAccessResult& x, const SocketAccessResult& y) {
+              return x.access.distance < y.access.distance;
+            });
+
+  int violations = 0;
+  fprintf(file,
+          "%-14s %10s %-24s %10s %-24s %-26s  %s\n",
+          "key",
+          "pcb mm",
+          "closest",
+          "access mm",
+          "closest",
+          "tightest point",
+          "status");
+  for (const SocketAccessResult& r : sorted) {
+    std::string status;
+    if (r.pcb_violation) {
+      status += "PCB ";
+    }
+    if (r.access_violation) {
+      status += "ACCESS";
+    }
+    if (r.pcb_violation || r.access_violation) {
+      ++violations;
+    } else {
+      status = "ok";
+    }
+    fprintf(file,
+            "%-14s %10.3f %-24s %10.3f %-24s [%7.2f, %7.2f, %7.2f]  %s\n",
+            KeyName(r.key).c_str(),
+            r.pcb.distance,
+            r.pcb_obstacle.empty() ? "-" : r.pcb_obstacle.c_str(),
+            r.access.distance,
+            r.access_obstacle.empty() ? "-" : r.access_obstacle.c_str(),
+            r.tightest_point.x,
+            r.tightest_point.y,
+            r.tightest_point.z,
+            status.c_str());
+  }
+  fprintf(file, "%d of %d keys are too tight for the pcb\n", violations, (int)sorted.size());
+  return violations;
+}
+
+}  // namespace scad
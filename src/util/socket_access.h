@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "key.h"
+
+namespace scad {
+
+// Whether a hand wired PCB (e.g. an Amoeba) fits under each switch and can be reached with an
+// iron, checked against the convex pieces of the case without rendering anything.
+
+// A convex piece of the case which could be in the way, e.g. a wall slice or plate hull.
+struct SocketObstacle {
+  std::string name;
+  Polytope polytope;
+  // The key whose socket this is, so a key isn't checked against its own socket.
+  const Key* key = nullptr;
+};
+
+struct SocketAccessOptions {
+  // The PCB in the switch frame, centered under the switch. The defaults are an Amoeba King.
+  double pcb_width = 17.8;
+  double pcb_length = 17.8;
+  double pcb_thickness = 1.6;
+  // From the top of the switch plate down to the PCB, i.e. the switch housing below the plate.
+  double pcb_offset = 5;
+  // Room needed below the PCB to get the PCB over the pins and an iron on the joints. The PCB is
+  // swept this far straight down, since the case is open underneath while soldering.
+  double iron_depth = 10;
+  // Gaps between the PCB and the case smaller than this fail. The swept volume only fails where it
+  // runs into the case.
+  double min_clearance = 0.5;
+  // Obstacles further away than this aren't measured.
+  double search_distance = 10;
+  int jobs = 1;
+};
+
+struct SocketAccessResult {
+  const Key* key = nullptr;
+  // The closest obstacle to the PCB and to the PCB swept down by iron_depth. Nothing was found
+  // within search_distance if the name is empty.
+  DistanceResult pcb;
+  std::string pcb_obstacle;
+  DistanceResult access;
+  std::string access_obstacle;
+  // The point of the case closest to (or furthest into) the access volume.
+  glm::dvec3 tightest_point = glm::dvec3(0);
+  bool pcb_violation = false;
+  bool access_violation = false;
+};
+
+// The PCB under the switch of the key.
+Polytope GetPcbPolytope(const Key& key, const SocketAccessOptions& options);
+// The PCB swept iron_depth straight down, cut off at the ground.
+Polytope GetAccessPolytope(const Key& key, const SocketAccessOptions& options);
+
+// The switch sockets of the keys (GetSwitchPolytope), named after the keys.
+std::vector<SocketObstacle> GetSocketObstacles(const std::vector<Key*>& keys);
+
+// Finds the obstacles near each key through a grid over their bounds, and measures the distance
+// to each with GJK. Keys are split between jobs threads.
+std::vector<SocketAccessResult> CheckSocketAccess(const std::vector<Key*>& keys,
+                                                  const std::vector<SocketObstacle>& obstacles,
+                                                  const SocketAccessOptions& options = {});
+
+// Prints one row per key sorted by access clearance. Returns the number of keys which fail.
+int PrintSocketAccessReport(const std::vector<SocketAccessResult>& results,
+                            std::FILE* file = stdout);
+
+}  // namespace scad
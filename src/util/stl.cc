@@ -0,0 +1,181 @@
+#include "stl.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace scad {
+namespace {
+
+constexpr size_t kHeaderSize = 80;
+constexpr size_t kBinaryTriangleSize = 50;
+
+glm::vec3 ReadVec3(const char* p) {
+  float f[3];
+  std::memcpy(f, p, sizeof(f));
+  return glm::vec3(f[0], f[1], f[2]);
+}
+
+void WriteVec3(const glm::vec3& v, std::FILE* file) {
+  float f[3] = {v.x, v.y, v.z};
+  std::fwrite(f, sizeof(float), 3, file);
+}
+
+// Splits ASCII stl into words without copying it.
+class Tokenizer {
+ public:
+  Tokenizer(const char* data, size_t size) : p_(data), end_(data + size) {
+  }
+
+  // Returns false at the end of the data.
+  bool Next(std::string_view* word) {
+    while (p_ < end_ && std::isspace((unsigned char)*p_)) {
+      ++p_;
+    }
+    const char* start = p_;
+    while (p_ < end_ && !std::isspace((unsigned char)*p_)) {
+      ++p_;
+    }
+    *word = std::string_view(start, p_ - start);
+    return p_ > start;
+  }
+
+  bool NextFloat(float* f) {
+    std::string_view word;
+    if (!Next(&word)) {
+      return false;
+    }
+    // from_chars doesn't accept a leading plus.
+    if (word.size() > 1 && word[0] == '+') {
+      word.remove_prefix(1);
+    }
+    auto result = std::from_chars(word.data(), word.data() + word.size(), *f);
+    return result.ec == std::errc() && result.ptr == word.data() + word.size();
+  }
+
+  bool NextVec3(glm::vec3* v) {
+    return NextFloat(&v->x) && NextFloat(&v->y) && NextFloat(&v->z);
+  }
+
+ private:
+  const char* p_;
+  const char* end_;
+};
+
+bool ReadAscii(const char* data, size_t size, std::vector<StlTriangle>* triangles) {
+  Tokenizer tokenizer(data, size);
+  std::string_view word;
+  StlTriangle triangle;
+  int vertex = 0;
+  while (tokenizer.Next(&word)) {
+    if (word == "normal") {
+      if (!tokenizer.NextVec3(&triangle.normal)) {
+        return false;
+      }
+    } else if (word == "vertex") {
+      if (vertex == 3 || !tokenizer.NextVec3(&triangle.vertices[vertex++])) {
+        return false;
+      }
+    } else if (word == "endfacet") {
+      if (vertex != 3) {
+        return false;
+      }
+      triangles->push_back(triangle);
+      vertex = 0;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+Bounds GetBounds(const std::vector<StlTriangle>& triangles) {
+  Bounds bounds;
+  for (const StlTriangle& triangle : triangles) {
+    for (const glm::vec3& v : triangle.vertices) {
+      bounds.Add(v);
+    }
+  }
+  return bounds;
+}
+
+// ASCII files start with "solid" but so do some binary ones, so check the size first.
+bool IsBinaryStl(const char* data, size_t size) {
+  if (size < kHeaderSize + 4) {
+    return false;
+  }
+  return size == kHeaderSize + 4 + (size_t)GetBinaryStlCount(data) * kBinaryTriangleSize;
+}
+
+uint32_t GetBinaryStlCount(const char* data) {
+  uint32_t count;
+  std::memcpy(&count, data + kHeaderSize, sizeof(count));
+  return count;
+}
+
+StlTriangle GetBinaryStlTriangle(const char* data, size_t index) {
+  const char* p = data + kHeaderSize + 4 + index * kBinaryTriangleSize;
+  StlTriangle triangle;
+  triangle.normal = ReadVec3(p);
+  for (int j = 0; j < 3; ++j) {
+    triangle.vertices[j] = ReadVec3(p + 12 * (j + 1));
+  }
+  return triangle;
+}
+
+bool ParseStl(const char* data, size_t size, std::vector<StlTriangle>* triangles) {
+  if (!IsBinaryStl(data, size)) {
+    return ReadAscii(data, size, triangles);
+  }
+  uint32_t count = GetBinaryStlCount(data);
+  triangles->reserve(triangles->size() + count);
+  for (uint32_t i = 0; i < count; ++i) {
+    triangles->push_back(GetBinaryStlTriangle(data, i));
+  }
+  return true;
+}
+
+bool ReadStl(const std::string& file_name, std::vector<StlTriangle>* triangles) {
+  MappedFile file;
+  if (!file.Open(file_name)) {
+    return false;
+  }
+  if (!ParseStl(file.data(), file.size(), triangles)) {
+    fprintf(stderr, "Could not parse %s\n", file_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool WriteStl(const std::string& file_name, const std::vector<StlTriangle>& triangles) {
+  std::FILE* file = std::fopen(file_name.c_str(), "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+  char header[kHeaderSize] = "binary stl written by dactyl";
+  std::fwrite(header, 1, sizeof(header), file);
+  uint32_t count = triangles.size();
+  std::fwrite(&count, sizeof(count), 1, file);
+  for (const StlTriangle& triangle : triangles) {
+    WriteVec3(triangle.normal, file);
+    for (const glm::vec3& v : triangle.vertices) {
+      WriteVec3(v, file);
+    }
+    uint16_t attributes = 0;
+    std::fwrite(&attributes, sizeof(attributes), 1, file);
+  }
+  std::fclose(file);
+  return true;
+}
+
+}  // namespace scad
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+namespace scad {
+
+// A triangle soup as stored in an STL file.
+struct StlTriangle {
+  glm::vec3 normal;
+  glm::vec3 vertices[3];
+};
+
+struct Bounds {
+  glm::vec3 min = glm::vec3(1e30f);
+  glm::vec3 max = glm::vec3(-1e30f);
+
+  bool empty() const {
+    return min.x > max.x;
+  }
+  void Add(const glm::vec3& p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  }
+  // Touching counts as overlapping since the solids still have to be unioned.
+  bool Overlaps(const Bounds& other, float epsilon = 1e-4f) const {
+    return !empty() && !other.empty() && glm::all(glm::lessThanEqual(min, other.max + epsilon)) &&
+           glm::all(glm::lessThanEqual(other.min, max + epsilon));
+  }
+};
+
+Bounds GetBounds(const std::vector<StlTriangle>& triangles);
+
+// Reads binary or ASCII STL, appending to triangles. The file is memory mapped and parsed in
+// place.
+bool ReadStl(const std::string& file_name, std::vector<StlTriangle>* triangles);
+// The same for STL already in memory.
+bool ParseStl(const char* data, size_t size, std::vector<StlTriangle>* triangles);
+
+// Binary STL stores every triangle at a fixed offset, so they can be read in any order, e.g. by
+// several threads at once.
+bool IsBinaryStl(const char* data, size_t size);
+uint32_t GetBinaryStlCount(const char* data);
+StlTriangle GetBinaryStlTriangle(const char* data, size_t index);
+// Always writes binary STL.
+bool WriteStl(const std::string& file_name, const std::vector<StlTriangle>& triangles);
+
+}  // namespace scad
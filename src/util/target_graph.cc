@@ -0,0 +1,196 @@
+#include "target_graph.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "alloc_tracker.h"
+#include "trace.h"
+
+namespace scad {
+namespace {
+
+// Visit states used for the depth first search in Resolve.
+constexpr int kVisiting = 1;
+constexpr int kDone = 2;
+
+}  // namespace
+
+void TargetGraph::AddTarget(const std::string& name,
+                            const std::vector<std::string>& dependencies,
+                            BuildFn build,
+                            bool is_output) {
+  if (!targets_.count(name)) {
+    names_.push_back(name);
+  }
+  Target& target = targets_[name];
+  target.dependencies = dependencies;
+  target.build = std::move(build);
+  target.is_output = is_output;
+}
+
+std::vector<std::string> TargetGraph::GetOutputs() const {
+  std::vector<std::string> outputs;
+  for (const std::string& name : names_) {
+    if (targets_.at(name).is_output) {
+      outputs.push_back(name);
+    }
+  }
+  return outputs;
+}
+
+void TargetGraph::PrintTargets(std::FILE* file) const {
+  for (const std::string& name : names_) {
+    const Target& target = targets_.at(name);
+    fprintf(file, "%s%s", name.c_str(), target.is_output ? " (output)" : "");
+    if (!target.dependencies.empty()) {
+      fprintf(file, " <-");
+      for (const std::string& dependency : target.dependencies) {
+        fprintf(file, " %s", dependency.c_str());
+      }
+    }
+    fprintf(file, "\n");
+  }
+}
+
+bool TargetGraph::Visit(const std::string& name,
+                        std::map<std::string, int>* state,
+                        std::vector<std::string>* order) const {
+  auto it = targets_.find(name);
+  if (it == targets_.end()) {
+    fprintf(stderr, "Unknown target %s\n", name.c_str());
+    return false;
+  }
+  int& s = (*state)[name];
+  if (s == kDone) {
+    return true;
+  }
+  if (s == kVisiting) {
+    fprintf(stderr, "Dependency cycle at target %s\n", name.c_str());
+    return false;
+  }
+  s = kVisiting;
+  for (const std::string& dependency : it->second.dependencies) {
+    if (!Visit(dependency, state, order)) {
+      return false;
+    }
+  }
+  (*state)[name] = kDone;
+  order->push_back(name);
+  return true;
+}
+
+bool TargetGraph::Resolve(const std::vector<std::string>& selection,
+                          std::vector<std::string>* order) const {
+  std::map<std::string, int> state;
+  for (const std::string& name : selection.empty() ? GetOutputs() : selection) {
+    if (!Visit(name, &state, order)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TargetGraph::Run(const std::vector<std::string>& selection, int jobs) {
+  std::vector<std::string> order;
+  if (!Resolve(selection, &order)) {
+    return false;
+  }
+
+  // Number of unfinished dependencies of each target and who is waiting on it.
+  std::map<std::string, int> waiting_on;
+  std::map<std::string, std::vector<std::string>> dependents;
+  std::vector<std::string> ready;
+  for (const std::string& name : order) {
+    const Target& target = targets_.at(name);
+    waiting_on[name] = target.dependencies.size();
+    for (const std::string& dependency : target.dependencies) {
+      dependents[dependency].push_back(name);
+    }
+    if (target.dependencies.empty()) {
+      ready.push_back(name);
+    }
+  }
+  // Take targets in resolve order so a single job runs them in a predictable sequence.
+  std::reverse(ready.begin(), ready.end());
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  size_t finished = 0;
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (finished < order.size()) {
+      if (ready.empty()) {
+        changed.wait(lock);
+        continue;
+      }
+      std::string name = ready.back();
+      ready.pop_back();
+      const Target& target = targets_.at(name);
+      if (target.build && !built_.count(name)) {
+        lock.unlock();
+        TRACE_SCOPE(name);
+        AllocationPhase allocation_phase(name.c_str());
+        target.build();
+        lock.lock();
+      }
+      built_.insert(name);
+      ++finished;
+      for (const std::string& dependent : dependents[name]) {
+        if (--waiting_on[dependent] == 0) {
+          ready.insert(ready.begin(), dependent);
+        }
+      }
+      changed.notify_all();
+    }
+  };
+
+  jobs = std::max(1, std::min(jobs, (int)order.size()));
+  std::vector<std::thread> threads;
+  for (int i = 1; i < jobs; ++i) {
+    threads.emplace_back([&worker, i]() {
+      SetTraceThreadName("target worker " + std::to_string(i));
+      worker();
+    });
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return true;
+}
+
+int TargetGraph::Invalidate(const std::string& name) {
+  std::set<std::string> invalid = {name};
+  // Dependencies can be added in any order so repeat until nothing else depends on an invalid
+  // target.
+  bool added = true;
+  while (added) {
+    added = false;
+    for (const auto& [target_name, target] : targets_) {
+      if (invalid.count(target_name)) {
+        continue;
+      }
+      for (const std::string& dependency : target.dependencies) {
+        if (invalid.count(dependency)) {
+          invalid.insert(target_name);
+          added = true;
+          break;
+        }
+      }
+    }
+  }
+  int count = 0;
+  for (const std::string& target_name : invalid) {
+    count += built_.erase(target_name);
+  }
+  return count;
+}
+
+}  // namespace scad
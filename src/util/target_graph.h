@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace scad {
+
+// A set of named build steps with explicit dependencies. Selecting a target runs it and
+// everything it depends on, with independent targets running in parallel. Targets communicate
+// through state captured by their build functions; a target may read anything written by its
+// dependencies.
+//
+// The graph remembers what it has built. Running it again only builds targets which were
+// invalidated since, so a long running process can keep the results of the previous run.
+class TargetGraph {
+ public:
+  using BuildFn = std::function<void()>;
+
+  // Targets without a build function are groups which just pull in their dependencies.
+  // Outputs are the targets built when nothing is selected.
+  void AddTarget(const std::string& name,
+                 const std::vector<std::string>& dependencies,
+                 BuildFn build,
+                 bool is_output = false);
+  void AddOutput(const std::string& name,
+                 const std::vector<std::string>& dependencies,
+                 BuildFn build) {
+    AddTarget(name, dependencies, std::move(build), true);
+  }
+  void AddGroup(const std::string& name, const std::vector<std::string>& dependencies) {
+    AddTarget(name, dependencies, nullptr);
+  }
+
+  bool HasTarget(const std::string& name) const {
+    return targets_.count(name) > 0;
+  }
+  std::vector<std::string> GetOutputs() const;
+  void PrintTargets(std::FILE* file) const;
+
+  // Every target needed to build the selection, dependencies first. Returns false and prints an
+  // error for unknown targets or dependency cycles.
+  bool Resolve(const std::vector<std::string>& selection, std::vector<std::string>* order) const;
+
+  // Builds the selection (or every output when empty) on up to jobs threads, skipping targets
+  // which are already built. Returns false if the selection could not be resolved.
+  bool Run(const std::vector<std::string>& selection, int jobs);
+
+  // Marks the target and everything depending on it as needing to be built again. Returns the
+  // number of targets which had been built.
+  int Invalidate(const std::string& name);
+
+ private:
+  struct Target {
+    std::vector<std::string> dependencies;
+    BuildFn build;
+    bool is_output = false;
+  };
+
+  bool Visit(const std::string& name,
+             std::map<std::string, int>* state,
+             std::vector<std::string>* order) const;
+
+  std::map<std::string, Target> targets_;
+  // Insertion order, used when listing targets.
+  std::vector<std::string> names_;
+  std::set<std::string> built_;
+};
+
+}  // namespace scad
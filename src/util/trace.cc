@@ -0,0 +1,140 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace scad {
+namespace {
+
+struct TraceEvent {
+  std::string name;
+  std::string detail;
+  long long start_us;
+  long long duration_us;
+};
+
+// Only written by its own thread.
+struct ThreadTrace {
+  int id = 0;
+  std::string name;
+  std::vector<TraceEvent> events;
+};
+
+std::chrono::steady_clock::time_point trace_start;
+
+std::mutex threads_mutex;
+// Kept until exit so threads which have finished still show up.
+std::vector<std::unique_ptr<ThreadTrace>> thread_traces;
+
+ThreadTrace* GetThreadTrace() {
+  thread_local ThreadTrace* trace = nullptr;
+  if (trace == nullptr) {
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    thread_traces.push_back(std::make_unique<ThreadTrace>());
+    trace = thread_traces.back().get();
+    trace->id = thread_traces.size();
+    trace->name = trace->id == 1 ? "main" : "worker " + std::to_string(trace->id - 1);
+  }
+  return trace;
+}
+
+long long MicrosSinceStart(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time - trace_start).count();
+}
+
+void WriteJsonString(std::FILE* file, const std::string& s) {
+  fputc('"', file);
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      fputc('\\', file);
+      fputc(c, file);
+    } else if ((unsigned char)c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+}  // namespace
+
+namespace trace_internal {
+std::atomic<bool> enabled(false);
+}  // namespace trace_internal
+
+void StartTracing() {
+  trace_start = std::chrono::steady_clock::now();
+  // Register the calling thread first so it gets the main track.
+  GetThreadTrace();
+  trace_internal::enabled = true;
+}
+
+void SetTraceThreadName(const std::string& name) {
+  if (IsTracingEnabled()) {
+    GetThreadTrace()->name = name;
+  }
+}
+
+bool WriteTrace(const std::string& file_name) {
+  std::FILE* file = std::fopen(file_name.c_str(), "w");
+  if (file == nullptr) {
+    fprintf(stderr, "Could not open file %s\n", file_name.c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(threads_mutex);
+  fprintf(file, "{\"traceEvents\": [\n");
+  bool first = true;
+  for (const auto& trace : thread_traces) {
+    fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, ",
+            first ? "" : ",\n", trace->id);
+    fprintf(file, "\"args\": {\"name\": ");
+    WriteJsonString(file, trace->name);
+    fprintf(file, "}}");
+    first = false;
+
+    for (const TraceEvent& event : trace->events) {
+      fprintf(file, ",\n{\"name\": ");
+      WriteJsonString(file, event.name);
+      fprintf(file,
+              ", \"cat\": \"dactyl\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": 1, "
+              "\"tid\": %d",
+              event.start_us,
+              event.duration_us,
+              trace->id);
+      if (!event.detail.empty()) {
+        fprintf(file, ", \"args\": {\"detail\": ");
+        WriteJsonString(file, event.detail);
+        fprintf(file, "}");
+      }
+      fprintf(file, "}");
+    }
+  }
+  fprintf(file, "\n], \"displayTimeUnit\": \"ms\"}\n");
+  std::fclose(file);
+  return true;
+}
+
+void TraceScope::Start(const char* name, const std::string* detail) {
+  active_ = true;
+  name_ = name;
+  if (detail != nullptr) {
+    detail_ = *detail;
+  }
+  start_ = std::chrono::steady_clock::now();
+}
+
+void TraceScope::End() {
+  auto end = std::chrono::steady_clock::now();
+  long long start_us = MicrosSinceStart(start_);
+  GetThreadTrace()->events.push_back(
+      {std::move(name_), std::move(detail_), start_us, MicrosSinceStart(end) - start_us});
+}
+
+}  // namespace scad
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace scad {
+
+// Scoped timing events written in the Chrome trace event format, which loads in chrome://tracing
+// and Perfetto. Each thread gets its own track. Tracing is off until StartTracing is called and a
+// disabled scope only checks a flag.
+//
+//   void MakeWalls() {
+//     TRACE_SCOPE("MakeWalls");
+//     ...
+//   }
+void StartTracing();
+
+namespace trace_internal {
+extern std::atomic<bool> enabled;
+}  // namespace trace_internal
+
+inline bool IsTracingEnabled() {
+  return trace_internal::enabled.load(std::memory_order_relaxed);
+}
+// Names the track of the calling thread.
+void SetTraceThreadName(const std::string& name);
+// Writes every event recorded so far. Call once the traced threads are done.
+bool WriteTrace(const std::string& file_name);
+
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name) {
+    if (IsTracingEnabled()) {
+      Start(name, nullptr);
+    }
+  }
+  explicit TraceScope(const std::string& name) : TraceScope(name.c_str()) {
+  }
+  // detail is shown in the args of the event, e.g. the file being written.
+  TraceScope(const char* name, const std::string& detail) {
+    if (IsTracingEnabled()) {
+      Start(name, &detail);
+    }
+  }
+  ~TraceScope() {
+    if (active_) {
+      End();
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  void Start(const char* name, const std::string* detail);
+  void End();
+
+  bool active_ = false;
+  std::string name_;
+  std::string detail_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+#define SCAD_TRACE_CONCAT_INNER(a, b) a##b
+#define SCAD_TRACE_CONCAT(a, b) SCAD_TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(...) \
+  ::scad::TraceScope SCAD_TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+}  // namespace scad
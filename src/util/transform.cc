@@ -1,38 +1,170 @@
 #include "transform.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <new>
 #include <vector>
 
 #include "scad.h"
 
 namespace scad {
 
-glm::vec3 Transform::Apply(const glm::vec3& p) const {
+glm::mat4 Transform::GetMatrix() const {
   glm::mat4 transform(1.0f);
   transform = glm::translate(transform, translation());
   transform = glm::rotate(transform, glm::radians((float)ry), glm::vec3(0, 1, 0));
   transform = glm::rotate(transform, glm::radians((float)rx), glm::vec3(1, 0, 0));
   transform = glm::rotate(transform, glm::radians((float)rz), glm::vec3(0, 0, 1));
+  return transform;
+}
 
-  glm::vec4 transformed = transform * glm::vec4(p.x, p.y, p.z, 1);
+glm::vec3 Transform::Apply(const glm::vec3& p) const {
+  glm::vec4 transformed = GetMatrix() * glm::vec4(p.x, p.y, p.z, 1);
   return glm::vec3(transformed.x, transformed.y, transformed.z);
 }
 
+TransformList::TransformList(const TransformList& other) {
+  *this = other;
+}
+
+TransformList::TransformList(TransformList&& other) noexcept {
+  *this = std::move(other);
+}
+
+TransformList& TransformList::operator=(const TransformList& other) {
+  if (this == &other) {
+    return *this;
+  }
+  if (other.size_ > capacity_) {
+    if (!is_inline()) {
+      ::operator delete(data_);
+    }
+    capacity_ = other.capacity_;
+    data_ = static_cast<Transform*>(::operator new(capacity_ * sizeof(Transform)));
+  }
+  // Keep the same room at the front as other where it fits.
+  head_ = std::min(other.head_, capacity_ - other.size_);
+  size_ = other.size_;
+  std::memcpy(static_cast<void*>(data_ + head_), other.begin(), size_ * sizeof(Transform));
+  if (other.matrix_state_.load(std::memory_order_acquire) == kMatrixReady) {
+    matrix_ = other.matrix_;
+    matrix_state_.store(kMatrixReady, std::memory_order_relaxed);
+  } else {
+    Changed();
+  }
+  return *this;
+}
+
+TransformList& TransformList::operator=(TransformList&& other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  if (other.is_inline()) {
+    return *this = static_cast<const TransformList&>(other);
+  }
+  if (!is_inline()) {
+    ::operator delete(data_);
+  }
+  data_ = other.data_;
+  capacity_ = other.capacity_;
+  head_ = other.head_;
+  size_ = other.size_;
+  matrix_ = other.matrix_;
+  matrix_state_.store(other.matrix_state_.load(std::memory_order_acquire),
+                      std::memory_order_relaxed);
+  other.data_ = other.inline_data();
+  other.capacity_ = kInlineCapacity;
+  other.head_ = kInlineCapacity / 4;
+  other.size_ = 0;
+  other.Changed();
+  return *this;
+}
+
+TransformList::~TransformList() {
+  if (!is_inline()) {
+    ::operator delete(data_);
+  }
+}
+
+void TransformList::MakeRoom(int front, int back) {
+  int needed = size_ + front + back;
+  int capacity = capacity_;
+  // Key transforms are at most about 14 long so they stay inline. Longer lists double, leaving
+  // room at both ends.
+  while (needed > capacity) {
+    capacity *= 2;
+  }
+  // Split the spare room between the ends, favouring the end which ran out.
+  int spare = capacity - needed;
+  int head = front + (front > 0 ? spare * 3 / 4 : spare / 4);
+
+  Transform* data = data_;
+  if (capacity != capacity_) {
+    data = static_cast<Transform*>(::operator new(capacity * sizeof(Transform)));
+  }
+  std::memmove(static_cast<void*>(data + head), begin(), size_ * sizeof(Transform));
+  if (data != data_ && !is_inline()) {
+    ::operator delete(data_);
+  }
+  data_ = data;
+  capacity_ = capacity;
+  head_ = head;
+}
+
+TransformList& TransformList::Append(const TransformList& other) {
+  if (head_ + size_ + other.size_ > capacity_) {
+    MakeRoom(0, other.size_);
+  }
+  Changed();
+  std::memcpy(static_cast<void*>(data_ + head_ + size_), other.begin(), other.size_ * sizeof(Transform));
+  size_ += other.size_;
+  return *this;
+}
+
+TransformList& TransformList::AppendFront(const TransformList& other) {
+  int count = other.size_;
+  if (head_ < count) {
+    MakeRoom(count, 0);
+  }
+  Changed();
+  // other may be this list, so copy before moving the head.
+  std::memcpy(static_cast<void*>(data_ + head_ - count), other.begin(), count * sizeof(Transform));
+  head_ -= count;
+  size_ += count;
+  return *this;
+}
+
 Shape TransformList::Apply(const Shape& in) const {
   Shape shape = in;
-  for (auto& transform : transforms_) {
-    shape = transform.Apply(shape);
+  for (const Transform& transform : *this) {
+    shape = transform.Apply(std::move(shape));
   }
   return shape;
 }
 
-glm::vec3 TransformList::Apply(const glm::vec3& in) const {
-  glm::vec3 point = in;
-  for (auto& transform : transforms_) {
-    point = transform.Apply(point);
+glm::mat4 TransformList::GetMatrix() const {
+  if (matrix_state_.load(std::memory_order_acquire) == kMatrixReady) {
+    return matrix_;
+  }
+  glm::mat4 matrix(1.0f);
+  for (const Transform& transform : *this) {
+    matrix = transform.GetMatrix() * matrix;
+  }
+  // Several threads may apply the same list, e.g. a key's transforms, so only one writes it.
+  int expected = kMatrixMissing;
+  if (matrix_state_.compare_exchange_strong(expected, kMatrixWriting, std::memory_order_acquire)) {
+    matrix_ = matrix;
+    matrix_state_.store(kMatrixReady, std::memory_order_release);
   }
-  return point;
+  return matrix;
+}
+
+glm::vec3 TransformList::Apply(const glm::vec3& in) const {
+  glm::vec4 transformed = GetMatrix() * glm::vec4(in.x, in.y, in.z, 1);
+  return glm::vec3(transformed.x, transformed.y, transformed.z);
 }
 
 }  // namespace scad
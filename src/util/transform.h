@@ -1,6 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <glm/glm.hpp>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "scad.h"
@@ -72,53 +76,84 @@ struct Transform {
     return *this;
   }
 
-  Shape Apply(const Shape& in) const {
-    Shape shape = in;
+  Shape Apply(Shape shape) const {
     if (rz != 0) {
-      shape = shape.RotateZ(rz);
+      shape = std::move(shape).RotateZ(rz);
     }
     if (rx != 0) {
-      shape = shape.RotateX(rx);
+      shape = std::move(shape).RotateX(rx);
     }
     if (ry != 0) {
-      shape = shape.RotateY(ry);
+      shape = std::move(shape).RotateY(ry);
     }
     if (x != 0 || y != 0 || z != 0) {
-      shape = shape.Translate(x, y, z);
+      shape = std::move(shape).Translate(x, y, z);
     }
     return shape;
   }
 
   glm::vec3 Apply(const glm::vec3& p) const;
+  glm::mat4 GetMatrix() const;
 };
 
+// TransformList copies transforms as raw memory.
+static_assert(std::is_trivially_copyable<Transform>::value, "Transform must stay trivially copyable");
+
 // A list of transforms to apply to a shape or a point. The transforms are applied in order. If you
 // are looking at a shape which has been placed by a transform list and you want to rotate it in
 // place, the transform you add needs to be applied first and you must use a "front" method.
+//
+// Key transforms are copied and extended constantly, so short lists are stored inline and there is
+// room kept at both ends so adding to the front is as cheap as adding to the back. Applying the
+// list to points composes the transforms into one matrix the first time and reuses it after.
 class TransformList {
  public:
+  TransformList() {
+  }
+  TransformList(const TransformList& other);
+  TransformList(TransformList&& other) noexcept;
+  TransformList& operator=(const TransformList& other);
+  TransformList& operator=(TransformList&& other) noexcept;
+  ~TransformList();
+
   Shape Apply(const Shape& shape) const;
   glm::vec3 Apply(const glm::vec3& p) const;
 
+  // The transforms combined into one matrix, which is cached until the list changes.
+  glm::mat4 GetMatrix() const;
+
+  // The returned reference is only valid until the list is next changed or applied.
   Transform& AddTransform(Transform t = {}) {
-    transforms_.push_back(t);
-    return transforms_.back();
+    if (head_ + size_ == capacity_) {
+      MakeRoom(0, 1);
+    }
+    Changed();
+    return *new (&data_[head_ + size_++]) Transform(t);
   }
 
   Transform& AddTransformFront(Transform t = {}) {
-    transforms_.insert(transforms_.begin(), t);
-    return transforms_.front();
+    if (head_ == 0) {
+      MakeRoom(1, 0);
+    }
+    Changed();
+    --head_;
+    ++size_;
+    return *new (&data_[head_]) Transform(t);
   }
 
   bool empty() const {
-    return transforms_.empty();
+    return size_ == 0;
+  }
+  int size() const {
+    return size_;
   }
 
   Transform& mutable_front() {
     if (empty()) {
       return AddTransform();
     }
-    return transforms_.front();
+    Changed();
+    return data_[head_];
   }
 
   TransformList& RotateX(float deg) {
@@ -170,18 +205,46 @@ class TransformList {
     return Translate(0, 0, z);
   }
 
-  TransformList& Append(const TransformList& other) {
-    transforms_.insert(transforms_.end(), other.transforms_.begin(), other.transforms_.end());
-    return *this;
-  }
+  TransformList& Append(const TransformList& other);
+  TransformList& AppendFront(const TransformList& other);
 
-  TransformList& AppendFront(const TransformList& other) {
-    transforms_.insert(transforms_.begin(), other.transforms_.begin(), other.transforms_.end());
-    return *this;
+  const Transform* begin() const {
+    return data_ + head_;
+  }
+  const Transform* end() const {
+    return data_ + head_ + size_;
   }
 
  private:
-  std::vector<Transform> transforms_;
+  static constexpr int kInlineCapacity = 16;
+
+  // Moves the transforms so there are at least front free slots before them and back after,
+  // growing onto the heap if needed.
+  void MakeRoom(int front, int back);
+  void Changed() {
+    matrix_state_.store(kMatrixMissing, std::memory_order_relaxed);
+  }
+  Transform* inline_data() {
+    return reinterpret_cast<Transform*>(inline_);
+  }
+  bool is_inline() const {
+    return data_ == reinterpret_cast<const Transform*>(inline_);
+  }
+
+  // The cached matrix is written by whichever thread computes it first.
+  static constexpr int kMatrixMissing = 0;
+  static constexpr int kMatrixWriting = 1;
+  static constexpr int kMatrixReady = 2;
+
+  // Left uninitialized, only the slots in use hold transforms.
+  alignas(Transform) unsigned char inline_[kInlineCapacity * sizeof(Transform)];
+  Transform* data_ = inline_data();
+  int capacity_ = kInlineCapacity;
+  // Lists are usually extended at the back so keep most of the room there.
+  int head_ = kInlineCapacity / 4;
+  int size_ = 0;
+  mutable std::atomic<int> matrix_state_{kMatrixMissing};
+  mutable glm::mat4 matrix_;
 };
 
 }  // namespace scad